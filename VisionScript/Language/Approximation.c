@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <math.h>
+#include "Approximation.h"
+
+static RuntimeError SampleFunction(EvaluationContext * context, Equation equation, List(Binding) parameters, scalar_t t, VectorArray * result) {
+	parameters[0].value.xyzw[0] = &t;
+	return EvaluateExpressionInContext(context, parameters, equation.expression, result);
+}
+
+static double Clenshaw(const double * c, int32_t n, double x) {
+	double d = 0.0, dd = 0.0;
+	for (int32_t j = n - 1; j > 0; j--) {
+		double sv = d;
+		d = 2.0 * x * d - dd + c[j];
+		dd = sv;
+	}
+	return x * d - dd + 0.5 * c[0];
+}
+
+static RuntimeError SamplePiece(EvaluationContext * context, Equation equation, List(Binding) parameters, double lower, double upper, double * xs, int32_t count, Approximation * approximation, double * values) {
+	// values are laid out per element, per dimension, then per point
+	for (int32_t k = 0; k < count; k++) {
+		VectorArray value;
+		RuntimeError error = SampleFunction(context, equation, parameters, 0.5 * (upper + lower) + 0.5 * (upper - lower) * xs[k], &value);
+		if (error.code != RuntimeErrorCodeNone) { return error; }
+		if (value.length != approximation->length || value.dimensions != approximation->dimensions) {
+			// the shape changes somewhere in the domain, a negative tolerance marks the approximation as unusable
+			FreeVectorArray(value);
+			approximation->tolerance = -1.0;
+			return (RuntimeError){ RuntimeErrorCodeNone };
+		}
+		for (int32_t i = 0; i < approximation->length; i++) {
+			for (int32_t d = 0; d < approximation->dimensions; d++) { values[(i * approximation->dimensions + d) * count + k] = value.xyzw[d][i]; }
+		}
+		FreeVectorArray(value);
+	}
+	return (RuntimeError){ RuntimeErrorCodeNone };
+}
+
+static RuntimeError FitPiece(EvaluationContext * context, Equation equation, List(Binding) parameters, double lower, double upper, int32_t depth, int32_t * budget, Approximation * approximation) {
+	// interpolate at the Chebyshev nodes, then split the piece if it isn't converged
+	const int32_t n = APPROXIMATION_DEGREE, m = APPROXIMATION_DEGREE / 2;
+	int32_t stride = approximation->length * approximation->dimensions;
+	double nodes[APPROXIMATION_DEGREE], checks[APPROXIMATION_DEGREE / 2];
+	for (int32_t k = 0; k < n; k++) { nodes[k] = cos(M_PI * (k + 0.5) / n); }
+	for (int32_t k = 0; k < m; k++) { checks[k] = -1.0 + 2.0 * k / (m - 1); }
+	(*budget)--;
+	
+	double * values = malloc(n * stride * sizeof(double));
+	double * checkValues = malloc(m * stride * sizeof(double));
+	RuntimeError result = SamplePiece(context, equation, parameters, lower, upper, nodes, n, approximation, values);
+	if (result.code == RuntimeErrorCodeNone && approximation->tolerance >= 0.0) {
+		result = SamplePiece(context, equation, parameters, lower, upper, checks, m, approximation, checkValues);
+	}
+	if (result.code != RuntimeErrorCodeNone || approximation->tolerance < 0.0) {
+		free(values);
+		free(checkValues);
+		return result;
+	}
+
+	double * coefficients = malloc(n * stride * sizeof(double));
+	double * derivatives = malloc(n * stride * sizeof(double));
+	double error = 0.0;
+	for (int32_t s = 0; s < stride; s++) {
+		double * c = &coefficients[s * n], * dc = &derivatives[s * n];
+		for (int32_t j = 0; j < n; j++) {
+			double sum = 0.0;
+			for (int32_t k = 0; k < n; k++) { sum += values[s * n + k] * cos(M_PI * j * (k + 0.5) / n); }
+			c[j] = 2.0 * sum / n;
+		}
+		
+		// the trailing coefficients estimate the truncation error, the check points catch what aliased into the lower ones
+		double estimate = fabs(c[n - 1]) + fabs(c[n - 2]);
+		for (int32_t k = 0; k < m; k++) {
+			double difference = fabs(Clenshaw(c, n, checks[k]) - checkValues[s * m + k]);
+			if (!(difference <= estimate)) { estimate = difference; }
+		}
+		if (!(estimate <= error)) { error = estimate; }
+
+		// derivative series from the recurrence c'[j - 1] = c'[j + 1] + 2 j c[j], scaled to the piece
+		dc[n - 1] = 0.0;
+		dc[n - 2] = 2.0 * (n - 1) * c[n - 1];
+		for (int32_t j = n - 2; j > 0; j--) { dc[j - 1] = dc[j + 1] + 2.0 * j * c[j]; }
+		for (int32_t j = 0; j < n; j++) { dc[j] *= 2.0 / (upper - lower); }
+	}
+	free(values);
+	free(checkValues);
+
+	// the estimate only sees the sampled points, so leave some margin for what falls between them
+	bool converged = 2.0 * error <= approximation->tolerance;
+	if (converged) {
+		if (ListLength(approximation->bounds) == 0) { approximation->bounds = ListPush(approximation->bounds, &lower); }
+		approximation->bounds = ListPush(approximation->bounds, &upper);
+		for (int32_t j = 0; j < n * stride; j++) {
+			approximation->coefficients = ListPush(approximation->coefficients, &coefficients[j]);
+			approximation->derivatives = ListPush(approximation->derivatives, &derivatives[j]);
+		}
+	}
+	free(coefficients);
+	free(derivatives);
+	if (converged) { return (RuntimeError){ RuntimeErrorCodeNone }; }
+
+	// splitting can't fix values that aren't finite, and past the budget exact evaluation is cheaper anyway
+	if (!isfinite(error) || depth >= 16 || *budget < 2) {
+		approximation->tolerance = -1.0;
+		return (RuntimeError){ RuntimeErrorCodeNone };
+	}
+	result = FitPiece(context, equation, parameters, lower, 0.5 * (lower + upper), depth + 1, budget, approximation);
+	if (result.code != RuntimeErrorCodeNone || approximation->tolerance < 0.0) { return result; }
+	return FitPiece(context, equation, parameters, 0.5 * (lower + upper), upper, depth + 1, budget, approximation);
+}
+
+RuntimeError CreateApproximation(EvaluationContext * context, Equation equation, scalar_t lower, scalar_t upper, scalar_t tolerance, Approximation * approximation) {
+	*approximation = (Approximation){
+		.lower = lower,
+		.upper = upper,
+		.tolerance = tolerance,
+		.bounds = ListCreate(sizeof(double), 64),
+		.coefficients = ListCreate(sizeof(double), 1024),
+		.derivatives = ListCreate(sizeof(double), 1024),
+	};
+
+	List(Binding) parameters = ListPush(ListCreate(sizeof(Binding), 1), &(Binding){ 0 });
+	parameters[0].identifier = equation.declaration.parameters[0];
+	parameters[0].value = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = &lower };
+
+	VectorArray initial;
+	RuntimeError error = SampleFunction(context, equation, parameters, lower, &initial);
+	if (error.code != RuntimeErrorCodeNone) {
+		ListFree(parameters);
+		return error;
+	}
+	approximation->length = initial.length;
+	approximation->dimensions = initial.dimensions;
+	FreeVectorArray(initial);
+
+	// start from a few uniform pieces so a single fit can't miss features between its nodes
+	const int32_t initialPieces = 8;
+	int32_t budget = APPROXIMATION_MAX_FITS;
+	for (int32_t i = 0; i < initialPieces && approximation->tolerance >= 0.0; i++) {
+		double a = lower + (upper - lower) * ((double)i / initialPieces);
+		double b = lower + (upper - lower) * ((double)(i + 1) / initialPieces);
+		error = FitPiece(context, equation, parameters, a, b, 0, &budget, approximation);
+		if (error.code != RuntimeErrorCodeNone) { break; }
+	}
+	if (approximation->tolerance < 0.0) {
+		approximation->bounds = ListClear(approximation->bounds);
+		approximation->coefficients = ListClear(approximation->coefficients);
+		approximation->derivatives = ListClear(approximation->derivatives);
+	}
+	approximation->tolerance = tolerance;
+	ListFree(parameters);
+	return error;
+}
+
+bool IsApproximationUsable(Approximation approximation) {
+	return ListLength(approximation.bounds) > 1;
+}
+
+void EvaluateApproximation(Approximation approximation, scalar_t t, VectorArray * result, VectorArray * tangent) {
+	// binary search for the piece containing t
+	int32_t lower = 0, upper = ListLength(approximation.bounds) - 2;
+	while (lower < upper) {
+		int32_t middle = (lower + upper + 1) / 2;
+		if (t < approximation.bounds[middle]) { upper = middle - 1; }
+		else { lower = middle; }
+	}
+	double a = approximation.bounds[lower], b = approximation.bounds[lower + 1];
+	double x = (2.0 * t - a - b) / (b - a);
+
+	const int32_t n = APPROXIMATION_DEGREE;
+	int32_t offset = lower * approximation.length * approximation.dimensions * n;
+	*result = CreateVectorArray(approximation.dimensions, approximation.length);
+	*tangent = CreateVectorArray(approximation.dimensions, approximation.length);
+	for (int32_t d = 0; d < approximation.dimensions; d++) {
+		for (int32_t i = 0; i < approximation.length; i++) {
+			int32_t index = offset + (i * approximation.dimensions + d) * n;
+			result->xyzw[d][i] = Clenshaw(&approximation.coefficients[index], n, x);
+			tangent->xyzw[d][i] = Clenshaw(&approximation.derivatives[index], n, x);
+		}
+	}
+}
+
+void FreeApproximation(Approximation approximation) {
+	ListFree(approximation.bounds);
+	ListFree(approximation.coefficients);
+	ListFree(approximation.derivatives);
+}
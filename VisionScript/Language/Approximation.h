@@ -0,0 +1,26 @@
+#ifndef Approximation_h
+#define Approximation_h
+
+#include "Evaluator.h"
+
+#define APPROXIMATION_DEGREE 24
+#define APPROXIMATION_MAX_FITS 384
+
+// piecewise Chebyshev interpolant of a function of one parameter over [lower, upper]
+typedef struct Approximation {
+	scalar_t lower;
+	scalar_t upper;
+	scalar_t tolerance;
+	uint32_t dimensions;
+	uint32_t length;
+	List(double) bounds;       // piece boundaries, one more than the number of pieces, empty if the function couldn't be approximated
+	List(double) coefficients; // per piece, per element, per dimension: APPROXIMATION_DEGREE coefficients
+	List(double) derivatives;  // coefficients of the derivative in the same layout
+} Approximation;
+
+RuntimeError CreateApproximation(EvaluationContext * context, Equation equation, scalar_t lower, scalar_t upper, scalar_t tolerance, Approximation * approximation);
+bool IsApproximationUsable(Approximation approximation);
+void EvaluateApproximation(Approximation approximation, scalar_t t, VectorArray * result, VectorArray * tangent);
+void FreeApproximation(Approximation approximation);
+
+#endif
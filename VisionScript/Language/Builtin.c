@@ -1,7 +1,14 @@
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
+#include <tgmath.h>
+#include <float.h>
 #include "Builtin.h"
+#include "ComplexNumbers.h"
+#include "Geometry.h"
+#include "Planner.h"
+#include "Spatial.h"
+#include "Spectral.h"
+#include "Utilities/FastMath.h"
 
 static const char * builtinFunctions[] = {
 	"sin", "cos", "tan", "asin", "acos", "atan", "atan2",
@@ -9,14 +16,25 @@ static const char * builtinFunctions[] = {
 	"sinh", "cosh", "tanh", "asinh", "acosh", "atanh",
 	"sech", "csch", "coth", "asech", "acsch", "acoth",
 	
-	"abs", "argmax", "argmin", "cbrt", "ceil", "corr",
-	"count", "cov", "erf", "exp", "factorial", "floor",
-	"gamma", "interleave", "join", "ln", "log", "log10", "log2",
+	"abs", "argmax", "argmin", "argsort", "cbrt", "ceil", "corr",
+	"count", "cov", "cummax", "cummin", "cumprod", "cumsum", "diff",
+	"digamma", "erf", "exp", "factorial", "floor",
+	"gamma", "groupcount", "groupmean", "groupsum", "hist", "hist2d",
+	"interleave", "join", "ln", "log", "log10", "log2",
 	"max", "mean", "median", "min", "prod", "quantile",
-	"rand", "round", "shuffle", "sign", "sort", "sqrt",
-	"stdev", "sum", "var",
+	"rand", "randdisk", "randn", "round", "shuffle", "sign",
+	"sort", "sqrt", "stdev", "sum", "var",
 	
-	"cross", "dist", "distsq", "dot", "length", "lengthsq", "normalize",
+	"cross", "dist", "distsq", "dot", "length", "lengthsq", "nearest", "normalize",
+	"within",
+	
+	"delaunay", "hull",
+	
+	"blur", "grad", "laplacian", "shift",
+	
+	"convolve", "fft", "ifft", "lowpass",
+	
+	"det", "inverse", "matrix", "mul", "trace", "transpose",
 };
 
 static BuiltinFunction multiArgumentBuiltins[] = {
@@ -24,6 +42,10 @@ static BuiltinFunction multiArgumentBuiltins[] = {
 	BuiltinFunctionCORR,
 	BuiltinFunctionCOUNT,
 	BuiltinFunctionCOV,
+	BuiltinFunctionGROUPMEAN,
+	BuiltinFunctionGROUPSUM,
+	BuiltinFunctionHIST,
+	BuiltinFunctionHIST2D,
 	BuiltinFunctionINTERLEAVE,
 	BuiltinFunctionJOIN,
 	BuiltinFunctionLOG,
@@ -31,12 +53,40 @@ static BuiltinFunction multiArgumentBuiltins[] = {
 	BuiltinFunctionMIN,
 	BuiltinFunctionQUANTILE,
 	BuiltinFunctionRAND,
+	BuiltinFunctionRANDDISK,
+	BuiltinFunctionRANDN,
 	BuiltinFunctionSHUFFLE,
 	BuiltinFunctionSORT,
 	BuiltinFunctionCROSS,
 	BuiltinFunctionDIST,
 	BuiltinFunctionDISTSQ,
 	BuiltinFunctionDOT,
+	BuiltinFunctionNEAREST,
+	BuiltinFunctionWITHIN,
+	BuiltinFunctionBLUR,
+	BuiltinFunctionSHIFT,
+	BuiltinFunctionCONVOLVE,
+	BuiltinFunctionLOWPASS,
+	BuiltinFunctionMUL,
+};
+
+static BuiltinFunction elementwiseBuiltins[] = {
+	BuiltinFunctionABS,
+	BuiltinFunctionCBRT,
+	BuiltinFunctionCEIL,
+	BuiltinFunctionDIGAMMA,
+	BuiltinFunctionERF,
+	BuiltinFunctionEXP,
+	BuiltinFunctionFACTORIAL,
+	BuiltinFunctionFLOOR,
+	BuiltinFunctionGAMMA,
+	BuiltinFunctionLN,
+	BuiltinFunctionLOG10,
+	BuiltinFunctionLOG2,
+	BuiltinFunctionROUND,
+	BuiltinFunctionSIGN,
+	BuiltinFunctionSQRT,
+	BuiltinFunctionNORMALIZE,
 };
 
 static int compare(const void * a, const void * b) {
@@ -44,40 +94,304 @@ static int compare(const void * a, const void * b) {
 	return (*(scalar_t *)a - *(scalar_t *)b > 0) - (*(scalar_t *)a - *(scalar_t *)b < 0);
 }
 
-static int coupled_compare(const void * a, const void * b) {
-	// used for list sorting relative to another list
-	struct { int32_t i; scalar_t s; } * x = (void *)a;
-	struct { int32_t i; scalar_t s; } * y = (void *)b;
-	return (x->s - y->s > 0) - (x->s - y->s < 0);
+static void TruncateVectorArray(VectorArray * value, uint32_t length) {
+	// repacks the leading elements of each channel into a block of the new length
+	VectorArray truncated = CreateVectorArray(value->dimensions, length);
+	truncated.kind = value->kind;
+	for (int32_t d = 0; d < value->dimensions; d++) { memcpy(truncated.xyzw[d], value->xyzw[d], length * sizeof(scalar_t)); }
+	FreeVectorArray(*value);
+	*value = truncated;
+}
+
+// reductions run over fixed blocks, each reduced in a few independent lanes that vectorize, and the block results are
+// combined pairwise in double so the error grows with the log of the length, blocks don't depend on the thread count
+// so the result is the same however many threads take part
+#define REDUCTION_BLOCK 256
+#define REDUCTION_LANES 8
+
+typedef enum ReductionKind {
+	ReductionKindSum,
+	ReductionKindProduct,
+	ReductionKindMoments,   // mean and squared deviations of a
+	ReductionKindComoments, // the same for a and b and their co-deviations
+} ReductionKind;
+
+typedef struct Reduction {
+	double n;
+	double a;  // the sum, product or mean of a
+	double b;  // the mean of b
+	double aa; // sum of squared deviations of a from its mean
+	double bb;
+	double ab; // sum of products of the deviations of a and b
+} Reduction;
+
+typedef struct ReductionJob {
+	ReductionKind kind;
+	const scalar_t * a;
+	const scalar_t * b;
+	uint32_t length;
+	Reduction * blocks;
+} ReductionJob;
+
+// the lanes are indexed off a pointer to each row, an index like x[i + l] could wrap and keeps the rows from vectorizing
+
+static inline double LaneSum(const scalar_t * lanes) {
+	return ((lanes[0] + (double)lanes[1]) + (lanes[2] + (double)lanes[3])) + ((lanes[4] + (double)lanes[5]) + (lanes[6] + (double)lanes[7]));
+}
+
+static double BlockSum(const scalar_t * restrict x, uint32_t n) {
+	scalar_t lanes[REDUCTION_LANES] = { 0 };
+	uint32_t i = 0;
+	for (; i + REDUCTION_LANES <= n; i += REDUCTION_LANES) {
+		const scalar_t * row = x + i;
+		for (int32_t l = 0; l < REDUCTION_LANES; l++) { lanes[l] += row[l]; }
+	}
+	for (; i < n; i++) { lanes[i % REDUCTION_LANES] += x[i]; }
+	return LaneSum(lanes);
+}
+
+static double BlockProduct(const scalar_t * restrict x, uint32_t n) {
+	// in double, a float product of a block overflows easily
+	double lanes[REDUCTION_LANES] = { 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0 };
+	uint32_t i = 0;
+	for (; i + REDUCTION_LANES <= n; i += REDUCTION_LANES) {
+		const scalar_t * row = x + i;
+		for (int32_t l = 0; l < REDUCTION_LANES; l++) { lanes[l] *= row[l]; }
+	}
+	for (; i < n; i++) { lanes[i % REDUCTION_LANES] *= x[i]; }
+	return ((lanes[0] * lanes[1]) * (lanes[2] * lanes[3])) * ((lanes[4] * lanes[5]) * (lanes[6] * lanes[7]));
+}
+
+static double BlockCodeviation(const scalar_t * restrict x, scalar_t mx, const scalar_t * restrict y, scalar_t my, uint32_t n) {
+	scalar_t lanes[REDUCTION_LANES] = { 0 };
+	uint32_t i = 0;
+	for (; i + REDUCTION_LANES <= n; i += REDUCTION_LANES) {
+		const scalar_t * xr = x + i, * yr = y + i;
+		for (int32_t l = 0; l < REDUCTION_LANES; l++) { lanes[l] += (xr[l] - mx) * (yr[l] - my); }
+	}
+	for (; i < n; i++) { lanes[i % REDUCTION_LANES] += (x[i] - mx) * (y[i] - my); }
+	return LaneSum(lanes);
+}
+
+static Reduction ReduceBlock(ReductionKind kind, const scalar_t * a, const scalar_t * b, uint32_t n) {
+	// a block is in cache, so its moments take a second look at it rather than a second pass over the array
+	Reduction r = { .n = n };
+	switch (kind) {
+		case ReductionKindSum: r.a = BlockSum(a, n); break;
+		case ReductionKindProduct: r.a = BlockProduct(a, n); break;
+		case ReductionKindComoments:
+			r.b = BlockSum(b, n) / n;
+			r.bb = BlockCodeviation(b, r.b, b, r.b, n);
+			// fall through
+		case ReductionKindMoments:
+			r.a = BlockSum(a, n) / n;
+			r.aa = BlockCodeviation(a, r.a, a, r.a, n);
+			if (kind == ReductionKindComoments) { r.ab = BlockCodeviation(a, r.a, b, r.b, n); }
+			break;
+	}
+	return r;
+}
+
+static Reduction CombineReductions(ReductionKind kind, Reduction x, Reduction y) {
+	// moments are merged with the pairwise update of Chan et al., the parallel form of Welford's
+	if (x.n == 0) { return y; }
+	if (y.n == 0) { return x; }
+	Reduction r = { .n = x.n + y.n };
+	switch (kind) {
+		case ReductionKindSum: r.a = x.a + y.a; break;
+		case ReductionKindProduct: r.a = x.a * y.a; break;
+		default: {
+			double f = x.n * y.n / r.n, da = y.a - x.a, db = y.b - x.b;
+			r.a = x.a + da * y.n / r.n;
+			r.b = x.b + db * y.n / r.n;
+			r.aa = x.aa + y.aa + da * da * f;
+			r.bb = x.bb + y.bb + db * db * f;
+			r.ab = x.ab + y.ab + da * db * f;
+			break;
+		}
+	}
+	return r;
+}
+
+static Reduction CombineBlocks(ReductionKind kind, const Reduction * blocks, uint32_t count) {
+	if (count == 1) { return blocks[0]; }
+	return CombineReductions(kind, CombineBlocks(kind, blocks, count / 2), CombineBlocks(kind, blocks + count / 2, count - count / 2));
+}
+
+static void ReduceBlocks(void * data, uint32_t start, uint32_t end) {
+	ReductionJob * job = data;
+	for (uint32_t k = start; k < end; k++) {
+		uint32_t i = k * REDUCTION_BLOCK, n = job->length - i < REDUCTION_BLOCK ? job->length - i : REDUCTION_BLOCK;
+		job->blocks[k] = ReduceBlock(job->kind, job->a + i, job->b == NULL ? NULL : job->b + i, n);
+	}
+}
+
+static Reduction Reduce(ReductionKind kind, const scalar_t * a, const scalar_t * b, uint32_t length) {
+	// b is only read for comoments
+	if (length <= REDUCTION_BLOCK) { return length == 0 ? (Reduction){ .a = kind == ReductionKindProduct ? 1.0 : 0.0 } : ReduceBlock(kind, a, b, length); }
+	static const BuiltinFunction costs[] = { BuiltinFunctionSUM, BuiltinFunctionPROD, BuiltinFunctionVAR, BuiltinFunctionCOV };
+	uint32_t count = (length + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+	ReductionJob job = { kind, a, b, length, malloc(count * sizeof(Reduction)) };
+	if (PlanExecution(EstimateBuiltinCost(costs[kind], false), 1, length) == ExecutionStrategyParallel) { ParallelFor(count, ReduceBlocks, &job); }
+	else { ReduceBlocks(&job, 0, count); }
+	Reduction r = CombineBlocks(kind, job.blocks, count);
+	free(job.blocks);
+	return r;
+}
+
+// scans run over fixed blocks too, a block is scanned a row of lanes at a time, each row prefixed on its own so the
+// rows don't wait on each other and then offset by the rows before them in one vector step, the blocks are scanned on
+// their own and then offset by the blocks before them, so both passes spread over the threads and the result doesn't
+// depend on how many
+#define SCAN_BLOCK 2048
+#define SCAN_LANES 8
+
+typedef enum ScanKind {
+	ScanKindSum,
+	ScanKindProduct,
+	ScanKindMax,
+	ScanKindMin,
+} ScanKind;
+
+typedef struct ScanJob {
+	const EvaluationContext * context; // checked before each block on the threads, the serial loop checks for itself
+	ScanKind kind;
+	scalar_t * x;
+	uint32_t length;
+	scalar_t * totals; // each block's total, then what the blocks before it combine to
+} ScanJob;
+
+static inline scalar_t ScanCombine(ScanKind kind, scalar_t a, scalar_t b) {
+	// a comes before b, a NaN in b is passed over by the running extremes
+	switch (kind) {
+		case ScanKindSum: return a + b;
+		case ScanKindProduct: return a * b;
+		case ScanKindMax: return b > a ? b : a;
+		default: return b < a ? b : a;
+	}
+}
+
+static inline scalar_t ScanBlock(ScanKind kind, scalar_t * restrict x, uint32_t n) {
+	// returns the block's total, -0 leaves every sum unchanged, -0 included
+	static const scalar_t identities[] = { -0.0, 1.0, -INFINITY, INFINITY };
+	scalar_t carry = identities[kind];
+	uint32_t i = 0;
+	for (; i + SCAN_LANES <= n; i += SCAN_LANES) {
+		// only the carry runs from row to row, a shifted log2(lanes) prefix measured slower than this without intrinsics
+		scalar_t * row = x + i, lanes[SCAN_LANES];
+		// seeded through the identity so a NaN starting a row is passed over like anywhere else
+		lanes[0] = ScanCombine(kind, identities[kind], row[0]);
+		for (int32_t l = 1; l < SCAN_LANES; l++) { lanes[l] = ScanCombine(kind, lanes[l - 1], row[l]); }
+		for (int32_t l = 0; l < SCAN_LANES; l++) { row[l] = ScanCombine(kind, carry, lanes[l]); }
+		carry = row[SCAN_LANES - 1];
+	}
+	for (; i < n; i++) { x[i] = carry = ScanCombine(kind, carry, x[i]); }
+	return carry;
+}
+
+static void ScanBlocks(void * data, uint32_t start, uint32_t end) {
+	// the kind is fixed for each call so every case gets its own inlined loops
+	ScanJob * job = data;
+	for (uint32_t k = start; k < end; k++) {
+		if (EvaluationContextCheckpoint(job->context) != RuntimeErrorCodeNone) { return; }
+		uint32_t i = k * SCAN_BLOCK, n = job->length - i < SCAN_BLOCK ? job->length - i : SCAN_BLOCK;
+		switch (job->kind) {
+			case ScanKindSum: job->totals[k] = ScanBlock(ScanKindSum, job->x + i, n); break;
+			case ScanKindProduct: job->totals[k] = ScanBlock(ScanKindProduct, job->x + i, n); break;
+			case ScanKindMax: job->totals[k] = ScanBlock(ScanKindMax, job->x + i, n); break;
+			case ScanKindMin: job->totals[k] = ScanBlock(ScanKindMin, job->x + i, n); break;
+		}
+	}
+}
+
+static void OffsetBlocks(void * data, uint32_t start, uint32_t end) {
+	ScanJob * job = data;
+	for (uint32_t k = start > 0 ? start : 1; k < end; k++) {
+		uint32_t i = k * SCAN_BLOCK, n = job->length - i < SCAN_BLOCK ? job->length - i : SCAN_BLOCK;
+		scalar_t * restrict x = job->x + i, offset = job->totals[k];
+		switch (job->kind) {
+			case ScanKindSum: for (uint32_t j = 0; j < n; j++) { x[j] = offset + x[j]; } break;
+			case ScanKindProduct: for (uint32_t j = 0; j < n; j++) { x[j] = offset * x[j]; } break;
+			case ScanKindMax: for (uint32_t j = 0; j < n; j++) { x[j] = ScanCombine(ScanKindMax, offset, x[j]); } break;
+			case ScanKindMin: for (uint32_t j = 0; j < n; j++) { x[j] = ScanCombine(ScanKindMin, offset, x[j]); } break;
+		}
+	}
+}
+
+static RuntimeErrorCode Scan(EvaluationContext * context, ScanKind kind, scalar_t * x, uint32_t length) {
+	// inclusive and in place, the blocks stop being scanned once the evaluation is cancelled or out of time
+	static const BuiltinFunction costs[] = { BuiltinFunctionCUMSUM, BuiltinFunctionCUMPROD, BuiltinFunctionCUMMAX, BuiltinFunctionCUMMIN };
+	uint32_t count = (length + SCAN_BLOCK - 1) / SCAN_BLOCK;
+	bool parallel = PlanExecution(EstimateBuiltinCost(costs[kind], false), 1, length) == ExecutionStrategyParallel;
+	ScanJob job = { parallel ? context : NULL, kind, x, length, AllocateElements(count, sizeof(scalar_t)) };
+	if (parallel) {
+		ParallelFor(count, ScanBlocks, &job);
+		RuntimeErrorCode code = EvaluationContextCheckpoint(context);
+		if (code != RuntimeErrorCodeNone) {
+			free(job.totals);
+			return code;
+		}
+		// the block totals scanned exclusively, block 0 isn't offset
+		scalar_t offset = job.totals[0];
+		for (uint32_t k = 1; k < count; k++) {
+			scalar_t total = job.totals[k];
+			job.totals[k] = offset;
+			offset = ScanCombine(kind, offset, total);
+		}
+		ParallelFor(count, OffsetBlocks, &job);
+	} else {
+		// the same two passes a block at a time so each block is offset while it's still in cache
+		scalar_t offset = 0.0;
+		for (uint32_t k = 0; k < count && EvaluationContextCheckpoint(context) == RuntimeErrorCodeNone; k++) {
+			ScanBlocks(&job, k, k + 1);
+			scalar_t total = job.totals[k];
+			job.totals[k] = offset;
+			OffsetBlocks(&job, k, k + 1);
+			offset = k > 0 ? ScanCombine(kind, offset, total) : total;
+		}
+	}
+	free(job.totals);
+	return EvaluationContextCheckpoint(context);
+}
+
+static RuntimeErrorCode ScanChannels(EvaluationContext * context, ScanKind kind, VectorArray * result) {
+	// each channel on its own, along the whole array even for a grid
+	for (int32_t d = 0; d < result->dimensions; d++) {
+		RuntimeErrorCode code = Scan(context, kind, result->xyzw[d], result->length);
+		if (code != RuntimeErrorCodeNone) { return code; }
+	}
+	result->columns = 0;
+	if (kind != ScanKindSum) { result->kind = NumberKindReal; }
+	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _sin(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = sinf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = sin(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _cos(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = cosf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = cos(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _tan(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = tanf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = tan(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _asin(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = asinf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = asin(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _acos(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = acosf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = acos(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _atan(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = atanf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = atan(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
@@ -95,111 +409,110 @@ static RuntimeErrorCode _atan2(List(VectorArray) args, VectorArray * result) {
 	bool yi = y.length == 1 && x.length > 1;
 	bool xi = x.length == 1 && y.length > 1;
 	
-	result->xyzw[0] = malloc(result->length * sizeof(scalar_t));
-	for (int32_t i = 0; i < result->length; i++) { result->xyzw[0][i] = atan2f(y.xyzw[0][yi ? 0 : i], x.xyzw[0][xi ? 0 : i]); }
+	*result = CreateVectorArray(1, result->length);
+	for (int32_t i = 0; i < result->length; i++) { result->xyzw[0][i] = atan2(y.xyzw[0][yi ? 0 : i], x.xyzw[0][xi ? 0 : i]); }
 	
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _sec(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / cosf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / cos(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _csc(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / sinf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / sin(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _cot(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / tanf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / tan(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _asec(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = acosf(1.0 / result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = acos(1.0 / result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _acsc(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = asinf(1.0 / result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = asin(1.0 / result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _acot(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = M_PI_2 - atanf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = M_PI_2 - atan(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _sinh(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = sinhf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = sinh(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _cosh(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = coshf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = cosh(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _tanh(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = tanhf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = tanh(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _asinh(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = asinhf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = asinh(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _acosh(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = acoshf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = acosh(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _atanh(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = atanhf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = atanh(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _sech(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / coshf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / cosh(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _csch(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / sinhf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / sinh(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _coth(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / tanhf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = 1.0 / tanh(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _asech(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = acoshf(1.0 / result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = acosh(1.0 / result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _acsch(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = asinhf(1.0 / result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = asinh(1.0 / result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _acoth(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = atanhf(1.0 / result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = atanh(1.0 / result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _abs(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = fabsf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = fabs(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _argmax(VectorArray * result) {
 	// argmax takes 1 non-vector argument
 	if (result->dimensions > 1) { return RuntimeErrorCodeInvalidArgumentType; }
-	result->length = 1;
 	
 	scalar_t max = result->xyzw[0][0];
 	int32_t index = 0;
@@ -209,16 +522,14 @@ static RuntimeErrorCode _argmax(VectorArray * result) {
 			index = i;
 		}
 	}
-	free(result->xyzw[0]);
-	result->xyzw[0] = malloc(sizeof(scalar_t));
 	result->xyzw[0][0] = (scalar_t)index;
+	TruncateVectorArray(result, 1);
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _argmin(VectorArray * result) {
 	// argmin takes 1 non-vector argument
 	if (result->dimensions > 1) { return RuntimeErrorCodeInvalidArgumentType; }
-	result->length = 1;
 	
 	scalar_t min = result->xyzw[0][0];
 	int32_t index = 0;
@@ -228,53 +539,31 @@ static RuntimeErrorCode _argmin(VectorArray * result) {
 			index = i;
 		}
 	}
-	free(result->xyzw[0]);
-	result->xyzw[0] = malloc(sizeof(scalar_t));
 	result->xyzw[0][0] = index;
+	TruncateVectorArray(result, 1);
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _cbrt(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = cbrtf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = cbrt(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _ceil(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = ceilf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = ceil(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _corr(List(VectorArray) args, VectorArray * result) {
-	// corr takes two arguments of same dimensionality
+	// corr takes two arguments of same dimensionality, the correlation of each channel
 	if (ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
 	if (args[0].dimensions != args[1].dimensions) { return RuntimeErrorCodeInvalidArgumentType; }
-	result->length = 1;
-	result->dimensions = args[0].dimensions;
-	
 	VectorArray a = args[0], b = args[1];
-	int32_t length = a.length < b.length ? a.length : b.length;
+	uint32_t length = a.length < b.length ? a.length : b.length;
+	*result = CreateVectorArray(a.dimensions, 1);
 	for (int32_t d = 0; d < a.dimensions; d++) {
-		// calculate the means for both
-		scalar_t avgA = 0.0, avgB = 0.0;
-		for (int32_t i = 0; i < length; i++) {
-			avgA += a.xyzw[d][i];
-			avgB += b.xyzw[d][i];
-		}
-		avgA /= length;
-		avgB /= length;
-		
-		// calculate the variance for both
-		scalar_t varA = 0.0, varB = 0.0;
-		for (int32_t i = 0; i < length; i++) {
-			varA += (a.xyzw[d][i] - avgA) * (a.xyzw[d][i] - avgA);
-			varB += (b.xyzw[d][i] - avgB) * (b.xyzw[d][i] - avgB);
-		}
-		
-		// calculate final normalized sum
-		scalar_t sum = 0.0;
-		for (int32_t i = 0; i < length; i++) { sum += (a.xyzw[d][i] - avgA) * (b.xyzw[d][i] - avgB); }
-		result->xyzw[d] = malloc(sizeof(scalar_t));
-		result->xyzw[d][0] = sum / sqrtf(varA * varB);
+		Reduction r = Reduce(ReductionKindComoments, a.xyzw[d], b.xyzw[d], length);
+		result->xyzw[d][0] = r.ab / sqrt(r.aa * r.bb);
 	}
 	return RuntimeErrorCodeNone;
 }
@@ -290,7 +579,7 @@ static RuntimeErrorCode _count(List(VectorArray) args, VectorArray * result) {
 	if (ListLength(args) == 1) {
 		// returns length of the vector array passed
 		int32_t len = args[0].length;
-		result->xyzw[0] = malloc(sizeof(scalar_t));
+		*result = CreateVectorArray(1, 1);
 		result->xyzw[0][0] = len;
 		return RuntimeErrorCodeNone;
 	}
@@ -307,7 +596,7 @@ static RuntimeErrorCode _count(List(VectorArray) args, VectorArray * result) {
 			}
 			if (equal) { count++; }
 		}
-		result->xyzw[0] = malloc(sizeof(scalar_t));
+		*result = CreateVectorArray(1, 1);
 		result->xyzw[0][0] = count;
 		return RuntimeErrorCodeNone;
 	}
@@ -315,58 +604,259 @@ static RuntimeErrorCode _count(List(VectorArray) args, VectorArray * result) {
 }
 
 static RuntimeErrorCode _cov(List(VectorArray) args, VectorArray * result) {
-	// cov takes two arguments of same dimensionality
+	// cov takes two arguments of same dimensionality, the sample covariance of each channel
 	if (ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
 	if (args[0].dimensions != args[1].dimensions) { return RuntimeErrorCodeInvalidArgumentType; }
-	result->length = 1;
-	result->dimensions = args[0].dimensions;
-	
 	VectorArray a = args[0], b = args[1];
-	int32_t length = a.length < b.length ? a.length : b.length;
-	for (int32_t d = 0; d < a.dimensions; d++) {
-		// calculate means
-		scalar_t avgA = 0.0, avgB = 0.0;
-		for (int32_t i = 0; i < length; i++) {
-			avgA += a.xyzw[d][i];
-			avgB += b.xyzw[d][i];
-		}
-		avgA /= length;
-		avgB /= length;
-		
-		// then calculate the covariance
-		scalar_t sum = 0.0;
-		for (int32_t i = 0; i < length; i++) { sum += (a.xyzw[d][i] - avgA) * (b.xyzw[d][i] - avgB); }
-		result->xyzw[d] = malloc(sizeof(scalar_t));
-		result->xyzw[d][0] = sum / (length - 1);
+	uint32_t length = a.length < b.length ? a.length : b.length;
+	*result = CreateVectorArray(a.dimensions, 1);
+	for (int32_t d = 0; d < a.dimensions; d++) { result->xyzw[d][0] = Reduce(ReductionKindComoments, a.xyzw[d], b.xyzw[d], length).ab / (length - 1.0); }
+	return RuntimeErrorCodeNone;
+}
+
+static scalar_t digamma(scalar_t x) {
+	// reflection for negative values, recurrence up to x >= 6, then the asymptotic series
+	if (x <= 0.0 && floor(x) == x) { return NAN; }
+	if (x < 0.0) { return digamma(1.0 - x) - M_PI / tan(M_PI * x); }
+	scalar_t result = 0.0;
+	while (x < 6.0) {
+		result -= 1.0 / x;
+		x += 1.0;
+	}
+	scalar_t f = 1.0 / (x * x);
+	return result + log(x) - 0.5 / x - f * (1.0 / 12.0 - f * (1.0 / 120.0 - f * (1.0 / 252.0 - f * (1.0 / 240.0 - f / 132.0))));
+}
+
+static scalar_t trigamma(scalar_t x) {
+	// same scheme as digamma, reflection uses psi1(1 - x) + psi1(x) = pi^2 / sin^2(pi x)
+	if (x <= 0.0 && floor(x) == x) { return NAN; }
+	if (x < 0.0) { return M_PI * M_PI / (sin(M_PI * x) * sin(M_PI * x)) - trigamma(1.0 - x); }
+	scalar_t result = 0.0;
+	while (x < 6.0) {
+		result += 1.0 / (x * x);
+		x += 1.0;
+	}
+	scalar_t f = 1.0 / (x * x);
+	return result + 1.0 / x + f * (0.5 + (1.0 / x) * (1.0 / 6.0 - f * (1.0 / 30.0 - f * (1.0 / 42.0 - f / 30.0))));
+}
+
+static RuntimeErrorCode _cummax(EvaluationContext * context, VectorArray * result) {
+	return ScanChannels(context, ScanKindMax, result);
+}
+
+static RuntimeErrorCode _cummin(EvaluationContext * context, VectorArray * result) {
+	return ScanChannels(context, ScanKindMin, result);
+}
+
+static RuntimeErrorCode _cumprod(EvaluationContext * context, VectorArray * result) {
+	return ScanChannels(context, ScanKindProduct, result);
+}
+
+static RuntimeErrorCode _cumsum(EvaluationContext * context, VectorArray * result) {
+	return ScanChannels(context, ScanKindSum, result);
+}
+
+static RuntimeErrorCode _diff(VectorArray * result) {
+	// differences of neighbouring elements, one fewer than there are elements
+	uint32_t length = result->length > 0 ? result->length - 1 : 0;
+	for (int32_t d = 0; d < result->dimensions; d++) {
+		scalar_t * x = result->xyzw[d];
+		for (uint32_t i = 0; i < length; i++) { x[i] = x[i + 1] - x[i]; }
 	}
+	result->columns = 0;
+	TruncateVectorArray(result, length);
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _digamma(VectorArray * result) {
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = digamma(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _erf(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = erff(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = erf(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _exp(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = expf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = exp(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _factorial(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = tgammaf(result->xyzw[d][i] + 1.0); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = tgamma(result->xyzw[d][i] + 1.0); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _floor(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = floorf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = floor(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _gamma(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = tgammaf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = tgamma(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
+// histograms split the samples into a fixed slice per thread, each slice counts into bins of its own so no bin is shared
+// while counting, then the slices' bins are added up, the counts come out the same however the slices were run
+typedef struct HistogramJob {
+	const scalar_t * channels[2]; // the samples along each axis, hist2d has two
+	int32_t axes;
+	uint32_t length, slices;
+	uint32_t bins[2];
+	scalar_t lower[2], upper[2], scale[2];
+	uint32_t extremes[PLANNER_MAX_THREADS][2][2]; // each slice's lowest and highest finite sample along each axis
+	uint32_t * counts;                            // a run of bins for each slice
+	scalar_t * merged;
+} HistogramJob;
+
+static void BoundHistogram(void * data, uint32_t start, uint32_t end) {
+	// the first of equal extremes is kept so the tangents read a fixed sample
+	HistogramJob * job = data;
+	for (uint32_t s = start; s < end; s++) {
+		uint32_t first = (uint64_t)job->length * s / job->slices, last = (uint64_t)job->length * (s + 1) / job->slices;
+		for (int32_t a = 0; a < job->axes; a++) {
+			const scalar_t * x = job->channels[a];
+			// NaNs fail both comparisons, infinities can't be the new extreme
+			uint32_t lowest = UINT32_MAX, highest = UINT32_MAX;
+			scalar_t low = INFINITY, high = -INFINITY;
+			for (uint32_t i = first; i < last; i++) {
+				if (x[i] < low && x[i] > -INFINITY) { low = x[i]; lowest = i; }
+				if (x[i] > high && x[i] < INFINITY) { high = x[i]; highest = i; }
+			}
+			job->extremes[s][a][0] = lowest;
+			job->extremes[s][a][1] = highest;
+		}
+	}
+}
+
+static inline uint32_t HistogramBin(scalar_t x, scalar_t lower, scalar_t scale, uint32_t bins) {
+	// the upper edge goes in the last bin, rounding can't push a sample in range outside the bins
+	uint32_t bin = (x - lower) * scale;
+	return bin < bins ? bin : bins - 1;
+}
+
+static void CountHistogram(void * data, uint32_t start, uint32_t end) {
+	// the job is read into locals, the counts could alias it as far as the compiler knows
+	HistogramJob * job = data;
+	const scalar_t * x = job->channels[0], * y = job->channels[1];
+	scalar_t x0 = job->lower[0], x1 = job->upper[0], sx = job->scale[0], y0 = job->lower[1], y1 = job->upper[1], sy = job->scale[1];
+	uint32_t columns = job->bins[0], rows = job->bins[1];
+	for (uint32_t s = start; s < end; s++) {
+		uint32_t first = (uint64_t)job->length * s / job->slices, last = (uint64_t)job->length * (s + 1) / job->slices;
+		uint32_t * counts = job->counts + (size_t)s * columns * rows;
+		// samples outside the range and NaNs fail the comparisons and aren't counted
+		if (job->axes == 1) {
+			for (uint32_t i = first; i < last; i++) {
+				if (x[i] >= x0 && x[i] <= x1) { counts[HistogramBin(x[i], x0, sx, columns)]++; }
+			}
+		} else {
+			for (uint32_t i = first; i < last; i++) {
+				if (!(x[i] >= x0 && x[i] <= x1 && y[i] >= y0 && y[i] <= y1)) { continue; }
+				counts[HistogramBin(y[i], y0, sy, rows) * columns + HistogramBin(x[i], x0, sx, columns)]++;
+			}
+		}
+	}
+}
+
+static void MergeHistogram(void * data, uint32_t start, uint32_t end) {
+	HistogramJob * job = data;
+	size_t stride = (size_t)job->bins[0] * job->bins[1];
+	for (uint32_t b = start; b < end; b++) {
+		uint32_t count = 0;
+		for (uint32_t s = 0; s < job->slices; s++) { count += job->counts[s * stride + b]; }
+		job->merged[b] = count;
+	}
+}
+
+static RuntimeErrorCode HistogramRange(List(VectorArray) args, HistogramJob * job, uint32_t extremes[2][2]) {
+	// hist(x, bins, (lower, upper)) and hist2d(p, bins, [(x0, y0), (x1, y1)]) or the bounds of the finite samples, an
+	// empty span is widened by a half on either side, extremes is left as UINT32_MAX for a range that was given
+	for (int32_t a = 0; a < job->axes; a++) { extremes[a][0] = extremes[a][1] = UINT32_MAX; }
+	if (ListLength(args) == 3) {
+		VectorArray range = args[2];
+		bool valid = job->axes == 1 ? range.dimensions == 2 && range.length == 1 : range.dimensions == 2 && range.length == 2;
+		if (!valid || IsVectorArrayComplex(range)) { return RuntimeErrorCodeInvalidArgumentType; }
+		for (int32_t a = 0; a < job->axes; a++) {
+			job->lower[a] = job->axes == 1 ? range.xyzw[0][0] : range.xyzw[a][0];
+			job->upper[a] = job->axes == 1 ? range.xyzw[1][0] : range.xyzw[a][1];
+			if (!(isfinite(job->lower[a]) && isfinite(job->upper[a]) && job->lower[a] < job->upper[a])) { return RuntimeErrorCodeInvalidArgumentType; }
+		}
+	} else {
+		if (job->slices > 1) { ParallelTasks(job->slices, BoundHistogram, job); }
+		else { BoundHistogram(job, 0, 1); }
+		for (int32_t a = 0; a < job->axes; a++) {
+			const scalar_t * x = job->channels[a];
+			for (uint32_t s = 0; s < job->slices; s++) {
+				uint32_t lowest = job->extremes[s][a][0], highest = job->extremes[s][a][1];
+				if (lowest == UINT32_MAX) { continue; }
+				if (extremes[a][0] == UINT32_MAX || x[lowest] < x[extremes[a][0]]) { extremes[a][0] = lowest; }
+				if (extremes[a][1] == UINT32_MAX || x[highest] > x[extremes[a][1]]) { extremes[a][1] = highest; }
+			}
+			job->lower[a] = extremes[a][0] == UINT32_MAX ? 0.0 : x[extremes[a][0]];
+			job->upper[a] = extremes[a][1] == UINT32_MAX ? 1.0 : x[extremes[a][1]];
+			if (job->lower[a] == job->upper[a]) {
+				job->lower[a] -= 0.5;
+				job->upper[a] += 0.5;
+			}
+		}
+	}
+	for (int32_t a = 0; a < job->axes; a++) { job->scale[a] = job->bins[a] / (job->upper[a] - job->lower[a]); }
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode Histogram(EvaluationContext * context, int32_t axes, List(VectorArray) args, VectorArray * result, uint32_t extremes[2][2]) {
+	// hist gives (center, count) for each bin, hist2d gives (x, y, count) as a grid with a column for each bin along x
+	if (ListLength(args) != 2 && ListLength(args) != 3) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	VectorArray samples = args[0], bins = args[1];
+	if (samples.dimensions != axes || IsVectorArrayComplex(samples) || IsVectorArrayMatrix(samples)) { return RuntimeErrorCodeInvalidArgumentType; }
+	if ((bins.dimensions != 1 && bins.dimensions != axes) || bins.length != 1) { return RuntimeErrorCodeInvalidArgumentType; }
+	HistogramJob job = { .axes = axes, .length = samples.length, .bins = { 1, 1 } };
+	for (int32_t a = 0; a < axes; a++) {
+		scalar_t n = bins.xyzw[bins.dimensions == 1 ? 0 : a][0];
+		if (!(n >= 1.0 && n < 0x1p31)) { return RuntimeErrorCodeInvalidArgumentType; }
+		job.bins[a] = n;
+		job.channels[a] = samples.xyzw[a];
+	}
+	double total = (double)job.bins[0] * job.bins[1];
+	RuntimeErrorCode code = EvaluationContextReserve(context, axes + 1, total);
+	if (code != RuntimeErrorCodeNone) { return code; }
+
+	// a slice for each thread once the samples outnumber the bins, before that adding up the slices costs more than counting
+	BuiltinFunction function = axes == 1 ? BuiltinFunctionHIST : BuiltinFunctionHIST2D;
+	bool parallel = PlanExecution(EstimateBuiltinCost(function, false), axes, samples.length) == ExecutionStrategyParallel;
+	job.slices = parallel && samples.length > total * GetPlannerCalibration().threads ? GetPlannerCalibration().threads : 1;
+	code = HistogramRange(args, &job, extremes);
+	if (code != RuntimeErrorCodeNone) { return code; }
+
+	job.counts = calloc(job.slices * total, sizeof(uint32_t));
+	if (job.slices > 1) { ParallelTasks(job.slices, CountHistogram, &job); }
+	else { CountHistogram(&job, 0, 1); }
+	*result = CreateVectorArray(axes + 1, total);
+	result->columns = axes == 1 ? 0 : job.bins[0];
+	job.merged = result->xyzw[axes];
+	if (job.slices > 1) { ParallelFor(total, MergeHistogram, &job); }
+	else { MergeHistogram(&job, 0, total); }
+	free(job.counts);
+
+	for (uint32_t k = 0; k < result->length; k++) {
+		uint32_t cell[2] = { k % job.bins[0], k / job.bins[0] };
+		for (int32_t a = 0; a < axes; a++) { result->xyzw[a][k] = job.lower[a] + (cell[a] + 0.5) / job.scale[a]; }
+	}
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _hist(EvaluationContext * context, List(VectorArray) args, VectorArray * result) {
+	uint32_t extremes[2][2];
+	return Histogram(context, 1, args, result, extremes);
+}
+
+static RuntimeErrorCode _hist2d(EvaluationContext * context, List(VectorArray) args, VectorArray * result) {
+	uint32_t extremes[2][2];
+	return Histogram(context, 2, args, result, extremes);
+}
+
 static RuntimeErrorCode _interleave(List(VectorArray) args, VectorArray * result) {
 	// takes n arguments of same dimensionality
 	result->dimensions = 0;
@@ -379,8 +869,8 @@ static RuntimeErrorCode _interleave(List(VectorArray) args, VectorArray * result
 	}
 	
 	// interleave the contents of each argument into a single array
+	*result = CreateVectorArray(result->dimensions, result->length);
 	for (int32_t d = 0; d < result->dimensions; d++) {
-		result->xyzw[d] = malloc(result->length * sizeof(scalar_t));
 		int32_t * counters = calloc(ListLength(args), sizeof(int32_t));
 		int32_t c = 0;
 		while (c < result->length) {
@@ -406,8 +896,8 @@ static RuntimeErrorCode _join(List(VectorArray) args, VectorArray * result)
 	}
 	
 	// copy the contents of each argument into a single array
+	*result = CreateVectorArray(result->dimensions, result->length);
 	for (int32_t d = 0; d < result->dimensions; d++) {
-		result->xyzw[d] = malloc(result->length * sizeof(scalar_t));
 		for (int32_t i = 0, p = 0; i < ListLength(args); i++) {
 			memcpy(result->xyzw[d] + p, args[i].xyzw[d], args[i].length * sizeof(scalar_t));
 			p += args[i].length;
@@ -417,7 +907,7 @@ static RuntimeErrorCode _join(List(VectorArray) args, VectorArray * result)
 }
 
 static RuntimeErrorCode _ln(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = logf(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = log(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
@@ -438,10 +928,10 @@ static RuntimeErrorCode _log(List(VectorArray) args, VectorArray * result) {
 	bool bd = b.dimensions == 1 && a.dimensions > 1;
 	
 	// calculate the log
+	*result = CreateVectorArray(result->dimensions, result->length);
 	for (int32_t d = 0; d < result->dimensions; d++) {
-		result->xyzw[d] = malloc(result->length * sizeof(scalar_t));
 		for (int32_t i = 0; i < result->length; i++) {
-			result->xyzw[d][i] = logf(a.xyzw[ad ? 0 : d][ai ? 0 : i]) / logf(b.xyzw[bd ? 0 : d][bi ? 0 : i]);
+			result->xyzw[d][i] = log(a.xyzw[ad ? 0 : d][ai ? 0 : i]) / log(b.xyzw[bd ? 0 : d][bi ? 0 : i]);
 		}
 	}
 	
@@ -449,12 +939,12 @@ static RuntimeErrorCode _log(List(VectorArray) args, VectorArray * result) {
 }
 
 static RuntimeErrorCode _log10(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = log10f(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = log10(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _log2(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = log2f(result->xyzw[d][i]); } }
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = log2(result->xyzw[d][i]); } }
 	return RuntimeErrorCodeNone;
 }
 
@@ -472,33 +962,209 @@ static RuntimeErrorCode _max(List(VectorArray) args, VectorArray * result) {
 			if (args[i].xyzw[0][j] > max) { max = args[i].xyzw[0][j]; }
 		}
 	}
-	result->xyzw[0] = malloc(sizeof(scalar_t));
+	*result = CreateVectorArray(1, 1);
 	result->xyzw[0][0] = max;
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _mean(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) {
-		scalar_t sum = 0.0;
-		for (int32_t i = 0; i < result->length; i++) { sum += result->xyzw[d][i]; }
-		free(result->xyzw[d]);
-		result->xyzw[d] = malloc(sizeof(scalar_t));
-		result->xyzw[d][0] = sum / result->length;
-	}
-	result->length = 1;
+	for (int32_t d = 0; d < result->dimensions; d++) { result->xyzw[d][0] = Reduce(ReductionKindSum, result->xyzw[d], NULL, result->length).a / result->length; }
+	TruncateVectorArray(result, 1);
 	return RuntimeErrorCodeNone;
 }
 
-static RuntimeErrorCode _median(VectorArray * result) {
+// selection partitions a copy around pivots until every wanted rank sits where a sort would put it, which is linear on
+// average, long arrays are first split into ordered buckets on all the threads and only the buckets holding a rank are kept
+#define SELECT_INSERTION_LENGTH 16
+#define SELECT_BUCKETS 256
+#define SELECT_OVERSAMPLING 8
+#define SELECT_PARALLEL_LENGTH (16 * SELECT_BUCKETS * SELECT_OVERSAMPLING)
+
+static inline void SwapScalars(scalar_t * a, scalar_t * b) {
+	scalar_t t = *a;
+	*a = *b;
+	*b = t;
+}
+
+static int rank_compare(const void * a, const void * b) {
+	return (*(uint32_t *)a > *(uint32_t *)b) - (*(uint32_t *)a < *(uint32_t *)b);
+}
+
+static uint32_t PartitionNaN(scalar_t * v, uint32_t lo, uint32_t hi) {
+	// moves the NaNs in [lo, hi) to its end and returns where they start, so they take the last ranks like they sort last
+	uint32_t end = lo;
+	for (uint32_t i = lo; i < hi; i++) {
+		if (v[i] == v[i]) { SwapScalars(&v[end++], &v[i]); }
+	}
+	return end;
+}
+
+static void MultiSelect(const EvaluationContext * context, scalar_t * v, uint32_t lo, uint32_t hi, const uint32_t * ranks, uint32_t count, int32_t budget) {
+	// ranks are ascending and all within [lo, hi), the depth budget falls back to a sort so a bad run of pivots stays n log n,
+	// a cancelled or late evaluation stops it before the next partition
+	while (count > 0 && hi - lo > SELECT_INSERTION_LENGTH) {
+		if (EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) { return; }
+		if (budget-- == 0) {
+			qsort(v + lo, hi - lo, sizeof(scalar_t), compare);
+			return;
+		}
+		// median of three placed at the lower middle, then a Hoare partition around it
+		uint32_t mid = lo + (hi - lo - 1) / 2;
+		if (v[mid] < v[lo]) { SwapScalars(&v[mid], &v[lo]); }
+		if (v[hi - 1] < v[lo]) { SwapScalars(&v[hi - 1], &v[lo]); }
+		if (v[hi - 1] < v[mid]) { SwapScalars(&v[hi - 1], &v[mid]); }
+		scalar_t pivot = v[mid];
+		int64_t i = (int64_t)lo - 1, j = hi;
+		while (true) {
+			do { i++; } while (v[i] < pivot);
+			do { j--; } while (pivot < v[j]);
+			if (i >= j) { break; }
+			SwapScalars(&v[i], &v[j]);
+		}
+		uint32_t split = j + 1, left = 0;
+		while (left < count && ranks[left] < split) { left++; }
+		// the side with fewer ranks recurses, the other continues the loop
+		if (left < count - left) {
+			MultiSelect(context, v, lo, split, ranks, left, budget);
+			lo = split;
+			ranks += left;
+			count -= left;
+		} else {
+			MultiSelect(context, v, split, hi, ranks + left, count - left, budget);
+			hi = split;
+			count = left;
+		}
+	}
+	if (count == 0) { return; }
+	for (uint32_t i = lo + 1; i < hi; i++) {
+		scalar_t x = v[i];
+		uint32_t j = i;
+		for (; j > lo && x < v[j - 1]; j--) { v[j] = v[j - 1]; }
+		v[j] = x;
+	}
+}
+
+typedef struct SelectJob {
+	const scalar_t * values;
+	scalar_t splitters[SELECT_BUCKETS - 1];
+	bool wanted[SELECT_BUCKETS];
+	atomic_uint counts[SELECT_BUCKETS];
+	atomic_uint cursors[SELECT_BUCKETS]; // where the next gathered element of each wanted bucket goes
+	scalar_t * gathered;
+} SelectJob;
+
+static inline uint32_t SelectBucket(const scalar_t * splitters, scalar_t x) {
+	// the number of splitters below x, so every element of a bucket is above all the buckets before it, NaN splitters
+	// are above everything and NaN elements go in the last bucket
+	if (x != x) { return SELECT_BUCKETS - 1; }
+	uint32_t b = 0;
+	for (uint32_t step = SELECT_BUCKETS / 2; step > 0; step >>= 1) {
+		if (b + step < SELECT_BUCKETS && splitters[b + step - 1] < x) { b += step; }
+	}
+	return b;
+}
+
+static void CountBuckets(void * data, uint32_t start, uint32_t end) {
+	SelectJob * job = data;
+	uint32_t counts[SELECT_BUCKETS] = { 0 };
+	for (uint32_t i = start; i < end; i++) { counts[SelectBucket(job->splitters, job->values[i])]++; }
+	for (uint32_t b = 0; b < SELECT_BUCKETS; b++) { if (counts[b] > 0) { atomic_fetch_add(&job->counts[b], counts[b]); } }
+}
+
+static void GatherBuckets(void * data, uint32_t start, uint32_t end) {
+	// counts the slice's share of each wanted bucket, reserves that much of the bucket and then copies into it
+	SelectJob * job = data;
+	uint32_t counts[SELECT_BUCKETS] = { 0 }, cursors[SELECT_BUCKETS];
+	for (uint32_t i = start; i < end; i++) { counts[SelectBucket(job->splitters, job->values[i])]++; }
+	for (uint32_t b = 0; b < SELECT_BUCKETS; b++) { if (job->wanted[b] && counts[b] > 0) { cursors[b] = atomic_fetch_add(&job->cursors[b], counts[b]); } }
+	for (uint32_t i = start; i < end; i++) {
+		uint32_t b = SelectBucket(job->splitters, job->values[i]);
+		if (job->wanted[b]) { job->gathered[cursors[b]++] = job->values[i]; }
+	}
+}
+
+static RuntimeErrorCode SelectRanks(EvaluationContext * context, const scalar_t * values, uint32_t length, const uint32_t * ranks, uint32_t count, scalar_t * selected) {
+	// selected[i] gets the element of rank ranks[i] without touching values, ranks can come in any order, NaN ranks
+	// last as it does in sort
+	uint32_t * sorted = malloc(count * sizeof(uint32_t));
+	memcpy(sorted, ranks, count * sizeof(uint32_t));
+	qsort(sorted, count, sizeof(uint32_t), rank_compare);
+	int32_t budget = 2 * (int32_t)log2(length + 1.0) + 8;
+
+	if (length < SELECT_PARALLEL_LENGTH || PlanExecution(EstimateBuiltinCost(BuiltinFunctionMEDIAN, false), 1, length) != ExecutionStrategyParallel) {
+		scalar_t * v = EvaluationContextScratch(context, length);
+		memcpy(v, values, length * sizeof(scalar_t));
+		uint32_t numbers = PartitionNaN(v, 0, length), below = 0;
+		while (below < count && sorted[below] < numbers) { below++; }
+		MultiSelect(context, v, 0, numbers, sorted, below, budget);
+		for (uint32_t i = 0; i < count; i++) { selected[i] = v[ranks[i]]; }
+		free(sorted);
+		return EvaluationContextCheckpoint(context);
+	}
+
+	// splitters are evenly spaced in a sorted sample, so buckets hold about length / SELECT_BUCKETS elements each
+	SelectJob * job = calloc(1, sizeof(SelectJob));
+	job->values = values;
+	scalar_t sample[SELECT_BUCKETS * SELECT_OVERSAMPLING];
+	uint32_t sampleLength = SELECT_BUCKETS * SELECT_OVERSAMPLING, stride = length / sampleLength;
+	for (uint32_t i = 0; i < sampleLength; i++) { sample[i] = values[i * stride + stride / 2]; }
+	qsort(sample, PartitionNaN(sample, 0, sampleLength), sizeof(scalar_t), compare);
+	for (uint32_t b = 0; b < SELECT_BUCKETS - 1; b++) { job->splitters[b] = sample[(b + 1) * SELECT_OVERSAMPLING - 1]; }
+	ParallelFor(length, CountBuckets, job);
+	RuntimeErrorCode code = EvaluationContextCheckpoint(context);
+	if (code != RuntimeErrorCodeNone) {
+		free(sorted);
+		free(job);
+		return code;
+	}
+
+	// prefix sums give each bucket's first rank, the wanted buckets get consecutive regions of the scratch
+	uint32_t first[SELECT_BUCKETS + 1] = { 0 }, offsets[SELECT_BUCKETS], gathered = 0;
+	for (uint32_t b = 0; b < SELECT_BUCKETS; b++) { first[b + 1] = first[b] + atomic_load(&job->counts[b]); }
+	for (uint32_t i = 0, b = 0; i < count; i++) {
+		while (first[b + 1] <= sorted[i]) { b++; }
+		job->wanted[b] = true;
+	}
+	for (uint32_t b = 0; b < SELECT_BUCKETS; b++) {
+		offsets[b] = gathered;
+		atomic_store(&job->cursors[b], gathered);
+		if (job->wanted[b]) { gathered += first[b + 1] - first[b]; }
+	}
+	job->gathered = EvaluationContextScratch(context, gathered);
+	ParallelFor(length, GatherBuckets, job);
+
+	// each wanted bucket is selected on its own with the ranks that fall in it, shifted to the bucket's region
+	uint32_t * shifted = malloc(count * sizeof(uint32_t));
+	for (uint32_t i = 0, b = 0; i < count;) {
+		while (first[b + 1] <= sorted[i]) { b++; }
+		uint32_t n = 0;
+		for (; i < count && sorted[i] < first[b + 1]; i++) { shifted[n++] = sorted[i] - first[b] + offsets[b]; }
+		uint32_t numbers = PartitionNaN(job->gathered, offsets[b], offsets[b] + first[b + 1] - first[b]), below = 0;
+		while (below < n && shifted[below] < numbers) { below++; }
+		MultiSelect(context, job->gathered, offsets[b], numbers, shifted, below, budget);
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t b = 0;
+		while (first[b + 1] <= ranks[i]) { b++; }
+		selected[i] = job->gathered[ranks[i] - first[b] + offsets[b]];
+	}
+	free(shifted);
+	free(sorted);
+	free(job);
+	return EvaluationContextCheckpoint(context);
+}
+
+static RuntimeErrorCode _median(EvaluationContext * context, VectorArray * result) {
 	for (int32_t d = 0; d < result->dimensions; d++) {
-		// sorts the list then gets the element in the middle
-		qsort(result->xyzw[d], result->length, sizeof(scalar_t), compare);
-		scalar_t median = result->length % 2 == 1 ? result->xyzw[d][result->length / 2] : (result->xyzw[d][result->length / 2] + result->xyzw[d][result->length / 2 - 1]) / 2.0;
-		free(result->xyzw[d]);
-		result->xyzw[d] = malloc(sizeof(scalar_t));
-		result->xyzw[d][0] = median;
+		// the two middle ranks, the same one for odd lengths
+		if (result->length == 0) { result->xyzw[d][0] = NAN; continue; }
+		uint32_t ranks[2] = { (result->length - 1) / 2, result->length / 2 };
+		scalar_t middle[2];
+		RuntimeErrorCode code = SelectRanks(context, result->xyzw[d], result->length, ranks, 2, middle);
+		if (code != RuntimeErrorCodeNone) { return code; }
+		result->xyzw[d][0] = (middle[0] + middle[1]) / 2.0;
 	}
-	result->length = 1;
+	TruncateVectorArray(result, 1);
 	return RuntimeErrorCodeNone;
 }
 
@@ -516,144 +1182,714 @@ static RuntimeErrorCode _min(List(VectorArray) args, VectorArray * result) {
 			if (args[i].xyzw[0][j] < min) { min = args[i].xyzw[0][j]; }
 		}
 	}
-	result->xyzw[0] = malloc(sizeof(scalar_t));
+	*result = CreateVectorArray(1, 1);
 	result->xyzw[0][0] = min;
 	return RuntimeErrorCodeNone;
 }
 
 static RuntimeErrorCode _prod(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) {
-		scalar_t prod = 1.0;
-		for (int32_t i = 0; i < result->length; i++) { prod *= result->xyzw[d][i]; }
-		free(result->xyzw[d]);
-		result->xyzw[d] = malloc(sizeof(scalar_t));
-		result->xyzw[d][0] = prod;
-	}
-	result->length = 1;
+	for (int32_t d = 0; d < result->dimensions; d++) { result->xyzw[d][0] = Reduce(ReductionKindProduct, result->xyzw[d], NULL, result->length).a; }
+	TruncateVectorArray(result, 1);
 	return RuntimeErrorCodeNone;
 }
 
-static RuntimeErrorCode _quantile(List(VectorArray) args, VectorArray * result) {
+static RuntimeErrorCode _quantile(EvaluationContext * context, List(VectorArray) args, VectorArray * result) {
 	// takes two arguments, second argument must not be a vector
 	if (ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
 	if (args[1].dimensions > 1) { return RuntimeErrorCodeInvalidArgumentType; }
-	result->length = args[1].length;
-	result->dimensions = args[0].dimensions;
-	
+	*result = CreateVectorArray(args[0].dimensions, args[1].length);
+	if (args[0].length == 0) {
+		for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = NAN; } }
+		return RuntimeErrorCodeNone;
+	}
+	// the two ranks around each quantile, all of them selected together per channel, the arguments are left as they are
+	const scalar_t * q = args[1].xyzw[0];
+	uint32_t * ranks = malloc(2 * result->length * sizeof(uint32_t));
+	scalar_t * selected = malloc(2 * result->length * sizeof(scalar_t));
+	for (int32_t i = 0; i < result->length; i++) {
+		scalar_t index = q[i] >= 0.0 && q[i] <= 1.0 ? q[i] * (args[0].length - 1) : 0.0;
+		ranks[2 * i] = floor(index);
+		ranks[2 * i + 1] = ceil(index);
+	}
 	for (int32_t d = 0; d < result->dimensions; d++) {
-		// sort list and get each element at each given quantile
-		qsort(args[0].xyzw[d], args[0].length, sizeof(scalar_t), compare);
-		result->xyzw[d] = malloc(result->length * sizeof(scalar_t));
+		RuntimeErrorCode code = SelectRanks(context, args[0].xyzw[d], args[0].length, ranks, 2 * result->length, selected);
+		if (code != RuntimeErrorCodeNone) {
+			free(ranks);
+			free(selected);
+			FreeVectorArray(*result);
+			return code;
+		}
 		for (int32_t i = 0; i < result->length; i++) {
-			if (args[1].xyzw[0][i] < 0.0 || args[1].xyzw[0][i] > 1.0) { result->xyzw[d][i] = NAN; continue; }
-			scalar_t index = args[1].xyzw[0][i] * (args[0].length - 1);
-			int32_t a = floorf(index), b = ceilf(index);
-			result->xyzw[d][i] = args[0].xyzw[d][a] * (1.0 - (index - a)) + args[0].xyzw[d][b] * (index - a);
+			if (!(q[i] >= 0.0 && q[i] <= 1.0)) { result->xyzw[d][i] = NAN; continue; }
+			scalar_t t = q[i] * (args[0].length - 1) - ranks[2 * i];
+			result->xyzw[d][i] = selected[2 * i] * (1.0 - t) + selected[2 * i + 1] * t;
 		}
 	}
+	free(ranks);
+	free(selected);
 	return RuntimeErrorCodeNone;
 }
 
-static RuntimeErrorCode _rand(List(VectorArray) args, VectorArray * result) {
-	return RuntimeErrorCodeNotImplemented;
+static RuntimeErrorCode _round(VectorArray * result) {
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = round(result->xyzw[d][i]); } }
+	return RuntimeErrorCodeNone;
 }
 
-static RuntimeErrorCode _round(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = roundf(result->xyzw[d][i]); } }
+static RuntimeErrorCode _sign(VectorArray * result) {
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = (result->xyzw[d][i] > 0) - (result->xyzw[d][i] < 0); } }
 	return RuntimeErrorCodeNone;
 }
 
-static RuntimeErrorCode _shuffle(List(VectorArray) args, VectorArray * result) {
-	return RuntimeErrorCodeNotImplemented;
+// sort and argsort share a stable permutation from an LSD radix sort over the bits of the keys, long arrays are sorted
+// in runs on all the threads which are then merged pairwise, each merge split between the threads as well
+#define SORT_INSERTION_LENGTH 32
+#define SORT_PARALLEL_LENGTH 32768
+#define SORT_RUNS_PER_THREAD 2
+#define SORT_CHECKPOINT_LENGTH 65536 // keys counted between checks of the evaluation
+
+#if defined(VISIONSCRIPT_DOUBLE)
+typedef uint64_t SortKey;
+#else
+typedef uint32_t SortKey;
+#endif
+
+static inline SortKey SortKeyOf(scalar_t x) {
+	// flipping the sign bit of positives and every bit of negatives makes the unsigned order the numeric order,
+	// -0 is folded into 0 and every NaN into one key above infinity
+	const SortKey sign = (SortKey)1 << (8 * sizeof(SortKey) - 1);
+	if (x != x) { return ~(SortKey)0; }
+	if (x == 0.0) { return sign; }
+	SortKey bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return bits & sign ? ~bits : bits | sign;
+}
+
+static void RadixSortRun(const EvaluationContext * context, SortKey * keys, uint32_t * indices, SortKey * keysTemp, uint32_t * indicesTemp, uint32_t n) {
+	// sorts n keys with their indices in place, the temporaries are used for the passes in between, stopping between
+	// passes when the evaluation is cancelled or out of time
+	if (n < SORT_INSERTION_LENGTH) {
+		for (uint32_t i = 1; i < n; i++) {
+			SortKey k = keys[i];
+			uint32_t index = indices[i], j = i;
+			for (; j > 0 && keys[j - 1] > k; j--) {
+				keys[j] = keys[j - 1];
+				indices[j] = indices[j - 1];
+			}
+			keys[j] = k;
+			indices[j] = index;
+		}
+		return;
+	}
+	// every digit's histogram in one pass, digits all the keys share are skipped
+	uint32_t counts[sizeof(SortKey)][256] = { 0 };
+	for (uint32_t a = 0; a < n; a += SORT_CHECKPOINT_LENGTH) {
+		if (EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) { return; }
+		for (uint32_t i = a, e = n - a < SORT_CHECKPOINT_LENGTH ? n : a + SORT_CHECKPOINT_LENGTH; i < e; i++) {
+			for (int32_t p = 0; p < sizeof(SortKey); p++) { counts[p][(keys[i] >> (8 * p)) & 255]++; }
+		}
+	}
+	SortKey * source = keys, * destination = keysTemp;
+	uint32_t * sourceIndices = indices, * destinationIndices = indicesTemp;
+	for (int32_t p = 0; p < sizeof(SortKey); p++) {
+		int32_t shift = 8 * p;
+		if (counts[p][(keys[0] >> shift) & 255] == n) { continue; }
+		if (EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) { return; }
+		uint32_t offsets[256];
+		for (uint32_t d = 0, total = 0; d < 256; d++) {
+			offsets[d] = total;
+			total += counts[p][d];
+		}
+		for (uint32_t i = 0; i < n; i++) {
+			uint32_t o = offsets[(source[i] >> shift) & 255]++;
+			destination[o] = source[i];
+			destinationIndices[o] = sourceIndices[i];
+		}
+		SortKey * k = source;
+		source = destination;
+		destination = k;
+		uint32_t * d = sourceIndices;
+		sourceIndices = destinationIndices;
+		destinationIndices = d;
+	}
+	if (source != keys) {
+		memcpy(keys, source, n * sizeof(SortKey));
+		memcpy(indices, sourceIndices, n * sizeof(uint32_t));
+	}
 }
 
-static RuntimeErrorCode _sign(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = (result->xyzw[d][i] > 0) - (result->xyzw[d][i] < 0); } }
+typedef struct SortJob {
+	const EvaluationContext * context;
+	SortKey * keys[2];
+	uint32_t * indices[2];
+	uint32_t length;
+	uint32_t runs;
+	uint32_t width;  // runs already merged into each block
+	uint32_t pieces; // tasks each merge of two blocks is split into
+	int32_t source;  // the buffer holding the sorted blocks
+} SortJob;
+
+static inline uint32_t SortRunStart(SortJob * job, uint32_t run) {
+	return run >= job->runs ? job->length : (uint64_t)job->length * run / job->runs;
+}
+
+static void SortRuns(void * data, uint32_t start, uint32_t end) {
+	SortJob * job = data;
+	for (uint32_t r = start; r < end; r++) {
+		uint32_t a = SortRunStart(job, r), n = SortRunStart(job, r + 1) - a;
+		RadixSortRun(job->context, job->keys[0] + a, job->indices[0] + a, job->keys[1] + a, job->indices[1] + a, n);
+	}
+}
+
+static uint32_t MergeSplit(const SortKey * a, uint32_t aLength, const SortKey * b, uint32_t bLength, uint32_t k) {
+	// how many of the first k merged elements come from a, ties go to a first so the merge stays stable
+	uint32_t lo = k > bLength ? k - bLength : 0, hi = k < aLength ? k : aLength;
+	while (lo < hi) {
+		uint32_t i = lo + (hi - lo) / 2;
+		if (a[i] <= b[k - i - 1]) { lo = i + 1; }
+		else { hi = i; }
+	}
+	return lo;
+}
+
+static void MergeRuns(void * data, uint32_t start, uint32_t end) {
+	// each task merges one piece of a pair of blocks, the piece's inputs are found by splitting at both of its ends
+	SortJob * job = data;
+	const SortKey * keys = job->keys[job->source];
+	const uint32_t * indices = job->indices[job->source];
+	SortKey * keysOut = job->keys[!job->source];
+	uint32_t * indicesOut = job->indices[!job->source];
+	for (uint32_t t = start; t < end && EvaluationContextCheckpoint(job->context) == RuntimeErrorCodeNone; t++) {
+		uint32_t pair = t / job->pieces, piece = t % job->pieces;
+		uint32_t a = SortRunStart(job, 2 * pair * job->width), b = SortRunStart(job, (2 * pair + 1) * job->width), e = SortRunStart(job, (2 * pair + 2) * job->width);
+		uint32_t aLength = b - a, bLength = e - b, total = aLength + bLength;
+		uint32_t k0 = (uint64_t)total * piece / job->pieces, k1 = (uint64_t)total * (piece + 1) / job->pieces;
+		uint32_t i = MergeSplit(keys + a, aLength, keys + b, bLength, k0), iEnd = MergeSplit(keys + a, aLength, keys + b, bLength, k1);
+		uint32_t j = k0 - i, jEnd = k1 - iEnd;
+		for (uint32_t o = a + k0; o < a + k1; o++) {
+			bool left = j >= jEnd || (i < iEnd && keys[a + i] <= keys[b + j]);
+			uint32_t from = left ? a + i++ : b + j++;
+			keysOut[o] = keys[from];
+			indicesOut[o] = indices[from];
+		}
+	}
+}
+
+static SortJob CreateSortJob(const EvaluationContext * context, uint32_t length) {
+	// the keys are filled in by the caller
+	SortJob job = { .context = context, .length = length, .runs = 1 };
+	for (int32_t b = 0; b < 2; b++) {
+		job.keys[b] = AllocateElements(length, sizeof(SortKey));
+		job.indices[b] = AllocateElements(length, sizeof(uint32_t));
+	}
+	for (uint32_t i = 0; i < length; i++) { job.indices[0][i] = i; }
+	return job;
+}
+
+static RuntimeErrorCode SortJobPermutation(SortJob job, uint32_t ** permutation) {
+	// the order that sorts the keys ascending, equal keys keep their order, nothing when the sort was stopped
+	uint32_t length = job.length, threads = GetPlannerCalibration().threads;
+	if (length >= SORT_PARALLEL_LENGTH && PlanExecution(EstimateBuiltinCost(BuiltinFunctionSORT, false), 1, length) == ExecutionStrategyParallel) {
+		job.runs = threads * SORT_RUNS_PER_THREAD;
+	}
+	ParallelTasks(job.runs, SortRuns, &job);
+	RuntimeErrorCode code = EvaluationContextCheckpoint(job.context);
+	for (job.width = 1; job.width < job.runs && code == RuntimeErrorCodeNone; job.width *= 2) {
+		uint32_t pairs = (job.runs + 2 * job.width - 1) / (2 * job.width);
+		job.pieces = pairs >= 2 * threads ? 1 : 2 * threads / pairs;
+		ParallelTasks(pairs * job.pieces, MergeRuns, &job);
+		job.source = !job.source;
+		code = EvaluationContextCheckpoint(job.context);
+	}
+	free(job.keys[0]);
+	free(job.keys[1]);
+	free(job.indices[!job.source]);
+	if (code != RuntimeErrorCodeNone) {
+		free(job.indices[job.source]);
+		return code;
+	}
+	*permutation = job.indices[job.source];
 	return RuntimeErrorCodeNone;
 }
 
-static RuntimeErrorCode _sort(List(VectorArray) args, VectorArray * result) {
-	// if one argument is passed then sort in ascending order
-	if (ListLength(args) == 1) {
-		result->length = args[0].length;
-		result->dimensions = 1;
-		for (int32_t d = 0; d < result->dimensions; d++) {
-			result->xyzw[d] = malloc(result->length * sizeof(scalar_t));
-			memcpy(result->xyzw[d], args[0].xyzw[d], result->length * sizeof(scalar_t));
-			qsort(result->xyzw[d], result->length, sizeof(scalar_t), compare);
+static RuntimeErrorCode SortPermutation(const EvaluationContext * context, const scalar_t * values, uint32_t length, uint32_t ** permutation) {
+	// the order that sorts values ascending with NaN last, equal values keep their order
+	SortJob job = CreateSortJob(context, length);
+	for (uint32_t i = 0; i < length; i++) { job.keys[0][i] = SortKeyOf(values[i]); }
+	return SortJobPermutation(job, permutation);
+}
+
+static RuntimeErrorCode _argsort(EvaluationContext * context, VectorArray * result) {
+	// the indices that sort the first channel, as integers so they index exactly at any length
+	uint32_t * permutation;
+	RuntimeErrorCode code = SortPermutation(context, result->xyzw[0], result->length, &permutation);
+	if (code != RuntimeErrorCodeNone) { return code; }
+	VectorArray indices = CreateTypedVectorArray(ElementTypeInt32, 1, result->length);
+	memcpy(VECTOR_ARRAY_INT32(indices, 0), permutation, result->length * sizeof(int32_t));
+	free(permutation);
+	FreeVectorArray(*result);
+	*result = indices;
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _sort(EvaluationContext * context, List(VectorArray) args, VectorArray * result) {
+	// one argument sorts its first channel, a second one is the key every channel of the first is ordered by
+	if (ListLength(args) != 1 && ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	if (ListLength(args) == 2 && args[1].dimensions > 1) { return RuntimeErrorCodeInvalidArgumentType; }
+	VectorArray keys = args[ListLength(args) - 1];
+	uint32_t length = args[0].length < keys.length ? args[0].length : keys.length;
+	uint32_t * permutation;
+	RuntimeErrorCode code = SortPermutation(context, keys.xyzw[0], length, &permutation);
+	if (code != RuntimeErrorCodeNone) { return code; }
+	*result = CreateVectorArray(ListLength(args) == 1 ? 1 : args[0].dimensions, length);
+	for (int32_t d = 0; d < result->dimensions; d++) {
+		for (uint32_t i = 0; i < length; i++) { result->xyzw[d][i] = args[0].xyzw[d][permutation[i]]; }
+	}
+	free(permutation);
+	return RuntimeErrorCodeNone;
+}
+
+// rand, randn, randdisk and shuffle use a counter based generator, Philox4x32-10 (Salmon et al. 2011), every element's
+// bits are a function of the key and the element's index alone, so they come out the same on any number of threads
+#define PHILOX_ROUNDS 10
+#define RANDOM_BLOCK 256
+
+typedef enum RandomDistribution {
+	RandomDistributionUniform, // in [0, 1)
+	RandomDistributionNormal,  // mean 0 and deviation 1
+	RandomDistributionDisk,    // points spread evenly over the unit disk
+} RandomDistribution;
+
+typedef struct RandomKey {
+	uint32_t seed[2];
+	uint32_t domain; // 0 for an explicit seed, one more than the index of the call at its call site otherwise
+} RandomKey;
+
+static void RandomBits(RandomKey key, uint32_t start, uint32_t end, uint64_t * bits) {
+	// 64 bits for each element in [start, end), two elements to a counter, element i lands at bits[i - start rounded
+	// down to even], the rounds are a fixed sequence of multiplies and xors so the loop over counters vectorizes
+	for (uint32_t c = start / 2; c < (end + 1) / 2; c++) {
+		uint32_t x0 = c, x1 = 0, x2 = 0, x3 = key.domain, k0 = key.seed[0], k1 = key.seed[1];
+		for (int32_t r = 0; r < PHILOX_ROUNDS; r++) {
+			uint64_t p0 = (uint64_t)0xD2511F53 * x0, p1 = (uint64_t)0xCD9E8D57 * x2;
+			x0 = (uint32_t)(p1 >> 32) ^ x1 ^ k0;
+			x1 = (uint32_t)p1;
+			x2 = (uint32_t)(p0 >> 32) ^ x3 ^ k1;
+			x3 = (uint32_t)p0;
+			k0 += 0x9E3779B9;
+			k1 += 0xBB67AE85;
 		}
-		return RuntimeErrorCodeNone;
+		uint64_t * pair = bits + 2 * (c - start / 2);
+		pair[0] = (uint64_t)x0 << 32 | x1;
+		pair[1] = (uint64_t)x2 << 32 | x3;
 	}
-	// if two arguments are passed then sort relative the second list
-	if (ListLength(args) == 2) {
-		if (args[1].dimensions > 1) { return RuntimeErrorCodeInvalidArgumentType; }
-		result->length = args[0].length < args[1].length ? args[0].length : args[1].length;
-		result->dimensions = args[0].dimensions;
-		// each index of the first list is coupled with the corresponding element of the second list
-		struct { int32_t i; scalar_t s; } * coupled = malloc(result->length * (sizeof(int32_t) + sizeof(scalar_t)));
-		for (int32_t i = 0; i < result->length; i++) { coupled[i].i = i; coupled[i].s = args[1].xyzw[0][i]; }
-		qsort(coupled, result->length, sizeof(int32_t) + sizeof(scalar_t), coupled_compare);
-		
-		// rearrange the first list to be in the order of how the second list was sorted
-		for (int32_t d = 0; d < result->dimensions; d++) {
-			result->xyzw[d] = malloc(result->length * sizeof(scalar_t));
-			for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = args[0].xyzw[d][coupled[i].i]; }
+}
+
+// a uniform in [0, 1) from the top bits of an element's 64, and one from each half for the distributions that take two
+#if defined(VISIONSCRIPT_DOUBLE)
+#define RANDOM_UNIFORM(bits) ((scalar_t)((bits) >> 11) * 0x1p-53)
+#define RANDOM_HALF_UNIFORM(word) ((scalar_t)(uint32_t)(word) * 0x1p-32)
+#else
+#define RANDOM_UNIFORM(bits) ((scalar_t)((bits) >> 40) * 0x1p-24f)
+#define RANDOM_HALF_UNIFORM(word) ((scalar_t)((uint32_t)(word) >> 8) * 0x1p-24f)
+#endif
+
+typedef struct RandomJob {
+	RandomKey key;
+	RandomDistribution distribution;
+	bool fast;
+	scalar_t * x;
+	scalar_t * y;
+} RandomJob;
+
+static void RunRandomJob(void * data, uint32_t start, uint32_t end) {
+	// bits for a block at a time, then a branch free transform of the block into the distribution
+	RandomJob * job = data;
+	uint64_t bits[RANDOM_BLOCK + 2];
+	for (uint32_t a = start; a < end; a += RANDOM_BLOCK) {
+		uint32_t n = end - a < RANDOM_BLOCK ? end - a : RANDOM_BLOCK;
+		RandomBits(job->key, a, a + n, bits);
+		const uint64_t * row = bits + (a & 1);
+		scalar_t * restrict x = job->x + a;
+		if (job->distribution == RandomDistributionUniform) {
+			for (uint32_t i = 0; i < n; i++) { x[i] = RANDOM_UNIFORM(row[i]); }
+			continue;
+		}
+		// Box-Muller for the normal, taking the radius from 1 - u keeps the logarithm finite, and a square rooted radius
+		// for the disk so the points are even over its area
+		scalar_t * restrict y = job->y == NULL ? NULL : job->y + a;
+		bool normal = job->distribution == RandomDistributionNormal;
+		if (job->fast) {
+			for (uint32_t i = 0; i < n; i++) {
+				float u = 1.0 - RANDOM_HALF_UNIFORM(row[i] >> 32), v = RANDOM_HALF_UNIFORM(row[i]), s, c;
+				float r = normal ? sqrtf(-2.0f * (float)M_LN2 * fast_log2(u)) : sqrtf(u);
+				fast_sincos(2.0f * (float)M_PI * v, &s, &c);
+				x[i] = r * c;
+				if (!normal) { y[i] = r * s; }
+			}
+		} else {
+			for (uint32_t i = 0; i < n; i++) {
+				scalar_t u = 1.0 - RANDOM_HALF_UNIFORM(row[i] >> 32), v = RANDOM_HALF_UNIFORM(row[i]);
+				scalar_t r = normal ? sqrt(-2.0 * log(u)) : sqrt(u);
+				x[i] = r * cos(2.0 * M_PI * v);
+				if (!normal) { y[i] = r * sin(2.0 * M_PI * v); }
+			}
 		}
+	}
+}
+
+static RuntimeErrorCode RandomKeyOf(EvaluationContext * context, List(VectorArray) args, int32_t index, bool repeat, RandomKey * key) {
+	// an explicit seed picks the sequence, without one a call is seeded by where it's written and how many calls were
+	// made from there earlier in the evaluation, so a script draws the same numbers every time it's evaluated and
+	// points don't jump around between frames while a comprehension or a function called twice draws new ones,
+	// repeat gives the key of the last call again
+	if (ListLength(args) <= index) {
+		*key = (RandomKey){ { (uint32_t)context->callSite, (uint32_t)(context->callSite >> 32) }, 1 + EvaluationContextCallIndex(context, repeat) };
 		return RuntimeErrorCodeNone;
 	}
-	return RuntimeErrorCodeIncorrectArgumentCount;
+	if (args[index].dimensions != 1 || args[index].length != 1 || !(fabs(args[index].xyzw[0][0]) < 0x1p63)) { return RuntimeErrorCodeInvalidArgumentType; }
+	uint64_t seed = (int64_t)args[index].xyzw[0][0];
+	*key = (RandomKey){ { (uint32_t)seed, (uint32_t)(seed >> 32) }, 0 };
+	return RuntimeErrorCodeNone;
 }
 
-static RuntimeErrorCode _sqrt(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = sqrtf(result->xyzw[d][i]); } }
+static RuntimeErrorCode _rand(EvaluationContext * context, RandomDistribution distribution, List(VectorArray) args, VectorArray * result) {
+	// rand(n) and rand(n, seed), and the same for randn and randdisk
+	if (ListLength(args) != 1 && ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	if (args[0].dimensions != 1 || args[0].length != 1 || !(args[0].xyzw[0][0] >= 0.0)) { return RuntimeErrorCodeInvalidArgumentType; }
+	RandomJob job = { .distribution = distribution, .fast = context->profile == EvaluationProfileFast };
+	RuntimeErrorCode code = RandomKeyOf(context, args, 1, false, &job.key);
+	if (code != RuntimeErrorCodeNone) { return code; }
+	uint32_t dimensions = distribution == RandomDistributionDisk ? 2 : 1;
+	code = EvaluationContextReserve(context, dimensions, floor(args[0].xyzw[0][0]));
+	if (code != RuntimeErrorCodeNone) { return code; }
+
+	*result = CreateVectorArray(dimensions, args[0].xyzw[0][0]);
+	job.x = result->xyzw[0];
+	job.y = dimensions == 2 ? result->xyzw[1] : NULL;
+	BuiltinFunction function = distribution == RandomDistributionUniform ? BuiltinFunctionRAND : distribution == RandomDistributionNormal ? BuiltinFunctionRANDN : BuiltinFunctionRANDDISK;
+	if (PlanExecution(EstimateBuiltinCost(function, job.fast), dimensions, result->length) == ExecutionStrategyParallel) { ParallelFor(result->length, RunRandomJob, &job); }
+	else { RunRandomJob(&job, 0, result->length); }
 	return RuntimeErrorCodeNone;
 }
 
-static RuntimeErrorCode _stdev(VectorArray * result) {
+static RuntimeErrorCode ShufflePermutation(const EvaluationContext * context, RandomKey key, uint32_t length, uint32_t ** permutation) {
+	// sorting the indices by random keys, the radix sort keeps it linear and spreads it over the threads, unlike a
+	// Fisher-Yates pass, and the order is the same for a key however many threads sort it
+	SortJob job = CreateSortJob(context, length);
+	uint64_t bits[RANDOM_BLOCK + 2];
+	for (uint32_t a = 0; a < length; a += RANDOM_BLOCK) {
+		uint32_t n = length - a < RANDOM_BLOCK ? length - a : RANDOM_BLOCK;
+		RandomBits(key, a, a + n, bits);
+		for (uint32_t i = 0; i < n; i++) { job.keys[0][a + i] = bits[i] >> (64 - 8 * sizeof(SortKey)); }
+	}
+	return SortJobPermutation(job, permutation);
+}
+
+static RuntimeErrorCode _shuffle(EvaluationContext * context, List(VectorArray) args, VectorArray * result) {
+	// shuffle(x) and shuffle(x, seed), every channel of an element moves together
+	if (ListLength(args) != 1 && ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	RandomKey key;
+	RuntimeErrorCode code = RandomKeyOf(context, args, 1, false, &key);
+	if (code != RuntimeErrorCodeNone) { return code; }
+	uint32_t * permutation;
+	code = ShufflePermutation(context, key, args[0].length, &permutation);
+	if (code != RuntimeErrorCodeNone) { return code; }
+	*result = CreateVectorArray(args[0].dimensions, args[0].length);
+	result->kind = args[0].kind == NumberKindComplex ? NumberKindComplex : NumberKindReal;
 	for (int32_t d = 0; d < result->dimensions; d++) {
-		// calculate the mean
-		scalar_t avg = 0.0;
-		for (int32_t i = 0; i < result->length; i++) { avg += result->xyzw[d][i]; }
-		avg /= result->length;
-		
-		// sum the deviations
-		scalar_t sum = 0.0;
-		for (int32_t i = 0; i < result->length; i++) { sum += (result->xyzw[d][i] - avg) * (result->xyzw[d][i] - avg); }
-		free(result->xyzw[d]);
-		result->xyzw[d] = malloc(sizeof(scalar_t));
-		result->xyzw[d][0] = sqrtf(sum / result->length);
+		for (uint32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = args[0].xyzw[d][permutation[i]]; }
 	}
-	result->length = 1;
+	free(permutation);
 	return RuntimeErrorCodeNone;
 }
 
-static RuntimeErrorCode _sum(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) {
-		scalar_t sum = 0.0;
-		for (int32_t i = 0; i < result->length; i++) { sum += result->xyzw[d][i]; }
-		free(result->xyzw[d]);
-		result->xyzw[d] = malloc(sizeof(scalar_t));
-		result->xyzw[d][0] = sum;
+// group reductions first count into small hash tables, one for each of a fixed number of slices of the samples, which
+// are added together in slice order, when there are too many keys for the tables the keys are sorted instead and the
+// runs of equal keys reduced, the sorted order split into fixed blocks that are reduced on their own and a group that
+// starts in an earlier block gets the block's leading part added afterwards in block order, either way the sums are
+// the same however many threads took part
+#define GROUP_HASH_BITS 12
+#define GROUP_HASH_SLOTS (1 << GROUP_HASH_BITS)
+#define GROUP_HASH_KEYS (GROUP_HASH_SLOTS / 4)
+#define GROUP_SLICES 64
+#define GROUP_SLICE_LENGTH 65536
+#define GROUP_BLOCK 4096
+
+typedef struct GroupTable {
+	scalar_t keys[GROUP_HASH_SLOTS];
+	uint32_t counts[GROUP_HASH_SLOTS]; // 0 for an empty slot
+	double sums[GROUP_HASH_SLOTS][4];
+	uint32_t used;
+	bool full;
+} GroupTable;
+
+typedef struct GroupJob {
+	const EvaluationContext * context;
+	const scalar_t * keys;
+	VectorArray values;     // no dimensions for groupcount
+	uint32_t length;
+	GroupTable * tables;    // a table for each slice
+	uint32_t slices;
+	const uint32_t * order; // sorted by key, NaN keys are left off the end
+	scalar_t * sorted;      // the keys in that order
+	uint32_t * firsts;      // groups starting in each block, then the index of the first one
+	uint32_t * starts;      // where each group starts in the sorted order, and the length after the last
+	double * sums;          // a run of dimensions for each group
+	double * heads;         // and for each block, what it adds to a group started before it
+} GroupJob;
+
+static inline uint32_t GroupSlot(GroupTable * table, scalar_t key) {
+	// the sort key folds -0 into 0 like the comparison does, a full table gives GROUP_HASH_SLOTS for a new key
+	uint32_t slot = (uint64_t)SortKeyOf(key) * 0x9E3779B97F4A7C15ull >> (64 - GROUP_HASH_BITS);
+	while (table->counts[slot] != 0 && table->keys[slot] != key) { slot = (slot + 1) & (GROUP_HASH_SLOTS - 1); }
+	if (table->counts[slot] == 0) {
+		if (table->used == GROUP_HASH_KEYS) { return GROUP_HASH_SLOTS; }
+		table->keys[slot] = key;
+		table->used++;
 	}
-	result->length = 1;
+	return slot;
+}
+
+static void HashGroups(void * data, uint32_t start, uint32_t end) {
+	GroupJob * job = data;
+	int32_t dimensions = job->values.dimensions;
+	for (uint32_t s = start; s < end && EvaluationContextCheckpoint(job->context) == RuntimeErrorCodeNone; s++) {
+		GroupTable * table = &job->tables[s];
+		uint32_t first = (uint64_t)job->length * s / job->slices, last = (uint64_t)job->length * (s + 1) / job->slices;
+		for (uint32_t i = first; i < last; i++) {
+			if (job->keys[i] != job->keys[i]) { continue; }
+			uint32_t slot = GroupSlot(table, job->keys[i]);
+			if (slot == GROUP_HASH_SLOTS) {
+				table->full = true;
+				break;
+			}
+			table->counts[slot]++;
+			for (int32_t d = 0; d < dimensions; d++) { table->sums[slot][d] += job->values.xyzw[d][i]; }
+		}
+	}
+}
+
+static bool GroupByHash(GroupJob * job, bool parallel, GroupTable * merged) {
+	// false when a slice or all of them together have too many keys
+	job->slices = (job->length + GROUP_SLICE_LENGTH - 1) / GROUP_SLICE_LENGTH < GROUP_SLICES ? (job->length + GROUP_SLICE_LENGTH - 1) / GROUP_SLICE_LENGTH : GROUP_SLICES;
+	job->tables = calloc(job->slices, sizeof(GroupTable));
+	if (parallel) { ParallelTasks(job->slices, HashGroups, job); }
+	else { HashGroups(job, 0, job->slices); }
+	bool full = false;
+	for (uint32_t s = 0; s < job->slices && !full; s++) {
+		GroupTable * table = &job->tables[s];
+		full = table->full;
+		for (uint32_t slot = 0; slot < GROUP_HASH_SLOTS && !full; slot++) {
+			if (table->counts[slot] == 0) { continue; }
+			uint32_t into = GroupSlot(merged, table->keys[slot]);
+			if (into == GROUP_HASH_SLOTS) {
+				full = true;
+				break;
+			}
+			merged->counts[into] += table->counts[slot];
+			for (int32_t d = 0; d < job->values.dimensions; d++) { merged->sums[into][d] += table->sums[slot][d]; }
+		}
+	}
+	free(job->tables);
+	return !full;
+}
+
+static void CountGroups(void * data, uint32_t start, uint32_t end) {
+	// gathers the block's keys so the later passes read them in order, the key before the block is read through the
+	// order since its block may not be gathered yet
+	GroupJob * job = data;
+	for (uint32_t k = start; k < end && EvaluationContextCheckpoint(job->context) == RuntimeErrorCodeNone; k++) {
+		uint32_t first = k * GROUP_BLOCK, last = job->length - first < GROUP_BLOCK ? job->length : first + GROUP_BLOCK;
+		for (uint32_t i = first; i < last; i++) { job->sorted[i] = job->keys[job->order[i]]; }
+		uint32_t count = first == 0 || job->sorted[first] != job->keys[job->order[first - 1]];
+		for (uint32_t i = first + 1; i < last; i++) { count += job->sorted[i] != job->sorted[i - 1]; }
+		job->firsts[k] = count;
+	}
+}
+
+static void ReduceGroups(void * data, uint32_t start, uint32_t end) {
+	// -0 and 0 are equal and sort together
+	GroupJob * job = data;
+	int32_t dimensions = job->values.dimensions;
+	for (uint32_t k = start; k < end && EvaluationContextCheckpoint(job->context) == RuntimeErrorCodeNone; k++) {
+		uint32_t first = k * GROUP_BLOCK, last = job->length - first < GROUP_BLOCK ? job->length : first + GROUP_BLOCK;
+		// g is the next group to start, the sums go to the block's head until one does
+		uint32_t g = job->firsts[k];
+		double sums[4] = { 0.0 }, * into = job->heads + (size_t)k * dimensions;
+		for (uint32_t i = first; i < last; i++) {
+			if (i == 0 || job->sorted[i] != job->sorted[i - 1]) {
+				for (int32_t d = 0; d < dimensions; d++) { into[d] = sums[d]; sums[d] = 0.0; }
+				job->starts[g] = i;
+				into = job->sums + (size_t)g * dimensions;
+				g++;
+			}
+			for (int32_t d = 0; d < dimensions; d++) { sums[d] += job->values.xyzw[d][job->order[i]]; }
+		}
+		for (int32_t d = 0; d < dimensions; d++) { into[d] = sums[d]; }
+	}
+}
+
+static RuntimeErrorCode GroupBySort(GroupJob * job, bool parallel, uint32_t * groupCount) {
+	// finds the number of groups, the keys of each group start at job->sorted[job->starts[g]], nothing is left
+	// allocated when the evaluation stops part way
+	uint32_t * order;
+	RuntimeErrorCode code = SortPermutation(job->context, job->keys, job->length, &order);
+	if (code != RuntimeErrorCodeNone) { return code; }
+	job->order = order;
+	while (job->length > 0 && job->keys[order[job->length - 1]] != job->keys[order[job->length - 1]]) { job->length--; }
+	uint32_t blocks = (job->length + GROUP_BLOCK - 1) / GROUP_BLOCK, dimensions = job->values.dimensions;
+	job->sorted = AllocateElements(job->length, sizeof(scalar_t));
+	job->firsts = malloc((blocks + 1) * sizeof(uint32_t));
+	if (parallel) { ParallelFor(blocks, CountGroups, job); }
+	else { CountGroups(job, 0, blocks); }
+	code = EvaluationContextCheckpoint(job->context);
+	if (code != RuntimeErrorCodeNone) {
+		free(order);
+		free(job->sorted);
+		free(job->firsts);
+		return code;
+	}
+	uint32_t groups = 0;
+	for (uint32_t k = 0; k < blocks; k++) {
+		uint32_t count = job->firsts[k];
+		job->firsts[k] = groups;
+		groups += count;
+	}
+
+	job->starts = malloc((groups + 1) * sizeof(uint32_t));
+	job->sums = AllocateElements(((size_t)groups + blocks) * dimensions, sizeof(double));
+	job->heads = job->sums + (size_t)groups * dimensions;
+	if (parallel) { ParallelFor(blocks, ReduceGroups, job); }
+	else { ReduceGroups(job, 0, blocks); }
+	code = EvaluationContextCheckpoint(job->context);
+	if (code != RuntimeErrorCodeNone) {
+		free(order);
+		free(job->sorted);
+		free(job->firsts);
+		free(job->starts);
+		free(job->sums);
+		return code;
+	}
+	job->starts[groups] = job->length;
+	// a block that starts inside a group adds its head to the group before the first one starting in it
+	for (uint32_t k = 1; k < blocks; k++) {
+		if (job->sorted[k * GROUP_BLOCK] != job->sorted[k * GROUP_BLOCK - 1]) { continue; }
+		for (int32_t d = 0; d < dimensions; d++) { job->sums[(size_t)(job->firsts[k] - 1) * dimensions + d] += job->heads[(size_t)k * dimensions + d]; }
+	}
+	free(order);
+	free(job->firsts);
+	*groupCount = groups;
 	return RuntimeErrorCodeNone;
 }
 
-static RuntimeErrorCode _var(VectorArray * result) {
-	for (int32_t d = 0; d < result->dimensions; d++) {
-		// calculate the mean
-		scalar_t avg = 0.0;
-		for (int32_t i = 0; i < result->length; i++) { avg += result->xyzw[d][i]; }
-		avg /= result->length;
-		
-		// sum the variances
-		scalar_t sum = 0.0;
-		for (int32_t i = 0; i < result->length; i++) { sum += (result->xyzw[d][i] - avg) * (result->xyzw[d][i] - avg); }
-		free(result->xyzw[d]);
-		result->xyzw[d] = malloc(sizeof(scalar_t));
-		result->xyzw[d][0] = sum / result->length;
+static RuntimeErrorCode Group(EvaluationContext * context, BuiltinFunction function, VectorArray keys, VectorArray values, VectorArray * result) {
+	// keys in ascending order with NaN keys left out, groupcount gives (key, count) and the others a value per group
+	if (keys.dimensions != 1 || IsVectorArrayComplex(keys) || IsVectorArrayMatrix(values) || values.length != keys.length) { return RuntimeErrorCodeInvalidArgumentType; }
+	GroupJob job = { .context = context, .keys = keys.xyzw[0], .values = values, .length = keys.length };
+	bool parallel = PlanExecution(EstimateBuiltinCost(function, false), values.dimensions, keys.length) == ExecutionStrategyParallel;
+	int32_t dimensions = function == BuiltinFunctionGROUPCOUNT ? 2 : values.dimensions;
+	GroupTable * merged = calloc(1, sizeof(GroupTable));
+	bool hashed = GroupByHash(&job, parallel, merged);
+	RuntimeErrorCode code = EvaluationContextCheckpoint(context);
+	if (code != RuntimeErrorCodeNone) {
+		free(merged);
+		return code;
 	}
-	result->length = 1;
+	if (hashed) {
+		// the few keys are put in order by sorting the slots
+		scalar_t * found = AllocateElements(merged->used, sizeof(scalar_t));
+		uint32_t * slots = AllocateElements(merged->used, sizeof(uint32_t)), groups = 0;
+		for (uint32_t slot = 0; slot < GROUP_HASH_SLOTS; slot++) {
+			if (merged->counts[slot] == 0) { continue; }
+			found[groups] = merged->keys[slot];
+			slots[groups++] = slot;
+		}
+		uint32_t * order;
+		code = SortPermutation(context, found, groups, &order);
+		if (code != RuntimeErrorCodeNone) {
+			free(slots);
+			free(found);
+			free(merged);
+			return code;
+		}
+		*result = CreateVectorArray(dimensions, groups);
+		for (uint32_t g = 0; g < groups; g++) {
+			uint32_t slot = slots[order[g]];
+			if (function == BuiltinFunctionGROUPCOUNT) {
+				result->xyzw[0][g] = merged->keys[slot] + 0.0;
+				result->xyzw[1][g] = merged->counts[slot];
+			} else {
+				for (int32_t d = 0; d < dimensions; d++) { result->xyzw[d][g] = function == BuiltinFunctionGROUPMEAN ? merged->sums[slot][d] / merged->counts[slot] : merged->sums[slot][d]; }
+			}
+		}
+		free(order);
+		free(slots);
+		free(found);
+	} else {
+		uint32_t groups;
+		code = GroupBySort(&job, parallel, &groups);
+		if (code != RuntimeErrorCodeNone) {
+			free(merged);
+			return code;
+		}
+		*result = CreateVectorArray(dimensions, groups);
+		for (uint32_t g = 0; g < groups; g++) {
+			uint32_t count = job.starts[g + 1] - job.starts[g];
+			if (function == BuiltinFunctionGROUPCOUNT) {
+				result->xyzw[0][g] = job.sorted[job.starts[g]] + 0.0;
+				result->xyzw[1][g] = count;
+			} else {
+				for (int32_t d = 0; d < dimensions; d++) {
+					double sum = job.sums[(size_t)g * dimensions + d];
+					result->xyzw[d][g] = function == BuiltinFunctionGROUPMEAN ? sum / count : sum;
+				}
+			}
+		}
+		free(job.sorted);
+		free(job.starts);
+		free(job.sums);
+	}
+	free(merged);
+	if (function != BuiltinFunctionGROUPCOUNT) { result->kind = values.kind == NumberKindComplex ? NumberKindComplex : NumberKindReal; }
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _groupcount(EvaluationContext * context, VectorArray * result) {
+	VectorArray keys = *result, counts;
+	RuntimeErrorCode code = Group(context, BuiltinFunctionGROUPCOUNT, keys, (VectorArray){ .length = keys.length }, &counts);
+	if (code != RuntimeErrorCodeNone) { return code; }
+	FreeVectorArray(*result);
+	*result = counts;
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _groupsum(EvaluationContext * context, BuiltinFunction function, List(VectorArray) args, VectorArray * result) {
+	// groupsum(values, keys) and groupmean(values, keys)
+	if (ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	return Group(context, function, args[1], args[0], result);
+}
+
+static RuntimeErrorCode _sqrt(VectorArray * result) {
+	for (int32_t d = 0; d < result->dimensions; d++) { for (int32_t i = 0; i < result->length; i++) { result->xyzw[d][i] = sqrt(result->xyzw[d][i]); } }
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _stdev(VectorArray * result) {
+	for (int32_t d = 0; d < result->dimensions; d++) { result->xyzw[d][0] = sqrt(Reduce(ReductionKindMoments, result->xyzw[d], NULL, result->length).aa / result->length); }
+	TruncateVectorArray(result, 1);
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _sum(VectorArray * result) {
+	for (int32_t d = 0; d < result->dimensions; d++) { result->xyzw[d][0] = Reduce(ReductionKindSum, result->xyzw[d], NULL, result->length).a; }
+	TruncateVectorArray(result, 1);
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _var(VectorArray * result) {
+	// population variance
+	for (int32_t d = 0; d < result->dimensions; d++) { result->xyzw[d][0] = Reduce(ReductionKindMoments, result->xyzw[d], NULL, result->length).aa / result->length; }
+	TruncateVectorArray(result, 1);
 	return RuntimeErrorCodeNone;
 }
 
@@ -668,8 +1904,8 @@ static RuntimeErrorCode _cross(List(VectorArray) args, VectorArray * result) {
 	
 	bool ai = args[0].length == 1 && args[1].length > 1;
 	bool bi = args[1].length == 1 && args[0].length > 1;
+	*result = CreateVectorArray(result->dimensions, result->length);
 	for (int32_t d = 0; d < result->dimensions; d++) {
-		result->xyzw[d] = malloc(result->length * sizeof(scalar_t));
 		for (int32_t i = 0; i < result->length; i++) {
 			if (d == 0) { result->xyzw[0][i] = args[0].xyzw[1][ai ? 0 : i] * args[1].xyzw[2][bi ? 0 : i] - args[0].xyzw[2][ai ? 0 : i] * args[1].xyzw[1][bi ? 0 : i]; }
 			if (d == 1) { result->xyzw[1][i] = args[0].xyzw[2][ai ? 0 : i] * args[1].xyzw[0][bi ? 0 : i] - args[0].xyzw[0][ai ? 0 : i] * args[1].xyzw[2][bi ? 0 : i]; }
@@ -690,14 +1926,14 @@ static RuntimeErrorCode _dist(List(VectorArray) args, VectorArray * result) {
 	
 	bool ai = args[0].length == 1 && args[1].length > 1;
 	bool bi = args[1].length == 1 && args[0].length > 1;
-	result->xyzw[0] = malloc(result->length * sizeof(scalar_t));
+	*result = CreateVectorArray(1, result->length);
 	for (int32_t i = 0; i < result->length; i++) {
 		result->xyzw[0][i] = 0.0;
 		for (int32_t d = 0; d < args[0].dimensions; d++) {
 			scalar_t l = args[0].xyzw[d][ai ? 0 : i] - args[1].xyzw[d][bi ? 0 : i];
 			result->xyzw[0][i] += l * l;
 		}
-		result->xyzw[0][i] = sqrtf(result->xyzw[0][i]);
+		result->xyzw[0][i] = sqrt(result->xyzw[0][i]);
 	}
 	
 	return RuntimeErrorCodeNone;
@@ -714,7 +1950,7 @@ static RuntimeErrorCode _distsq(List(VectorArray) args, VectorArray * result) {
 	
 	bool ai = args[0].length == 1 && args[1].length > 1;
 	bool bi = args[1].length == 1 && args[0].length > 1;
-	result->xyzw[0] = malloc(result->length * sizeof(scalar_t));
+	*result = CreateVectorArray(1, result->length);
 	for (int32_t i = 0; i < result->length; i++) {
 		result->xyzw[0][i] = 0.0;
 		for (int32_t d = 0; d < args[0].dimensions; d++) {
@@ -737,7 +1973,7 @@ static RuntimeErrorCode _dot(List(VectorArray) args, VectorArray * result) {
 	
 	bool ai = args[0].length == 1 && args[1].length > 1;
 	bool bi = args[1].length == 1 && args[0].length > 1;
-	result->xyzw[0] = malloc(result->length * sizeof(scalar_t));
+	*result = CreateVectorArray(1, result->length);
 	for (int32_t i = 0; i < result->length; i++) {
 		result->xyzw[0][i] = 0.0;
 		for (int32_t d = 0; d < args[0].dimensions; d++) { result->xyzw[0][i] += args[0].xyzw[d][ai ? 0 : i] * args[1].xyzw[d][bi ? 0 : i]; }
@@ -752,9 +1988,8 @@ static RuntimeErrorCode _length(VectorArray * result) {
 	for (int32_t i = 0; i < result->length; i++) {
 		result->xyzw[0][i] = result->xyzw[0][i] * result->xyzw[0][i];
 		for (int32_t d = 1; d < result->dimensions; d++) { result->xyzw[0][i] += result->xyzw[d][i] * result->xyzw[d][i]; }
-		result->xyzw[0][i] = sqrtf(result->xyzw[0][i]);
+		result->xyzw[0][i] = sqrt(result->xyzw[0][i]);
 	}
-	for (int32_t d = 1; d < result->dimensions; d++) { free(result->xyzw[d]); }
 	result->dimensions = 1;
 	return RuntimeErrorCodeNone;
 }
@@ -765,23 +2000,591 @@ static RuntimeErrorCode _lengthsq(VectorArray * result) {
 		result->xyzw[0][i] = result->xyzw[0][i] * result->xyzw[0][i];
 		for (int32_t d = 1; d < result->dimensions; d++) { result->xyzw[0][i] += result->xyzw[d][i] * result->xyzw[d][i]; }
 	}
-	for (int32_t d = 1; d < result->dimensions; d++) { free(result->xyzw[d]); }
 	result->dimensions = 1;
 	return RuntimeErrorCodeNone;
 }
 
+// nearest and within search a k-d tree over the points, built once for a variable and kept with its cache entry so
+// searching the same points again skips building it, points computed in the call get a tree just for the call
+#define SPATIAL_QUERY_BLOCK 1024 // queries between checks of the evaluation
+
+typedef struct SpatialJob {
+	const EvaluationContext * context;
+	const SpatialIndex * index;
+	VectorArray queries;
+	uint32_t k;
+	VectorArray radii;
+	VectorArray * result;
+} SpatialJob;
+
+static SpatialIndex * SpatialIndexOf(EvaluationContext * context, VectorArray points, bool * temporary) {
+	// the tree is only shared when it was built over the same published array this context read, NULL when the
+	// evaluation stopped while it was built
+	*temporary = false;
+	for (int32_t i = 0; context->points != NULL && i < ListLength(context->snapshot); i++) {
+		if (!StringEquals(context->snapshot[i].identifier, context->points)) { continue; }
+		VectorArray cached = context->snapshot[i].value;
+		if (cached.length != points.length || cached.dimensions != points.dimensions || cached.length == 0) { break; }
+		SpatialIndex * index = ReadEnvironmentIndex(context->environment, context->points);
+		if (index == NULL) {
+			index = CreateSpatialIndex(context, cached);
+			if (index == NULL) { return NULL; }
+			index->source = cached.xyzw[0];
+			index = PublishEnvironmentIndex(context->environment, context->points, index);
+		}
+		if (index->source == cached.xyzw[0]) { return index; }
+		break;
+	}
+	*temporary = true;
+	return CreateSpatialIndex(context, points);
+}
+
+static RuntimeErrorCode SpatialArguments(List(VectorArray) args) {
+	VectorArray queries = args[0], points = args[1];
+	if (queries.dimensions != points.dimensions || IsVectorArrayComplex(queries) || IsVectorArrayComplex(points)) { return RuntimeErrorCodeInvalidArgumentType; }
+	if (IsVectorArrayMatrix(queries) || IsVectorArrayMatrix(points)) { return RuntimeErrorCodeInvalidArgumentType; }
+	return RuntimeErrorCodeNone;
+}
+
+static void NearestQueries(void * data, uint32_t start, uint32_t end) {
+	// the jth nearest of query i goes to element j * queries + i
+	SpatialJob * job = data;
+	uint32_t * nearest = AllocateElements(job->k, sizeof(uint32_t));
+	int32_t * out = VECTOR_ARRAY_INT32(*job->result, 0);
+	for (uint32_t i = start; i < end; i++) {
+		if ((i - start) % SPATIAL_QUERY_BLOCK == 0 && EvaluationContextCheckpoint(job->context) != RuntimeErrorCodeNone) { break; }
+		scalar_t query[4];
+		for (int32_t d = 0; d < job->queries.dimensions; d++) { query[d] = job->queries.xyzw[d][i]; }
+		NearestPoints(job->index, query, job->k, nearest);
+		for (uint32_t j = 0; j < job->k; j++) { out[(size_t)j * job->queries.length + i] = nearest[j]; }
+	}
+	free(nearest);
+}
+
+static RuntimeErrorCode _nearest(EvaluationContext * context, List(VectorArray) args, VectorArray * result) {
+	// nearest(A, B) and nearest(A, B, k), the indices into B of the points nearest to each point of A, as integers so
+	// B[nearest(A, B)] reads them, with k the nearest of every point come first, then the second nearest and so on
+	if (ListLength(args) != 2 && ListLength(args) != 3) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	RuntimeErrorCode code = SpatialArguments(args);
+	if (code != RuntimeErrorCodeNone) { return code; }
+	uint32_t k = 1;
+	if (ListLength(args) == 3) {
+		if (args[2].dimensions != 1 || args[2].length != 1 || !(args[2].xyzw[0][0] >= 1.0 && args[2].xyzw[0][0] < 0x1p31)) { return RuntimeErrorCodeInvalidArgumentType; }
+		k = args[2].xyzw[0][0];
+	}
+	k = k < args[1].length ? k : args[1].length;
+	code = EvaluationContextReserve(context, 1, (double)args[0].length * k);
+	if (code != RuntimeErrorCodeNone) { return code; }
+
+	bool temporary;
+	SpatialIndex * index = SpatialIndexOf(context, args[1], &temporary);
+	if (index == NULL) { return EvaluationContextCheckpoint(context); }
+	// points with a NaN coordinate aren't in the tree
+	k = k < index->length ? k : index->length;
+	*result = CreateTypedVectorArray(ElementTypeInt32, 1, args[0].length * k);
+	SpatialJob job = { .context = context, .index = index, .queries = args[0], .k = k, .result = result };
+	if (PlanExecution(EstimateBuiltinCost(BuiltinFunctionNEAREST, false), args[0].dimensions, args[0].length) == ExecutionStrategyParallel) { ParallelFor(args[0].length, NearestQueries, &job); }
+	else { NearestQueries(&job, 0, args[0].length); }
+	if (temporary) { FreeSpatialIndex(index); }
+	code = EvaluationContextCheckpoint(context);
+	if (code != RuntimeErrorCodeNone) { FreeVectorArray(*result); }
+	return code;
+}
+
 static RuntimeErrorCode _normalize(VectorArray * result) {
 	// takes a single vector argument
 	if (result->dimensions == 1) { return RuntimeErrorCodeNone; } // if it's 1 dimension then return itself
 	for (int32_t i = 0; i < result->length; i++) {
 		scalar_t len = 0.0;
 		for (int32_t d = 0; d < result->dimensions; d++) { len += result->xyzw[d][i] * result->xyzw[d][i]; }
-		len = sqrtf(len);
+		len = sqrt(len);
 		for (int32_t d = 0; d < result->dimensions; d++) { result->xyzw[d][i] /= len; }
 	}
 	return RuntimeErrorCodeNone;
 }
 
+static void WithinQueries(void * data, uint32_t start, uint32_t end) {
+	SpatialJob * job = data;
+	for (uint32_t i = start; i < end; i++) {
+		if ((i - start) % SPATIAL_QUERY_BLOCK == 0 && EvaluationContextCheckpoint(job->context) != RuntimeErrorCodeNone) { break; }
+		scalar_t query[4];
+		for (int32_t d = 0; d < job->queries.dimensions; d++) { query[d] = job->queries.xyzw[d][i]; }
+		job->result->xyzw[0][i] = CountPointsWithin(job->index, query, job->radii.xyzw[0][job->radii.length == 1 ? 0 : i]);
+	}
+}
+
+static RuntimeErrorCode _within(EvaluationContext * context, List(VectorArray) args, VectorArray * result) {
+	// within(A, B, r), how many points of B are at most r from each point of A, r is a number or one for each point
+	if (ListLength(args) != 3) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	RuntimeErrorCode code = SpatialArguments(args);
+	if (code != RuntimeErrorCodeNone) { return code; }
+	VectorArray radii = args[2];
+	if (radii.dimensions != 1 || IsVectorArrayComplex(radii) || (radii.length != 1 && radii.length != args[0].length)) { return RuntimeErrorCodeInvalidArgumentType; }
+
+	bool temporary;
+	SpatialIndex * index = SpatialIndexOf(context, args[1], &temporary);
+	if (index == NULL) { return EvaluationContextCheckpoint(context); }
+	*result = CreateVectorArray(1, args[0].length);
+	SpatialJob job = { .context = context, .index = index, .queries = args[0], .radii = radii, .result = result };
+	if (PlanExecution(EstimateBuiltinCost(BuiltinFunctionWITHIN, false), args[0].dimensions, args[0].length) == ExecutionStrategyParallel) { ParallelFor(args[0].length, WithinQueries, &job); }
+	else { WithinQueries(&job, 0, args[0].length); }
+	if (temporary) { FreeSpatialIndex(index); }
+	code = EvaluationContextCheckpoint(context);
+	if (code != RuntimeErrorCodeNone) { FreeVectorArray(*result); }
+	return code;
+}
+
+// hull and delaunay give triangles as three vertices each, counter-clockwise, so a polygons equation draws them as
+// they are, every vertex is one of the points so the tangents are the points' tangents in the same order
+static uint32_t * TriangleCorners(const EvaluationContext * context, BuiltinFunction function, VectorArray points, uint32_t * count) {
+	// the index of the point at each vertex, the hull is a fan from its leftmost corner
+	if (function == BuiltinFunctionDELAUNAY) {
+		uint32_t * corners = AllocateElements(6 * points.length, sizeof(uint32_t));
+		*count = 3 * DelaunayTriangulation(context, points.xyzw[0], points.xyzw[1], points.length, corners);
+		return corners;
+	}
+	uint32_t * hull = malloc((points.length + 1) * sizeof(uint32_t));
+	uint32_t length = ConvexHull(context, points.xyzw[0], points.xyzw[1], points.length, hull);
+	*count = length >= 3 ? 3 * (length - 2) : 0;
+	uint32_t * corners = AllocateElements(*count, sizeof(uint32_t));
+	for (uint32_t i = 0; i < *count / 3; i++) {
+		corners[3 * i] = hull[0];
+		corners[3 * i + 1] = hull[i + 1];
+		corners[3 * i + 2] = hull[i + 2];
+	}
+	free(hull);
+	return corners;
+}
+
+static RuntimeErrorCode _triangles(EvaluationContext * context, BuiltinFunction function, VectorArray * result, VectorArray * tangent) {
+	// hull(P) and delaunay(P) of 2d points, points with a coordinate that isn't finite are left out, tangent is NULL
+	// when it isn't needed and otherwise has the shape of the points
+	VectorArray points = *result;
+	if (points.dimensions != 2 || IsVectorArrayComplex(points) || IsVectorArrayMatrix(points)) { return RuntimeErrorCodeInvalidArgumentType; }
+	// at most 2n - 5 triangles, a hull fan has fewer
+	RuntimeErrorCode code = EvaluationContextReserve(context, tangent == NULL ? 2 : 4, 6.0 * points.length);
+	if (code != RuntimeErrorCodeNone) { return code; }
+
+	uint32_t count;
+	uint32_t * corners = TriangleCorners(context, function, points, &count);
+	code = EvaluationContextCheckpoint(context);
+	if (code != RuntimeErrorCodeNone) {
+		free(corners);
+		return code;
+	}
+	*result = CreateVectorArray(2, count);
+	for (int32_t d = 0; d < 2; d++) {
+		for (uint32_t i = 0; i < count; i++) { result->xyzw[d][i] = points.xyzw[d][corners[i]]; }
+	}
+	if (tangent != NULL) {
+		VectorArray t = *tangent;
+		*tangent = ZeroVectorArray(2, count);
+		for (int32_t d = 0; d < 2; d++) {
+			for (uint32_t i = 0; i < count; i++) { tangent->xyzw[d][i] = t.xyzw[d][corners[i]]; }
+		}
+		FreeVectorArray(t);
+	}
+	free(corners);
+	FreeVectorArray(points);
+	return RuntimeErrorCodeNone;
+}
+
+// grids are processed in strips of this many columns so the rows a stencil reads stay in cache
+#define GRID_STRIP_COLUMNS 512
+
+static RuntimeErrorCode _blur(EvaluationContext * context, List(VectorArray) args, VectorArray * result) {
+	// box blur over a (2r + 1) square, cells outside the grid are left out of the average
+	if (ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	VectorArray a = args[0];
+	if (a.columns == 0) { return RuntimeErrorCodeInvalidGridArgument; }
+	if (args[1].dimensions != 1 || args[1].length != 1 || !(args[1].xyzw[0][0] >= 0.0)) { return RuntimeErrorCodeInvalidArgumentType; }
+	int32_t columns = a.columns, rows = a.length / a.columns, r = round(args[1].xyzw[0][0]);
+	
+	*result = CreateVectorArray(a.dimensions, a.length);
+	result->columns = columns;
+	scalar_t * rowBlurred = EvaluationContextScratch(context, a.length);
+	for (int32_t d = 0; d < a.dimensions; d++) {
+		// separable, a running sum along each row first
+		for (int32_t y = 0; y < rows; y++) {
+			const scalar_t * in = a.xyzw[d] + y * columns;
+			scalar_t * out = rowBlurred + y * columns;
+			double sum = 0.0;
+			for (int32_t x = 0; x < r && x < columns; x++) { sum += in[x]; }
+			for (int32_t x = 0; x < columns; x++) {
+				if (x + r < columns) { sum += in[x + r]; }
+				if (x - r - 1 >= 0) { sum -= in[x - r - 1]; }
+				int32_t count = (x + r < columns ? x + r : columns - 1) - (x - r > 0 ? x - r : 0) + 1;
+				out[x] = sum / count;
+			}
+		}
+		
+		// then down the columns, a strip at a time with a running sum per column
+		double sums[GRID_STRIP_COLUMNS];
+		for (int32_t x0 = 0; x0 < columns; x0 += GRID_STRIP_COLUMNS) {
+			int32_t width = columns - x0 < GRID_STRIP_COLUMNS ? columns - x0 : GRID_STRIP_COLUMNS;
+			for (int32_t x = 0; x < width; x++) { sums[x] = 0.0; }
+			for (int32_t y = 0; y < r && y < rows; y++) {
+				for (int32_t x = 0; x < width; x++) { sums[x] += rowBlurred[y * columns + x0 + x]; }
+			}
+			for (int32_t y = 0; y < rows; y++) {
+				if (y + r < rows) { for (int32_t x = 0; x < width; x++) { sums[x] += rowBlurred[(y + r) * columns + x0 + x]; } }
+				if (y - r - 1 >= 0) { for (int32_t x = 0; x < width; x++) { sums[x] -= rowBlurred[(y - r - 1) * columns + x0 + x]; } }
+				int32_t count = (y + r < rows ? y + r : rows - 1) - (y - r > 0 ? y - r : 0) + 1;
+				scalar_t * out = result->xyzw[d] + y * columns + x0;
+				for (int32_t x = 0; x < width; x++) { out[x] = sums[x] / count; }
+			}
+		}
+	}
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _grad(VectorArray * result) {
+	// central differences on a unit spaced grid, one sided along the edges
+	if (result->columns == 0) { return RuntimeErrorCodeInvalidGridArgument; }
+	if (result->dimensions != 1) { return RuntimeErrorCodeInvalidArgumentType; }
+	int32_t columns = result->columns, rows = result->length / result->columns;
+	VectorArray gradient = CreateVectorArray(2, result->length);
+	gradient.columns = columns;
+	for (int32_t y = 0; y < rows; y++) {
+		const scalar_t * f = result->xyzw[0] + y * columns;
+		scalar_t * dx = gradient.xyzw[0] + y * columns;
+		if (columns == 1) { dx[0] = 0.0; }
+		else {
+			dx[0] = f[1] - f[0];
+			for (int32_t x = 1; x < columns - 1; x++) { dx[x] = 0.5 * (f[x + 1] - f[x - 1]); }
+			dx[columns - 1] = f[columns - 1] - f[columns - 2];
+		}
+		
+		int32_t above = y + 1 < rows ? y + 1 : y, below = y > 0 ? y - 1 : y;
+		scalar_t scale = above > below ? 1.0 / (above - below) : 0.0;
+		const scalar_t * up = result->xyzw[0] + above * columns, * down = result->xyzw[0] + below * columns;
+		scalar_t * dy = gradient.xyzw[1] + y * columns;
+		for (int32_t x = 0; x < columns; x++) { dy[x] = (up[x] - down[x]) * scale; }
+	}
+	FreeVectorArray(*result);
+	*result = gradient;
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _laplacian(VectorArray * result) {
+	// five point stencil on a unit spaced grid, the edge cells are repeated past the border
+	if (result->columns == 0) { return RuntimeErrorCodeInvalidGridArgument; }
+	int32_t columns = result->columns, rows = result->length / result->columns;
+	VectorArray laplacian = CreateVectorArray(result->dimensions, result->length);
+	laplacian.columns = columns;
+	for (int32_t d = 0; d < result->dimensions; d++) {
+		for (int32_t x0 = 0; x0 < columns; x0 += GRID_STRIP_COLUMNS) {
+			int32_t x1 = columns - x0 < GRID_STRIP_COLUMNS ? columns : x0 + GRID_STRIP_COLUMNS;
+			for (int32_t y = 0; y < rows; y++) {
+				const scalar_t * f = result->xyzw[d] + y * columns;
+				const scalar_t * up = result->xyzw[d] + (y + 1 < rows ? y + 1 : y) * columns;
+				const scalar_t * down = result->xyzw[d] + (y > 0 ? y - 1 : y) * columns;
+				scalar_t * out = laplacian.xyzw[d] + y * columns;
+				for (int32_t x = x0; x < x1; x++) {
+					scalar_t left = f[x > 0 ? x - 1 : x], right = f[x + 1 < columns ? x + 1 : x];
+					out[x] = left + right + up[x] + down[x] - 4.0 * f[x];
+				}
+			}
+		}
+	}
+	FreeVectorArray(*result);
+	*result = laplacian;
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _shift(List(VectorArray) args, VectorArray * result) {
+	// shift(a, (dx, dy)) moves the grid by whole cells, cells that come from outside the grid are NaN like out of range indices
+	if (ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	VectorArray a = args[0];
+	if (a.columns == 0) { return RuntimeErrorCodeInvalidGridArgument; }
+	if (args[1].dimensions != 2 || args[1].length != 1) { return RuntimeErrorCodeInvalidArgumentType; }
+	int32_t columns = a.columns, rows = a.length / a.columns;
+	int32_t dx = round(args[1].xyzw[0][0]), dy = round(args[1].xyzw[1][0]);
+	
+	// the cells of each row that stay in the grid are copied in one go
+	int32_t start = dx > 0 ? (dx < columns ? dx : columns) : 0, end = dx < 0 ? (-dx < columns ? columns + dx : 0) : columns;
+	*result = CreateVectorArray(a.dimensions, a.length);
+	result->columns = columns;
+	for (int32_t d = 0; d < a.dimensions; d++) {
+		for (int32_t y = 0; y < rows; y++) {
+			scalar_t * out = result->xyzw[d] + y * columns;
+			int32_t from = y - dy;
+			if (from < 0 || from >= rows) {
+				for (int32_t x = 0; x < columns; x++) { out[x] = NAN; }
+				continue;
+			}
+			for (int32_t x = 0; x < start; x++) { out[x] = NAN; }
+			if (end > start) { memcpy(out + start, a.xyzw[d] + from * columns + start - dx, (end - start) * sizeof(scalar_t)); }
+			for (int32_t x = end > start ? end : start; x < columns; x++) { out[x] = NAN; }
+		}
+	}
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _convolve(EvaluationContext * context, List(VectorArray) args, VectorArray * result) {
+	// convolve(x, kernel) has the length of x with the kernel centered on each element, a one channel kernel is used
+	// for every channel of x and a kernel with as many channels as x goes channel by channel
+	if (ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	VectorArray x = args[0], kernel = args[1];
+	if (IsVectorArrayMatrix(x) || IsVectorArrayMatrix(kernel)) { return RuntimeErrorCodeInvalidArgumentType; }
+	if (kernel.dimensions != 1 && kernel.dimensions != x.dimensions) { return RuntimeErrorCodeDifferingOperonDimensions; }
+	*result = CreateVectorArray(x.dimensions, x.length);
+	if (kernel.dimensions == 1) { result->kind = x.kind; }
+	for (int32_t d = 0; d < x.dimensions; d++) { ConvolveChannel(context, x.xyzw[d], x.length, kernel.xyzw[kernel.dimensions == 1 ? 0 : d], kernel.length, result->xyzw[d]); }
+	RuntimeErrorCode code = EvaluationContextCheckpoint(context);
+	if (code != RuntimeErrorCodeNone) { FreeVectorArray(*result); }
+	return code;
+}
+
+static RuntimeErrorCode Fourier(EvaluationContext * context, VectorArray * result, bool inverse) {
+	// one channel is a real signal, two are the real and imaginary parts of a complex one, the result is complex
+	if (result->dimensions > 2 || IsVectorArrayMatrix(*result)) { return RuntimeErrorCodeInvalidArgumentType; }
+	VectorArray spectrum = CreateVectorArray(2, result->length);
+	spectrum.kind = NumberKindComplex;
+	FourierTransform(context, result->xyzw[0], result->dimensions == 2 ? result->xyzw[1] : NULL, result->length, inverse, spectrum.xyzw[0], spectrum.xyzw[1]);
+	RuntimeErrorCode code = EvaluationContextCheckpoint(context);
+	if (code != RuntimeErrorCodeNone) {
+		FreeVectorArray(spectrum);
+		return code;
+	}
+	FreeVectorArray(*result);
+	*result = spectrum;
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _fft(EvaluationContext * context, VectorArray * result) {
+	return Fourier(context, result, false);
+}
+
+static RuntimeErrorCode _ifft(EvaluationContext * context, VectorArray * result) {
+	return Fourier(context, result, true);
+}
+
+static RuntimeErrorCode _lowpass(EvaluationContext * context, List(VectorArray) args, VectorArray * result) {
+	// lowpass(x, cutoff) keeps the frequencies below cutoff, a fraction of the highest one the samples can hold, with a
+	// Blackman windowed sinc filter, near the ends it's divided by the part of the filter that lies over x like blur does
+	if (ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	VectorArray x = args[0];
+	if (IsVectorArrayMatrix(x) || args[1].dimensions != 1 || args[1].length != 1 || !(args[1].xyzw[0][0] > 0.0)) { return RuntimeErrorCodeInvalidArgumentType; }
+	double cutoff = args[1].xyzw[0][0];
+	*result = CreateVectorArray(x.dimensions, x.length);
+	result->kind = x.kind;
+	if (cutoff >= 1.0 || x.length == 0) {
+		for (int32_t d = 0; d < x.dimensions; d++) { memcpy(result->xyzw[d], x.xyzw[d], x.length * sizeof(scalar_t)); }
+		return RuntimeErrorCodeNone;
+	}
+
+	// enough taps for a transition band of about 0.7 cutoff, the filter is never more than twice as long as x
+	uint32_t half = ceil(8.0 / cutoff) < x.length ? ceil(8.0 / cutoff) : x.length, taps = 2 * half + 1;
+	scalar_t * kernel = malloc((2 * taps + 1 + x.length) * sizeof(scalar_t)), * prefix = kernel + taps, * weights = prefix + taps + 1;
+	double sum = 0.0;
+	for (uint32_t j = 0; j < taps; j++) {
+		double t = (double)j - half, window = 0.42 - 0.5 * cos(2.0 * M_PI * j / (taps - 1)) + 0.08 * cos(4.0 * M_PI * j / (taps - 1));
+		kernel[j] = (t == 0.0 ? cutoff : sin(M_PI * cutoff * t) / (M_PI * t)) * window;
+		sum += kernel[j];
+	}
+	prefix[0] = 0.0;
+	for (uint32_t j = 0; j < taps; j++) {
+		kernel[j] /= sum;
+		prefix[j + 1] = prefix[j] + kernel[j];
+	}
+	// element i sees the taps j with 0 <= i + half - j < length
+	for (uint32_t i = 0; i < x.length; i++) {
+		uint32_t first = i + half + 1 > x.length ? i + half + 1 - x.length : 0, last = i + half + 1 < taps ? i + half + 1 : taps;
+		weights[i] = prefix[last] - prefix[first];
+	}
+	for (int32_t d = 0; d < x.dimensions; d++) {
+		ConvolveChannel(context, x.xyzw[d], x.length, kernel, taps, result->xyzw[d]);
+		for (uint32_t i = 0; i < x.length; i++) { result->xyzw[d][i] /= weights[i]; }
+	}
+	free(kernel);
+	RuntimeErrorCode code = EvaluationContextCheckpoint(context);
+	if (code != RuntimeErrorCodeNone) { FreeVectorArray(*result); }
+	return code;
+}
+
+// matrices are d by d for d from 2 to 4, kept as an array of rows with the rows of every matrix grouped together,
+// row r of matrix k is element r * count + k, so [(c, -s), (s, c)] over arrays c and s is an array of rotations
+// and the kernels below run along k over contiguous channels
+
+// vectors are transformed a block at a time so the input channels stay in cache for every output channel
+#define MATRIX_BLOCK_LENGTH 1024
+
+static uint32_t MatrixCount(VectorArray value) {
+	// number of matrices an array of rows holds, 0 if it can't be split into whole square matrices
+	if (value.dimensions < 2 || value.length == 0 || value.length % value.dimensions != 0) { return 0; }
+	return value.length / value.dimensions;
+}
+
+static void LoadMatrix(VectorArray value, uint32_t count, uint32_t k, scalar_t * m) {
+	for (int32_t r = 0; r < value.dimensions; r++) {
+		for (int32_t c = 0; c < value.dimensions; c++) { m[r * value.dimensions + c] = value.xyzw[c][r * count + k]; }
+	}
+}
+
+static scalar_t InvertMatrix(int32_t d, const scalar_t * m, scalar_t * inverse) {
+	// closed form adjugate over the determinant, returns the determinant and skips the inverse when it's NULL
+	scalar_t det, adjugate[16];
+	if (d == 2) {
+		det = m[0] * m[3] - m[1] * m[2];
+		adjugate[0] = m[3]; adjugate[1] = -m[1];
+		adjugate[2] = -m[2]; adjugate[3] = m[0];
+	} else if (d == 3) {
+		adjugate[0] = m[4] * m[8] - m[5] * m[7];
+		adjugate[1] = m[2] * m[7] - m[1] * m[8];
+		adjugate[2] = m[1] * m[5] - m[2] * m[4];
+		adjugate[3] = m[5] * m[6] - m[3] * m[8];
+		adjugate[4] = m[0] * m[8] - m[2] * m[6];
+		adjugate[5] = m[2] * m[3] - m[0] * m[5];
+		adjugate[6] = m[3] * m[7] - m[4] * m[6];
+		adjugate[7] = m[1] * m[6] - m[0] * m[7];
+		adjugate[8] = m[0] * m[4] - m[1] * m[3];
+		det = m[0] * adjugate[0] + m[1] * adjugate[3] + m[2] * adjugate[6];
+	} else {
+		// expanded along the 2x2 minors of the top two rows and the bottom two rows
+		scalar_t s0 = m[0] * m[5] - m[4] * m[1], s1 = m[0] * m[6] - m[4] * m[2], s2 = m[0] * m[7] - m[4] * m[3];
+		scalar_t s3 = m[1] * m[6] - m[5] * m[2], s4 = m[1] * m[7] - m[5] * m[3], s5 = m[2] * m[7] - m[6] * m[3];
+		scalar_t c5 = m[10] * m[15] - m[14] * m[11], c4 = m[9] * m[15] - m[13] * m[11], c3 = m[9] * m[14] - m[13] * m[10];
+		scalar_t c2 = m[8] * m[15] - m[12] * m[11], c1 = m[8] * m[14] - m[12] * m[10], c0 = m[8] * m[13] - m[12] * m[9];
+		det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+		if (inverse == NULL) { return det; }
+		adjugate[0] = m[5] * c5 - m[6] * c4 + m[7] * c3;
+		adjugate[1] = -m[1] * c5 + m[2] * c4 - m[3] * c3;
+		adjugate[2] = m[13] * s5 - m[14] * s4 + m[15] * s3;
+		adjugate[3] = -m[9] * s5 + m[10] * s4 - m[11] * s3;
+		adjugate[4] = -m[4] * c5 + m[6] * c2 - m[7] * c1;
+		adjugate[5] = m[0] * c5 - m[2] * c2 + m[3] * c1;
+		adjugate[6] = -m[12] * s5 + m[14] * s2 - m[15] * s1;
+		adjugate[7] = m[8] * s5 - m[10] * s2 + m[11] * s1;
+		adjugate[8] = m[4] * c4 - m[5] * c2 + m[7] * c0;
+		adjugate[9] = -m[0] * c4 + m[1] * c2 - m[3] * c0;
+		adjugate[10] = m[12] * s4 - m[13] * s2 + m[15] * s0;
+		adjugate[11] = -m[8] * s4 + m[9] * s2 - m[11] * s0;
+		adjugate[12] = -m[4] * c3 + m[5] * c1 - m[6] * c0;
+		adjugate[13] = m[0] * c3 - m[1] * c1 + m[2] * c0;
+		adjugate[14] = -m[12] * s3 + m[13] * s1 - m[14] * s0;
+		adjugate[15] = m[8] * s3 - m[9] * s1 + m[10] * s0;
+	}
+	if (inverse != NULL) {
+		for (int32_t j = 0; j < d * d; j++) { inverse[j] = adjugate[j] / det; }
+	}
+	return det;
+}
+
+static inline void MatrixAccumulate(scalar_t * restrict out, const scalar_t * restrict a, bool aSingle, const scalar_t * restrict b, bool bSingle, uint32_t n) {
+	// out += a * b along the matrices, a side of length one is held in a register so the loops stay plain multiply adds
+	if (aSingle && bSingle) { for (uint32_t j = 0; j < n; j++) { out[j] += a[0] * b[0]; } }
+	else if (aSingle) { scalar_t s = a[0]; for (uint32_t j = 0; j < n; j++) { out[j] += s * b[j]; } }
+	else if (bSingle) { scalar_t s = b[0]; for (uint32_t j = 0; j < n; j++) { out[j] += a[j] * s; } }
+	else { for (uint32_t j = 0; j < n; j++) { out[j] += a[j] * b[j]; } }
+}
+
+static RuntimeErrorCode _det(VectorArray * result) {
+	// one determinant per matrix
+	uint32_t count = MatrixCount(*result);
+	if (count == 0) { return RuntimeErrorCodeInvalidArgumentType; }
+	VectorArray determinant = CreateVectorArray(1, count);
+	scalar_t m[16];
+	for (uint32_t k = 0; k < count; k++) {
+		LoadMatrix(*result, count, k, m);
+		determinant.xyzw[0][k] = InvertMatrix(result->dimensions, m, NULL);
+	}
+	FreeVectorArray(*result);
+	*result = determinant;
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _inverse(VectorArray * result) {
+	// singular matrices come out as infinities and NaN like a division by zero
+	uint32_t count = MatrixCount(*result), d = result->dimensions;
+	if (count == 0) { return RuntimeErrorCodeInvalidArgumentType; }
+	VectorArray inverse = CreateVectorArray(d, result->length);
+	inverse.kind = NumberKindMatrix;
+	scalar_t m[16], n[16];
+	for (uint32_t k = 0; k < count; k++) {
+		LoadMatrix(*result, count, k, m);
+		InvertMatrix(d, m, n);
+		for (int32_t r = 0; r < d; r++) {
+			for (int32_t c = 0; c < d; c++) { inverse.xyzw[c][r * count + k] = n[r * d + c]; }
+		}
+	}
+	FreeVectorArray(*result);
+	*result = inverse;
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _matrix(VectorArray * result) {
+	// marks an array of rows as matrices, which is how mul tells a matrix from a list of vectors
+	if (MatrixCount(*result) == 0) { return RuntimeErrorCodeInvalidArgumentType; }
+	result->kind = NumberKindMatrix;
+	result->columns = 0;
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _mul(List(VectorArray) args, VectorArray * result) {
+	// mul(A, B) multiplies matrices when B is one, otherwise it transforms each vector of B,
+	// a single matrix or vector on either side goes with every one on the other
+	if (ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
+	VectorArray a = args[0], b = args[1];
+	uint32_t d = a.dimensions, ca = MatrixCount(a);
+	if (ca == 0 || b.dimensions != d) { return RuntimeErrorCodeInvalidArgumentType; }
+	bool matrices = IsVectorArrayMatrix(b);
+	uint32_t cb = matrices ? b.length / d : b.length;
+	uint32_t count = ca == 1 ? cb : (cb == 1 ? ca : (ca < cb ? ca : cb));
+	
+	*result = ZeroVectorArray(d, matrices ? d * count : count);
+	if (matrices) { result->kind = NumberKindMatrix; }
+	else if (b.length == count) { result->columns = b.columns; }
+	for (uint32_t j0 = 0; j0 < count; j0 += MATRIX_BLOCK_LENGTH) {
+		uint32_t n = count - j0 < MATRIX_BLOCK_LENGTH ? count - j0 : MATRIX_BLOCK_LENGTH;
+		uint32_t oa = ca == 1 ? 0 : j0, ob = cb == 1 ? 0 : j0;
+		if (matrices) {
+			// row i of a product is the rows of B weighted by row i of A
+			for (uint32_t i = 0; i < d; i++) {
+				for (uint32_t c = 0; c < d; c++) {
+					scalar_t * out = result->xyzw[c] + i * count + j0;
+					for (uint32_t k = 0; k < d; k++) { MatrixAccumulate(out, a.xyzw[k] + i * ca + oa, ca == 1, b.xyzw[c] + k * cb + ob, cb == 1, n); }
+				}
+			}
+		} else {
+			// channel c of a transformed vector is row c of A dotted with it
+			for (uint32_t c = 0; c < d; c++) {
+				scalar_t * out = result->xyzw[c] + j0;
+				for (uint32_t k = 0; k < d; k++) { MatrixAccumulate(out, a.xyzw[k] + c * ca + oa, ca == 1, b.xyzw[k] + ob, cb == 1, n); }
+			}
+		}
+	}
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _trace(VectorArray * result) {
+	// sum of the diagonal, one value per matrix
+	uint32_t count = MatrixCount(*result);
+	if (count == 0) { return RuntimeErrorCodeInvalidArgumentType; }
+	VectorArray trace = ZeroVectorArray(1, count);
+	for (int32_t r = 0; r < result->dimensions; r++) {
+		const scalar_t * diagonal = result->xyzw[r] + r * count;
+		for (uint32_t k = 0; k < count; k++) { trace.xyzw[0][k] += diagonal[k]; }
+	}
+	FreeVectorArray(*result);
+	*result = trace;
+	return RuntimeErrorCodeNone;
+}
+
+static RuntimeErrorCode _transpose(VectorArray * result) {
+	// row r channel c of the transpose is row c channel r of the matrix, whole runs of matrices at once
+	uint32_t count = MatrixCount(*result), d = result->dimensions;
+	if (count == 0) { return RuntimeErrorCodeInvalidArgumentType; }
+	VectorArray transposed = CreateVectorArray(d, result->length);
+	transposed.kind = NumberKindMatrix;
+	for (uint32_t r = 0; r < d; r++) {
+		for (uint32_t c = 0; c < d; c++) { memcpy(transposed.xyzw[c] + r * count, result->xyzw[r] + c * count, count * sizeof(scalar_t)); }
+	}
+	FreeVectorArray(*result);
+	*result = transposed;
+	return RuntimeErrorCodeNone;
+}
+
 BuiltinFunction DetermineBuiltinFunction(const char * identifier) {
 	for (int32_t i = 0; i < sizeof(builtinFunctions) / sizeof(builtinFunctions[0]); i++) {
 		if (strcmp(identifier, builtinFunctions[i]) == 0) { return i; }
@@ -796,7 +2599,18 @@ bool IsFunctionSingleArgument(BuiltinFunction function) {
 	return true;
 }
 
-RuntimeErrorCode EvaluateBuiltinFunction(BuiltinFunction function, List(VectorArray) arguments, VectorArray * result) {
+bool IsFunctionElementwise(BuiltinFunction function) {
+	// single argument builtins that work on each element in place without changing the shape, so any slice of the
+	// channels can be evaluated on its own
+	if (function <= BuiltinFunctionACOTH) { return function != BuiltinFunctionATAN2; }
+	for (int32_t i = 0; i < sizeof(elementwiseBuiltins) / sizeof(elementwiseBuiltins[0]); i++) {
+		if (function == elementwiseBuiltins[i]) { return true; }
+	}
+	return false;
+}
+
+RuntimeErrorCode EvaluateBuiltinFunction(EvaluationContext * context, BuiltinFunction function, List(VectorArray) arguments, VectorArray * result) {
+	if (IsFunctionSingleArgument(function) && IsVectorArrayComplex(*result) && EvaluateComplexFunction(function, result, NULL)) { return RuntimeErrorCodeNone; }
 	switch (function) {
 		case BuiltinFunctionSIN: return _sin(result);
 		case BuiltinFunctionCOS: return _cos(result);
@@ -826,16 +2640,28 @@ RuntimeErrorCode EvaluateBuiltinFunction(BuiltinFunction function, List(VectorAr
 		case BuiltinFunctionABS: return _abs(result);
 		case BuiltinFunctionARGMAX: return _argmax(result);
 		case BuiltinFunctionARGMIN: return _argmin(result);
+		case BuiltinFunctionARGSORT: return _argsort(context, result);
 		case BuiltinFunctionCBRT: return _cbrt(result);
 		case BuiltinFunctionCEIL: return _ceil(result);
 		case BuiltinFunctionCORR: return _corr(arguments, result);
 		case BuiltinFunctionCOUNT: return _count(arguments, result);
 		case BuiltinFunctionCOV: return _cov(arguments, result);
+		case BuiltinFunctionCUMMAX: return _cummax(context, result);
+		case BuiltinFunctionCUMMIN: return _cummin(context, result);
+		case BuiltinFunctionCUMPROD: return _cumprod(context, result);
+		case BuiltinFunctionCUMSUM: return _cumsum(context, result);
+		case BuiltinFunctionDIFF: return _diff(result);
+		case BuiltinFunctionDIGAMMA: return _digamma(result);
 		case BuiltinFunctionERF: return _erf(result);
 		case BuiltinFunctionEXP: return _exp(result);
 		case BuiltinFunctionFACTORIAL: return _factorial(result);
 		case BuiltinFunctionFLOOR: return _floor(result);
 		case BuiltinFunctionGAMMA: return _gamma(result);
+		case BuiltinFunctionGROUPCOUNT: return _groupcount(context, result);
+		case BuiltinFunctionGROUPMEAN:
+		case BuiltinFunctionGROUPSUM: return _groupsum(context, function, arguments, result);
+		case BuiltinFunctionHIST: return _hist(context, arguments, result);
+		case BuiltinFunctionHIST2D: return _hist2d(context, arguments, result);
 		case BuiltinFunctionINTERLEAVE: return _interleave(arguments, result);
 		case BuiltinFunctionJOIN: return _join(arguments, result);
 		case BuiltinFunctionLN: return _ln(result);
@@ -844,15 +2670,17 @@ RuntimeErrorCode EvaluateBuiltinFunction(BuiltinFunction function, List(VectorAr
 		case BuiltinFunctionLOG2: return _log2(result);
 		case BuiltinFunctionMAX: return _max(arguments, result);
 		case BuiltinFunctionMEAN: return _mean(result);
-		case BuiltinFunctionMEDIAN: return _median(result);
+		case BuiltinFunctionMEDIAN: return _median(context, result);
 		case BuiltinFunctionMIN: return _min(arguments, result);
 		case BuiltinFunctionPROD: return _prod(result);
-		case BuiltinFunctionQUANTILE: return _quantile(arguments, result);
-		case BuiltinFunctionRAND: return _rand(arguments, result);
+		case BuiltinFunctionQUANTILE: return _quantile(context, arguments, result);
+		case BuiltinFunctionRAND: return _rand(context, RandomDistributionUniform, arguments, result);
+		case BuiltinFunctionRANDDISK: return _rand(context, RandomDistributionDisk, arguments, result);
+		case BuiltinFunctionRANDN: return _rand(context, RandomDistributionNormal, arguments, result);
 		case BuiltinFunctionROUND: return _round(result);
-		case BuiltinFunctionSHUFFLE: return _shuffle(arguments, result);
+		case BuiltinFunctionSHUFFLE: return _shuffle(context, arguments, result);
 		case BuiltinFunctionSIGN: return _sign(result);
-		case BuiltinFunctionSORT: return _sort(arguments, result);
+		case BuiltinFunctionSORT: return _sort(context, arguments, result);
 		case BuiltinFunctionSQRT: return _sqrt(result);
 		case BuiltinFunctionSTDEV: return _stdev(result);
 		case BuiltinFunctionSUM: return _sum(result);
@@ -863,16 +2691,694 @@ RuntimeErrorCode EvaluateBuiltinFunction(BuiltinFunction function, List(VectorAr
 		case BuiltinFunctionDOT: return _dot(arguments, result);
 		case BuiltinFunctionLENGTH: return _length(result);
 		case BuiltinFunctionLENGTHSQ: return _lengthsq(result);
+		case BuiltinFunctionNEAREST: return _nearest(context, arguments, result);
 		case BuiltinFunctionNORMALIZE: return _normalize(result);
+		case BuiltinFunctionWITHIN: return _within(context, arguments, result);
+		case BuiltinFunctionDELAUNAY:
+		case BuiltinFunctionHULL: return _triangles(context, function, result, NULL);
+		case BuiltinFunctionBLUR: return _blur(context, arguments, result);
+		case BuiltinFunctionGRAD: return _grad(result);
+		case BuiltinFunctionLAPLACIAN: return _laplacian(result);
+		case BuiltinFunctionSHIFT: return _shift(arguments, result);
+		case BuiltinFunctionCONVOLVE: return _convolve(context, arguments, result);
+		case BuiltinFunctionFFT: return _fft(context, result);
+		case BuiltinFunctionIFFT: return _ifft(context, result);
+		case BuiltinFunctionLOWPASS: return _lowpass(context, arguments, result);
+		case BuiltinFunctionDET: return _det(result);
+		case BuiltinFunctionINVERSE: return _inverse(result);
+		case BuiltinFunctionMATRIX: return _matrix(result);
+		case BuiltinFunctionMUL: return _mul(arguments, result);
+		case BuiltinFunctionTRACE: return _trace(result);
+		case BuiltinFunctionTRANSPOSE: return _transpose(result);
 		default: return RuntimeErrorCodeNotImplemented;
 	}
 }
 
+static bool derivative(BuiltinFunction function, scalar_t x, scalar_t * dx) {
+	// derivatives of the element-wise builtins, returns false if the function isn't element-wise
+	switch (function) {
+		case BuiltinFunctionSIN: *dx = cos(x); return true;
+		case BuiltinFunctionCOS: *dx = -sin(x); return true;
+		case BuiltinFunctionTAN: *dx = 1.0 / (cos(x) * cos(x)); return true;
+		case BuiltinFunctionASIN: *dx = 1.0 / sqrt(1.0 - x * x); return true;
+		case BuiltinFunctionACOS: *dx = -1.0 / sqrt(1.0 - x * x); return true;
+		case BuiltinFunctionATAN: *dx = 1.0 / (1.0 + x * x); return true;
+		case BuiltinFunctionSEC: *dx = tan(x) / cos(x); return true;
+		case BuiltinFunctionCSC: *dx = -1.0 / (tan(x) * sin(x)); return true;
+		case BuiltinFunctionCOT: *dx = -1.0 / (sin(x) * sin(x)); return true;
+		case BuiltinFunctionASEC: *dx = 1.0 / (fabs(x) * sqrt(x * x - 1.0)); return true;
+		case BuiltinFunctionACSC: *dx = -1.0 / (fabs(x) * sqrt(x * x - 1.0)); return true;
+		case BuiltinFunctionACOT: *dx = -1.0 / (1.0 + x * x); return true;
+		case BuiltinFunctionSINH: *dx = cosh(x); return true;
+		case BuiltinFunctionCOSH: *dx = sinh(x); return true;
+		case BuiltinFunctionTANH: *dx = 1.0 - tanh(x) * tanh(x); return true;
+		case BuiltinFunctionASINH: *dx = 1.0 / sqrt(x * x + 1.0); return true;
+		case BuiltinFunctionACOSH: *dx = 1.0 / sqrt(x * x - 1.0); return true;
+		case BuiltinFunctionATANH: *dx = 1.0 / (1.0 - x * x); return true;
+		case BuiltinFunctionSECH: *dx = -tanh(x) / cosh(x); return true;
+		case BuiltinFunctionCSCH: *dx = -1.0 / (tanh(x) * sinh(x)); return true;
+		case BuiltinFunctionCOTH: *dx = -1.0 / (sinh(x) * sinh(x)); return true;
+		case BuiltinFunctionASECH: *dx = -1.0 / (x * sqrt(1.0 - x * x)); return true;
+		case BuiltinFunctionACSCH: *dx = -1.0 / (fabs(x) * sqrt(1.0 + x * x)); return true;
+		case BuiltinFunctionACOTH: *dx = 1.0 / (1.0 - x * x); return true;
+		case BuiltinFunctionABS: *dx = (x > 0) - (x < 0); return true;
+		case BuiltinFunctionCBRT: *dx = 1.0 / (3.0 * cbrt(x) * cbrt(x)); return true;
+		case BuiltinFunctionCEIL: *dx = 0.0; return true;
+		case BuiltinFunctionDIGAMMA: *dx = trigamma(x); return true;
+		case BuiltinFunctionERF: *dx = M_2_SQRTPI * exp(-x * x); return true;
+		case BuiltinFunctionEXP: *dx = exp(x); return true;
+		case BuiltinFunctionFACTORIAL: *dx = tgamma(x + 1.0) * digamma(x + 1.0); return true;
+		case BuiltinFunctionFLOOR: *dx = 0.0; return true;
+		case BuiltinFunctionGAMMA: *dx = tgamma(x) * digamma(x); return true;
+		case BuiltinFunctionLN: *dx = 1.0 / x; return true;
+		case BuiltinFunctionLOG10: *dx = 1.0 / (x * M_LN10); return true;
+		case BuiltinFunctionLOG2: *dx = 1.0 / (x * M_LN2); return true;
+		case BuiltinFunctionROUND: *dx = 0.0; return true;
+		case BuiltinFunctionSIGN: *dx = 0.0; return true;
+		case BuiltinFunctionSQRT: *dx = 0.5 / sqrt(x); return true;
+		default: return false;
+	}
+}
+
+static inline scalar_t tangent_at(VectorArray tangent, int32_t d, int32_t i) {
+	// tangents with no dimensions are constant zero
+	return tangent.dimensions == 0 ? 0.0 : tangent.xyzw[d][i];
+}
+
+static RuntimeErrorCode _difference_tangent(EvaluationContext * context, BuiltinFunction function, List(VectorArray) args, List(VectorArray) tangents, VectorArray * result, VectorArray * tangent) {
+	// central difference along the tangent direction, used for builtins without an exact rule (e.g. sort, median)
+	bool single = IsFunctionSingleArgument(function);
+	int32_t count = single ? 1 : ListLength(args);
+	VectorArray * inputs = single ? result : args;
+	VectorArray * directions = single ? tangent : tangents;
+	scalar_t magnitude = 1.0, scale = 0.0;
+	for (int32_t k = 0; k < count; k++) {
+		for (int32_t d = 0; d < directions[k].dimensions; d++) {
+			for (int32_t i = 0; i < inputs[k].length; i++) {
+				if (fabs(inputs[k].xyzw[d][i]) > magnitude) { magnitude = fabs(inputs[k].xyzw[d][i]); }
+				if (fabs(directions[k].xyzw[d][i]) > scale) { scale = fabs(directions[k].xyzw[d][i]); }
+			}
+		}
+	}
+	
+	VectorArray forward, backward;
+	RuntimeErrorCode code = RuntimeErrorCodeNone;
+	scalar_t h = cbrt(SCALAR_EPSILON) * magnitude / scale;
+	if (scale > 0.0) {
+		List(VectorArray) forwardArgs = ListCreate(sizeof(VectorArray), count);
+		List(VectorArray) backwardArgs = ListCreate(sizeof(VectorArray), count);
+		for (int32_t k = 0; k < count; k++) {
+			VectorArray forwardArg = CopyVectorArray(inputs[k]), backwardArg = CopyVectorArray(inputs[k]);
+			forwardArgs = ListPush(forwardArgs, &forwardArg);
+			backwardArgs = ListPush(backwardArgs, &backwardArg);
+			for (int32_t d = 0; d < directions[k].dimensions; d++) {
+				for (int32_t i = 0; i < inputs[k].length; i++) {
+					forwardArgs[k].xyzw[d][i] += h * directions[k].xyzw[d][i];
+					backwardArgs[k].xyzw[d][i] -= h * directions[k].xyzw[d][i];
+				}
+			}
+		}
+		if (single) {
+			forward = forwardArgs[0];
+			backward = backwardArgs[0];
+			code = EvaluateBuiltinFunction(context, function, NULL, &forward);
+			if (code == RuntimeErrorCodeNone) { code = EvaluateBuiltinFunction(context, function, NULL, &backward); }
+		} else {
+			code = EvaluateBuiltinFunction(context, function, forwardArgs, &forward);
+			if (code == RuntimeErrorCodeNone) { code = EvaluateBuiltinFunction(context, function, backwardArgs, &backward); }
+			for (int32_t k = 0; k < count; k++) {
+				FreeVectorArray(forwardArgs[k]);
+				FreeVectorArray(backwardArgs[k]);
+			}
+		}
+		ListFree(forwardArgs);
+		ListFree(backwardArgs);
+		if (code != RuntimeErrorCodeNone) { return code; }
+	}
+	if (single) { FreeVectorArray(*tangent); }
+	
+	code = EvaluateBuiltinFunction(context, function, args, result);
+	*tangent = (VectorArray){ 0 };
+	if (scale > 0.0) {
+		if (code == RuntimeErrorCodeNone && forward.dimensions == result->dimensions && forward.length == result->length && backward.length == result->length) {
+			*tangent = ZeroVectorArray(result->dimensions, result->length);
+			for (int32_t d = 0; d < result->dimensions; d++) {
+				for (int32_t i = 0; i < result->length; i++) { tangent->xyzw[d][i] = (forward.xyzw[d][i] - backward.xyzw[d][i]) / (2.0 * h); }
+			}
+		}
+		FreeVectorArray(forward);
+		FreeVectorArray(backward);
+	}
+	return code;
+}
+
+static RuntimeErrorCode _single_tangent(EvaluationContext * context, BuiltinFunction function, VectorArray * result, VectorArray * tangent) {
+	// element-wise functions scale the tangent by their derivative at each element
+	scalar_t dx;
+	if (derivative(function, 0.0, &dx)) {
+		for (int32_t d = 0; d < result->dimensions; d++) {
+			for (int32_t i = 0; i < result->length; i++) {
+				derivative(function, result->xyzw[d][i], &dx);
+				tangent->xyzw[d][i] *= dx;
+			}
+		}
+		return EvaluateBuiltinFunction(context, function, NULL, result);
+	}
+	
+	VectorArray x = *result, t = *tangent;
+	switch (function) {
+		case BuiltinFunctionSUM:
+		case BuiltinFunctionMEAN:
+		case BuiltinFunctionMATRIX:
+		case BuiltinFunctionTRACE:
+		case BuiltinFunctionTRANSPOSE:
+			// linear so the tangent goes through the same function
+			EvaluateBuiltinFunction(context, function, NULL, tangent);
+			return EvaluateBuiltinFunction(context, function, NULL, result);
+		case BuiltinFunctionGRAD:
+		case BuiltinFunctionLAPLACIAN:
+			// linear as well, the tangent is laid out on the same grid
+			if (t.length != x.length) { return _difference_tangent(context, function, NULL, NULL, result, tangent); }
+			tangent->columns = x.columns;
+			EvaluateBuiltinFunction(context, function, NULL, tangent);
+			return EvaluateBuiltinFunction(context, function, NULL, result);
+		case BuiltinFunctionCUMSUM:
+		case BuiltinFunctionDIFF:
+			// linear, the tangent is scanned or differenced the same way
+			if (t.length != x.length) { return _difference_tangent(context, function, NULL, NULL, result, tangent); }
+			EvaluateBuiltinFunction(context, function, NULL, tangent);
+			return EvaluateBuiltinFunction(context, function, NULL, result);
+		case BuiltinFunctionCUMPROD:
+			// dP[i] = dP[i - 1] x[i] + P[i - 1] dx[i], a serial pass that stays exact through zeros
+			if (t.length != x.length || t.dimensions != x.dimensions) { return _difference_tangent(context, function, NULL, NULL, result, tangent); }
+			for (int32_t d = 0; d < x.dimensions; d++) {
+				scalar_t p = 1.0, dp = 0.0;
+				for (uint32_t i = 0; i < x.length; i++) {
+					dp = dp * x.xyzw[d][i] + p * t.xyzw[d][i];
+					p *= x.xyzw[d][i];
+					t.xyzw[d][i] = dp;
+				}
+			}
+			tangent->columns = 0;
+			return EvaluateBuiltinFunction(context, function, NULL, result);
+		case BuiltinFunctionCUMMAX:
+		case BuiltinFunctionCUMMIN:
+			// the tangent of the element the running extreme was taken from
+			if (t.length != x.length || t.dimensions != x.dimensions) { return _difference_tangent(context, function, NULL, NULL, result, tangent); }
+			for (int32_t d = 0; d < x.dimensions && x.length > 0; d++) {
+				scalar_t best = x.xyzw[d][0], bestTangent = t.xyzw[d][0];
+				if (best != best) {
+					// a leading NaN is passed over, the value starts from the identity until a number comes
+					best = function == BuiltinFunctionCUMMAX ? -INFINITY : INFINITY;
+					bestTangent = t.xyzw[d][0] = 0.0;
+				}
+				for (uint32_t i = 1; i < x.length; i++) {
+					scalar_t v = x.xyzw[d][i];
+					if (function == BuiltinFunctionCUMMAX ? v > best : v < best) {
+						best = v;
+						bestTangent = t.xyzw[d][i];
+					}
+					t.xyzw[d][i] = bestTangent;
+				}
+			}
+			tangent->columns = 0;
+			return EvaluateBuiltinFunction(context, function, NULL, result);
+		case BuiltinFunctionFFT:
+		case BuiltinFunctionIFFT:
+			// linear, the tangent is transformed too
+			if (t.length != x.length) { return _difference_tangent(context, function, NULL, NULL, result, tangent); }
+			EvaluateBuiltinFunction(context, function, NULL, tangent);
+			return EvaluateBuiltinFunction(context, function, NULL, result);
+		case BuiltinFunctionINVERSE: {
+			// -M^-1 dM M^-1, made of the same products scripts get from mul
+			if (t.length != x.length) { return _difference_tangent(context, function, NULL, NULL, result, tangent); }
+			RuntimeErrorCode code = EvaluateBuiltinFunction(context, function, NULL, result);
+			if (code != RuntimeErrorCodeNone) {
+				FreeVectorArray(t);
+				*tangent = (VectorArray){ 0 };
+				return code;
+			}
+			t.kind = NumberKindMatrix;
+			VectorArray product;
+			List(VectorArray) factors = ListCreate(sizeof(VectorArray), 2);
+			factors = ListPush(factors, result);
+			factors = ListPush(factors, &t);
+			EvaluateBuiltinFunction(context, BuiltinFunctionMUL, factors, &product);
+			factors[0] = product;
+			factors[1] = *result;
+			EvaluateBuiltinFunction(context, BuiltinFunctionMUL, factors, tangent);
+			for (int32_t d = 0; d < tangent->dimensions; d++) {
+				for (int32_t i = 0; i < tangent->length; i++) { tangent->xyzw[d][i] = -tangent->xyzw[d][i]; }
+			}
+			ListFree(factors);
+			FreeVectorArray(product);
+			FreeVectorArray(t);
+			return code;
+		}
+		case BuiltinFunctionDELAUNAY:
+		case BuiltinFunctionHULL: {
+			// the triangles keep their corners under a small enough change, so they move with their points
+			if (t.length != x.length || t.dimensions != x.dimensions) { return _difference_tangent(context, function, NULL, NULL, result, tangent); }
+			RuntimeErrorCode code = _triangles(context, function, result, tangent);
+			if (code != RuntimeErrorCodeNone) {
+				FreeVectorArray(t);
+				*tangent = (VectorArray){ 0 };
+			}
+			return code;
+		}
+		case BuiltinFunctionARGMAX:
+		case BuiltinFunctionARGMIN:
+		case BuiltinFunctionARGSORT:
+		case BuiltinFunctionGROUPCOUNT:
+			FreeVectorArray(*tangent);
+			*tangent = (VectorArray){ 0 };
+			return EvaluateBuiltinFunction(context, function, NULL, result);
+		case BuiltinFunctionPROD: {
+			// sum of each tangent times the product of every other element, using prefix and suffix products
+			*tangent = ZeroVectorArray(x.dimensions, 1);
+			scalar_t * suffix = malloc((x.length + 1) * sizeof(scalar_t));
+			for (int32_t d = 0; d < x.dimensions; d++) {
+				suffix[x.length] = 1.0;
+				for (int32_t i = x.length - 1; i >= 0; i--) { suffix[i] = suffix[i + 1] * x.xyzw[d][i]; }
+				scalar_t prefix = 1.0;
+				for (int32_t i = 0; i < x.length; i++) {
+					tangent->xyzw[d][0] += t.xyzw[d][i] * prefix * suffix[i + 1];
+					prefix *= x.xyzw[d][i];
+				}
+			}
+			free(suffix);
+			FreeVectorArray(t);
+			return EvaluateBuiltinFunction(context, function, NULL, result);
+		}
+		case BuiltinFunctionVAR:
+		case BuiltinFunctionSTDEV: {
+			// var' = 2/n * sum((x - mean) * t), which is the co-deviation of x and t since the deviations sum to zero
+			*tangent = ZeroVectorArray(x.dimensions, 1);
+			for (int32_t d = 0; d < x.dimensions; d++) { tangent->xyzw[d][0] = 2.0 * Reduce(ReductionKindComoments, x.xyzw[d], t.xyzw[d], x.length).ab / x.length; }
+			FreeVectorArray(t);
+			RuntimeErrorCode code = EvaluateBuiltinFunction(context, function, NULL, result);
+			if (function == BuiltinFunctionSTDEV) {
+				for (int32_t d = 0; d < result->dimensions; d++) { tangent->xyzw[d][0] /= 2.0 * result->xyzw[d][0]; }
+			}
+			return code;
+		}
+		case BuiltinFunctionLENGTH:
+		case BuiltinFunctionLENGTHSQ: {
+			if (x.dimensions == 1 && function == BuiltinFunctionLENGTH) { return RuntimeErrorCodeNone; }
+			*tangent = ZeroVectorArray(1, x.length);
+			for (int32_t i = 0; i < x.length; i++) {
+				for (int32_t d = 0; d < x.dimensions; d++) { tangent->xyzw[0][i] += 2.0 * x.xyzw[d][i] * t.xyzw[d][i]; }
+			}
+			FreeVectorArray(t);
+			RuntimeErrorCode code = EvaluateBuiltinFunction(context, function, NULL, result);
+			if (function == BuiltinFunctionLENGTH) {
+				for (int32_t i = 0; i < result->length; i++) { tangent->xyzw[0][i] /= 2.0 * result->xyzw[0][i]; }
+			}
+			return code;
+		}
+		case BuiltinFunctionNORMALIZE: {
+			// (t - n * dot(n, t)) / |x|
+			if (x.dimensions == 1) { return RuntimeErrorCodeNone; }
+			for (int32_t i = 0; i < x.length; i++) {
+				scalar_t len = 0.0, dot = 0.0;
+				for (int32_t d = 0; d < x.dimensions; d++) { len += x.xyzw[d][i] * x.xyzw[d][i]; }
+				len = sqrt(len);
+				for (int32_t d = 0; d < x.dimensions; d++) { dot += x.xyzw[d][i] * t.xyzw[d][i]; }
+				for (int32_t d = 0; d < x.dimensions; d++) { t.xyzw[d][i] = (t.xyzw[d][i] - x.xyzw[d][i] * dot / (len * len)) / len; }
+			}
+			return EvaluateBuiltinFunction(context, function, NULL, result);
+		}
+		default: return _difference_tangent(context, function, NULL, NULL, result, tangent);
+	}
+}
+
+static RuntimeErrorCode _multi_tangent(EvaluationContext * context, BuiltinFunction function, List(VectorArray) args, List(VectorArray) tangents, VectorArray * result, VectorArray * tangent) {
+	RuntimeErrorCode code;
+	switch (function) {
+		case BuiltinFunctionATAN2: {
+			// (x dy - y dx) / (x^2 + y^2)
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone) { return code; }
+			VectorArray y = args[0], x = args[1];
+			bool yi = y.length == 1 && x.length > 1, xi = x.length == 1 && y.length > 1;
+			*tangent = ZeroVectorArray(1, result->length);
+			for (int32_t i = 0; i < result->length; i++) {
+				scalar_t a = y.xyzw[0][yi ? 0 : i], b = x.xyzw[0][xi ? 0 : i];
+				tangent->xyzw[0][i] = (b * tangent_at(tangents[0], 0, yi ? 0 : i) - a * tangent_at(tangents[1], 0, xi ? 0 : i)) / (a * a + b * b);
+			}
+			return code;
+		}
+		case BuiltinFunctionLOG: {
+			// log_b(a) = ln(a) / ln(b)
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone) { return code; }
+			VectorArray b = args[0], a = args[1];
+			bool ai = a.length == 1 && b.length > 1, bi = b.length == 1 && a.length > 1;
+			bool ad = a.dimensions == 1 && b.dimensions > 1, bd = b.dimensions == 1 && a.dimensions > 1;
+			*tangent = ZeroVectorArray(result->dimensions, result->length);
+			for (int32_t d = 0; d < result->dimensions; d++) {
+				for (int32_t i = 0; i < result->length; i++) {
+					scalar_t x = a.xyzw[ad ? 0 : d][ai ? 0 : i], base = b.xyzw[bd ? 0 : d][bi ? 0 : i];
+					scalar_t dx = tangent_at(tangents[1], ad ? 0 : d, ai ? 0 : i), dbase = tangent_at(tangents[0], bd ? 0 : d, bi ? 0 : i);
+					tangent->xyzw[d][i] = (dx / x - result->xyzw[d][i] * dbase / base) / log(base);
+				}
+			}
+			return code;
+		}
+		case BuiltinFunctionDOT:
+		case BuiltinFunctionDISTSQ:
+		case BuiltinFunctionDIST: {
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone) { return code; }
+			bool ai = args[0].length == 1 && args[1].length > 1, bi = args[1].length == 1 && args[0].length > 1;
+			*tangent = ZeroVectorArray(1, result->length);
+			for (int32_t i = 0; i < result->length; i++) {
+				for (int32_t d = 0; d < args[0].dimensions; d++) {
+					scalar_t a = args[0].xyzw[d][ai ? 0 : i], b = args[1].xyzw[d][bi ? 0 : i];
+					scalar_t da = tangent_at(tangents[0], d, ai ? 0 : i), db = tangent_at(tangents[1], d, bi ? 0 : i);
+					if (function == BuiltinFunctionDOT) { tangent->xyzw[0][i] += da * b + a * db; }
+					else { tangent->xyzw[0][i] += 2.0 * (a - b) * (da - db); }
+				}
+				if (function == BuiltinFunctionDIST) { tangent->xyzw[0][i] /= 2.0 * result->xyzw[0][i]; }
+			}
+			return code;
+		}
+		case BuiltinFunctionCROSS: {
+			// da x b + a x db
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone) { return code; }
+			bool ai = args[0].length == 1 && args[1].length > 1, bi = args[1].length == 1 && args[0].length > 1;
+			*tangent = ZeroVectorArray(3, result->length);
+			for (int32_t i = 0; i < result->length; i++) {
+				for (int32_t d = 0; d < 3; d++) {
+					int32_t u = (d + 1) % 3, v = (d + 2) % 3;
+					VectorArray a = args[0], b = args[1];
+					int32_t ia = ai ? 0 : i, ib = bi ? 0 : i;
+					tangent->xyzw[d][i] = tangent_at(tangents[0], u, ia) * b.xyzw[v][ib] - tangent_at(tangents[0], v, ia) * b.xyzw[u][ib]
+						+ a.xyzw[u][ia] * tangent_at(tangents[1], v, ib) - a.xyzw[v][ia] * tangent_at(tangents[1], u, ib);
+				}
+			}
+			return code;
+		}
+		case BuiltinFunctionJOIN:
+		case BuiltinFunctionINTERLEAVE: {
+			// linear so the tangent goes through the same function
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone) { return code; }
+			List(VectorArray) dense = ListCreate(sizeof(VectorArray), ListLength(args));
+			for (int32_t k = 0; k < ListLength(args); k++) {
+				VectorArray t = tangents[k].dimensions > 0 ? CopyVectorArray(tangents[k]) : ZeroVectorArray(args[k].dimensions, args[k].length);
+				dense = ListPush(dense, &t);
+			}
+			code = EvaluateBuiltinFunction(context, function, dense, tangent);
+			for (int32_t k = 0; k < ListLength(dense); k++) { FreeVectorArray(dense[k]); }
+			ListFree(dense);
+			return code;
+		}
+		case BuiltinFunctionBLUR:
+		case BuiltinFunctionSHIFT: {
+			// linear in the grid, the radius and offset are rounded so they don't contribute
+			if (tangents[0].dimensions > 0 && tangents[0].length != args[0].length) { return _difference_tangent(context, function, args, tangents, result, tangent); }
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone || tangents[0].dimensions == 0) { return code; }
+			List(VectorArray) moved = ListCreate(sizeof(VectorArray), 2);
+			VectorArray grid = tangents[0];
+			grid.columns = args[0].columns;
+			moved = ListPush(moved, &grid);
+			moved = ListPush(moved, &args[1]);
+			code = EvaluateBuiltinFunction(context, function, moved, tangent);
+			ListFree(moved);
+			return code;
+		}
+		case BuiltinFunctionCONVOLVE: {
+			// bilinear, convolve(dx, k) + convolve(x, dk)
+			for (int32_t k = 0; k < 2; k++) {
+				if (tangents[k].dimensions > 0 && (tangents[k].length != args[k].length || tangents[k].dimensions != args[k].dimensions)) { return _difference_tangent(context, function, args, tangents, result, tangent); }
+			}
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone) { return code; }
+			List(VectorArray) factors = ListCreate(sizeof(VectorArray), 2);
+			for (int32_t k = 0; k < 2; k++) {
+				if (tangents[k].dimensions == 0) { continue; }
+				VectorArray term;
+				factors = ListClear(factors);
+				factors = ListPush(factors, k == 0 ? &tangents[0] : &args[0]);
+				factors = ListPush(factors, k == 0 ? &args[1] : &tangents[1]);
+				code = EvaluateBuiltinFunction(context, function, factors, &term);
+				if (code != RuntimeErrorCodeNone) { break; }
+				if (tangent->dimensions == 0) { *tangent = term; continue; }
+				for (int32_t d = 0; d < tangent->dimensions; d++) {
+					for (int32_t i = 0; i < tangent->length; i++) { tangent->xyzw[d][i] += term.xyzw[d][i]; }
+				}
+				FreeVectorArray(term);
+			}
+			ListFree(factors);
+			return code;
+		}
+		case BuiltinFunctionLOWPASS: {
+			// linear in the signal, a changing cutoff is left to differences
+			if (tangents[1].dimensions > 0 || tangents[0].length != args[0].length) { return _difference_tangent(context, function, args, tangents, result, tangent); }
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone) { return code; }
+			List(VectorArray) filtered = ListCreate(sizeof(VectorArray), 2);
+			filtered = ListPush(filtered, &tangents[0]);
+			filtered = ListPush(filtered, &args[1]);
+			code = EvaluateBuiltinFunction(context, function, filtered, tangent);
+			ListFree(filtered);
+			return code;
+		}
+		case BuiltinFunctionMUL: {
+			// bilinear, mul(dA, B) + mul(A, dB) with dB read the same way as B
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone) { return code; }
+			List(VectorArray) factors = ListCreate(sizeof(VectorArray), 2);
+			for (int32_t k = 0; k < 2; k++) {
+				if (tangents[k].dimensions == 0) { continue; }
+				VectorArray term, changed = tangents[k];
+				changed.kind = args[k].kind;
+				factors = ListClear(factors);
+				factors = ListPush(factors, k == 0 ? &changed : &args[0]);
+				factors = ListPush(factors, k == 0 ? &args[1] : &changed);
+				code = EvaluateBuiltinFunction(context, function, factors, &term);
+				if (code != RuntimeErrorCodeNone) { break; }
+				if (tangent->dimensions == 0) { *tangent = term; continue; }
+				for (int32_t d = 0; d < tangent->dimensions; d++) {
+					for (int32_t i = 0; i < tangent->length; i++) { tangent->xyzw[d][i] += term.xyzw[d][i]; }
+				}
+				FreeVectorArray(term);
+			}
+			ListFree(factors);
+			if (code != RuntimeErrorCodeNone) {
+				FreeVectorArray(*tangent);
+				FreeVectorArray(*result);
+				*tangent = (VectorArray){ 0 };
+				return _difference_tangent(context, function, args, tangents, result, tangent);
+			}
+			return code;
+		}
+		case BuiltinFunctionMAX:
+		case BuiltinFunctionMIN: {
+			// tangent of whichever element was selected
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone) { return code; }
+			*tangent = ZeroVectorArray(1, 1);
+			for (int32_t k = ListLength(args) - 1; k >= 0; k--) {
+				for (int32_t i = args[k].length - 1; i >= 0; i--) {
+					if (args[k].xyzw[0][i] == result->xyzw[0][0]) { tangent->xyzw[0][0] = tangent_at(tangents[k], 0, i); }
+				}
+			}
+			return code;
+		}
+		case BuiltinFunctionGROUPMEAN:
+		case BuiltinFunctionGROUPSUM: {
+			// linear in the values, the keys only decide which group each one goes to
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone || tangents[0].dimensions == 0) { return code; }
+			VectorArray changed = tangents[0];
+			changed.kind = args[0].kind;
+			List(VectorArray) parts = ListCreate(sizeof(VectorArray), 2);
+			parts = ListPush(parts, &changed);
+			parts = ListPush(parts, &args[1]);
+			code = EvaluateBuiltinFunction(context, function, parts, tangent);
+			ListFree(parts);
+			return code;
+		}
+		case BuiltinFunctionHIST:
+		case BuiltinFunctionHIST2D: {
+			// the counts don't change, the centers move with the ends of the range, which are the extreme samples
+			// when the range isn't given, a sample that crosses into another bin is a jump the tangent can't show
+			int32_t axes = function == BuiltinFunctionHIST ? 1 : 2;
+			uint32_t extremes[2][2];
+			code = Histogram(context, axes, args, result, extremes);
+			if (code != RuntimeErrorCodeNone) { return code; }
+			*tangent = ZeroVectorArray(result->dimensions, result->length);
+			uint32_t columns = axes == 1 ? result->length : result->columns;
+			for (int32_t a = 0; a < axes; a++) {
+				scalar_t lower, upper;
+				if (ListLength(args) == 3) {
+					lower = tangent_at(tangents[2], axes == 1 ? 0 : a, 0);
+					upper = tangent_at(tangents[2], axes == 1 ? 1 : a, axes == 1 ? 0 : 1);
+				} else {
+					lower = extremes[a][0] == UINT32_MAX ? 0.0 : tangent_at(tangents[0], a, extremes[a][0]);
+					upper = extremes[a][1] == UINT32_MAX ? 0.0 : tangent_at(tangents[0], a, extremes[a][1]);
+				}
+				uint32_t bins = a == 0 ? columns : result->length / columns;
+				for (uint32_t k = 0; k < result->length; k++) {
+					scalar_t t = ((a == 0 ? k % columns : k / columns) + 0.5) / bins;
+					tangent->xyzw[a][k] = lower + t * (upper - lower);
+				}
+			}
+			return code;
+		}
+		case BuiltinFunctionCOUNT:
+		case BuiltinFunctionRAND:
+		case BuiltinFunctionRANDDISK:
+		case BuiltinFunctionRANDN:
+		case BuiltinFunctionNEAREST:
+		case BuiltinFunctionWITHIN:
+			*tangent = (VectorArray){ 0 };
+			return EvaluateBuiltinFunction(context, function, args, result);
+		case BuiltinFunctionSORT: {
+			// the elements only move, so the tangents move with them
+			if (ListLength(args) != 1 && ListLength(args) != 2) { return RuntimeErrorCodeIncorrectArgumentCount; }
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone || tangents[0].dimensions == 0) { return code; }
+			VectorArray keys = args[ListLength(args) - 1];
+			uint32_t * permutation;
+			code = SortPermutation(context, keys.xyzw[0], result->length, &permutation);
+			if (code != RuntimeErrorCodeNone) {
+				FreeVectorArray(*result);
+				return code;
+			}
+			*tangent = ZeroVectorArray(result->dimensions, result->length);
+			for (int32_t d = 0; d < result->dimensions; d++) {
+				for (uint32_t i = 0; i < result->length; i++) { tangent->xyzw[d][i] = tangent_at(tangents[0], d, permutation[i]); }
+			}
+			free(permutation);
+			return code;
+		}
+		case BuiltinFunctionSHUFFLE: {
+			// the same permutation as the values, from the key of the call just made
+			code = EvaluateBuiltinFunction(context, function, args, result);
+			if (code != RuntimeErrorCodeNone || tangents[0].dimensions == 0) { return code; }
+			RandomKey key;
+			RandomKeyOf(context, args, 1, true, &key);
+			uint32_t * permutation;
+			code = ShufflePermutation(context, key, result->length, &permutation);
+			if (code != RuntimeErrorCodeNone) {
+				FreeVectorArray(*result);
+				return code;
+			}
+			*tangent = ZeroVectorArray(result->dimensions, result->length);
+			for (int32_t d = 0; d < result->dimensions; d++) {
+				for (uint32_t i = 0; i < result->length; i++) { tangent->xyzw[d][i] = tangent_at(tangents[0], d, permutation[i]); }
+			}
+			free(permutation);
+			return code;
+		}
+		default: return _difference_tangent(context, function, args, tangents, result, tangent);
+	}
+}
+
+RuntimeErrorCode EvaluateBuiltinFunctionTangent(EvaluationContext * context, BuiltinFunction function, List(VectorArray) arguments, List(VectorArray) tangents, VectorArray * result, VectorArray * tangent) {
+	if (IsFunctionSingleArgument(function)) {
+		if (IsVectorArrayComplex(*result) && EvaluateComplexFunction(function, result, tangent)) { return RuntimeErrorCodeNone; }
+		if (tangent->dimensions == 0) { return EvaluateBuiltinFunction(context, function, NULL, result); }
+		return _single_tangent(context, function, result, tangent);
+	}
+	
+	bool constant = true;
+	for (int32_t i = 0; i < ListLength(tangents); i++) { constant &= tangents[i].dimensions == 0; }
+	*tangent = (VectorArray){ 0 };
+	if (constant) { return EvaluateBuiltinFunction(context, function, arguments, result); }
+	return _multi_tangent(context, function, arguments, tangents, result, tangent);
+}
+
+RuntimeErrorCode EvaluateBuiltinFunctionFast(EvaluationContext * context, BuiltinFunction function, VectorArray * result, VectorArray * tangent) {
+	// single argument builtins with a reduced accuracy kernel, everything else goes through the precise path
+	// the length is kept in a local, stores through the arrays could alias result and keep the loops from vectorizing
+	bool differentiate = tangent != NULL && tangent->dimensions > 0;
+	int32_t length = result->length;
+	// complex kernels only come in the precise form
+	switch (IsVectorArrayComplex(*result) ? BuiltinFunctionNone : function) {
+		case BuiltinFunctionSIN:
+		case BuiltinFunctionCOS:
+			// kept as separate loops without branches so they vectorize
+			for (int32_t d = 0; d < result->dimensions; d++) {
+				scalar_t * x = result->xyzw[d];
+				if (differentiate) {
+					scalar_t * t = tangent->xyzw[d];
+					if (function == BuiltinFunctionSIN) { for (int32_t i = 0; i < length; i++) { float s, c; fast_sincos(x[i], &s, &c); x[i] = s; t[i] *= c; } }
+					else { for (int32_t i = 0; i < length; i++) { float s, c; fast_sincos(x[i], &s, &c); x[i] = c; t[i] *= -s; } }
+				} else {
+					if (function == BuiltinFunctionSIN) { for (int32_t i = 0; i < length; i++) { float s, c; fast_sincos(x[i], &s, &c); x[i] = s; } }
+					else { for (int32_t i = 0; i < length; i++) { float s, c; fast_sincos(x[i], &s, &c); x[i] = c; } }
+				}
+			}
+			return RuntimeErrorCodeNone;
+		case BuiltinFunctionEXP:
+			for (int32_t d = 0; d < result->dimensions; d++) {
+				scalar_t * x = result->xyzw[d];
+				for (int32_t i = 0; i < length; i++) { x[i] = fast_exp2(x[i] * 1.44269504f); }
+				if (differentiate) { for (int32_t i = 0; i < length; i++) { tangent->xyzw[d][i] *= x[i]; } }
+			}
+			return RuntimeErrorCodeNone;
+		case BuiltinFunctionLENGTH:
+		case BuiltinFunctionNORMALIZE: {
+			// one reciprocal square root per vector instead of a square root and a division per component, done in
+			// blocks with the components on the outside so every loop vectorizes without any scratch allocation
+			if (result->dimensions == 1) { return RuntimeErrorCodeNone; }
+			VectorArray x = *result;
+			for (int32_t start = 0; start < x.length; start += 256) {
+				int32_t count = x.length - start < 256 ? x.length - start : 256;
+				scalar_t reciprocal[256] = { 0 }, dot[256] = { 0 };
+				for (int32_t d = 0; d < x.dimensions; d++) {
+					scalar_t * xd = &x.xyzw[d][start];
+					for (int32_t i = 0; i < count; i++) { reciprocal[i] += xd[i] * xd[i]; }
+					if (differentiate) { for (int32_t i = 0; i < count; i++) { dot[i] += xd[i] * tangent->xyzw[d][start + i]; } }
+				}
+				
+				if (function == BuiltinFunctionLENGTH) {
+					// clamped to the smallest normal number on the bits so a zero vector has length 0 rather than 0 * inf
+					scalar_t * length = &x.xyzw[0][start];
+					for (int32_t i = 0; i < count; i++) {
+						int32_t bits = fast_bits(reciprocal[i]);
+						scalar_t lengthsq = reciprocal[i];
+						reciprocal[i] = fast_rsqrt(fast_float(bits > 0x00800000 ? bits : 0x00800000));
+						length[i] = lengthsq * reciprocal[i];
+					}
+					if (differentiate) { for (int32_t i = 0; i < count; i++) { tangent->xyzw[0][start + i] = dot[i] * reciprocal[i]; } }
+					continue;
+				}
+				for (int32_t i = 0; i < count; i++) { reciprocal[i] = fast_rsqrt(reciprocal[i]); }
+				for (int32_t d = 0; d < x.dimensions; d++) {
+					scalar_t * xd = &x.xyzw[d][start];
+					if (differentiate) {
+						// (t - n * dot(n, t)) / |x|
+						scalar_t * td = &tangent->xyzw[d][start];
+						for (int32_t i = 0; i < count; i++) { td[i] = (td[i] - xd[i] * dot[i] * reciprocal[i] * reciprocal[i]) * reciprocal[i]; }
+					}
+					for (int32_t i = 0; i < count; i++) { xd[i] *= reciprocal[i]; }
+				}
+			}
+			if (function == BuiltinFunctionLENGTH) {
+				result->dimensions = 1;
+				if (differentiate) { tangent->dimensions = 1; }
+			}
+			return RuntimeErrorCodeNone;
+		}
+		default:
+			if (tangent != NULL) { return EvaluateBuiltinFunctionTangent(context, function, NULL, NULL, result, tangent); }
+			return EvaluateBuiltinFunction(context, function, NULL, result);
+	}
+}
+
 static const char * builtinVariables[] = {
 	[BuiltinVariablePI]       = "pi",
 	[BuiltinVariableTAU]      = "tau",
 	[BuiltinVariableE]        = "e",
 	[BuiltinVariableINF]      = "inf",
+	[BuiltinVariableI]        = "i",
 	[BuiltinVariablePOSITION] = "position",
 	[BuiltinVariableSCALE]    = "scale",
 	[BuiltinVariableROTATION] = "rotation",
@@ -887,42 +3393,50 @@ BuiltinVariable DetermineBuiltinVariable(const char * identifier) {
 }
 
 void InitializeBuiltinVariables(Environment * environment) {
-	VectorArray pi = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = malloc(sizeof(scalar_t)) };
+	VectorArray pi = CreateVectorArray(1, 1);
 	pi.xyzw[0][0] = M_PI;
 	SetEnvironmentCache(environment, builtinVariables[BuiltinVariablePI], pi);
 	
-	VectorArray tau = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = malloc(sizeof(scalar_t)) };
+	VectorArray tau = CreateVectorArray(1, 1);
 	tau.xyzw[0][0] = 2 * M_PI;
 	SetEnvironmentCache(environment, builtinVariables[BuiltinVariableTAU], tau);
 	
-	VectorArray e = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = malloc(sizeof(scalar_t)) };
+	VectorArray e = CreateVectorArray(1, 1);
 	e.xyzw[0][0] = M_E;
 	SetEnvironmentCache(environment, builtinVariables[BuiltinVariableE], e);
 	
-	VectorArray inf = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = malloc(sizeof(scalar_t)) };
+	VectorArray inf = CreateVectorArray(1, 1);
 	inf.xyzw[0][0] = INFINITY;
 	SetEnvironmentCache(environment, builtinVariables[BuiltinVariableINF], inf);
 	
-	VectorArray position = (VectorArray){ .length = 1, .dimensions = 2, .xyzw = { malloc(sizeof(scalar_t)), malloc(sizeof(scalar_t)) } };
+	VectorArray position = CreateVectorArray(2, 1);
 	position.xyzw[0][0] = 0;
 	position.xyzw[1][0] = 0;
 	SetEnvironmentCache(environment, builtinVariables[BuiltinVariablePOSITION], position);
 	
-	VectorArray scale = (VectorArray){ .length = 1, .dimensions = 2, .xyzw = { malloc(sizeof(scalar_t)), malloc(sizeof(scalar_t)) } };
+	VectorArray scale = CreateVectorArray(2, 1);
 	scale.xyzw[0][0] = 1;
 	scale.xyzw[1][0] = 1;
 	SetEnvironmentCache(environment, builtinVariables[BuiltinVariableSCALE], scale);
 	
-	VectorArray rotation = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = malloc(sizeof(scalar_t)) };
+	VectorArray rotation = CreateVectorArray(1, 1);
 	rotation.xyzw[0][0] = 0.0;
 	SetEnvironmentCache(environment, builtinVariables[BuiltinVariableROTATION], rotation);
 	
-	VectorArray time = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = malloc(sizeof(scalar_t)) };
+	VectorArray time = CreateVectorArray(1, 1);
 	time.xyzw[0][0] = 0.0;
 	SetEnvironmentCache(environment, builtinVariables[BuiltinVariableTIME], time);
 }
 
 RuntimeErrorCode EvaluateBuiltinVariable(Environment environment, BuiltinVariable variable, VectorArray * result) {
+	// i isn't cached so it never hides a script's own variable i
+	if (variable == BuiltinVariableI) {
+		*result = CreateVectorArray(2, 1);
+		result->kind = NumberKindComplex;
+		result->xyzw[0][0] = 0.0;
+		result->xyzw[1][0] = 1.0;
+		return RuntimeErrorCodeNone;
+	}
 	VectorArray * cached = GetEnvironmentCache(&environment, builtinVariables[variable]);
 	if (cached == NULL) { return RuntimeErrorCodeNotImplemented; }
 	*result = CopyVectorArray(*cached);
@@ -32,16 +32,28 @@ typedef enum BuiltinFunction {
 	BuiltinFunctionABS,
 	BuiltinFunctionARGMAX,
 	BuiltinFunctionARGMIN,
+	BuiltinFunctionARGSORT,
 	BuiltinFunctionCBRT,
 	BuiltinFunctionCEIL,
 	BuiltinFunctionCORR,
 	BuiltinFunctionCOUNT,
 	BuiltinFunctionCOV,
+	BuiltinFunctionCUMMAX,
+	BuiltinFunctionCUMMIN,
+	BuiltinFunctionCUMPROD,
+	BuiltinFunctionCUMSUM,
+	BuiltinFunctionDIFF,
+	BuiltinFunctionDIGAMMA,
 	BuiltinFunctionERF,
 	BuiltinFunctionEXP,
 	BuiltinFunctionFACTORIAL,
 	BuiltinFunctionFLOOR,
 	BuiltinFunctionGAMMA,
+	BuiltinFunctionGROUPCOUNT,
+	BuiltinFunctionGROUPMEAN,
+	BuiltinFunctionGROUPSUM,
+	BuiltinFunctionHIST,
+	BuiltinFunctionHIST2D,
 	BuiltinFunctionINTERLEAVE,
 	BuiltinFunctionJOIN,
 	BuiltinFunctionLN,
@@ -55,6 +67,8 @@ typedef enum BuiltinFunction {
 	BuiltinFunctionPROD,
 	BuiltinFunctionQUANTILE,
 	BuiltinFunctionRAND,
+	BuiltinFunctionRANDDISK,
+	BuiltinFunctionRANDN,
 	BuiltinFunctionROUND,
 	BuiltinFunctionSHUFFLE,
 	BuiltinFunctionSIGN,
@@ -69,19 +83,41 @@ typedef enum BuiltinFunction {
 	BuiltinFunctionDOT,
 	BuiltinFunctionLENGTH,
 	BuiltinFunctionLENGTHSQ,
+	BuiltinFunctionNEAREST,
 	BuiltinFunctionNORMALIZE,
+	BuiltinFunctionWITHIN,
+	BuiltinFunctionDELAUNAY,
+	BuiltinFunctionHULL,
+	BuiltinFunctionBLUR,
+	BuiltinFunctionGRAD,
+	BuiltinFunctionLAPLACIAN,
+	BuiltinFunctionSHIFT,
+	BuiltinFunctionCONVOLVE,
+	BuiltinFunctionFFT,
+	BuiltinFunctionIFFT,
+	BuiltinFunctionLOWPASS,
+	BuiltinFunctionDET,
+	BuiltinFunctionINVERSE,
+	BuiltinFunctionMATRIX,
+	BuiltinFunctionMUL,
+	BuiltinFunctionTRACE,
+	BuiltinFunctionTRANSPOSE,
 	BuiltinFunctionNone,
 } BuiltinFunction;
 
 BuiltinFunction DetermineBuiltinFunction(const char * identifier);
 bool IsFunctionSingleArgument(BuiltinFunction function);
-RuntimeErrorCode EvaluateBuiltinFunction(BuiltinFunction function, List(VectorArray) arguments, VectorArray * result);
+bool IsFunctionElementwise(BuiltinFunction function);
+RuntimeErrorCode EvaluateBuiltinFunction(EvaluationContext * context, BuiltinFunction function, List(VectorArray) arguments, VectorArray * result);
+RuntimeErrorCode EvaluateBuiltinFunctionTangent(EvaluationContext * context, BuiltinFunction function, List(VectorArray) arguments, List(VectorArray) tangents, VectorArray * result, VectorArray * tangent);
+RuntimeErrorCode EvaluateBuiltinFunctionFast(EvaluationContext * context, BuiltinFunction function, VectorArray * result, VectorArray * tangent);
 
 typedef enum BuiltinVariable {
 	BuiltinVariablePI,
 	BuiltinVariableTAU,
 	BuiltinVariableE,
 	BuiltinVariableINF,
+	BuiltinVariableI,
 	BuiltinVariablePOSITION,
 	BuiltinVariableSCALE,
 	BuiltinVariableROTATION,
@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <string.h>
+#include <tgmath.h>
+#include "ComplexNumbers.h"
+
+// an operand's channels, used in place when they already cover the result, otherwise spread into storage
+typedef struct ComplexOperand {
+	const scalar_t * re;
+	const scalar_t * im;
+	VectorArray storage;
+} ComplexOperand;
+
+static ComplexOperand PromoteOperand(VectorArray value, uint32_t length) {
+	if (value.dimensions == 2 && value.length == length) { return (ComplexOperand){ value.xyzw[0], value.xyzw[1] }; }
+	ComplexOperand operand = { .storage = CreateVectorArray(2, length) };
+	for (int32_t d = 0; d < 2; d++) {
+		scalar_t * channel = operand.storage.xyzw[d];
+		if (d >= value.dimensions) { memset(channel, 0, length * sizeof(scalar_t)); }
+		else if (value.length == 1) { for (uint32_t j = 0; j < length; j++) { channel[j] = value.xyzw[d][0]; } }
+		else { memcpy(channel, value.xyzw[d], length * sizeof(scalar_t)); }
+	}
+	operand.re = operand.storage.xyzw[0];
+	operand.im = operand.storage.xyzw[1];
+	return operand;
+}
+
+static inline void complex_mul(scalar_t ar, scalar_t ai, scalar_t br, scalar_t bi, scalar_t * r, scalar_t * i) {
+	*r = ar * br - ai * bi;
+	*i = ar * bi + ai * br;
+}
+
+static inline void complex_div(scalar_t ar, scalar_t ai, scalar_t br, scalar_t bi, scalar_t * r, scalar_t * i) {
+	scalar_t d = br * br + bi * bi;
+	*r = (ar * br + ai * bi) / d;
+	*i = (ai * br - ar * bi) / d;
+}
+
+static inline void complex_pow(scalar_t ar, scalar_t ai, scalar_t br, scalar_t bi, scalar_t * r, scalar_t * i) {
+	// exp(b ln a), with 0^b taken as 1 for b = 0 and 0 otherwise
+	if (ar == 0.0 && ai == 0.0) {
+		*r = br == 0.0 && bi == 0.0 ? 1.0 : 0.0;
+		*i = 0.0;
+		return;
+	}
+	scalar_t lr = log(hypot(ar, ai)), li = atan2(ai, ar);
+	scalar_t m = exp(br * lr - bi * li), angle = br * li + bi * lr;
+	*r = m * cos(angle);
+	*i = m * sin(angle);
+}
+
+static bool IntegerExponent(VectorArray right, int32_t * n) {
+	// real whole number exponents are raised by repeated squaring, which is exact for small powers and much faster
+	if (right.dimensions != 1 || right.length != 1) { return false; }
+	scalar_t b = right.xyzw[0][0];
+	if (!(fabs(b) <= 1024.0) || b != round(b)) { return false; }
+	*n = b;
+	return true;
+}
+
+bool IsComplexOperator(Operator operator) {
+	return operator == OperatorAdd || operator == OperatorSubtract || operator == OperatorMultiply || operator == OperatorDivide || operator == OperatorPower;
+}
+
+RuntimeErrorCode EvaluateComplexArithmetic(Operator operator, VectorArray left, VectorArray right, VectorArray leftTangent, VectorArray rightTangent, VectorArray * result, VectorArray * tangent) {
+	if (left.dimensions > 2 || right.dimensions > 2) { return RuntimeErrorCodeDifferingOperonDimensions; }
+	uint32_t length;
+	if (left.length == 1) { length = right.length; }
+	else if (right.length == 1) { length = left.length; }
+	else { length = left.length < right.length ? left.length : right.length; }
+
+	int32_t n = 0;
+	bool integer = operator == OperatorPower && IntegerExponent(right, &n);
+	ComplexOperand a = PromoteOperand(left, length), b = integer ? (ComplexOperand){ 0 } : PromoteOperand(right, length);
+	*result = CreateVectorArray(2, length);
+	result->kind = NumberKindComplex;
+	if (left.length == length && left.columns > 0) { result->columns = left.columns; }
+	else if (right.length == length) { result->columns = right.columns; }
+
+	// separate loops over the split channels so the rational operators vectorize
+	const scalar_t * restrict ar = a.re, * restrict ai = a.im, * restrict br = b.re, * restrict bi = b.im;
+	scalar_t * restrict rr = result->xyzw[0], * restrict ri = result->xyzw[1];
+	switch (operator) {
+		case OperatorAdd: for (uint32_t j = 0; j < length; j++) { rr[j] = ar[j] + br[j]; ri[j] = ai[j] + bi[j]; } break;
+		case OperatorSubtract: for (uint32_t j = 0; j < length; j++) { rr[j] = ar[j] - br[j]; ri[j] = ai[j] - bi[j]; } break;
+		case OperatorMultiply: for (uint32_t j = 0; j < length; j++) { complex_mul(ar[j], ai[j], br[j], bi[j], &rr[j], &ri[j]); } break;
+		case OperatorDivide: for (uint32_t j = 0; j < length; j++) { complex_div(ar[j], ai[j], br[j], bi[j], &rr[j], &ri[j]); } break;
+		case OperatorPower:
+			if (integer) {
+				for (uint32_t j = 0; j < length; j++) {
+					scalar_t xr = ar[j], xi = ai[j], pr = 1.0, pi = 0.0;
+					for (uint32_t k = abs(n); k > 0; k >>= 1) {
+						if (k & 1) { complex_mul(pr, pi, xr, xi, &pr, &pi); }
+						complex_mul(xr, xi, xr, xi, &xr, &xi);
+					}
+					if (n < 0) { complex_div(1.0, 0.0, pr, pi, &pr, &pi); }
+					rr[j] = pr;
+					ri[j] = pi;
+				}
+			} else {
+				for (uint32_t j = 0; j < length; j++) { complex_pow(ar[j], ai[j], br[j], bi[j], &rr[j], &ri[j]); }
+			}
+			break;
+		default: break;
+	}
+
+	if (tangent != NULL) {
+		*tangent = (VectorArray){ 0 };
+		if (leftTangent.dimensions > 0 || rightTangent.dimensions > 0) {
+			if (integer) { b = PromoteOperand(right, length); }
+			ComplexOperand da = PromoteOperand(leftTangent, length), db = PromoteOperand(rightTangent, length);
+			*tangent = CreateVectorArray(2, length);
+			scalar_t * restrict tr = tangent->xyzw[0], * restrict ti = tangent->xyzw[1];
+			for (uint32_t j = 0; j < length; j++) {
+				scalar_t xr, xi, yr, yi;
+				switch (operator) {
+					case OperatorAdd: tr[j] = da.re[j] + db.re[j]; ti[j] = da.im[j] + db.im[j]; break;
+					case OperatorSubtract: tr[j] = da.re[j] - db.re[j]; ti[j] = da.im[j] - db.im[j]; break;
+					case OperatorMultiply:
+						// da b + a db
+						complex_mul(da.re[j], da.im[j], b.re[j], b.im[j], &xr, &xi);
+						complex_mul(a.re[j], a.im[j], db.re[j], db.im[j], &yr, &yi);
+						tr[j] = xr + yr;
+						ti[j] = xi + yi;
+						break;
+					case OperatorDivide:
+						// (da - r db) / b
+						complex_mul(rr[j], ri[j], db.re[j], db.im[j], &xr, &xi);
+						complex_div(da.re[j] - xr, da.im[j] - xi, b.re[j], b.im[j], &tr[j], &ti[j]);
+						break;
+					case OperatorPower:
+						// b a^(b - 1) da + r ln(a) db, each term left out when its derivative is zero
+						tr[j] = ti[j] = 0.0;
+						if (da.re[j] != 0.0 || da.im[j] != 0.0) {
+							if (a.re[j] == 0.0 && a.im[j] == 0.0) { complex_pow(a.re[j], a.im[j], b.re[j] - 1.0, b.im[j], &xr, &xi); }
+							else { complex_div(rr[j], ri[j], a.re[j], a.im[j], &xr, &xi); }
+							complex_mul(xr, xi, b.re[j], b.im[j], &xr, &xi);
+							complex_mul(xr, xi, da.re[j], da.im[j], &tr[j], &ti[j]);
+						}
+						if (db.re[j] != 0.0 || db.im[j] != 0.0) {
+							complex_mul(rr[j], ri[j], log(hypot(a.re[j], a.im[j])), atan2(a.im[j], a.re[j]), &xr, &xi);
+							complex_mul(xr, xi, db.re[j], db.im[j], &yr, &yi);
+							tr[j] += yr;
+							ti[j] += yi;
+						}
+						break;
+					default: tr[j] = ti[j] = 0.0; break;
+				}
+			}
+			FreeVectorArray(da.storage);
+			FreeVectorArray(db.storage);
+		}
+	}
+	FreeVectorArray(a.storage);
+	FreeVectorArray(b.storage);
+	return RuntimeErrorCodeNone;
+}
+
+bool EvaluateComplexFunction(BuiltinFunction function, VectorArray * result, VectorArray * tangent) {
+	// the analytic builtins, each element's tangent is multiplied by the complex derivative
+	switch (function) {
+		case BuiltinFunctionABS:
+		case BuiltinFunctionCOS:
+		case BuiltinFunctionEXP:
+		case BuiltinFunctionLN:
+		case BuiltinFunctionSIN:
+		case BuiltinFunctionSQRT: break;
+		default: return false;
+	}
+
+	uint32_t length = result->length;
+	bool differentiate = tangent != NULL && tangent->dimensions > 0;
+	if (differentiate && (tangent->dimensions != 2 || tangent->length != length)) {
+		ComplexOperand promoted = PromoteOperand(*tangent, length);
+		FreeVectorArray(*tangent);
+		*tangent = promoted.storage;
+	}
+	scalar_t * restrict re = result->xyzw[0], * restrict im = result->xyzw[1];
+	scalar_t * restrict tr = differentiate ? tangent->xyzw[0] : NULL, * restrict ti = differentiate ? tangent->xyzw[1] : NULL;
+
+	if (function == BuiltinFunctionABS) {
+		// the modulus, a real array
+		for (uint32_t j = 0; j < length; j++) {
+			scalar_t m = hypot(re[j], im[j]);
+			if (differentiate) { tr[j] = (re[j] * tr[j] + im[j] * ti[j]) / m; }
+			re[j] = m;
+		}
+		result->dimensions = 1;
+		result->kind = NumberKindReal;
+		if (differentiate) { tangent->dimensions = 1; }
+		return true;
+	}
+
+	for (uint32_t j = 0; j < length; j++) {
+		scalar_t x = re[j], y = im[j], fr, fi, dr, di;
+		switch (function) {
+			case BuiltinFunctionCOS:
+				fr = cos(x) * cosh(y);
+				fi = -sin(x) * sinh(y);
+				dr = -sin(x) * cosh(y);
+				di = -cos(x) * sinh(y);
+				break;
+			case BuiltinFunctionEXP: {
+				scalar_t m = exp(x);
+				fr = dr = m * cos(y);
+				fi = di = m * sin(y);
+				break;
+			}
+			case BuiltinFunctionLN:
+				fr = log(hypot(x, y));
+				fi = atan2(y, x);
+				complex_div(1.0, 0.0, x, y, &dr, &di);
+				break;
+			case BuiltinFunctionSIN:
+				fr = sin(x) * cosh(y);
+				fi = cos(x) * sinh(y);
+				dr = cos(x) * cosh(y);
+				di = -sin(x) * sinh(y);
+				break;
+			default: {
+				// principal root, computed from the modulus so it stays accurate near the negative real axis
+				scalar_t t = sqrt(0.5 * (hypot(x, y) + fabs(x)));
+				if (t == 0.0) { fr = fi = 0.0; }
+				else if (x >= 0.0) { fr = t; fi = 0.5 * y / t; }
+				else { fr = 0.5 * fabs(y) / t; fi = copysign(t, y); }
+				complex_div(0.5, 0.0, fr, fi, &dr, &di);
+				break;
+			}
+		}
+		if (differentiate) { complex_mul(tr[j], ti[j], dr, di, &tr[j], &ti[j]); }
+		re[j] = fr;
+		im[j] = fi;
+	}
+	return true;
+}
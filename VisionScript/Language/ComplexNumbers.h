@@ -0,0 +1,13 @@
+#ifndef ComplexNumbers_h
+#define ComplexNumbers_h
+
+#include "Builtin.h"
+
+// complex arrays are two channel arrays marked NumberKindComplex, the real part in x and the imaginary part in y,
+// real operands of length one or one dimension are promoted with a zero imaginary part
+
+bool IsComplexOperator(Operator operator);
+RuntimeErrorCode EvaluateComplexArithmetic(Operator operator, VectorArray left, VectorArray right, VectorArray leftTangent, VectorArray rightTangent, VectorArray * result, VectorArray * tangent);
+bool EvaluateComplexFunction(BuiltinFunction function, VectorArray * result, VectorArray * tangent);
+
+#endif
@@ -0,0 +1,1186 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "Derivative.h"
+#include "Builtin.h"
+
+static Expression * Allocate(Expression expression) {
+	Expression * allocated = malloc(sizeof(Expression));
+	*allocated = expression;
+	return allocated;
+}
+
+// an expression of type unknown stands for a derivative that is identically zero
+static Expression Zero(void) { return (Expression){ .type = ExpressionTypeUnknown }; }
+
+static bool IsZero(Expression expression) { return expression.type == ExpressionTypeUnknown; }
+
+static bool IsConstant(Expression expression, double value) { return expression.type == ExpressionTypeConstant && expression.constant == value; }
+
+static Expression Constant(double value, Expression origin) {
+	return (Expression){ .type = ExpressionTypeConstant, .constant = value, .start = origin.start, .end = origin.end, .line = origin.line };
+}
+
+static Expression Identifier(const char * identifier, Expression origin) {
+	return (Expression){ .type = ExpressionTypeIdentifier, .identifier = StringCreate(identifier), .start = origin.start, .end = origin.end, .line = origin.line };
+}
+
+static Expression UnaryNode(Operator operator, Expression expression, Expression origin) {
+	return (Expression){ .type = ExpressionTypeUnary, .unary = { operator, Allocate(expression) }, .start = origin.start, .end = origin.end, .line = origin.line };
+}
+
+static Expression BinaryNode(Operator operator, Expression left, Expression right, Expression origin) {
+	return (Expression){ .type = ExpressionTypeBinary, .binary = { operator, Allocate(left), Allocate(right) }, .start = origin.start, .end = origin.end, .line = origin.line };
+}
+
+static Expression Call(const char * identifier, List(Expression) arguments, Expression origin) {
+	Expression list = { .type = ExpressionTypeArguments, .list = arguments, .start = origin.start, .end = origin.end, .line = origin.line };
+	return BinaryNode(OperatorCallStart, Identifier(identifier, origin), list, origin);
+}
+
+static Expression Call1(const char * identifier, Expression a, Expression origin) {
+	List(Expression) arguments = ListCreate(sizeof(Expression), 1);
+	arguments = ListPush(arguments, &a);
+	return Call(identifier, arguments, origin);
+}
+
+static Expression Call2(const char * identifier, Expression a, Expression b, Expression origin) {
+	List(Expression) arguments = ListCreate(sizeof(Expression), 2);
+	arguments = ListPush(arguments, &a);
+	arguments = ListPush(arguments, &b);
+	return Call(identifier, arguments, origin);
+}
+
+static Expression Add(Expression a, Expression b, Expression origin) { return BinaryNode(OperatorAdd, a, b, origin); }
+static Expression Sub(Expression a, Expression b, Expression origin) { return BinaryNode(OperatorSubtract, a, b, origin); }
+static Expression Mul(Expression a, Expression b, Expression origin) { return BinaryNode(OperatorMultiply, a, b, origin); }
+static Expression Div(Expression a, Expression b, Expression origin) { return BinaryNode(OperatorDivide, a, b, origin); }
+static Expression Pow(Expression a, Expression b, Expression origin) { return BinaryNode(OperatorPower, a, b, origin); }
+static Expression Neg(Expression a, Expression origin) { return UnaryNode(OperatorNegate, a, origin); }
+static Expression Num(double value, Expression origin) { return Constant(value, origin); }
+
+static Expression Index(Expression a, Expression index, Expression origin) {
+	// a[index], with the brackets kept as an array literal like the parser does
+	List(Expression) list = ListCreate(sizeof(Expression), 1);
+	list = ListPush(list, &index);
+	Expression indices = { .type = ExpressionTypeArrayLiteral, .list = list, .start = origin.start, .end = origin.end, .line = origin.line };
+	return BinaryNode(OperatorIndexStart, a, indices, origin);
+}
+
+static Expression ZeroLike(Expression expression) {
+	// an explicit zero with the same shape as expression
+	if (expression.type == ExpressionTypeConstant) { return Constant(0.0, expression); }
+	Expression copy = CopyExpression(expression);
+	if ((copy.type == ExpressionTypeBinary && (copy.binary.operator == OperatorRange || copy.binary.operator == OperatorFor)) || (copy.type == ExpressionTypeTernary && copy.ternary.leftOperator == OperatorFor)) {
+		List(Expression) list = ListCreate(sizeof(Expression), 1);
+		list = ListPush(list, &copy);
+		copy = (Expression){ .type = ExpressionTypeArrayLiteral, .list = list, .start = expression.start, .end = expression.end, .line = expression.line };
+	}
+	return Mul(Constant(0.0, expression), copy, expression);
+}
+
+static Expression Materialize(Expression derivative, Expression expression) {
+	return IsZero(derivative) ? ZeroLike(expression) : derivative;
+}
+
+static Expression Broadcast(Expression derivative, Expression other) {
+	// dropping the zero derivative of other can't shrink the result if other is a scalar constant, otherwise keep its shape around
+	if (other.type == ExpressionTypeConstant) { return derivative; }
+	return Add(derivative, ZeroLike(other), other);
+}
+
+static Expression Sum(Expression a, Expression b, Expression origin) {
+	if (IsZero(a)) { return b; }
+	if (IsZero(b)) { return a; }
+	return Add(a, b, origin);
+}
+
+static int32_t FindVariable(List(String) variables, const char * identifier) {
+	for (int32_t i = 0; i < ListLength(variables); i++) {
+		if (StringEquals(variables[i], identifier)) { return i; }
+	}
+	return -1;
+}
+
+static bool DependsOn(Expression expression, List(String) variables) {
+	switch (expression.type) {
+		case ExpressionTypeIdentifier: return FindVariable(variables, expression.identifier) >= 0;
+		case ExpressionTypeVectorLiteral:
+		case ExpressionTypeArrayLiteral:
+		case ExpressionTypeArguments:
+			for (int32_t i = 0; i < ListLength(expression.list); i++) {
+				if (DependsOn(expression.list[i], variables)) { return true; }
+			}
+			return false;
+		case ExpressionTypeForAssignment: return DependsOn(*expression.assignment.expression, variables);
+		case ExpressionTypeUnary: return DependsOn(*expression.unary.expression, variables);
+		case ExpressionTypeBinary: return DependsOn(*expression.binary.left, variables) || DependsOn(*expression.binary.right, variables);
+		case ExpressionTypeTernary: return DependsOn(*expression.ternary.left, variables) || DependsOn(*expression.ternary.middle, variables) || DependsOn(*expression.ternary.right, variables);
+		case ExpressionTypeWhere:
+			for (int32_t i = 0; i < ListLength(expression.where.bindings); i++) {
+				if (DependsOn(expression.where.bindings[i], variables)) { return true; }
+			}
+			return DependsOn(*expression.where.expression, variables);
+		default: return false;
+	}
+}
+
+static SyntaxError EnsureDerivative(Environment * environment, const char * identifier, Expression origin);
+static SyntaxError EnsureTangent(Environment * environment, const char * identifier);
+
+static SyntaxError Differentiate(Environment * environment, List(String) variables, List(Expression) seeds, Expression expression, Expression * derivative);
+
+static SyntaxError DifferentiateList(Environment * environment, List(String) variables, List(Expression) seeds, Expression expression, Expression * derivative) {
+	List(Expression) list = ListCreate(sizeof(Expression), ListLength(expression.list) + 1);
+	bool zero = true;
+	for (int32_t i = 0; i < ListLength(expression.list); i++) {
+		Expression element;
+		SyntaxError error = Differentiate(environment, variables, seeds, expression.list[i], &element);
+		if (error.code != SyntaxErrorCodeNone) {
+			for (int32_t j = 0; j < ListLength(list); j++) { FreeExpression(list[j]); }
+			ListFree(list);
+			return error;
+		}
+		if (!IsZero(element)) { zero = false; }
+		list = ListPush(list, &element);
+	}
+
+	// components that don't change still need to be present to keep the dimensions and lengths intact
+	if (zero) {
+		ListFree(list);
+		*derivative = Zero();
+		return (SyntaxError){ SyntaxErrorCodeNone };
+	}
+	for (int32_t i = 0; i < ListLength(list); i++) { list[i] = Materialize(list[i], expression.list[i]); }
+	*derivative = expression;
+	derivative->list = list;
+	return (SyntaxError){ SyntaxErrorCodeNone };
+}
+
+static SyntaxError DifferentiateLoop(Environment * environment, List(String) variables, List(Expression) seeds, Expression body, Expression assignment, Expression * derivative) {
+	// the loop variable is only constant if what it iterates over is
+	if (DependsOn(*assignment.assignment.expression, variables)) {
+		return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, assignment.start, assignment.end, assignment.line };
+	}
+	List(String) innerVariables = ListClone(variables);
+	List(Expression) innerSeeds = ListClone(seeds);
+	int32_t shadowed = FindVariable(innerVariables, assignment.assignment.identifier);
+	if (shadowed >= 0) {
+		innerVariables = ListRemove(innerVariables, shadowed);
+		innerSeeds = ListRemove(innerSeeds, shadowed);
+	}
+	SyntaxError error = Differentiate(environment, innerVariables, innerSeeds, body, derivative);
+	ListFree(innerVariables);
+	ListFree(innerSeeds);
+	return error;
+}
+
+static SyntaxError DifferentiateUnary(Environment * environment, List(String) variables, List(Expression) seeds, Expression expression, Expression * derivative) {
+	Expression u = *expression.unary.expression, du;
+	SyntaxError error = Differentiate(environment, variables, seeds, u, &du);
+	if (error.code != SyntaxErrorCodeNone) { return error; }
+	if (IsZero(du) || expression.unary.operator == OperatorNot) {
+		if (!IsZero(du)) { FreeExpression(du); }
+		*derivative = Zero();
+		return (SyntaxError){ SyntaxErrorCodeNone };
+	}
+
+	switch (expression.unary.operator) {
+		case OperatorNegate: *derivative = Neg(du, expression); break;
+		case OperatorFactorial: *derivative = Mul(Mul(CopyExpression(expression), Call1("digamma", Add(CopyExpression(u), Num(1.0, u), u), u), expression), du, expression); break;
+		default:
+			FreeExpression(du);
+			return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.start, expression.end, expression.line };
+	}
+	return (SyntaxError){ SyntaxErrorCodeNone };
+}
+
+static SyntaxError DifferentiateArithmetic(Expression expression, Expression da, Expression db, Expression * derivative) {
+	Expression a = *expression.binary.left, b = *expression.binary.right;
+	switch (expression.binary.operator) {
+		case OperatorAdd:
+			if (IsZero(da)) { *derivative = Broadcast(db, a); }
+			else if (IsZero(db)) { *derivative = Broadcast(da, b); }
+			else { *derivative = Add(da, db, expression); }
+			break;
+		case OperatorSubtract:
+			if (IsZero(da)) { *derivative = Broadcast(Neg(db, b), a); }
+			else if (IsZero(db)) { *derivative = Broadcast(da, b); }
+			else { *derivative = Sub(da, db, expression); }
+			break;
+		case OperatorMultiply: {
+			Expression left = IsZero(da) ? Zero() : Mul(da, CopyExpression(b), expression);
+			Expression right = IsZero(db) ? Zero() : Mul(CopyExpression(a), db, expression);
+			*derivative = Sum(left, right, expression);
+			break;
+		}
+		case OperatorDivide:
+			if (IsZero(db)) { *derivative = Div(da, CopyExpression(b), expression); }
+			else {
+				Expression numerator = IsZero(da) ? Neg(Mul(CopyExpression(a), db, expression), expression) : Sub(Mul(da, CopyExpression(b), expression), Mul(CopyExpression(a), db, expression), expression);
+				*derivative = Div(numerator, Pow(CopyExpression(b), Num(2.0, b), b), expression);
+			}
+			break;
+		case OperatorModulo: {
+			// a % b = a - b * trunc(a / b), and trunc(a / b) = (a - a % b) / b
+			if (IsZero(db)) { *derivative = Broadcast(da, b); break; }
+			Expression quotient = Div(Sub(CopyExpression(a), CopyExpression(expression), expression), CopyExpression(b), expression);
+			Expression right = Mul(db, quotient, expression);
+			*derivative = IsZero(da) ? Neg(right, expression) : Sub(da, right, expression);
+			break;
+		}
+		case OperatorPower: {
+			Expression left = Zero(), right = Zero();
+			if (!IsZero(da)) {
+				Expression exponent = Sub(CopyExpression(b), Num(1.0, b), b);
+				left = Mul(Mul(CopyExpression(b), Pow(CopyExpression(a), exponent, expression), expression), da, expression);
+			}
+			if (!IsZero(db)) { right = Mul(Mul(CopyExpression(expression), Call1("ln", CopyExpression(a), a), expression), db, expression); }
+			*derivative = Sum(left, right, expression);
+			break;
+		}
+		default:
+			// comparisons are piecewise constant
+			if (!IsZero(da)) { FreeExpression(da); }
+			if (!IsZero(db)) { FreeExpression(db); }
+			*derivative = Zero();
+			break;
+	}
+	return (SyntaxError){ SyntaxErrorCodeNone };
+}
+
+static bool ElementwiseDerivative(BuiltinFunction function, Expression u, Expression origin, Expression * derivative) {
+	// derivative of an element-wise builtin evaluated at u, returns false if the function isn't element-wise
+	Expression o = origin;
+	#define U CopyExpression(u)
+	switch (function) {
+		case BuiltinFunctionSIN: *derivative = Call1("cos", U, o); return true;
+		case BuiltinFunctionCOS: *derivative = Neg(Call1("sin", U, o), o); return true;
+		case BuiltinFunctionTAN: *derivative = Pow(Call1("sec", U, o), Num(2.0, o), o); return true;
+		case BuiltinFunctionASIN: *derivative = Div(Num(1.0, o), Call1("sqrt", Sub(Num(1.0, o), Pow(U, Num(2.0, o), o), o), o), o); return true;
+		case BuiltinFunctionACOS: *derivative = Div(Num(-1.0, o), Call1("sqrt", Sub(Num(1.0, o), Pow(U, Num(2.0, o), o), o), o), o); return true;
+		case BuiltinFunctionATAN: *derivative = Div(Num(1.0, o), Add(Num(1.0, o), Pow(U, Num(2.0, o), o), o), o); return true;
+		case BuiltinFunctionSEC: *derivative = Mul(Call1("sec", U, o), Call1("tan", U, o), o); return true;
+		case BuiltinFunctionCSC: *derivative = Neg(Mul(Call1("csc", U, o), Call1("cot", U, o), o), o); return true;
+		case BuiltinFunctionCOT: *derivative = Neg(Pow(Call1("csc", U, o), Num(2.0, o), o), o); return true;
+		case BuiltinFunctionASEC: *derivative = Div(Num(1.0, o), Mul(Call1("abs", U, o), Call1("sqrt", Sub(Pow(U, Num(2.0, o), o), Num(1.0, o), o), o), o), o); return true;
+		case BuiltinFunctionACSC: *derivative = Div(Num(-1.0, o), Mul(Call1("abs", U, o), Call1("sqrt", Sub(Pow(U, Num(2.0, o), o), Num(1.0, o), o), o), o), o); return true;
+		case BuiltinFunctionACOT: *derivative = Div(Num(-1.0, o), Add(Num(1.0, o), Pow(U, Num(2.0, o), o), o), o); return true;
+		case BuiltinFunctionSINH: *derivative = Call1("cosh", U, o); return true;
+		case BuiltinFunctionCOSH: *derivative = Call1("sinh", U, o); return true;
+		case BuiltinFunctionTANH: *derivative = Pow(Call1("sech", U, o), Num(2.0, o), o); return true;
+		case BuiltinFunctionASINH: *derivative = Div(Num(1.0, o), Call1("sqrt", Add(Pow(U, Num(2.0, o), o), Num(1.0, o), o), o), o); return true;
+		case BuiltinFunctionACOSH: *derivative = Div(Num(1.0, o), Call1("sqrt", Sub(Pow(U, Num(2.0, o), o), Num(1.0, o), o), o), o); return true;
+		case BuiltinFunctionATANH: *derivative = Div(Num(1.0, o), Sub(Num(1.0, o), Pow(U, Num(2.0, o), o), o), o); return true;
+		case BuiltinFunctionSECH: *derivative = Neg(Mul(Call1("sech", U, o), Call1("tanh", U, o), o), o); return true;
+		case BuiltinFunctionCSCH: *derivative = Neg(Mul(Call1("csch", U, o), Call1("coth", U, o), o), o); return true;
+		case BuiltinFunctionCOTH: *derivative = Neg(Pow(Call1("csch", U, o), Num(2.0, o), o), o); return true;
+		case BuiltinFunctionASECH: *derivative = Div(Num(-1.0, o), Mul(U, Call1("sqrt", Sub(Num(1.0, o), Pow(U, Num(2.0, o), o), o), o), o), o); return true;
+		case BuiltinFunctionACSCH: *derivative = Div(Num(-1.0, o), Mul(Call1("abs", U, o), Call1("sqrt", Add(Num(1.0, o), Pow(U, Num(2.0, o), o), o), o), o), o); return true;
+		case BuiltinFunctionACOTH: *derivative = Div(Num(1.0, o), Sub(Num(1.0, o), Pow(U, Num(2.0, o), o), o), o); return true;
+		case BuiltinFunctionABS: *derivative = Call1("sign", U, o); return true;
+		case BuiltinFunctionCBRT: *derivative = Div(Num(1.0, o), Mul(Num(3.0, o), Pow(Call1("cbrt", U, o), Num(2.0, o), o), o), o); return true;
+		case BuiltinFunctionERF: *derivative = Mul(Num(M_2_SQRTPI, o), Call1("exp", Neg(Pow(U, Num(2.0, o), o), o), o), o); return true;
+		case BuiltinFunctionEXP: *derivative = Call1("exp", U, o); return true;
+		case BuiltinFunctionFACTORIAL: *derivative = Mul(Call1("factorial", U, o), Call1("digamma", Add(U, Num(1.0, o), o), o), o); return true;
+		case BuiltinFunctionGAMMA: *derivative = Mul(Call1("gamma", U, o), Call1("digamma", U, o), o); return true;
+		case BuiltinFunctionLN: *derivative = Div(Num(1.0, o), U, o); return true;
+		case BuiltinFunctionLOG10: *derivative = Div(Num(1.0, o), Mul(U, Num(M_LN10, o), o), o); return true;
+		case BuiltinFunctionLOG2: *derivative = Div(Num(1.0, o), Mul(U, Num(M_LN2, o), o), o); return true;
+		case BuiltinFunctionSQRT: *derivative = Div(Num(0.5, o), Call1("sqrt", U, o), o); return true;
+		default: return false;
+	}
+	#undef U
+}
+
+static Expression ProductDerivative(const char * product, const char * sum, Expression u, Expression du, Expression o) {
+	// zeros are swapped for ones so nothing is divided by them, with one zero only that element moves the product and with more it stays 0,
+	// cumprod counts the zeros with a running sum instead
+	Expression zeros = BinaryNode(OperatorEqual, CopyExpression(u), Num(0.0, o), o);
+	Expression nonzero = Add(CopyExpression(u), CopyExpression(zeros), o);
+	Expression count = Call1(sum, CopyExpression(zeros), o);
+	Expression none = Mul(BinaryNode(OperatorEqual, CopyExpression(count), Num(0.0, o), o), Call1(sum, Div(CopyExpression(du), CopyExpression(nonzero), o), o), o);
+	Expression one = Mul(BinaryNode(OperatorEqual, count, Num(1.0, o), o), Call1(sum, Mul(du, zeros, o), o), o);
+	return Mul(Call1(product, nonzero, o), Add(none, one, o), o);
+}
+
+static SyntaxError DifferentiateBuiltin(BuiltinFunction function, Expression expression, List(Expression) derivatives, Expression * derivative) {
+	List(Expression) args = expression.binary.right->list;
+	Expression o = expression;
+	*derivative = Zero();
+
+	// piecewise constant functions
+	if (function == BuiltinFunctionCEIL || function == BuiltinFunctionFLOOR || function == BuiltinFunctionROUND || function == BuiltinFunctionSIGN ||
+		function == BuiltinFunctionARGMAX || function == BuiltinFunctionARGMIN || function == BuiltinFunctionARGSORT || function == BuiltinFunctionCOUNT ||
+		function == BuiltinFunctionGROUPCOUNT || function == BuiltinFunctionRAND || function == BuiltinFunctionRANDDISK || function == BuiltinFunctionRANDN ||
+		function == BuiltinFunctionNEAREST || function == BuiltinFunctionWITHIN) {
+		for (int32_t i = 0; i < ListLength(derivatives); i++) { if (!IsZero(derivatives[i])) { FreeExpression(derivatives[i]); } }
+		return (SyntaxError){ SyntaxErrorCodeNone };
+	}
+
+	bool zero = true;
+	for (int32_t i = 0; i < ListLength(derivatives); i++) { if (!IsZero(derivatives[i])) { zero = false; } }
+	if (zero) { return (SyntaxError){ SyntaxErrorCodeNone }; }
+
+	if (IsFunctionSingleArgument(function)) {
+		if (ListLength(args) != 1) {
+			for (int32_t i = 0; i < ListLength(derivatives); i++) { if (!IsZero(derivatives[i])) { FreeExpression(derivatives[i]); } }
+			return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.start, expression.end, expression.line };
+		}
+		Expression u = args[0], du = derivatives[0];
+		#define U CopyExpression(u)
+		Expression fu;
+		if (ElementwiseDerivative(function, u, o, &fu)) {
+			*derivative = Mul(fu, du, o);
+			return (SyntaxError){ SyntaxErrorCodeNone };
+		}
+		switch (function) {
+			case BuiltinFunctionSUM: *derivative = Call1("sum", du, o); break;
+			case BuiltinFunctionMEAN: *derivative = Call1("mean", du, o); break;
+			case BuiltinFunctionMEDIAN: {
+				// the two middle tangents once they're in the order of u, which has to have one channel to be sorted by
+				Expression sorted = Call2("sort", Broadcast(du, u), U, o);
+				Expression lower = Call1("floor", Div(Sub(Call1("count", U, o), Num(1.0, o), o), Num(2.0, o), o), o);
+				Expression upper = Call1("floor", Div(Call1("count", U, o), Num(2.0, o), o), o);
+				*derivative = Div(Add(Index(CopyExpression(sorted), lower, o), Index(sorted, upper, o), o), Num(2.0, o), o);
+				break;
+			}
+			case BuiltinFunctionGRAD: *derivative = Call1("grad", Broadcast(du, u), o); break;
+			case BuiltinFunctionLAPLACIAN: *derivative = Call1("laplacian", Broadcast(du, u), o); break;
+			case BuiltinFunctionPROD: *derivative = ProductDerivative("prod", "sum", u, du, o); break;
+			case BuiltinFunctionVAR: *derivative = Mul(Num(2.0, o), Call1("mean", Mul(Sub(U, Call1("mean", U, o), o), du, o), o), o); break;
+			case BuiltinFunctionSTDEV: *derivative = Div(Call1("mean", Mul(Sub(U, Call1("mean", U, o), o), du, o), o), Call1("stdev", U, o), o); break;
+			case BuiltinFunctionLENGTH: *derivative = Div(Call2("dot", U, du, o), Call1("length", U, o), o); break;
+			case BuiltinFunctionLENGTHSQ: *derivative = Mul(Num(2.0, o), Call2("dot", U, du, o), o); break;
+			case BuiltinFunctionMATRIX: *derivative = Call1("matrix", Broadcast(du, u), o); break;
+			case BuiltinFunctionTRACE: *derivative = Call1("trace", Broadcast(du, u), o); break;
+			case BuiltinFunctionTRANSPOSE: *derivative = Call1("transpose", Broadcast(du, u), o); break;
+			case BuiltinFunctionCUMSUM: *derivative = Call1("cumsum", Broadcast(du, u), o); break;
+			case BuiltinFunctionCUMPROD: *derivative = ProductDerivative("cumprod", "cumsum", u, du, o); break;
+			case BuiltinFunctionDIFF: *derivative = Call1("diff", Broadcast(du, u), o); break;
+			case BuiltinFunctionFFT: *derivative = Call1("fft", Broadcast(du, u), o); break;
+			case BuiltinFunctionIFFT: *derivative = Call1("ifft", Broadcast(du, u), o); break;
+			case BuiltinFunctionINVERSE: {
+				// -M^-1 dM M^-1
+				Expression left = Call2("mul", Call1("inverse", U, o), Call1("matrix", Broadcast(du, u), o), o);
+				*derivative = Neg(Call2("mul", left, Call1("inverse", U, o), o), o);
+				break;
+			}
+			case BuiltinFunctionDET: {
+				// Jacobi's formula, det(M) trace(M^-1 dM)
+				Expression product = Call2("mul", Call1("inverse", U, o), Call1("matrix", Broadcast(du, u), o), o);
+				*derivative = Mul(Call1("det", U, o), Call1("trace", product, o), o);
+				break;
+			}
+			case BuiltinFunctionNORMALIZE: {
+				Expression projection = Mul(Call1("normalize", U, o), Call2("dot", Call1("normalize", U, o), CopyExpression(du), o), o);
+				*derivative = Div(Sub(du, projection, o), Call1("length", U, o), o);
+				break;
+			}
+			default:
+				FreeExpression(du);
+				return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.start, expression.end, expression.line };
+		}
+		#undef U
+		return (SyntaxError){ SyntaxErrorCodeNone };
+	}
+
+	// linear in every argument
+	if (function == BuiltinFunctionJOIN || function == BuiltinFunctionINTERLEAVE) {
+		List(Expression) list = ListCreate(sizeof(Expression), ListLength(args));
+		for (int32_t i = 0; i < ListLength(args); i++) {
+			Expression argument = Materialize(derivatives[i], args[i]);
+			list = ListPush(list, &argument);
+		}
+		*derivative = Call(function == BuiltinFunctionJOIN ? "join" : "interleave", list, o);
+		return (SyntaxError){ SyntaxErrorCodeNone };
+	}
+
+	// the tangent of the element picked, argmin and argmax find the same first one of equal elements
+	if (function == BuiltinFunctionMIN || function == BuiltinFunctionMAX) {
+		List(Expression) values = ListCreate(sizeof(Expression), ListLength(args));
+		List(Expression) tangents = ListCreate(sizeof(Expression), ListLength(args));
+		for (int32_t i = 0; i < ListLength(args); i++) {
+			Expression value = CopyExpression(args[i]);
+			Expression tangent = IsZero(derivatives[i]) ? ZeroLike(args[i]) : Broadcast(derivatives[i], args[i]);
+			values = ListPush(values, &value);
+			tangents = ListPush(tangents, &tangent);
+		}
+		Expression index = Call1(function == BuiltinFunctionMIN ? "argmin" : "argmax", Call("join", values, o), o);
+		*derivative = Index(Call("join", tangents, o), index, o);
+		return (SyntaxError){ SyntaxErrorCodeNone };
+	}
+
+	// the elements only move, so the tangents move with them, the keys are piecewise constant
+	if (function == BuiltinFunctionSORT && (ListLength(args) == 1 || ListLength(args) == 2)) {
+		if (ListLength(args) == 2 && !IsZero(derivatives[1])) { FreeExpression(derivatives[1]); }
+		if (IsZero(derivatives[0])) { return (SyntaxError){ SyntaxErrorCodeNone }; }
+		if (ListLength(args) == 2) { *derivative = Call2("sort", Broadcast(derivatives[0], args[0]), CopyExpression(args[1]), o); }
+		else {
+			// sort(x) orders the first channel of x by itself
+			Expression values = BinaryNode(OperatorDimension, Broadcast(derivatives[0], args[0]), Identifier("x", o), o);
+			*derivative = Call2("sort", values, BinaryNode(OperatorDimension, CopyExpression(args[0]), Identifier("x", o), o), o);
+		}
+		return (SyntaxError){ SyntaxErrorCodeNone };
+	}
+
+	if (ListLength(args) == 2) {
+		Expression a = args[0], b = args[1], da = derivatives[0], db = derivatives[1];
+		#define A CopyExpression(a)
+		#define B CopyExpression(b)
+		switch (function) {
+			case BuiltinFunctionATAN2: {
+				// atan2(y, x)' = (x y' - y x') / (x^2 + y^2)
+				Expression numerator = Sum(IsZero(da) ? Zero() : Mul(B, da, o), IsZero(db) ? Zero() : Neg(Mul(A, db, o), o), o);
+				*derivative = Div(numerator, Add(Pow(A, Num(2.0, o), o), Pow(B, Num(2.0, o), o), o), o);
+				break;
+			}
+			case BuiltinFunctionLOG: {
+				// log(a, b) = ln(b) / ln(a)
+				Expression left = IsZero(db) ? Zero() : Div(db, B, o);
+				Expression right = IsZero(da) ? Zero() : Neg(Mul(CopyExpression(expression), Div(da, A, o), o), o);
+				*derivative = Div(Sum(left, right, o), Call1("ln", A, o), o);
+				break;
+			}
+			case BuiltinFunctionCORR: {
+				// corr(a, b) = cov(a, b) / sqrt(cov(a, a) cov(b, b)), the quotient rule leaves corr(a, b) times the relative
+				// change of the variances
+				Expression dA = IsZero(da) ? Zero() : Broadcast(da, a), dB = IsZero(db) ? Zero() : Broadcast(db, b);
+				Expression numerator = Sum(IsZero(dA) ? Zero() : Call2("cov", CopyExpression(dA), B, o), IsZero(dB) ? Zero() : Call2("cov", A, CopyExpression(dB), o), o);
+				Expression left = Div(numerator, Call1("sqrt", Mul(Call2("cov", A, A, o), Call2("cov", B, B, o), o), o), o);
+				Expression varianceA = IsZero(dA) ? Zero() : Div(Call2("cov", A, dA, o), Call2("cov", A, A, o), o);
+				Expression varianceB = IsZero(dB) ? Zero() : Div(Call2("cov", B, dB, o), Call2("cov", B, B, o), o);
+				*derivative = Sub(left, Mul(CopyExpression(expression), Sum(varianceA, varianceB, o), o), o);
+				break;
+			}
+			case BuiltinFunctionQUANTILE: {
+				// interpolated between the tangents at the two ranks around each quantile, in the order of a, which has to have
+				// one channel to be sorted by, and the quantiles move along the slope between the two elements
+				Expression n = Sub(Call1("count", A, o), Num(1.0, o), o);
+				Expression rank = Mul(B, CopyExpression(n), o);
+				Expression lower = Call1("floor", CopyExpression(rank), o), upper = Call1("ceil", CopyExpression(rank), o);
+				Expression t = Sub(rank, CopyExpression(lower), o);
+				Expression left = Zero(), right = Zero();
+				if (!IsZero(da)) {
+					Expression sorted = Call2("sort", Broadcast(da, a), A, o);
+					Expression below = Mul(Index(CopyExpression(sorted), CopyExpression(lower), o), Sub(Num(1.0, o), CopyExpression(t), o), o);
+					left = Add(below, Mul(Index(sorted, CopyExpression(upper), o), CopyExpression(t), o), o);
+				}
+				if (!IsZero(db)) {
+					Expression sorted = Call2("sort", A, A, o);
+					Expression slope = Sub(Index(CopyExpression(sorted), CopyExpression(upper), o), Index(sorted, CopyExpression(lower), o), o);
+					right = Mul(Mul(slope, CopyExpression(n), o), db, o);
+				}
+				FreeExpression(n);
+				FreeExpression(lower);
+				FreeExpression(upper);
+				FreeExpression(t);
+				*derivative = Sum(left, right, o);
+				break;
+			}
+			case BuiltinFunctionCOV:
+			case BuiltinFunctionCROSS:
+			case BuiltinFunctionDOT: {
+				// bilinear
+				const char * name = function == BuiltinFunctionCOV ? "cov" : (function == BuiltinFunctionCROSS ? "cross" : "dot");
+				*derivative = Sum(IsZero(da) ? Zero() : Call2(name, da, B, o), IsZero(db) ? Zero() : Call2(name, A, db, o), o);
+				break;
+			}
+			case BuiltinFunctionMUL:
+				// bilinear too, keeping the shape of the other side tells mul whether dB holds matrices or vectors
+				*derivative = Sum(IsZero(da) ? Zero() : Call2("mul", Broadcast(da, a), B, o), IsZero(db) ? Zero() : Call2("mul", A, Broadcast(db, b), o), o);
+				break;
+			case BuiltinFunctionCONVOLVE:
+				// bilinear, each derivative keeps the length of the array it stands in for
+				*derivative = Sum(IsZero(da) ? Zero() : Call2("convolve", Broadcast(da, a), B, o), IsZero(db) ? Zero() : Call2("convolve", A, Broadcast(db, b), o), o);
+				break;
+			case BuiltinFunctionLOWPASS:
+				// linear in the signal, the response to the cutoff has no closed form here
+				if (!IsZero(db)) {
+					FreeExpression(db);
+					if (!IsZero(da)) { FreeExpression(da); }
+					return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.start, expression.end, expression.line };
+				}
+				*derivative = Call2("lowpass", Broadcast(da, a), B, o);
+				break;
+			case BuiltinFunctionGROUPMEAN:
+			case BuiltinFunctionGROUPSUM:
+				// linear in the values, the keys are piecewise constant
+				if (!IsZero(db)) { FreeExpression(db); }
+				if (!IsZero(da)) { *derivative = Call2(function == BuiltinFunctionGROUPMEAN ? "groupmean" : "groupsum", Broadcast(da, a), B, o); }
+				break;
+			case BuiltinFunctionBLUR:
+			case BuiltinFunctionSHIFT: {
+				// linear in the grid, the radius and offset are rounded to whole cells
+				if (!IsZero(db)) { FreeExpression(db); }
+				if (!IsZero(da)) { *derivative = Call2(function == BuiltinFunctionBLUR ? "blur" : "shift", Broadcast(da, a), B, o); }
+				break;
+			}
+			case BuiltinFunctionDIST:
+			case BuiltinFunctionDISTSQ: {
+				Expression difference = IsZero(db) ? da : (IsZero(da) ? Neg(db, o) : Sub(da, db, o));
+				Expression inner = Call2("dot", Sub(A, B, o), difference, o);
+				if (function == BuiltinFunctionDIST) { *derivative = Div(inner, Call2("dist", A, B, o), o); }
+				else { *derivative = Mul(Num(2.0, o), inner, o); }
+				break;
+			}
+			default:
+				if (!IsZero(da)) { FreeExpression(da); }
+				if (!IsZero(db)) { FreeExpression(db); }
+				return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.start, expression.end, expression.line };
+		}
+		#undef A
+		#undef B
+		return (SyntaxError){ SyntaxErrorCodeNone };
+	}
+
+	for (int32_t i = 0; i < ListLength(derivatives); i++) { if (!IsZero(derivatives[i])) { FreeExpression(derivatives[i]); } }
+	return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.start, expression.end, expression.line };
+}
+
+static SyntaxError DifferentiateCall(Environment * environment, List(String) variables, List(Expression) seeds, Expression expression, Expression * derivative) {
+	if (expression.binary.left->type != ExpressionTypeIdentifier || expression.binary.right->type != ExpressionTypeArguments) {
+		return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.start, expression.end, expression.line };
+	}
+	String identifier = expression.binary.left->identifier;
+	List(Expression) args = expression.binary.right->list;
+
+	// derivatives used inside of the function being differentiated have to exist first
+	if (GetEnvironmentEquation(environment, identifier) == NULL && identifier[StringLength(identifier) - 1] == '\'') {
+		SyntaxError error = EnsureDerivative(environment, identifier, *expression.binary.left);
+		if (error.code != SyntaxErrorCodeNone) { return error; }
+	}
+
+	List(Expression) derivatives = ListCreate(sizeof(Expression), ListLength(args) + 1);
+	bool zero = true;
+	for (int32_t i = 0; i < ListLength(args); i++) {
+		Expression argument;
+		SyntaxError error = Differentiate(environment, variables, seeds, args[i], &argument);
+		if (error.code != SyntaxErrorCodeNone) {
+			for (int32_t j = 0; j < ListLength(derivatives); j++) { if (!IsZero(derivatives[j])) { FreeExpression(derivatives[j]); } }
+			ListFree(derivatives);
+			return error;
+		}
+		if (!IsZero(argument)) { zero = false; }
+		derivatives = ListPush(derivatives, &argument);
+	}
+
+	Equation * equation = GetEnvironmentEquation(environment, identifier);
+	if (equation == NULL) {
+		BuiltinFunction function = DetermineBuiltinFunction(identifier);
+		if (function == BuiltinFunctionNone) {
+			for (int32_t j = 0; j < ListLength(derivatives); j++) { if (!IsZero(derivatives[j])) { FreeExpression(derivatives[j]); } }
+			ListFree(derivatives);
+			return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.binary.left->start, expression.binary.left->end, expression.line };
+		}
+		SyntaxError error = DifferentiateBuiltin(function, expression, derivatives, derivative);
+		ListFree(derivatives);
+		return error;
+	}
+
+	if (zero) {
+		ListFree(derivatives);
+		*derivative = Zero();
+		return (SyntaxError){ SyntaxErrorCodeNone };
+	}
+	// a derivative that is still being built has no body to go through yet, like e' in e(x) = e'(x) + 1
+	if (IsZero(equation->expression)) {
+		for (int32_t j = 0; j < ListLength(derivatives); j++) { if (!IsZero(derivatives[j])) { FreeExpression(derivatives[j]); } }
+		ListFree(derivatives);
+		return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.binary.left->start, expression.binary.left->end, expression.line };
+	}
+
+	// chain rule through the directional derivative of the callee
+	SyntaxError error = EnsureTangent(environment, identifier);
+	if (error.code != SyntaxErrorCodeNone) {
+		for (int32_t j = 0; j < ListLength(derivatives); j++) { if (!IsZero(derivatives[j])) { FreeExpression(derivatives[j]); } }
+		ListFree(derivatives);
+		return error;
+	}
+	List(Expression) arguments = ListCreate(sizeof(Expression), 2 * ListLength(args));
+	for (int32_t i = 0; i < 2 * ListLength(args); i++) {
+		Expression argument = i < ListLength(args) ? CopyExpression(args[i]) : Materialize(derivatives[i - ListLength(args)], args[i - ListLength(args)]);
+		arguments = ListPush(arguments, &argument);
+	}
+	ListFree(derivatives);
+	String tangent = StringCreate(identifier);
+	StringConcat(&tangent, "$tangent");
+	*derivative = Call(tangent, arguments, expression);
+	StringFree(tangent);
+	return (SyntaxError){ SyntaxErrorCodeNone };
+}
+
+static SyntaxError DifferentiateBinary(Environment * environment, List(String) variables, List(Expression) seeds, Expression expression, Expression * derivative) {
+	*derivative = Zero();
+	switch (expression.binary.operator) {
+		case OperatorRange: return (SyntaxError){ SyntaxErrorCodeNone };
+		case OperatorFor: {
+			if (expression.binary.right->type != ExpressionTypeForAssignment) { break; }
+			SyntaxError error = DifferentiateLoop(environment, variables, seeds, *expression.binary.left, *expression.binary.right, derivative);
+			if (error.code != SyntaxErrorCodeNone || IsZero(*derivative)) { return error; }
+			*derivative = BinaryNode(OperatorFor, *derivative, CopyExpression(*expression.binary.right), expression);
+			return error;
+		}
+		case OperatorDimension:
+		case OperatorIndexStart: {
+			SyntaxError error = Differentiate(environment, variables, seeds, *expression.binary.left, derivative);
+			if (error.code != SyntaxErrorCodeNone || IsZero(*derivative)) { return error; }
+			*derivative = BinaryNode(expression.binary.operator, *derivative, CopyExpression(*expression.binary.right), expression);
+			return error;
+		}
+		case OperatorCallStart: return DifferentiateCall(environment, variables, seeds, expression, derivative);
+		case OperatorWhen:
+		case OperatorIf:
+		case OperatorElse: break;
+		default: {
+			Expression da, db;
+			SyntaxError error = Differentiate(environment, variables, seeds, *expression.binary.left, &da);
+			if (error.code != SyntaxErrorCodeNone) { return error; }
+			error = Differentiate(environment, variables, seeds, *expression.binary.right, &db);
+			if (error.code != SyntaxErrorCodeNone) {
+				if (!IsZero(da)) { FreeExpression(da); }
+				return error;
+			}
+			if (IsZero(da) && IsZero(db)) { return (SyntaxError){ SyntaxErrorCodeNone }; }
+			return DifferentiateArithmetic(expression, da, db, derivative);
+		}
+	}
+	return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.start, expression.end, expression.line };
+}
+
+static SyntaxError DifferentiateTernary(Environment * environment, List(String) variables, List(Expression) seeds, Expression expression, Expression * derivative) {
+	*derivative = Zero();
+	if (expression.ternary.leftOperator == OperatorIf && expression.ternary.rightOperator == OperatorElse) {
+		// the condition only picks a branch
+		Expression da, db;
+		SyntaxError error = Differentiate(environment, variables, seeds, *expression.ternary.left, &da);
+		if (error.code != SyntaxErrorCodeNone) { return error; }
+		error = Differentiate(environment, variables, seeds, *expression.ternary.right, &db);
+		if (error.code != SyntaxErrorCodeNone) {
+			if (!IsZero(da)) { FreeExpression(da); }
+			return error;
+		}
+		if (IsZero(da) && IsZero(db)) { return error; }
+		*derivative = expression;
+		derivative->ternary.left = Allocate(Materialize(da, *expression.ternary.left));
+		derivative->ternary.middle = Allocate(CopyExpression(*expression.ternary.middle));
+		derivative->ternary.right = Allocate(Materialize(db, *expression.ternary.right));
+		return error;
+	}
+	if (expression.ternary.leftOperator == OperatorFor && expression.ternary.rightOperator == OperatorWhen && expression.ternary.middle->type == ExpressionTypeForAssignment) {
+		SyntaxError error = DifferentiateLoop(environment, variables, seeds, *expression.ternary.left, *expression.ternary.middle, derivative);
+		if (error.code != SyntaxErrorCodeNone || IsZero(*derivative)) { return error; }
+		Expression body = *derivative;
+		*derivative = expression;
+		derivative->ternary.left = Allocate(body);
+		derivative->ternary.middle = Allocate(CopyExpression(*expression.ternary.middle));
+		derivative->ternary.right = Allocate(CopyExpression(*expression.ternary.right));
+		return error;
+	}
+	return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.start, expression.end, expression.line };
+}
+
+static SyntaxError DifferentiateWhere(Environment * environment, List(String) variables, List(Expression) seeds, Expression expression, Expression * derivative) {
+	// each binding that varies gets a companion binding holding its derivative, which seeds it in everything after it
+	List(String) innerVariables = ListClone(variables);
+	List(Expression) innerSeeds = ListClone(seeds);
+	List(Expression) tangentSeeds = ListCreate(sizeof(Expression), 1);
+	List(Expression) bindings = ListCreate(sizeof(Expression), 2 * ListLength(expression.where.bindings) + 1);
+	SyntaxError error = { SyntaxErrorCodeNone };
+	for (int32_t i = 0; i < ListLength(expression.where.bindings); i++) {
+		Expression binding = expression.where.bindings[i], d;
+		error = Differentiate(environment, innerVariables, innerSeeds, *binding.assignment.expression, &d);
+		if (error.code != SyntaxErrorCodeNone) { break; }
+		Expression copy = CopyExpression(binding);
+		bindings = ListPush(bindings, &copy);
+		
+		int32_t shadowed = FindVariable(innerVariables, binding.assignment.identifier);
+		if (shadowed >= 0) {
+			innerVariables = ListRemove(innerVariables, shadowed);
+			innerSeeds = ListRemove(innerSeeds, shadowed);
+		}
+		if (IsZero(d)) { continue; }
+		String tangent = StringCreate(binding.assignment.identifier);
+		StringConcat(&tangent, "$tangent");
+		Expression seed = Identifier(tangent, binding);
+		Expression tangentBinding = { .type = ExpressionTypeForAssignment, .assignment = { tangent, Allocate(d) }, .start = binding.start, .end = binding.end, .line = binding.line };
+		bindings = ListPush(bindings, &tangentBinding);
+		tangentSeeds = ListPush(tangentSeeds, &seed);
+		innerVariables = ListInsert(innerVariables, &binding.assignment.identifier, 0);
+		innerSeeds = ListInsert(innerSeeds, &seed, 0);
+	}
+	
+	Expression body = Zero();
+	if (error.code == SyntaxErrorCodeNone) { error = Differentiate(environment, innerVariables, innerSeeds, *expression.where.expression, &body); }
+	for (int32_t i = 0; i < ListLength(tangentSeeds); i++) { FreeExpression(tangentSeeds[i]); }
+	ListFree(tangentSeeds);
+	ListFree(innerVariables);
+	ListFree(innerSeeds);
+	if (error.code != SyntaxErrorCodeNone || IsZero(body)) {
+		for (int32_t i = 0; i < ListLength(bindings); i++) { FreeExpression(bindings[i]); }
+		ListFree(bindings);
+		return error;
+	}
+	*derivative = (Expression){ .type = ExpressionTypeWhere, .where = { Allocate(body), bindings }, .start = expression.start, .end = expression.end, .line = expression.line };
+	return error;
+}
+
+static SyntaxError Differentiate(Environment * environment, List(String) variables, List(Expression) seeds, Expression expression, Expression * derivative) {
+	*derivative = Zero();
+	switch (expression.type) {
+		case ExpressionTypeConstant:
+		case ExpressionTypeConstantArray: return (SyntaxError){ SyntaxErrorCodeNone };
+		case ExpressionTypeIdentifier: {
+			int32_t index = FindVariable(variables, expression.identifier);
+			if (index >= 0) { *derivative = CopyExpression(seeds[index]); }
+			return (SyntaxError){ SyntaxErrorCodeNone };
+		}
+		case ExpressionTypeVectorLiteral:
+		case ExpressionTypeArrayLiteral: return DifferentiateList(environment, variables, seeds, expression, derivative);
+		case ExpressionTypeUnary: return DifferentiateUnary(environment, variables, seeds, expression, derivative);
+		case ExpressionTypeBinary: return DifferentiateBinary(environment, variables, seeds, expression, derivative);
+		case ExpressionTypeTernary: return DifferentiateTernary(environment, variables, seeds, expression, derivative);
+		case ExpressionTypeWhere: return DifferentiateWhere(environment, variables, seeds, expression, derivative);
+		default: return (SyntaxError){ SyntaxErrorCodeNonDifferentiableExpression, expression.start, expression.end, expression.line };
+	}
+}
+
+static Expression TakeChild(Expression expression, bool left) {
+	// keeps one side of a binary expression and frees the rest
+	Expression child = left ? *expression.binary.left : *expression.binary.right;
+	FreeExpression(left ? *expression.binary.right : *expression.binary.left);
+	free(expression.binary.left);
+	free(expression.binary.right);
+	return child;
+}
+
+static Expression Simplify(Expression expression) {
+	// folds constants and removes the identities (x + 0, x * 1, x ^ 1, --x) left over from differentiation
+	if (expression.type == ExpressionTypeVectorLiteral || expression.type == ExpressionTypeArrayLiteral || expression.type == ExpressionTypeArguments) {
+		for (int32_t i = 0; i < ListLength(expression.list); i++) { expression.list[i] = Simplify(expression.list[i]); }
+	}
+	if (expression.type == ExpressionTypeForAssignment) { *expression.assignment.expression = Simplify(*expression.assignment.expression); }
+	if (expression.type == ExpressionTypeTernary) {
+		*expression.ternary.left = Simplify(*expression.ternary.left);
+		*expression.ternary.middle = Simplify(*expression.ternary.middle);
+		*expression.ternary.right = Simplify(*expression.ternary.right);
+	}
+	if (expression.type == ExpressionTypeWhere) {
+		for (int32_t i = 0; i < ListLength(expression.where.bindings); i++) { expression.where.bindings[i] = Simplify(expression.where.bindings[i]); }
+		*expression.where.expression = Simplify(*expression.where.expression);
+	}
+	if (expression.type == ExpressionTypeUnary) {
+		Expression inner = Simplify(*expression.unary.expression);
+		*expression.unary.expression = inner;
+		if (expression.unary.operator == OperatorNegate && inner.type == ExpressionTypeConstant) {
+			free(expression.unary.expression);
+			return Constant(-inner.constant, expression);
+		}
+		if (expression.unary.operator == OperatorNegate && inner.type == ExpressionTypeUnary && inner.unary.operator == OperatorNegate) {
+			Expression result = *inner.unary.expression;
+			free(inner.unary.expression);
+			free(expression.unary.expression);
+			return result;
+		}
+	}
+	if (expression.type == ExpressionTypeBinary) {
+		*expression.binary.left = Simplify(*expression.binary.left);
+		*expression.binary.right = Simplify(*expression.binary.right);
+		Expression l = *expression.binary.left, r = *expression.binary.right;
+		if (l.type == ExpressionTypeConstant && r.type == ExpressionTypeConstant && expression.binary.operator <= OperatorPower) {
+			double value = 0.0;
+			switch (expression.binary.operator) {
+				case OperatorAdd: value = l.constant + r.constant; break;
+				case OperatorSubtract: value = l.constant - r.constant; break;
+				case OperatorMultiply: value = l.constant * r.constant; break;
+				case OperatorDivide: value = l.constant / r.constant; break;
+				case OperatorModulo: value = fmod(l.constant, r.constant); break;
+				case OperatorPower: value = pow(l.constant, r.constant); break;
+				default: break;
+			}
+			free(expression.binary.left);
+			free(expression.binary.right);
+			return Constant(value, expression);
+		}
+		bool negatedRight = r.type == ExpressionTypeUnary && r.unary.operator == OperatorNegate;
+		switch (expression.binary.operator) {
+			case OperatorAdd:
+				if (IsConstant(l, 0.0)) { return TakeChild(expression, false); }
+				if (IsConstant(r, 0.0)) { return TakeChild(expression, true); }
+				if (negatedRight) {
+					*expression.binary.right = *r.unary.expression;
+					free(r.unary.expression);
+					expression.binary.operator = OperatorSubtract;
+				}
+				break;
+			case OperatorSubtract:
+				if (IsConstant(r, 0.0)) { return TakeChild(expression, true); }
+				if (IsConstant(l, 0.0)) { return Simplify(Neg(TakeChild(expression, false), expression)); }
+				if (negatedRight) {
+					*expression.binary.right = *r.unary.expression;
+					free(r.unary.expression);
+					expression.binary.operator = OperatorAdd;
+				}
+				break;
+			case OperatorMultiply:
+				if (IsConstant(l, 1.0)) { return TakeChild(expression, false); }
+				if (IsConstant(r, 1.0)) { return TakeChild(expression, true); }
+				if (IsConstant(l, -1.0)) { return Simplify(Neg(TakeChild(expression, false), expression)); }
+				if (IsConstant(r, -1.0)) { return Simplify(Neg(TakeChild(expression, true), expression)); }
+				break;
+			case OperatorDivide:
+			case OperatorPower:
+				if (IsConstant(r, 1.0)) { return TakeChild(expression, true); }
+				break;
+			default: break;
+		}
+	}
+	return expression;
+}
+
+static bool IsTrivial(Expression expression) {
+	// not worth passing around as a separate value
+	if (expression.type == ExpressionTypeConstant || expression.type == ExpressionTypeIdentifier) { return true; }
+	if (expression.type == ExpressionTypeUnary) { return IsTrivial(*expression.unary.expression); }
+	if (expression.type == ExpressionTypeBinary && expression.binary.operator == OperatorDimension) { return IsTrivial(*expression.binary.left); }
+	if (expression.type == ExpressionTypeVectorLiteral) {
+		for (int32_t i = 0; i < ListLength(expression.list); i++) {
+			if (!IsTrivial(expression.list[i])) { return false; }
+		}
+		return true;
+	}
+	// arrays of constants, like the zeros and seeds put in by Materialize, cost no more to write again than to pass on
+	if (expression.type == ExpressionTypeArrayLiteral) {
+		for (int32_t i = 0; i < ListLength(expression.list); i++) {
+			if (expression.list[i].type != ExpressionTypeConstant) { return false; }
+		}
+		return true;
+	}
+	return false;
+}
+
+static void CollectSubexpressions(Expression * expression, List(Expression *) * subexpressions) {
+	// subexpressions that are always evaluated with only the function parameters in scope, loop bodies and branches are skipped
+	switch (expression->type) {
+		case ExpressionTypeVectorLiteral:
+		case ExpressionTypeArrayLiteral:
+		case ExpressionTypeArguments:
+			if (expression->type != ExpressionTypeArguments && !IsTrivial(*expression)) { *subexpressions = ListPush(*subexpressions, &expression); }
+			for (int32_t i = 0; i < ListLength(expression->list); i++) { CollectSubexpressions(&expression->list[i], subexpressions); }
+			break;
+		case ExpressionTypeUnary:
+			if (!IsTrivial(*expression)) { *subexpressions = ListPush(*subexpressions, &expression); }
+			CollectSubexpressions(expression->unary.expression, subexpressions);
+			break;
+		case ExpressionTypeBinary:
+			if (expression->binary.operator == OperatorRange || expression->binary.operator == OperatorFor || expression->binary.operator == OperatorWhen ||
+				expression->binary.operator == OperatorIf || expression->binary.operator == OperatorElse) { break; }
+			if (!IsTrivial(*expression)) { *subexpressions = ListPush(*subexpressions, &expression); }
+			if (expression->binary.operator != OperatorCallStart) { CollectSubexpressions(expression->binary.left, subexpressions); }
+			if (expression->binary.operator != OperatorDimension) { CollectSubexpressions(expression->binary.right, subexpressions); }
+			break;
+		case ExpressionTypeTernary:
+			if (expression->ternary.leftOperator == OperatorIf) { CollectSubexpressions(expression->ternary.middle, subexpressions); }
+			break;
+		default: break;
+	}
+}
+
+static int32_t ExpressionSize(Expression expression) {
+	switch (expression.type) {
+		case ExpressionTypeVectorLiteral:
+		case ExpressionTypeArrayLiteral:
+		case ExpressionTypeArguments: {
+			int32_t size = 1;
+			for (int32_t i = 0; i < ListLength(expression.list); i++) { size += ExpressionSize(expression.list[i]); }
+			return size;
+		}
+		case ExpressionTypeForAssignment: return 1 + ExpressionSize(*expression.assignment.expression);
+		case ExpressionTypeUnary: return 1 + ExpressionSize(*expression.unary.expression);
+		case ExpressionTypeBinary: return 1 + ExpressionSize(*expression.binary.left) + ExpressionSize(*expression.binary.right);
+		case ExpressionTypeTernary: return 1 + ExpressionSize(*expression.ternary.left) + ExpressionSize(*expression.ternary.middle) + ExpressionSize(*expression.ternary.right);
+		case ExpressionTypeWhere: {
+			int32_t size = 1 + ExpressionSize(*expression.where.expression);
+			for (int32_t i = 0; i < ListLength(expression.where.bindings); i++) { size += ExpressionSize(expression.where.bindings[i]); }
+			return size;
+		}
+		default: return 1;
+	}
+}
+
+static int32_t CountOccurrences(List(Expression *) subexpressions, Expression expression) {
+	int32_t count = 0;
+	for (int32_t i = 0; i < ListLength(subexpressions); i++) { count += ExpressionEquals(*subexpressions[i], expression); }
+	return count;
+}
+
+static Expression * ChooseSubexpression(List(Expression *) subexpressions, List(String) bound) {
+	// the largest repeated subexpression that doesn't use a value bound at this level, unless part of it is also repeated
+	// on its own outside of it, then that part has to come first so both can use it
+	Expression * best = NULL;
+	int32_t bestSize = 0;
+	for (int32_t i = 0; i < ListLength(subexpressions); i++) {
+		int32_t size = ExpressionSize(*subexpressions[i]);
+		if (size <= bestSize || CountOccurrences(subexpressions, *subexpressions[i]) < 2 || DependsOn(*subexpressions[i], bound)) { continue; }
+		best = subexpressions[i];
+		bestSize = size;
+	}
+	while (best != NULL) {
+		List(Expression *) inner = ListCreate(sizeof(Expression *), 16);
+		CollectSubexpressions(best, &inner);
+		int32_t occurrences = CountOccurrences(subexpressions, *best);
+		Expression * part = NULL;
+		int32_t partSize = 0;
+		for (int32_t i = 0; i < ListLength(inner); i++) {
+			int32_t size = ExpressionSize(*inner[i]);
+			if (inner[i] == best || size <= partSize) { continue; }
+			if (CountOccurrences(subexpressions, *inner[i]) > occurrences * CountOccurrences(inner, *inner[i])) {
+				part = inner[i];
+				partSize = size;
+			}
+		}
+		ListFree(inner);
+		if (part == NULL) { break; }
+		best = part;
+	}
+	return best;
+}
+
+static void EliminateCommonSubexpressions(Environment * environment, Equation * equation) {
+	// repeated subexpressions are evaluated once and passed as extra parameters to a helper function holding the rest of the
+	// body, the ones that use each other go to helpers further down
+	List(String) parameters = ListCreate(sizeof(String), ListLength(equation->declaration.parameters) + 1);
+	for (int32_t i = 0; i < ListLength(equation->declaration.parameters); i++) { parameters = ListPush(parameters, &(String){ StringCreate(equation->declaration.parameters[i]) }); }
+	List(Expression) arguments = ListCreate(sizeof(Expression), ListLength(parameters) + 1);
+	for (int32_t i = 0; i < ListLength(equation->declaration.parameters); i++) {
+		Expression argument = Identifier(equation->declaration.parameters[i], equation->expression);
+		arguments = ListPush(arguments, &argument);
+	}
+	List(String) bound = ListCreate(sizeof(String), 1);
+	while (true) {
+		List(Expression *) subexpressions = ListCreate(sizeof(Expression *), 16);
+		CollectSubexpressions(&equation->expression, &subexpressions);
+		Expression * best = ChooseSubexpression(subexpressions, bound);
+		if (best == NULL) {
+			ListFree(subexpressions);
+			break;
+		}
+
+		char name[16];
+		snprintf(name, sizeof(name), "$%i", ListLength(parameters));
+		parameters = ListPush(parameters, &(String){ StringCreate(name) });
+		bound = ListPush(bound, &parameters[ListLength(parameters) - 1]);
+
+		// occurrences can't be nested in each other, so all of them are found before any are replaced
+		Expression shared = CopyExpression(*best);
+		List(Expression *) occurrences = ListCreate(sizeof(Expression *), 2);
+		for (int32_t i = 0; i < ListLength(subexpressions); i++) {
+			if (ExpressionEquals(*subexpressions[i], shared)) { occurrences = ListPush(occurrences, &subexpressions[i]); }
+		}
+		for (int32_t i = 0; i < ListLength(occurrences); i++) {
+			Expression replacement = Identifier(name, *occurrences[i]);
+			FreeExpression(*occurrences[i]);
+			*occurrences[i] = replacement;
+		}
+		ListFree(occurrences);
+		ListFree(subexpressions);
+		arguments = ListPush(arguments, &shared);
+	}
+	ListFree(bound);
+	if (ListLength(parameters) == ListLength(equation->declaration.parameters)) {
+		for (int32_t i = 0; i < ListLength(parameters); i++) { StringFree(parameters[i]); }
+		ListFree(parameters);
+		for (int32_t i = 0; i < ListLength(arguments); i++) { FreeExpression(arguments[i]); }
+		ListFree(arguments);
+		return;
+	}
+
+	Equation helper = {
+		.type = EquationTypeFunction,
+		.declaration = { StringCreate(equation->declaration.identifier), parameters, DeclarationAttributeNone },
+		.expression = equation->expression,
+		.end = equation->end,
+		.line = equation->line,
+	};
+	StringConcat(&helper.declaration.identifier, "$");
+	equation->expression = Call(helper.declaration.identifier, arguments, helper.expression);
+
+	EliminateCommonSubexpressions(environment, &helper);
+	AddEnvironmentEquation(environment, helper);
+}
+
+static SyntaxError DifferentiateFunction(Environment * environment, Equation function, const char * identifier, List(String) parameters, List(String) variables, List(Expression) seeds) {
+	// the equation is added before its body is known so recursive functions can refer to it
+	Equation placeholder = {
+		.type = EquationTypeFunction,
+		.declaration = { StringCreate(identifier), parameters, DeclarationAttributeNone },
+		.expression = Zero(),
+		.end = function.end,
+		.line = function.line,
+	};
+	AddEnvironmentEquation(environment, placeholder);
+
+	Expression derivative;
+	SyntaxError error = Differentiate(environment, variables, seeds, function.expression, &derivative);
+	if (error.code != SyntaxErrorCodeNone) {
+		FreeEquation(*GetEnvironmentEquation(environment, identifier));
+		HashMapSet(environment->equations, identifier, NULL);
+		return error;
+	}
+
+	Equation equation = *GetEnvironmentEquation(environment, identifier);
+	equation.expression = Simplify(Materialize(derivative, function.expression));
+	EliminateCommonSubexpressions(environment, &equation);
+	*GetEnvironmentEquation(environment, identifier) = equation;
+	return error;
+}
+
+static SyntaxError EnsureTangent(Environment * environment, const char * identifier) {
+	// g$tangent(p..., p$tangent...) is the derivative of g when each parameter p moves along p$tangent
+	String name = StringCreate(identifier);
+	StringConcat(&name, "$tangent");
+	if (GetEnvironmentEquation(environment, name) != NULL) {
+		StringFree(name);
+		return (SyntaxError){ SyntaxErrorCodeNone };
+	}
+
+	Equation function = *GetEnvironmentEquation(environment, identifier);
+	List(String) variables = function.declaration.parameters;
+	List(String) parameters = ListCreate(sizeof(String), 2 * ListLength(variables));
+	List(Expression) seeds = ListCreate(sizeof(Expression), ListLength(variables));
+	for (int32_t i = 0; i < ListLength(variables); i++) { parameters = ListPush(parameters, &(String){ StringCreate(variables[i]) }); }
+	for (int32_t i = 0; i < ListLength(variables); i++) {
+		String tangent = StringCreate(variables[i]);
+		StringConcat(&tangent, "$tangent");
+		parameters = ListPush(parameters, &tangent);
+		Expression seed = Identifier(tangent, function.expression);
+		seeds = ListPush(seeds, &seed);
+	}
+
+	SyntaxError error = DifferentiateFunction(environment, function, name, parameters, variables, seeds);
+	for (int32_t i = 0; i < ListLength(seeds); i++) { FreeExpression(seeds[i]); }
+	ListFree(seeds);
+	StringFree(name);
+	return error;
+}
+
+static SyntaxError EnsureDerivative(Environment * environment, const char * identifier, Expression origin) {
+	if (GetEnvironmentEquation(environment, identifier) != NULL) { return (SyntaxError){ SyntaxErrorCodeNone }; }
+
+	// f'' is the derivative of f'
+	String base = StringSub((String)identifier, 0, StringLength((String)identifier) - 2);
+	if (GetEnvironmentEquation(environment, base) == NULL && StringLength(base) > 0 && base[StringLength(base) - 1] == '\'') {
+		SyntaxError error = EnsureDerivative(environment, base, origin);
+		if (error.code != SyntaxErrorCodeNone) {
+			StringFree(base);
+			return error;
+		}
+	}
+
+	Equation function;
+	Equation * equation = GetEnvironmentEquation(environment, base);
+	BuiltinFunction builtin = DetermineBuiltinFunction(base);
+	if (equation != NULL) { function = *equation; }
+	else if (builtin != BuiltinFunctionNone && IsFunctionSingleArgument(builtin)) {
+		// builtins are wrapped as f(x) = f(x)
+		List(String) parameters = ListCreate(sizeof(String), 1);
+		parameters = ListPush(parameters, &(String){ StringCreate("x") });
+		function = (Equation){ .type = EquationTypeFunction, .declaration = { StringCreate(base), parameters, DeclarationAttributeNone }, .end = origin.end, .line = origin.line };
+		function.expression = Call1(base, Identifier("x", origin), origin);
+	} else {
+		StringFree(base);
+		return (SyntaxError){ SyntaxErrorCodeInvalidDerivative, origin.start, origin.end, origin.line };
+	}
+	StringFree(base);
+
+	SyntaxError error = { SyntaxErrorCodeInvalidDerivative, origin.start, origin.end, origin.line };
+	if (function.type == EquationTypeFunction && ListLength(function.declaration.parameters) == 1) {
+		List(String) parameters = ListCreate(sizeof(String), 1);
+		parameters = ListPush(parameters, &(String){ StringCreate(function.declaration.parameters[0]) });
+		List(Expression) seeds = ListCreate(sizeof(Expression), 1);
+		Expression seed = Constant(1.0, function.expression);
+		seeds = ListPush(seeds, &seed);
+		error = DifferentiateFunction(environment, function, identifier, parameters, function.declaration.parameters, seeds);
+		ListFree(seeds);
+	}
+	if (equation == NULL) { FreeEquation(function); }
+	return error;
+}
+
+SyntaxError AddEnvironmentDerivatives(Environment * environment, Expression expression) {
+	SyntaxError error = { SyntaxErrorCodeNone };
+	switch (expression.type) {
+		case ExpressionTypeVectorLiteral:
+		case ExpressionTypeArrayLiteral:
+		case ExpressionTypeArguments:
+			for (int32_t i = 0; i < ListLength(expression.list) && error.code == SyntaxErrorCodeNone; i++) { error = AddEnvironmentDerivatives(environment, expression.list[i]); }
+			return error;
+		case ExpressionTypeForAssignment: return AddEnvironmentDerivatives(environment, *expression.assignment.expression);
+		case ExpressionTypeUnary: return AddEnvironmentDerivatives(environment, *expression.unary.expression);
+		case ExpressionTypeBinary:
+			if (expression.binary.operator == OperatorCallStart && expression.binary.left->type == ExpressionTypeIdentifier) {
+				String identifier = expression.binary.left->identifier;
+				if (identifier[StringLength(identifier) - 1] == '\'') { error = EnsureDerivative(environment, identifier, *expression.binary.left); }
+			}
+			if (error.code == SyntaxErrorCodeNone) { error = AddEnvironmentDerivatives(environment, *expression.binary.left); }
+			if (error.code == SyntaxErrorCodeNone) { error = AddEnvironmentDerivatives(environment, *expression.binary.right); }
+			return error;
+		case ExpressionTypeTernary:
+			error = AddEnvironmentDerivatives(environment, *expression.ternary.left);
+			if (error.code == SyntaxErrorCodeNone) { error = AddEnvironmentDerivatives(environment, *expression.ternary.middle); }
+			if (error.code == SyntaxErrorCodeNone) { error = AddEnvironmentDerivatives(environment, *expression.ternary.right); }
+			return error;
+		case ExpressionTypeWhere:
+			for (int32_t i = 0; i < ListLength(expression.where.bindings) && error.code == SyntaxErrorCodeNone; i++) { error = AddEnvironmentDerivatives(environment, expression.where.bindings[i]); }
+			if (error.code == SyntaxErrorCodeNone) { error = AddEnvironmentDerivatives(environment, *expression.where.expression); }
+			return error;
+		default: return error;
+	}
+}
+
+static bool IsGeneratedFrom(const char * identifier, const char * function) {
+	// f', f'', f$tangent and their helpers all continue the name of f with ' or $
+	size_t length = strlen(function);
+	return strncmp(identifier, function, length) == 0 && (identifier[length] == '\'' || identifier[length] == '$');
+}
+
+SyntaxError RebuildEnvironmentDerivatives(Environment * environment, const char * identifier) {
+	// everything generated from identifier is stale, and so is everything generated from a function calling it or one of those
+	List(String) stale = ListCreate(sizeof(String), 1);
+	stale = ListPush(stale, &(String){ StringCreate(identifier) });
+	List(String) keys = HashMapKeys(environment->equations);
+	for (bool changed = true; changed; ) {
+		changed = false;
+		for (int32_t i = 0; i < ListLength(keys); i++) {
+			if (FindVariable(stale, keys[i]) >= 0) { continue; }
+			Equation * equation = GetEnvironmentEquation(environment, keys[i]);
+			bool generated = false;
+			for (int32_t j = 0; j < ListLength(stale) && !generated; j++) { generated = IsGeneratedFrom(keys[i], stale[j]); }
+			if (generated || (equation->type == EquationTypeFunction && DependsOn(equation->expression, stale))) {
+				stale = ListPush(stale, &(String){ StringCreate(keys[i]) });
+				changed = true;
+			}
+		}
+	}
+	ListFree(keys);
+
+	for (int32_t i = 1; i < ListLength(stale); i++) {
+		if (strchr(stale[i], '\'') == NULL && strchr(stale[i], '$') == NULL) { continue; }
+		FreeEquation(*GetEnvironmentEquation(environment, stale[i]));
+		HashMapSet(environment->equations, stale[i], NULL);
+	}
+
+	// whatever is left that calls one of them builds the derivatives it uses again from the current definitions
+	SyntaxError error = { SyntaxErrorCodeNone };
+	keys = HashMapKeys(environment->equations);
+	for (int32_t i = 0; i < ListLength(keys) && error.code == SyntaxErrorCodeNone; i++) {
+		Equation * equation = GetEnvironmentEquation(environment, keys[i]);
+		if (StringEquals(keys[i], identifier) || !DependsOn(equation->expression, stale)) { continue; }
+		error = AddEnvironmentDerivatives(environment, equation->expression);
+	}
+	ListFree(keys);
+	for (int32_t i = 0; i < ListLength(stale); i++) { StringFree(stale[i]); }
+	ListFree(stale);
+	return error;
+}
@@ -0,0 +1,17 @@
+#ifndef Derivative_h
+#define Derivative_h
+
+#include "Evaluator.h"
+
+// f'(t) is the derivative of a function of one parameter. Derivatives are built symbolically when a script is loaded
+// and added to the environment as regular functions, along with the helper functions they call:
+//   f'       derivative of f with respect to its parameter
+//   g$tangent(p..., p$tangent...)  directional derivative of g, used for the chain rule through user functions
+//   f'$, f'$$ ...                  common subexpressions of f' passed in as extra parameters ($0, $1, ...)
+// '$' can't appear in source code so generated identifiers never collide with user ones.
+SyntaxError AddEnvironmentDerivatives(Environment * environment, Expression expression);
+// after a function is added or replaced, drops what was generated from its old definition and from the functions
+// calling it, then rebuilds the derivatives the other equations still use
+SyntaxError RebuildEnvironmentDerivatives(Environment * environment, const char * identifier);
+
+#endif
@@ -1,10 +1,15 @@
 #include <stdio.h>
 #include <limits.h>
-#include <math.h>
+#include <tgmath.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "Evaluator.h"
 #include "Builtin.h"
+#include "ComplexNumbers.h"
+#include "Planner.h"
+#include "Spatial.h"
+#include "Utilities/FastMath.h"
 
 const char * RuntimeErrorToString(RuntimeErrorCode code) {
 	switch (code) {
@@ -32,12 +37,18 @@ const char * RuntimeErrorToString(RuntimeErrorCode code) {
 		case RuntimeErrorCodeInvalidArgumentsExpression: return "trying to evaluate invalid arguments";
 		case RuntimeErrorCodeIncorrectArgumentCount: return "incorrect argument count";
 		case RuntimeErrorCodeDifferingOperonDimensions: return "unable to perform arithmetic on differing dimensionality";
+		case RuntimeErrorCodeInvalidArgumentType: return "invalid argument type";
+		case RuntimeErrorCodeInvalidGridArgument: return "argument must be a grid, made from a 2D range";
 		case RuntimeErrorCodeInvalidRenderDimension: return "render equation is of invalid dimension";
 		case RuntimeErrorCodeInvalidParametricEquation: return "invalid parametric equation, must be function of one parameter";
 		case RuntimeErrorCodeInvalidParametricDomain: return "invalid parametric domain";
 		case RuntimeErrorCodeInvalidColorDimension: return "invalid color dimension";
 		case RuntimeErrorCodeInvalidSizeDimension: return "invalid size dimension";
+		case RuntimeErrorCodeInvalidApproximationTolerance: return "invalid approximation tolerance, must be a single number";
 		case RuntimeErrorCodeReachedDepthLimit: return "reached expression depth limit";
+		case RuntimeErrorCodeExceededTimeBudget: return "evaluation took longer than its time budget";
+		case RuntimeErrorCodeExceededMemoryBudget: return "evaluation needs an array larger than its memory budget";
+		case RuntimeErrorCodeCancelled: return "evaluation cancelled";
 		case RuntimeErrorCodeNotImplemented: return "not implemented";
 		default: return "unknown error";
 	}
@@ -57,7 +68,7 @@ void PrintVectorArray(VectorArray value) {
 		if (value.dimensions > 1) { printf("("); }
 		for (int32_t j = 0; j < value.dimensions; j++) {
 			// print as an integer if float is an integer
-			if (value.xyzw[j][i] < LLONG_MAX && value.xyzw[j][i] - floorf(value.xyzw[j][i]) == 0) { printf("%lld", (long long)value.xyzw[j][i]); }
+			if (value.xyzw[j][i] < LLONG_MAX && value.xyzw[j][i] - floor(value.xyzw[j][i]) == 0) { printf("%lld", (long long)value.xyzw[j][i]); }
 			else { printf("%f", value.xyzw[j][i]); }
 			if (j != value.dimensions - 1) { printf(","); }
 		}
@@ -73,25 +84,119 @@ void PrintVectorArray(VectorArray value) {
 	if (value.length > 1) { printf("]"); }
 }
 
+uint32_t VectorArrayAlignedLength(uint32_t length) {
+	// channels are padded to whole alignment units, so kernels can run over the padding instead of handling a tail
+	const uint32_t lanes = VECTOR_ARRAY_ALIGNMENT / sizeof(scalar_t);
+	return (length + lanes - 1) / lanes * lanes;
+}
+
+VectorArray CreateVectorArray(uint32_t dimensions, uint32_t length) {
+	VectorArray result = { .length = length, .dimensions = dimensions };
+	if (dimensions == 0) { return result; }
+	uint32_t stride = VectorArrayAlignedLength(length);
+	size_t size = (size_t)dimensions * stride * sizeof(scalar_t);
+	scalar_t * block = aligned_alloc(VECTOR_ARRAY_ALIGNMENT, size > 0 ? size : VECTOR_ARRAY_ALIGNMENT);
+	for (int32_t d = 0; d < dimensions; d++) { result.xyzw[d] = block + d * stride; }
+	return result;
+}
+
+VectorArray CreateTypedVectorArray(ElementType type, uint32_t dimensions, uint32_t length) {
+	if (type == ElementTypeScalar) { return CreateVectorArray(dimensions, length); }
+	VectorArray result = { .length = length, .dimensions = dimensions, .type = type };
+	if (dimensions == 0) { return result; }
+	size_t bytes = type == ElementTypeInt32 ? length * sizeof(int32_t) : (length + 63) / 64 * sizeof(uint64_t);
+	size_t stride = (bytes + VECTOR_ARRAY_ALIGNMENT - 1) / VECTOR_ARRAY_ALIGNMENT * VECTOR_ARRAY_ALIGNMENT;
+	char * block = aligned_alloc(VECTOR_ARRAY_ALIGNMENT, stride > 0 ? dimensions * stride : VECTOR_ARRAY_ALIGNMENT);
+	if (type == ElementTypeBool) { memset(block, 0, dimensions * stride); }
+	for (int32_t d = 0; d < dimensions; d++) { result.xyzw[d] = (scalar_t *)(block + d * stride); }
+	return result;
+}
+
+static inline bool GetBit(const uint64_t * bits, uint32_t index) { return (bits[index >> 6] >> (index & 63)) & 1; }
+
+void ScalarizeVectorArray(VectorArray * value) {
+	// done once a typed array reaches code that reads its channels as scalars
+	if (value->type == ElementTypeScalar) { return; }
+	VectorArray scalars = CreateVectorArray(value->dimensions, value->length);
+	scalars.columns = value->columns;
+	scalars.kind = value->kind;
+	for (int32_t d = 0; d < value->dimensions; d++) {
+		scalar_t * restrict x = scalars.xyzw[d];
+		if (value->type == ElementTypeInt32) {
+			const int32_t * restrict n = VECTOR_ARRAY_INT32(*value, d);
+			for (uint32_t j = 0; j < value->length; j++) { x[j] = n[j]; }
+		} else {
+			const uint64_t * restrict bits = VECTOR_ARRAY_BITS(*value, d);
+			for (uint32_t j = 0; j < value->length; j++) { x[j] = GetBit(bits, j); }
+		}
+	}
+	FreeVectorArray(*value);
+	*value = scalars;
+}
+
+static bool IsVectorArrayContiguous(VectorArray value) {
+	// borrowed arrays can point anywhere, only the layout CreateVectorArray produces can be copied in one go
+	uint32_t stride = VectorArrayAlignedLength(value.length);
+	for (int32_t d = 1; d < value.dimensions; d++) {
+		if (value.xyzw[d] != value.xyzw[0] + d * stride) { return false; }
+	}
+	return true;
+}
+
 VectorArray CopyVectorArray(VectorArray value) {
-	VectorArray result = { .length = value.length, .dimensions = value.dimensions };
-	for (int32_t d = 0; d < result.dimensions; d++) {
-		result.xyzw[d] = malloc(result.length * sizeof(scalar_t));
-		memcpy(result.xyzw[d], value.xyzw[d], result.length * sizeof(scalar_t));
+	VectorArray result = CreateVectorArray(value.dimensions, value.length);
+	result.columns = value.columns;
+	result.kind = value.kind;
+	if (result.dimensions == 0) { return result; }
+	if (IsVectorArrayContiguous(value)) {
+		memcpy(result.xyzw[0], value.xyzw[0], ((value.dimensions - 1) * VectorArrayAlignedLength(value.length) + value.length) * sizeof(scalar_t));
+	} else {
+		for (int32_t d = 0; d < result.dimensions; d++) { memcpy(result.xyzw[d], value.xyzw[d], result.length * sizeof(scalar_t)); }
 	}
 	return result;
 }
 
+VectorArray ZeroVectorArray(uint32_t dimensions, uint32_t length) {
+	VectorArray result = CreateVectorArray(dimensions, length);
+	if (dimensions > 0) { memset(result.xyzw[0], 0, dimensions * VectorArrayAlignedLength(length) * sizeof(scalar_t)); }
+	return result;
+}
+
+bool IsVectorArrayComplex(VectorArray value) {
+	// a swizzle or reduction can leave fewer channels behind, and then the array is just real
+	return value.kind == NumberKindComplex && value.dimensions == 2;
+}
+
+bool IsVectorArrayMatrix(VectorArray value) {
+	// only whole square matrices, a reduction of one is a plain array again
+	return value.kind == NumberKindMatrix && value.dimensions >= 2 && value.length > 0 && value.length % value.dimensions == 0;
+}
+
 VectorArray VectorArrayAtIndex(VectorArray value, int32_t index) {
-	VectorArray indexed = { .length = 1, .dimensions = value.dimensions };
-	for (int32_t i = 0; i < value.dimensions; i++) {
-		indexed.xyzw[i] = malloc(sizeof(scalar_t));
-		indexed.xyzw[i][0] = value.xyzw[i][index];
-	}
+	VectorArray indexed = CreateVectorArray(value.dimensions, 1);
+	indexed.kind = value.kind == NumberKindComplex ? NumberKindComplex : NumberKindReal; // the elements of matrices are rows
+	for (int32_t i = 0; i < value.dimensions; i++) { indexed.xyzw[i][0] = value.xyzw[i][index]; }
 	return indexed;
 }
 
 bool TruthyVectorArray(VectorArray value) {
+	if (value.type == ElementTypeBool) {
+		// whole words at a time, the padding bits are always clear
+		for (int32_t i = 0; i < value.dimensions; i++) {
+			for (uint32_t j = 0; j < (value.length + 63) / 64; j++) {
+				if (VECTOR_ARRAY_BITS(value, i)[j]) { return true; }
+			}
+		}
+		return false;
+	}
+	if (value.type == ElementTypeInt32) {
+		for (int32_t i = 0; i < value.dimensions; i++) {
+			for (uint32_t j = 0; j < value.length; j++) {
+				if (VECTOR_ARRAY_INT32(value, i)[j]) { return true; }
+			}
+		}
+		return false;
+	}
 	for (int32_t i = 0; i < value.dimensions; i++) {
 		for (int32_t j = 0; j < value.length; j++) {
 			if (value.xyzw[i][j]) { return true; }
@@ -101,6 +206,37 @@ bool TruthyVectorArray(VectorArray value) {
 }
 
 void FreeVectorArray(VectorArray value) {
+	if (value.dimensions > 0) { free(value.xyzw[0]); }
+}
+
+void * AllocateElements(size_t count, size_t size) {
+	return malloc(count > 0 ? count * size : 1);
+}
+
+HalfArray EncodeHalfArray(VectorArray value) {
+	HalfArray half = { .dimensions = value.dimensions, .length = value.length, .columns = value.columns, .kind = value.kind };
+	for (int32_t d = 0; d < value.dimensions; d++) {
+		half_t * restrict h = malloc(value.length * sizeof(half_t));
+		const scalar_t * restrict x = value.xyzw[d];
+		for (int32_t i = 0; i < value.length; i++) { h[i] = half_from_float(x[i]); }
+		half.xyzw[d] = h;
+	}
+	return half;
+}
+
+VectorArray DecodeHalfArray(HalfArray value) {
+	VectorArray result = CreateVectorArray(value.dimensions, value.length);
+	result.columns = value.columns;
+	result.kind = value.kind;
+	for (int32_t d = 0; d < value.dimensions; d++) {
+		scalar_t * restrict x = result.xyzw[d];
+		const half_t * restrict h = value.xyzw[d];
+		for (int32_t i = 0; i < value.length; i++) { x[i] = half_to_float(h[i]); }
+	}
+	return result;
+}
+
+void FreeHalfArray(HalfArray value) {
 	for (int32_t d = 0; d < value.dimensions; d++) { free(value.xyzw[d]); }
 }
 
@@ -111,14 +247,23 @@ Binding CreateBinding(const char * identifier, VectorArray value) {
 void FreeBinding(Binding binding) {
 	StringFree(binding.identifier);
 	FreeVectorArray(binding.value);
+	FreeVectorArray(binding.tangent);
 }
 
 Environment CreateEmptyEnvironment() {
-	return (Environment) {
+	Environment environment = {
 		.equations = HashMapCreate(sizeof(Equation)),
 		.cache = HashMapCreate(sizeof(VectorArray)),
+		.halfCache = HashMapCreate(sizeof(HalfArray)),
+		.indices = HashMapCreate(sizeof(SpatialIndex *)),
 		.dependents = HashMapCreate(sizeof(List(String))),
+		.cacheLock = malloc(sizeof(pthread_mutex_t)),
+		.budget = { .seconds = EVALUATOR_DEFAULT_SECONDS, .bytes = EVALUATOR_DEFAULT_BYTES },
+		.cancelled = malloc(sizeof(atomic_int)),
 	};
+	pthread_mutex_init(environment.cacheLock, NULL);
+	atomic_init(environment.cancelled, 0);
+	return environment;
 }
 
 void AddEnvironmentEquation(Environment * environment, Equation equation) {
@@ -131,16 +276,100 @@ Equation * GetEnvironmentEquation(Environment * environment, const char * identi
 	return HashMapGet(environment->equations, identifier);
 }
 
+static void RemoveCacheEntries(Environment * environment, const char * identifier) {
+	VectorArray * cache = HashMapGet(environment->cache, identifier);
+	if (cache != NULL) {
+		FreeVectorArray(*cache);
+		HashMapSet(environment->cache, identifier, NULL);
+	}
+	HalfArray * halfCache = HashMapGet(environment->halfCache, identifier);
+	if (halfCache != NULL) {
+		FreeHalfArray(*halfCache);
+		HashMapSet(environment->halfCache, identifier, NULL);
+	}
+	SpatialIndex ** index = HashMapGet(environment->indices, identifier);
+	if (index != NULL) {
+		FreeSpatialIndex(*index);
+		HashMapSet(environment->indices, identifier, NULL);
+	}
+}
+
+// setting, getting and removing entries directly is for the thread that owns the environment, between evaluations
 void SetEnvironmentCache(Environment * environment, const char * identifier, VectorArray value) {
-	VectorArray * oldCache = HashMapGet(environment->cache, identifier);
-	if (oldCache != NULL) { FreeVectorArray(*oldCache); }
+	pthread_mutex_lock(environment->cacheLock);
+	RemoveCacheEntries(environment, identifier);
 	HashMapSet(environment->cache, identifier, &value);
+	pthread_mutex_unlock(environment->cacheLock);
 }
 
 VectorArray * GetEnvironmentCache(Environment * environment, const char * identifier) {
 	return HashMapGet(environment->cache, identifier);
 }
 
+void RemoveEnvironmentCache(Environment * environment, const char * identifier) {
+	pthread_mutex_lock(environment->cacheLock);
+	RemoveCacheEntries(environment, identifier);
+	pthread_mutex_unlock(environment->cacheLock);
+}
+
+VectorArray PublishEnvironmentCache(Environment * environment, const char * identifier, VectorArray value) {
+	// the first value published for an identifier wins, later ones are freed and the winner is returned instead
+	pthread_mutex_lock(environment->cacheLock);
+	VectorArray * published = HashMapGet(environment->cache, identifier);
+	if (published == NULL) { HashMapSet(environment->cache, identifier, &value); }
+	else {
+		FreeVectorArray(value);
+		value = *published;
+	}
+	pthread_mutex_unlock(environment->cacheLock);
+	return value;
+}
+
+static HalfArray PublishEnvironmentHalfCache(Environment * environment, const char * identifier, HalfArray value) {
+	pthread_mutex_lock(environment->cacheLock);
+	HalfArray * published = HashMapGet(environment->halfCache, identifier);
+	if (published == NULL) { HashMapSet(environment->halfCache, identifier, &value); }
+	else {
+		FreeHalfArray(value);
+		value = *published;
+	}
+	pthread_mutex_unlock(environment->cacheLock);
+	return value;
+}
+
+// an index is published for the cached array it was built over, readers check its source against the array they read
+SpatialIndex * ReadEnvironmentIndex(Environment * environment, const char * identifier) {
+	pthread_mutex_lock(environment->cacheLock);
+	SpatialIndex ** index = HashMapGet(environment->indices, identifier);
+	SpatialIndex * value = index == NULL ? NULL : *index;
+	pthread_mutex_unlock(environment->cacheLock);
+	return value;
+}
+
+SpatialIndex * PublishEnvironmentIndex(Environment * environment, const char * identifier, SpatialIndex * index) {
+	// like the cache the first index published wins
+	pthread_mutex_lock(environment->cacheLock);
+	SpatialIndex ** published = HashMapGet(environment->indices, identifier);
+	if (published == NULL) { HashMapSet(environment->indices, identifier, &index); }
+	else {
+		FreeSpatialIndex(index);
+		index = *published;
+	}
+	pthread_mutex_unlock(environment->cacheLock);
+	return index;
+}
+
+static bool ReadEnvironmentCache(Environment * environment, const char * identifier, VectorArray * value, HalfArray * halfValue) {
+	// entries are copied out by value since a concurrent publish can move the map's storage
+	pthread_mutex_lock(environment->cacheLock);
+	VectorArray * cached = HashMapGet(environment->cache, identifier);
+	HalfArray * halfCached = cached == NULL ? HashMapGet(environment->halfCache, identifier) : NULL;
+	*value = cached == NULL ? (VectorArray){ 0 } : *cached;
+	*halfValue = halfCached == NULL ? (HalfArray){ 0 } : *halfCached;
+	pthread_mutex_unlock(environment->cacheLock);
+	return cached != NULL || halfCached != NULL;
+}
+
 void InitializeEnvironmentDependents(Environment * environment) {
 	List(String) keys = HashMapKeys(environment->equations);
 	for (int32_t i = 0; i < ListLength(keys); i++) {
@@ -160,6 +389,15 @@ void InitializeEnvironmentDependents(Environment * environment) {
 	ListFree(keys);
 }
 
+void CancelEnvironmentEvaluations(Environment * environment) {
+	// only touches the flag, so it's safe to call from a signal handler
+	atomic_store(environment->cancelled, 1);
+}
+
+void ResumeEnvironmentEvaluations(Environment * environment) {
+	atomic_store(environment->cancelled, 0);
+}
+
 void FreeEnvironment(Environment environment) {
 	List(String) keys = HashMapKeys(environment.equations);
 	for (int32_t i = 0; i < ListLength(keys); i++) { FreeEquation(*(Equation *)HashMapGet(environment.equations, keys[i])); }
@@ -171,6 +409,19 @@ void FreeEnvironment(Environment environment) {
 	ListFree(keys);
 	HashMapFree(environment.cache);
 	
+	keys = HashMapKeys(environment.halfCache);
+	for (int32_t i = 0; i < ListLength(keys); i++) { FreeHalfArray(*(HalfArray *)HashMapGet(environment.halfCache, keys[i])); }
+	ListFree(keys);
+	HashMapFree(environment.halfCache);
+	
+	keys = HashMapKeys(environment.indices);
+	for (int32_t i = 0; i < ListLength(keys); i++) { FreeSpatialIndex(*(SpatialIndex **)HashMapGet(environment.indices, keys[i])); }
+	ListFree(keys);
+	HashMapFree(environment.indices);
+	pthread_mutex_destroy(environment.cacheLock);
+	free(environment.cacheLock);
+	free(environment.cancelled);
+	
 	keys = HashMapKeys(environment.dependents);
 	for (int32_t i = 0; i < ListLength(keys); i++) {
 		List(String) * identifiers = HashMapGet(environment.dependents, keys[i]);
@@ -181,93 +432,168 @@ void FreeEnvironment(Environment environment) {
 	HashMapFree(environment.dependents);
 }
 
-static RuntimeError _EvaluateExpression(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result);
+static RuntimeError _EvaluateExpression(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent);
+static RuntimeError EvaluateTypedExpression(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent);
 
-static RuntimeError EvaluateConstant(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
-	result->length = 1;
-	result->dimensions = 1;
-	result->xyzw[0] = malloc(sizeof(scalar_t));
+static RuntimeError EvaluateConstant(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
+	*result = CreateVectorArray(1, 1);
 	result->xyzw[0][0] = expression.constant;
+	if (tangent != NULL) { *tangent = (VectorArray){ 0 }; }
+	return (RuntimeError){ RuntimeErrorCodeNone };
+}
+
+static RuntimeError EvaluateConstantArray(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
+	// packed by the parser, so this is one pass over the block however long the literal is
+	ConstantArray constants = expression.constants;
+	*result = CreateVectorArray(constants.dimensions, constants.length);
+	for (int32_t d = 0; d < constants.dimensions; d++) {
+		scalar_t * restrict x = result->xyzw[d];
+		const double * restrict values = constants.values + d * constants.length;
+		for (uint32_t j = 0; j < constants.length; j++) { x[j] = values[j]; }
+	}
+	if (tangent != NULL) { *tangent = (VectorArray){ 0 }; }
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError EvaluateIdentifier(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+static RuntimeError EvaluateHalfAttribute(EvaluationContext * context, const char * identifier, int32_t depth, bool * half) {
+	String attribute = StringCreate(identifier);
+	StringConcat(&attribute, ":half");
+	Equation * equation = GetEnvironmentEquation(context->environment, attribute);
+	StringFree(attribute);
+	*half = false;
+	if (equation == NULL) { return (RuntimeError){ RuntimeErrorCodeNone }; }
+	
+	VectorArray value;
+	RuntimeError error = _EvaluateExpression(context, NULL, equation->expression, depth + 1, &value, NULL);
+	if (error.code != RuntimeErrorCodeNone) { return error; }
+	*half = TruthyVectorArray(value);
+	FreeVectorArray(value);
+	return error;
+}
+
+static RuntimeError EvaluateIdentifier(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
+	// only parameters can carry a tangent, everything else is constant with respect to them
+	if (tangent != NULL) { *tangent = (VectorArray){ 0 }; }
 	if (parameters != NULL) {
 		for (int32_t i = 0; i < ListLength(parameters); i++) {
 			if (StringEquals(parameters[i].identifier, expression.identifier)) {
 				*result = CopyVectorArray(parameters[i].value);
+				if (tangent != NULL && parameters[i].tangent.dimensions > 0) { *tangent = CopyVectorArray(parameters[i].tangent); }
 				return (RuntimeError){ RuntimeErrorCodeNone };
 			}
 		}
 	}
 	
-	VectorArray * cached = GetEnvironmentCache(environment, expression.identifier);
-	if (cached != NULL) {
-		*result = CopyVectorArray(*cached);
+	// published entries never change, so once a context has read one it keeps using that copy
+	for (int32_t i = 0; i < ListLength(context->snapshot); i++) {
+		if (StringEquals(context->snapshot[i].identifier, expression.identifier)) {
+			*result = CopyVectorArray(context->snapshot[i].value);
+			return (RuntimeError){ RuntimeErrorCodeNone };
+		}
+	}
+	VectorArray cached;
+	HalfArray halfCached;
+	if (ReadEnvironmentCache(context->environment, expression.identifier, &cached, &halfCached)) {
+		if (halfCached.dimensions > 0) { *result = DecodeHalfArray(halfCached); }
+		else {
+			context->snapshot = ListPush(context->snapshot, &(Binding){ .identifier = StringCreate(expression.identifier), .value = cached });
+			*result = CopyVectorArray(cached);
+		}
 		return (RuntimeError){ RuntimeErrorCodeNone };
 	}
 	
-	Equation * equation = GetEnvironmentEquation(environment, expression.identifier);
+	Equation * equation = GetEnvironmentEquation(context->environment, expression.identifier);
 	if (equation != NULL) {
 		if (equation->type == EquationTypeFunction) { return (RuntimeError){ RuntimeErrorCodeIdentifierNotVariable, expression.start, expression.end, expression.line }; }
-		RuntimeError error = _EvaluateExpression(environment, NULL, equation->expression, depth + 1, result);
-		if (error.code == RuntimeErrorCodeNone) { SetEnvironmentCache(environment, expression.identifier, CopyVectorArray(*result)); }
+		// cached values are shared by every equation so they're always computed precisely
+		EvaluationProfile profile = context->profile;
+		context->profile = EvaluationProfilePrecise;
+		RuntimeError error = _EvaluateExpression(context, NULL, equation->expression, depth + 1, result, NULL);
+		bool half = false;
+		if (error.code == RuntimeErrorCodeNone) { error = EvaluateHalfAttribute(context, expression.identifier, depth, &half); }
+		context->profile = profile;
+		if (error.code != RuntimeErrorCodeNone) { return error; }
+		
+		// large arrays can opt into half precision storage, every read then sees the rounded values, and if another
+		// context published the same variable in the meantime everyone reads the first value published
+		if (half) {
+			HalfArray encoded = PublishEnvironmentHalfCache(context->environment, expression.identifier, EncodeHalfArray(*result));
+			FreeVectorArray(*result);
+			*result = DecodeHalfArray(encoded);
+		} else {
+			cached = PublishEnvironmentCache(context->environment, expression.identifier, *result);
+			context->snapshot = ListPush(context->snapshot, &(Binding){ .identifier = StringCreate(expression.identifier), .value = cached });
+			*result = CopyVectorArray(cached);
+		}
 		return error;
 	}
 	
 	BuiltinVariable variable = DetermineBuiltinVariable(expression.identifier);
 	if (variable != BuiltinVariableNone) {
-		return (RuntimeError){ EvaluateBuiltinVariable(*environment, variable, result), expression.start, expression.end, expression.line };
+		return (RuntimeError){ EvaluateBuiltinVariable(*context->environment, variable, result), expression.start, expression.end, expression.line };
 	}
 	
 	return (RuntimeError){ RuntimeErrorCodeUndefinedIdentifier, expression.start, expression.end, expression.line };
 }
 
-static RuntimeError EvaluateVectorLiteral(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+static RuntimeError EvaluateVectorLiteral(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
 	if (ListLength(expression.list) > 4) { return (RuntimeError){ RuntimeErrorCodeTooManyVectorElements, expression.start, expression.end, expression.line }; }
 	result->dimensions = 0;
 	result->length = -1; // uint -1
 	
-	VectorArray components[4];
-	for (int32_t i = 0, d = 0; i < ListLength(expression.list); i++) {
-		RuntimeError error = _EvaluateExpression(environment, parameters, expression.list[i], depth + 1, &components[i]);
+	VectorArray components[4], tangents[4];
+	for (int32_t i = 0; i < ListLength(expression.list); i++) {
+		RuntimeError error = _EvaluateExpression(context, parameters, expression.list[i], depth + 1, &components[i], tangent == NULL ? NULL : &tangents[i]);
 		if (error.code != RuntimeErrorCodeNone) {
 			for (int32_t j = 0; j < i; j++) { FreeVectorArray(components[j]); }
+			if (tangent != NULL) { for (int32_t j = 0; j < i; j++) { FreeVectorArray(tangents[j]); } }
 			return error;
 		}
 		result->dimensions += components[i].dimensions;
 		if (result->dimensions > 4) {
 			for (int32_t j = 0; j <= i; j++) { FreeVectorArray(components[j]); }
+			if (tangent != NULL) { for (int32_t j = 0; j <= i; j++) { FreeVectorArray(tangents[j]); } }
 			return (RuntimeError){ RuntimeErrorCodeTooManyVectorElements, expression.list[i].start, expression.list[i].end, expression.line };
 		}
 		
 		// length is set to the smallest length of each component not including length 1 (since length 1 will assume length of the rest of the vector)
 		if (components[i].length > 1) { result->length = components[i].length < result->length ? components[i].length : result->length; }
-		for (int32_t j = 0; j < components[i].dimensions; j++) {
-			result->xyzw[d++] = components[i].xyzw[j];
-		}
 	}
 	if (result->length == -1) { result->length = 1; } // if all the component lengths are 1 then result->length will still be -1, so set it to 1
 	
-	// go through all the components of length 1 extend it to be same length as the rest of the vector
+	// the components are copied into one block, extending those of length 1 to the length of the rest of the vector
+	*result = CreateVectorArray(result->dimensions, result->length);
 	for (int32_t i = 0, d = 0; i < ListLength(expression.list); i++) {
-		if (components[i].length == 1 && result->length > 1) {
-			for (int32_t j = 0; j < components[i].dimensions; j++) {
-				result->xyzw[d + j] = malloc(sizeof(scalar_t) * result->length);
-				for (int32_t k = 0; k < result->length; k++) { result->xyzw[d + j][k] = components[i].xyzw[j][0]; }
-				free(components[i].xyzw[j]);
+		if (components[i].length == result->length && components[i].columns > 0) { result->columns = components[i].columns; }
+		for (int32_t j = 0; j < components[i].dimensions; j++, d++) {
+			if (components[i].length == 1) { for (int32_t k = 0; k < result->length; k++) { result->xyzw[d][k] = components[i].xyzw[j][0]; } }
+			else { memcpy(result->xyzw[d], components[i].xyzw[j], result->length * sizeof(scalar_t)); }
+		}
+	}
+	
+	// the tangent is assembled the same way, with constant components contributing zeros
+	if (tangent != NULL) {
+		bool varies = false;
+		for (int32_t i = 0; i < ListLength(expression.list); i++) { varies |= tangents[i].dimensions > 0; }
+		*tangent = varies ? CreateVectorArray(result->dimensions, result->length) : (VectorArray){ .length = result->length };
+		for (int32_t i = 0, d = 0; i < ListLength(expression.list) && tangent->dimensions > 0; i++) {
+			for (int32_t j = 0; j < components[i].dimensions; j++, d++) {
+				if (tangents[i].dimensions == 0) { memset(tangent->xyzw[d], 0, result->length * sizeof(scalar_t)); }
+				else if (components[i].length == 1) { for (int32_t k = 0; k < result->length; k++) { tangent->xyzw[d][k] = tangents[i].xyzw[j][0]; } }
+				else { memcpy(tangent->xyzw[d], tangents[i].xyzw[j], result->length * sizeof(scalar_t)); }
 			}
 		}
-		d += components[i].dimensions;
+		for (int32_t i = 0; i < ListLength(expression.list); i++) { FreeVectorArray(tangents[i]); }
 	}
+	for (int32_t i = 0; i < ListLength(expression.list); i++) { FreeVectorArray(components[i]); }
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError EvaluateRange(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+static RuntimeError EvaluateRange(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
 	VectorArray left, right;
-	RuntimeError error = _EvaluateExpression(environment, parameters, *expression.binary.left, depth + 1, &left);
+	RuntimeError error = _EvaluateExpression(context, parameters, *expression.binary.left, depth + 1, &left, NULL);
 	if (error.code != RuntimeErrorCodeNone) { return error; }
-	error = _EvaluateExpression(environment, parameters, *expression.binary.right, depth + 1, &right);
+	error = _EvaluateExpression(context, parameters, *expression.binary.right, depth + 1, &right, NULL);
 	if (error.code != RuntimeErrorCodeNone) {
 		FreeVectorArray(left);
 		return error;
@@ -276,31 +602,57 @@ static RuntimeError EvaluateRange(Environment * environment, List(Binding) param
 	if (right.length != 1) { return (RuntimeError){ RuntimeErrorCodeInvalidRangeOperon, expression.binary.right->start, expression.binary.right->end, expression.line }; }
 	if (left.dimensions != right.dimensions) { return (RuntimeError){ RuntimeErrorCodeNonUniformRange, expression.start, expression.end, expression.line }; }
 	
-	result->dimensions = left.dimensions;
-	result->length = 1;
-	for (int32_t i = 0; i < result->dimensions; i++) {
-		result->length *= fabsf(roundf(right.xyzw[i][0]) - roundf(left.xyzw[i][0])) + 1;
+	double length = 1.0;
+	for (int32_t i = 0; i < left.dimensions; i++) { length *= fabs(round(right.xyzw[i][0]) - round(left.xyzw[i][0])) + 1.0; }
+	RuntimeErrorCode code = EvaluationContextReserve(context, left.dimensions, length);
+	if (code != RuntimeErrorCodeNone) {
+		FreeVectorArray(left);
+		FreeVectorArray(right);
+		return (RuntimeError){ code, expression.start, expression.end, expression.line };
 	}
+	result->dimensions = left.dimensions;
+	result->length = length;
 	
+	// integers are exact past where floats stop counting, and indexing reads them without rounding
+	*result = CreateTypedVectorArray(ElementTypeInt32, result->dimensions, result->length);
 	for (int32_t i = 0, p = 1; i < result->dimensions; i++) {
-		result->xyzw[i] = malloc(sizeof(scalar_t) * result->length);
-		int32_t start = roundf(left.xyzw[i][0]);
-		int32_t end = roundf(right.xyzw[i][0]);
+		int32_t start = round(left.xyzw[i][0]);
+		int32_t end = round(right.xyzw[i][0]);
 		int32_t len = abs(end - start) + 1;
+		int32_t * restrict n = VECTOR_ARRAY_INT32(*result, i);
 		if (start <= end) {
-			for (int32_t j = 0; j < result->length; j++) { result->xyzw[i][j] = (j / p) % len + start; }
+			for (int32_t j = 0; j < result->length; j++) { n[j] = (j / p) % len + start; }
 		} else {
-			for (int32_t j = 0; j < result->length; j++) { result->xyzw[i][j] = start - (j / p) % len; }
+			for (int32_t j = 0; j < result->length; j++) { n[j] = start - (j / p) % len; }
 		}
 		p *= len;
 	}
 	
+	// x varies fastest, so a 2D range is a grid with one row per y value
+	if (result->dimensions == 2) { result->columns = abs((int32_t)round(right.xyzw[0][0]) - (int32_t)round(left.xyzw[0][0])) + 1; }
+	
+	// ranges are integer valued so they are locally constant
+	if (tangent != NULL) { *tangent = (VectorArray){ 0 }; }
 	FreeVectorArray(left);
 	FreeVectorArray(right);
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError EvaluateFor(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+static void ConcatenateTangents(VectorArray * values, VectorArray * tangents, int32_t count, VectorArray result, VectorArray * tangent) {
+	bool varies = false;
+	for (int32_t j = 0; j < count; j++) { varies |= tangents[j].dimensions > 0; }
+	*tangent = varies ? CreateVectorArray(result.dimensions, result.length) : (VectorArray){ .length = result.length };
+	for (int32_t i = 0; i < tangent->dimensions; i++) {
+		for (int32_t j = 0, p = 0; j < count; j++) {
+			if (tangents[j].dimensions == 0) { memset(tangent->xyzw[i] + p, 0, values[j].length * sizeof(scalar_t)); }
+			else { memcpy(tangent->xyzw[i] + p, tangents[j].xyzw[i], values[j].length * sizeof(scalar_t)); }
+			p += values[j].length;
+		}
+	}
+	for (int32_t j = 0; j < count; j++) { FreeVectorArray(tangents[j]); }
+}
+
+static RuntimeError EvaluateFor(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
 	Expression * left, * right;
 	if (expression.type == ExpressionTypeTernary) {
 		left = expression.ternary.left;
@@ -311,8 +663,8 @@ static RuntimeError EvaluateFor(Environment * environment, List(Binding) paramet
 	}
 	
 	if (right->type != ExpressionTypeForAssignment) { return (RuntimeError){ RuntimeErrorCodeMissingForAssignment, right->start, right->end, expression.line }; }
-	VectorArray assignment;
-	RuntimeError error = _EvaluateExpression(environment, parameters, *right->assignment.expression, depth + 1, &assignment);
+	VectorArray assignment, assignmentTangent = { 0 };
+	RuntimeError error = _EvaluateExpression(context, parameters, *right->assignment.expression, depth + 1, &assignment, tangent == NULL ? NULL : &assignmentTangent);
 	if (error.code != RuntimeErrorCodeNone) { return error; }
 	
 	if (parameters == NULL) { parameters = ListCreate(sizeof(Binding), 1); }
@@ -322,15 +674,18 @@ static RuntimeError EvaluateFor(Environment * environment, List(Binding) paramet
 	result->dimensions = 0;
 	result->length = 0;
 	VectorArray * values = malloc(assignment.length * sizeof(VectorArray));
+	VectorArray * tangents = tangent == NULL ? NULL : malloc(assignment.length * sizeof(VectorArray));
 	int32_t c = 0;
 	for (int32_t i = 0; i < assignment.length; i++) {
 		parameters[0].value.length = 1;
 		parameters[0].value.dimensions = assignment.dimensions;
 		for (int32_t j = 0; j < assignment.dimensions; j++) { parameters[0].value.xyzw[j] = &assignment.xyzw[j][i]; }
+		parameters[0].tangent = (VectorArray){ .length = 1, .dimensions = assignmentTangent.dimensions };
+		for (int32_t j = 0; j < assignmentTangent.dimensions; j++) { parameters[0].tangent.xyzw[j] = &assignmentTangent.xyzw[j][i]; }
 		
 		if (expression.type == ExpressionTypeTernary) {
 			VectorArray condition;
-			RuntimeError error = _EvaluateExpression(environment, parameters, *expression.ternary.right, depth + 1, &condition);
+			RuntimeError error = EvaluateTypedExpression(context, parameters, *expression.ternary.right, depth + 1, &condition, NULL);
 			if (error.code != RuntimeErrorCodeNone) { return error; }
 			if (!TruthyVectorArray(condition)) {
 				FreeVectorArray(condition);
@@ -340,14 +695,26 @@ static RuntimeError EvaluateFor(Environment * environment, List(Binding) paramet
 		}
 		
 		RuntimeError error;
-		if (left->type == ExpressionTypeBinary && left->binary.operator == OperatorRange) { error = EvaluateRange(environment, parameters, *left, depth, &values[c]); }
-		else if (left->type == ExpressionTypeBinary && left->binary.operator == OperatorFor) { error = EvaluateFor(environment, parameters, *left, depth, &values[c]); }
-		else if (left->type == ExpressionTypeTernary && left->ternary.leftOperator == OperatorFor) { error = EvaluateFor(environment, parameters, *left, depth, &values[c]); }
-		else { error = _EvaluateExpression(environment, parameters, *left, depth + 1, &values[c]); }
+		VectorArray * elementTangent = tangent == NULL ? NULL : &tangents[c];
+		if (left->type == ExpressionTypeBinary && left->binary.operator == OperatorRange) { error = EvaluateRange(context, parameters, *left, depth, &values[c], elementTangent); }
+		else if (left->type == ExpressionTypeBinary && left->binary.operator == OperatorFor) { error = EvaluateFor(context, parameters, *left, depth, &values[c], elementTangent); }
+		else if (left->type == ExpressionTypeTernary && left->ternary.leftOperator == OperatorFor) { error = EvaluateFor(context, parameters, *left, depth, &values[c], elementTangent); }
+		else { error = _EvaluateExpression(context, parameters, *left, depth + 1, &values[c], elementTangent); }
 		if (error.code != RuntimeErrorCodeNone) { goto free; }
+		ScalarizeVectorArray(&values[c]);
 		if (result->dimensions == 0) { result->dimensions = values[c].dimensions; }
 		if (values[c].dimensions != result->dimensions) {
 			error = (RuntimeError){ RuntimeErrorCodeNonUniformArray, left->start, left->end, expression.line };
+			FreeVectorArray(values[c]);
+			if (tangent != NULL) { FreeVectorArray(tangents[c]); }
+			goto free;
+		}
+		// only the new elements count against the budget, the whole array still has to fit its length
+		RuntimeErrorCode code = (double)result->length + values[c].length > UINT32_MAX ? RuntimeErrorCodeExceededMemoryBudget : EvaluationContextReserve(context, result->dimensions, values[c].length);
+		if (code != RuntimeErrorCodeNone) {
+			error = (RuntimeError){ code, expression.start, expression.end, expression.line };
+			FreeVectorArray(values[c]);
+			if (tangent != NULL) { FreeVectorArray(tangents[c]); }
 			goto free;
 		}
 		
@@ -356,71 +723,114 @@ static RuntimeError EvaluateFor(Environment * environment, List(Binding) paramet
 		continue;
 	free:
 		FreeVectorArray(assignment);
+		FreeVectorArray(assignmentTangent);
 		for (int32_t j = 0; j < c; j++) { FreeVectorArray(values[j]); }
+		if (tangent != NULL) { for (int32_t j = 0; j < c; j++) { FreeVectorArray(tangents[j]); } }
+		free(values);
+		free(tangents);
 		ListFree(parameters);
 		return error;
 	}
 	
+	if (tangent != NULL) { ConcatenateTangents(values, tangents, c, *result, tangent); }
+	*result = CreateVectorArray(result->dimensions, result->length);
+	result->kind = c > 0 ? NumberKindComplex : NumberKindReal;
+	for (int32_t j = 0; j < c; j++) { if (!IsVectorArrayComplex(values[j])) { result->kind = NumberKindReal; } }
 	for (int32_t i = 0; i < result->dimensions; i++) {
-		result->xyzw[i] = malloc(result->length * sizeof(scalar_t));
 		for (int32_t j = 0, p = 0; j < c; j++) {
 			memcpy(result->xyzw[i] + p, values[j].xyzw[i], values[j].length * sizeof(scalar_t));
 			p += values[j].length;
-			free(values[j].xyzw[i]);
 		}
 	}
+	for (int32_t j = 0; j < c; j++) { FreeVectorArray(values[j]); }
 	free(values);
+	free(tangents);
 	FreeVectorArray(assignment);
+	FreeVectorArray(assignmentTangent);
 	ListFree(parameters);
 	
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError EvaluateArrayLiteral(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+static RuntimeError EvaluateArrayLiteral(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
 	result->dimensions = 0;
 	result->length = 0;
 	
 	// evaluate each element of the array and store them in elements temporarily
 	VectorArray * elements = malloc(sizeof(VectorArray) * ListLength(expression.list));
+	VectorArray * tangents = tangent == NULL ? NULL : malloc(sizeof(VectorArray) * ListLength(expression.list));
 	for (int32_t i = 0; i < ListLength(expression.list); i++) {
 		RuntimeError error;
+		VectorArray * elementTangent = tangent == NULL ? NULL : &tangents[i];
 		if (expression.list[i].type == ExpressionTypeBinary && expression.list[i].binary.operator == OperatorRange) {
-			error = EvaluateRange(environment, parameters, expression.list[i], depth, &elements[i]);
+			error = EvaluateRange(context, parameters, expression.list[i], depth, &elements[i], elementTangent);
 		} else if (expression.list[i].type == ExpressionTypeBinary && expression.list[i].binary.operator == OperatorFor) {
-			error = EvaluateFor(environment, parameters, expression.list[i], depth, &elements[i]);
+			error = EvaluateFor(context, parameters, expression.list[i], depth, &elements[i], elementTangent);
 		} else if (expression.list[i].type == ExpressionTypeTernary && expression.list[i].ternary.leftOperator == OperatorFor) {
-			error = EvaluateFor(environment, parameters, expression.list[i], depth, &elements[i]);
+			error = EvaluateFor(context, parameters, expression.list[i], depth, &elements[i], elementTangent);
 		} else {
-			error = _EvaluateExpression(environment, parameters, expression.list[i], depth + 1, &elements[i]);
+			error = EvaluateTypedExpression(context, parameters, expression.list[i], depth + 1, &elements[i], elementTangent);
 		}
 		if (error.code != RuntimeErrorCodeNone) { goto free; }
 		
 		if (result->dimensions == 0) { result->dimensions = elements[i].dimensions; } // dimension of array is defined to be dimension of the first element
 		if (elements[i].dimensions != result->dimensions) {
 			error = (RuntimeError){ RuntimeErrorCodeNonUniformArray, expression.list[i].start, expression.list[i].end, expression.line };
+			FreeVectorArray(elements[i]);
+			if (tangent != NULL) { FreeVectorArray(tangents[i]); }
+			goto free;
+		}
+		// only the new elements count against the budget, the whole array still has to fit its length
+		RuntimeErrorCode code = (double)result->length + elements[i].length > UINT32_MAX ? RuntimeErrorCodeExceededMemoryBudget : EvaluationContextReserve(context, result->dimensions, elements[i].length);
+		if (code != RuntimeErrorCodeNone) {
+			error = (RuntimeError){ code, expression.start, expression.end, expression.line };
+			FreeVectorArray(elements[i]);
+			if (tangent != NULL) { FreeVectorArray(tangents[i]); }
 			goto free;
 		}
 		result->length += elements[i].length;
 		continue;
 	free:
 		for (int32_t j = 0; j < i; j++) { FreeVectorArray(elements[j]); }
+		if (tangent != NULL) { for (int32_t j = 0; j < i; j++) { FreeVectorArray(tangents[j]); } }
 		free(elements);
+		free(tangents);
 		return error;
 	}
 	
-	for (int32_t i = 0; i < result->dimensions; i++) {
-		if (ListLength(expression.list) == 1) { result->xyzw[i] = elements[0].xyzw[i]; } // if there's only one element then just move the pointer to save time
-		else {
-			result->xyzw[i] = malloc(sizeof(scalar_t) * result->length);
+	if (tangent != NULL) {
+		if (ListLength(expression.list) == 1) { *tangent = tangents[0]; }
+		else { ConcatenateTangents(elements, tangents, ListLength(expression.list), *result, tangent); }
+	}
+	bool integers = true;
+	for (int32_t j = 0; j < ListLength(expression.list); j++) { integers &= elements[j].type == ElementTypeInt32; }
+	if (ListLength(expression.list) == 1) { *result = elements[0]; } // if there's only one element then just move it to save time
+	else if (integers) {
+		// ranges joined together stay integers
+		*result = CreateTypedVectorArray(ElementTypeInt32, result->dimensions, result->length);
+		for (int32_t i = 0; i < result->dimensions; i++) {
+			for (int32_t j = 0, p = 0; j < ListLength(expression.list); j++) {
+				memcpy(VECTOR_ARRAY_INT32(*result, i) + p, VECTOR_ARRAY_INT32(elements[j], i), elements[j].length * sizeof(int32_t));
+				p += elements[j].length;
+			}
+		}
+		for (int32_t j = 0; j < ListLength(expression.list); j++) { FreeVectorArray(elements[j]); }
+	} else {
+		for (int32_t j = 0; j < ListLength(expression.list); j++) { ScalarizeVectorArray(&elements[j]); }
+		*result = CreateVectorArray(result->dimensions, result->length);
+		result->kind = NumberKindComplex;
+		for (int32_t j = 0; j < ListLength(expression.list); j++) { if (!IsVectorArrayComplex(elements[j])) { result->kind = NumberKindReal; } }
+		for (int32_t i = 0; i < result->dimensions; i++) {
 			for (int32_t j = 0, p = 0; j < ListLength(expression.list); j++) {
 				memcpy(result->xyzw[i] + p, elements[j].xyzw[i], elements[j].length * sizeof(scalar_t));
 				p += elements[j].length;
-				free(elements[j].xyzw[i]);
 			}
 		}
+		for (int32_t j = 0; j < ListLength(expression.list); j++) { FreeVectorArray(elements[j]); }
 	}
 	
 	free(elements);
+	free(tangents);
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
@@ -428,14 +838,68 @@ static inline scalar_t ApplyUnaryArithmetic(scalar_t value, Operator operator) {
 	switch (operator) {
 		case OperatorNegate: return -value;
 		case OperatorNot: return !value;
-		case OperatorFactorial: return tgammaf(value + 1.0);
+		case OperatorFactorial: return tgamma(value + 1.0);
 		default: return NAN;
 	}
 }
 
-static RuntimeError EvaluateUnary(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
-	RuntimeError error = _EvaluateExpression(environment, parameters, *expression.unary.expression, depth + 1, result);
+static bool EvaluateTypedUnary(Operator operator, VectorArray * value) {
+	// negated integers and inverted masks keep their type, anything else goes through scalars
+	if (operator == OperatorNot && value->type == ElementTypeBool) {
+		uint32_t words = (value->length + 63) / 64;
+		for (int32_t i = 0; i < value->dimensions && words > 0; i++) {
+			uint64_t * bits = VECTOR_ARRAY_BITS(*value, i);
+			for (uint32_t w = 0; w < words; w++) { bits[w] = ~bits[w]; }
+			if (value->length % 64 != 0) { bits[words - 1] &= (1ull << (value->length % 64)) - 1; }
+		}
+		return true;
+	}
+	if (operator == OperatorNot && value->type == ElementTypeInt32) {
+		VectorArray mask = CreateTypedVectorArray(ElementTypeBool, value->dimensions, value->length);
+		mask.columns = value->columns;
+		for (int32_t i = 0; i < value->dimensions; i++) {
+			const int32_t * n = VECTOR_ARRAY_INT32(*value, i);
+			uint64_t * bits = VECTOR_ARRAY_BITS(mask, i);
+			for (uint32_t j = 0; j < value->length; j++) { bits[j >> 6] |= (uint64_t)(n[j] == 0) << (j & 63); }
+		}
+		FreeVectorArray(*value);
+		*value = mask;
+		return true;
+	}
+	if (operator == OperatorNegate && value->type == ElementTypeInt32) {
+		for (int32_t i = 0; i < value->dimensions; i++) {
+			for (uint32_t j = 0; j < value->length; j++) {
+				if (VECTOR_ARRAY_INT32(*value, i)[j] == INT32_MIN) { return false; }
+			}
+		}
+		for (int32_t i = 0; i < value->dimensions; i++) {
+			int32_t * n = VECTOR_ARRAY_INT32(*value, i);
+			for (uint32_t j = 0; j < value->length; j++) { n[j] = -n[j]; }
+		}
+		return true;
+	}
+	return false;
+}
+
+static RuntimeError EvaluateUnary(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
+	RuntimeError error = EvaluateTypedExpression(context, parameters, *expression.unary.expression, depth + 1, result, tangent);
 	if (error.code != RuntimeErrorCodeNone) { return error; }
+	if (result->type != ElementTypeScalar && EvaluateTypedUnary(expression.unary.operator, result)) { return (RuntimeError){ RuntimeErrorCodeNone }; }
+	ScalarizeVectorArray(result);
+	if (tangent != NULL && tangent->dimensions > 0) {
+		if (expression.unary.operator == OperatorFactorial) {
+			return (RuntimeError){ EvaluateBuiltinFunctionTangent(context, BuiltinFunctionFACTORIAL, NULL, NULL, result, tangent), expression.start, expression.end, expression.line };
+		}
+		if (expression.unary.operator == OperatorNot) {
+			FreeVectorArray(*tangent);
+			*tangent = (VectorArray){ 0 };
+		}
+		if (expression.unary.operator == OperatorNegate) {
+			for (int32_t i = 0; i < tangent->dimensions; i++) {
+				for (int32_t j = 0; j < tangent->length; j++) { tangent->xyzw[i][j] = -tangent->xyzw[i][j]; }
+			}
+		}
+	}
 	for (int32_t i = 0; i < result->dimensions; i++) {
 		for (int32_t j = 0; j < result->length; j++) {
 			result->xyzw[i][j] = ApplyUnaryArithmetic(result->xyzw[i][j], expression.unary.operator);
@@ -451,60 +915,78 @@ static bool IsIdentifierSwizzling(String identifier) {
 	return true;
 }
 
-static RuntimeError EvaluateDimension(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+static void SwizzleVectorArray(String swizzle, VectorArray indexed, VectorArray * result) {
+	// a prefix like .xy keeps the block and just drops the trailing channels, anything else is rearranged into a new one
+	bool prefix = true;
+	for (int32_t i = 0; i < StringLength(swizzle); i++) { prefix &= swizzle[i] - 'x' == i; }
+	if (prefix) {
+		*result = indexed;
+		result->dimensions = StringLength(swizzle);
+		result->kind = NumberKindReal;
+		return;
+	}
+	*result = CreateVectorArray(StringLength(swizzle), indexed.length);
+	result->columns = indexed.columns;
+	for (int32_t i = 0; i < result->dimensions; i++) { memcpy(result->xyzw[i], indexed.xyzw[swizzle[i] - 'x'], result->length * sizeof(scalar_t)); }
+	FreeVectorArray(indexed);
+}
+
+static RuntimeError EvaluateDimension(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
 	if (expression.binary.right->type != ExpressionTypeIdentifier || !IsIdentifierSwizzling(expression.binary.right->identifier)) {
 		return (RuntimeError){ RuntimeErrorCodeInvalidDimensionOperon, expression.binary.right->start, expression.binary.right->end, expression.line };
 	}
 	
-	VectorArray indexed;
-	RuntimeError error = _EvaluateExpression(environment, parameters, *expression.binary.left, depth + 1, &indexed);
+	VectorArray indexed, indexedTangent;
+	RuntimeError error = _EvaluateExpression(context, parameters, *expression.binary.left, depth + 1, &indexed, tangent == NULL ? NULL : &indexedTangent);
 	if (error.code != RuntimeErrorCodeNone) { return error; }
 	
-	result->dimensions = StringLength(expression.binary.right->identifier);
-	result->length = indexed.length;
-	bool shouldDuplicate[4] = { false, false, false, false }; // keeps track of duplicate vectors (e.g. .xxyz)
-	for (int32_t i = 0; i < result->dimensions; i++) {
-		int32_t component = expression.binary.right->identifier[i] - 'x';
-		if (component >= indexed.dimensions) {
+	String swizzle = expression.binary.right->identifier;
+	for (int32_t i = 0; i < StringLength(swizzle); i++) {
+		if (swizzle[i] - 'x' >= indexed.dimensions) {
 			FreeVectorArray(indexed);
+			if (tangent != NULL) { FreeVectorArray(indexedTangent); }
 			return (RuntimeError){ RuntimeErrorCodeInvalidSwizzling, expression.binary.right->start, expression.binary.right->end, expression.line };
 		}
-		
-		if (!shouldDuplicate[component]) {
-			result->xyzw[i] = indexed.xyzw[component];
-			shouldDuplicate[component] = true;
-		} else {
-			result->xyzw[i] = malloc(result->length * sizeof(scalar_t));
-			memcpy(result->xyzw[i], indexed.xyzw[component], result->length * sizeof(scalar_t));
-		}
- 	}
+	}
 	
-	for (int32_t i = 0; i < indexed.dimensions; i++) {
-		if (!shouldDuplicate[i]) { free(indexed.xyzw[i]); }
+	SwizzleVectorArray(swizzle, indexed, result);
+	if (tangent != NULL) {
+		if (indexedTangent.dimensions > 0) { SwizzleVectorArray(swizzle, indexedTangent, tangent); }
+		else { *tangent = (VectorArray){ 0 }; }
 	}
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError EvaluateIndex(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
-	VectorArray indexed, indices;
-	RuntimeError error = _EvaluateExpression(environment, parameters, *expression.binary.right, depth + 1, &indices);
+static void GatherVectorArray(VectorArray indexed, VectorArray indices, VectorArray * result) {
+	*result = CreateVectorArray(indexed.dimensions, indices.length);
+	result->kind = indexed.kind == NumberKindComplex ? NumberKindComplex : NumberKindReal;
+	const int32_t * integers = indices.type == ElementTypeInt32 ? VECTOR_ARRAY_INT32(indices, 0) : NULL;
+	for (int32_t i = 0; i < result->dimensions; i++) {
+		for (int32_t j = 0; j < indices.length; j++) {
+			int32_t index = integers != NULL ? integers[j] : round(indices.xyzw[0][j]);
+			if (index < 0 || index >= indexed.length) { result->xyzw[i][j] = NAN; }
+			else { result->xyzw[i][j] = indexed.xyzw[i][index]; }
+		}
+	}
+}
+
+static RuntimeError EvaluateIndex(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
+	VectorArray indexed, indices, indexedTangent;
+	RuntimeError error = EvaluateTypedExpression(context, parameters, *expression.binary.right, depth + 1, &indices, NULL);
 	if (error.code != RuntimeErrorCodeNone) { return error; }
+	if (indices.type == ElementTypeBool) { ScalarizeVectorArray(&indices); }
 	if (indices.dimensions > 1) { return (RuntimeError){ RuntimeErrorCodeInvalidIndexDimension, expression.binary.right->start, expression.binary.right->end, expression.line }; }
-	error = _EvaluateExpression(environment, parameters, *expression.binary.left, depth + 1, &indexed);
+	error = _EvaluateExpression(context, parameters, *expression.binary.left, depth + 1, &indexed, tangent == NULL ? NULL : &indexedTangent);
 	if (error.code != RuntimeErrorCodeNone) {
 		FreeVectorArray(indices);
 		return error;
 	}
 	
-	result->length = indices.length;
-	result->dimensions = indexed.dimensions;
-	for (int32_t i = 0; i < result->dimensions; i++) {
-		result->xyzw[i] = malloc(result->length * sizeof(scalar_t));
-		for (int32_t j = 0; j < indices.length; j++) {
-			int32_t index = roundf(indices.xyzw[0][j]);
-			if (index < 0 || index >= indexed.length) { result->xyzw[i][j] = NAN; }
-			else { result->xyzw[i][j] = indexed.xyzw[i][index]; }
-		}
+	GatherVectorArray(indexed, indices, result);
+	if (tangent != NULL) {
+		*tangent = (VectorArray){ 0 };
+		if (indexedTangent.dimensions > 0) { GatherVectorArray(indexedTangent, indices, tangent); }
+		FreeVectorArray(indexedTangent);
 	}
 	
 	FreeVectorArray(indexed);
@@ -512,24 +994,41 @@ static RuntimeError EvaluateIndex(Environment * environment, List(Binding) param
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError EvaluateArguments(Environment * environment, List(Binding) parameters, Expression expression, List(String) variables, int32_t depth, List(Binding) * arguments) {
+static RuntimeError EvaluateArguments(EvaluationContext * context, List(Binding) parameters, Expression expression, List(String) variables, int32_t depth, bool differentiate, List(Binding) * arguments) {
 	if (ListLength(variables) != ListLength(expression.binary.right->list)) {
 		return (RuntimeError){ RuntimeErrorCodeIncorrectArgumentCount, expression.binary.right->start, expression.binary.right->end, expression.line };
 	}
 	
 	for (int32_t i = 0; i < ListLength(expression.binary.right->list); i++) {
-		VectorArray argument;
-		RuntimeError error = _EvaluateExpression(environment, parameters, expression.binary.right->list[i], depth + 1, &argument);
+		VectorArray argument, argumentTangent = { 0 };
+		RuntimeError error = _EvaluateExpression(context, parameters, expression.binary.right->list[i], depth + 1, &argument, differentiate ? &argumentTangent : NULL);
 		if (error.code != RuntimeErrorCodeNone) {
 			for (int32_t j = 0; j < i; j++) { FreeBinding((*arguments)[j]); }
 			return error;
 		}
-		*arguments = ListPush(*arguments, &(Binding){ .identifier = StringCreate(variables[i]), .value = argument });
+		*arguments = ListPush(*arguments, &(Binding){ .identifier = StringCreate(variables[i]), .value = argument, .tangent = argumentTangent });
 	}
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError EvaluateCall(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+typedef struct BuiltinJob {
+	EvaluationContext * context;
+	BuiltinFunction function;
+	VectorArray value;
+	atomic_int code; // the first error any slice ran into
+} BuiltinJob;
+
+static void RunBuiltinJob(void * data, uint32_t start, uint32_t end) {
+	// the elementwise builtins work in place, so each slice is a view into the channels
+	BuiltinJob * job = data;
+	VectorArray slice = job->value;
+	for (int32_t d = 0; d < slice.dimensions; d++) { slice.xyzw[d] += start; }
+	slice.length = end - start;
+	RuntimeErrorCode code = job->context->profile == EvaluationProfileFast ? EvaluateBuiltinFunctionFast(job->context, job->function, &slice, NULL) : EvaluateBuiltinFunction(job->context, job->function, NULL, &slice);
+	if (code != RuntimeErrorCodeNone) { atomic_store(&job->code, code); }
+}
+
+static RuntimeError EvaluateCall(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
 	if (expression.binary.left->type != ExpressionTypeIdentifier) {
 		return (RuntimeError){ RuntimeErrorCodeUncallableExpression, expression.binary.left->start, expression.binary.left->end, expression.line };
 	}
@@ -537,15 +1036,15 @@ static RuntimeError EvaluateCall(Environment * environment, List(Binding) parame
 		return (RuntimeError){ RuntimeErrorCodeInvalidArgumentsExpression, expression.binary.right->start, expression.binary.right->end, expression.line };
 	}
 	
-	Equation * equation = GetEnvironmentEquation(environment, expression.binary.left->identifier);
+	Equation * equation = GetEnvironmentEquation(context->environment, expression.binary.left->identifier);
 	if (equation != NULL) {
 		if (equation->type == EquationTypeVariable) {
 			return (RuntimeError){ RuntimeErrorCodeIdentifierNotFunction, expression.binary.left->start, expression.binary.left->end, expression.line };
 		}
 		
 		List(Binding) arguments = ListCreate(sizeof(Binding), 1);
-		RuntimeError error = EvaluateArguments(environment, parameters, expression, equation->declaration.parameters, depth, &arguments);
-		if (error.code == RuntimeErrorCodeNone) { error = _EvaluateExpression(environment, arguments, equation->expression, depth + 1, result); }
+		RuntimeError error = EvaluateArguments(context, parameters, expression, equation->declaration.parameters, depth, tangent != NULL, &arguments);
+		if (error.code == RuntimeErrorCodeNone) { error = _EvaluateExpression(context, arguments, equation->expression, depth + 1, result, tangent); }
 		for (int32_t j = 0; j < ListLength(arguments); j++) { FreeBinding(arguments[j]); }
 		ListFree(arguments);
 		return error;
@@ -557,21 +1056,50 @@ static RuntimeError EvaluateCall(Environment * environment, List(Binding) parame
 			if (ListLength(expression.binary.right->list) != 1) {
 				return (RuntimeError){ RuntimeErrorCodeIncorrectArgumentCount, expression.binary.right->start, expression.binary.right->end, expression.line };
 			}
-			RuntimeError error = _EvaluateExpression(environment, parameters, expression.binary.right->list[0], depth + 1, result);
+			RuntimeError error = _EvaluateExpression(context, parameters, expression.binary.right->list[0], depth + 1, result, tangent);
 			if (error.code != RuntimeErrorCodeNone) { return error; }
-			return (RuntimeError){ EvaluateBuiltinFunction(function, NULL, result), expression.start, expression.end, expression.line };
+			bool fast = context->profile == EvaluationProfileFast;
+			if (tangent == NULL && IsFunctionElementwise(function) && !IsVectorArrayComplex(*result)
+				&& PlanExecution(EstimateBuiltinCost(function, fast), result->dimensions, result->length) == ExecutionStrategyParallel) {
+				BuiltinJob job = { context, function, *result, RuntimeErrorCodeNone };
+				ParallelFor(result->length, RunBuiltinJob, &job);
+				return (RuntimeError){ atomic_load(&job.code), expression.start, expression.end, expression.line };
+			}
+			if (fast) { return (RuntimeError){ EvaluateBuiltinFunctionFast(context, function, result, tangent), expression.start, expression.end, expression.line }; }
+			if (tangent != NULL) { return (RuntimeError){ EvaluateBuiltinFunctionTangent(context, function, NULL, NULL, result, tangent), expression.start, expression.end, expression.line }; }
+			return (RuntimeError){ EvaluateBuiltinFunction(context, function, NULL, result), expression.start, expression.end, expression.line };
 		} else {
 			List(VectorArray) arguments = ListCreate(sizeof(VectorArray), 1);
+			List(VectorArray) tangents = tangent == NULL ? NULL : ListCreate(sizeof(VectorArray), 1);
 			for (int32_t i = 0; i < ListLength(expression.binary.right->list); i++) {
 				arguments = ListPush(arguments, &(VectorArray){ 0 });
-				RuntimeError error = _EvaluateExpression(environment, parameters, expression.binary.right->list[i], depth + 1, &arguments[i]);
+				if (tangent != NULL) { tangents = ListPush(tangents, &(VectorArray){ 0 }); }
+				RuntimeError error = _EvaluateExpression(context, parameters, expression.binary.right->list[i], depth + 1, &arguments[i], tangent == NULL ? NULL : &tangents[i]);
 				if (error.code != RuntimeErrorCodeNone) {
 					for (int32_t j = 0; j < i; j++) { FreeVectorArray(arguments[j]); }
 					ListFree(arguments);
+					if (tangent != NULL) {
+						for (int32_t j = 0; j < i; j++) { FreeVectorArray(tangents[j]); }
+						ListFree(tangents);
+					}
 					return error;
 				}
 			}
-			RuntimeErrorCode code = EvaluateBuiltinFunction(function, arguments, result);
+			RuntimeErrorCode code;
+			context->callSite = (uint64_t)(uint32_t)expression.line << 32 | (uint32_t)expression.start;
+			// a variable's points can keep their index between calls, unless a parameter of the same name hides it
+			context->points = NULL;
+			if ((function == BuiltinFunctionNEAREST || function == BuiltinFunctionWITHIN) && ListLength(expression.binary.right->list) > 1) {
+				Expression points = expression.binary.right->list[1];
+				bool parameter = false;
+				for (int32_t i = 0; parameters != NULL && i < ListLength(parameters); i++) { parameter |= points.type == ExpressionTypeIdentifier && StringEquals(parameters[i].identifier, points.identifier); }
+				if (points.type == ExpressionTypeIdentifier && !parameter) { context->points = points.identifier; }
+			}
+			if (tangent != NULL) {
+				code = EvaluateBuiltinFunctionTangent(context, function, arguments, tangents, result, tangent);
+				for (int32_t j = 0; j < ListLength(expression.binary.right->list); j++) { FreeVectorArray(tangents[j]); }
+				ListFree(tangents);
+			} else { code = EvaluateBuiltinFunction(context, function, arguments, result); }
 			for (int32_t j = 0; j < ListLength(expression.binary.right->list); j++) { FreeVectorArray(arguments[j]); }
 			ListFree(arguments);
 			return (RuntimeError){ code, expression.start, expression.end, expression.line };
@@ -581,14 +1109,14 @@ static RuntimeError EvaluateCall(Environment * environment, List(Binding) parame
 	return (RuntimeError){ RuntimeErrorCodeUndefinedIdentifier, expression.binary.left->start, expression.binary.left->end, expression.line };
 }
 
-static inline scalar_t ApplyBinaryArithmetic(scalar_t a, scalar_t b, Operator operator) {
+static inline scalar_t ApplyBinaryArithmetic(scalar_t a, scalar_t b, Operator operator, bool fast) {
 	switch (operator) {
 		case OperatorAdd: return a + b;
 		case OperatorSubtract: return a - b;
 		case OperatorMultiply: return a * b;
 		case OperatorDivide: return a / b;
-		case OperatorModulo: return fmodf(a, b);
-		case OperatorPower: return powf(a, b);
+		case OperatorModulo: return fmod(a, b);
+		case OperatorPower: return fast ? fast_pow(a, b) : pow(a, b);
 		case OperatorEqual: return a == b;
 		case OperatorNotEqual: return a != b;
 		case OperatorGreater: return a > b;
@@ -599,20 +1127,194 @@ static inline scalar_t ApplyBinaryArithmetic(scalar_t a, scalar_t b, Operator op
 	}
 }
 
-static RuntimeError EvaluateBinaryArithmetic(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
-	VectorArray left, right;
-	RuntimeError error = _EvaluateExpression(environment, parameters, *expression.binary.left, depth + 1, &left);
+static inline scalar_t ApplyBinaryTangent(scalar_t a, scalar_t b, scalar_t da, scalar_t db, scalar_t value, Operator operator) {
+	// derivative of a (operator) b given the derivatives of a and b, value is the already computed a (operator) b
+	switch (operator) {
+		case OperatorAdd: return da + db;
+		case OperatorSubtract: return da - db;
+		case OperatorMultiply: return da * b + a * db;
+		case OperatorDivide: return (da - value * db) / b;
+		case OperatorModulo: return da - db * trunc(a / b);
+		case OperatorPower: return (da == 0.0 ? 0.0 : b * pow(a, b - 1.0) * da) + (db == 0.0 ? 0.0 : value * log(a) * db);
+		default: return 0.0;
+	}
+}
+
+static inline bool IsComparisonOperator(Operator operator) { return operator >= OperatorEqual && operator <= OperatorLessEqual; }
+
+static inline bool ApplyComparison(double a, double b, Operator operator) {
+	switch (operator) {
+		case OperatorEqual: return a == b;
+		case OperatorNotEqual: return a != b;
+		case OperatorGreater: return a > b;
+		case OperatorGreaterEqual: return a >= b;
+		case OperatorLess: return a < b;
+		default: return a <= b;
+	}
+}
+
+static bool IntegerOperand(VectorArray * value) {
+	// integer arrays, or a single integer valued scalar like the 2 in [0..n] * 2
+	if (value->type == ElementTypeInt32) { return true; }
+	if (value->type != ElementTypeScalar || value->length != 1 || value->kind != NumberKindReal) { return false; }
+	for (int32_t i = 0; i < value->dimensions; i++) {
+		scalar_t x = value->xyzw[i][0];
+		if (!(x == round(x) && fabs(x) < 2147483648.0)) { return false; }
+	}
+	VectorArray integer = CreateTypedVectorArray(ElementTypeInt32, value->dimensions, 1);
+	for (int32_t i = 0; i < value->dimensions; i++) { VECTOR_ARRAY_INT32(integer, i)[0] = value->xyzw[i][0]; }
+	FreeVectorArray(*value);
+	*value = integer;
+	return true;
+}
+
+static bool EvaluateTypedBinary(Operator operator, VectorArray * left, VectorArray * right, bool constant, VectorArray * result) {
+	// comparisons become masks and integer arithmetic stays integer, false leaves the operator to the scalar path
+	bool comparison = IsComparisonOperator(operator);
+	bool integer = operator == OperatorAdd || operator == OperatorSubtract || operator == OperatorMultiply || operator == OperatorModulo;
+	if (!comparison && !(integer && constant && (left->type == ElementTypeInt32 || right->type == ElementTypeInt32))) { return false; }
+	if (left->type == ElementTypeBool) { ScalarizeVectorArray(left); }
+	if (right->type == ElementTypeBool) { ScalarizeVectorArray(right); }
+	bool integers = (left->type == ElementTypeInt32 || right->type == ElementTypeInt32) && IntegerOperand(left) && IntegerOperand(right);
+	if (!comparison && !integers) { return false; }
+	if (!integers) {
+		ScalarizeVectorArray(left);
+		ScalarizeVectorArray(right);
+	}
+
+	uint32_t length, dimensions = left->dimensions == 1 ? right->dimensions : left->dimensions;
+	if (left->length == 1) { length = right->length; }
+	else if (right->length == 1) { length = left->length; }
+	else { length = left->length < right->length ? left->length : right->length; }
+	uint32_t ls = left->length == 1 ? 0 : 1, rs = right->length == 1 ? 0 : 1;
+	*result = CreateTypedVectorArray(comparison ? ElementTypeBool : ElementTypeInt32, dimensions, length);
+	if (left->length == length && left->columns > 0) { result->columns = left->columns; }
+	else if (right->length == length) { result->columns = right->columns; }
+
+	for (int32_t i = 0; i < dimensions; i++) {
+		int32_t li = left->dimensions == 1 ? 0 : i, ri = right->dimensions == 1 ? 0 : i;
+		if (comparison) {
+			uint64_t * restrict bits = VECTOR_ARRAY_BITS(*result, i);
+			if (integers) {
+				const int32_t * a = VECTOR_ARRAY_INT32(*left, li), * b = VECTOR_ARRAY_INT32(*right, ri);
+				for (uint32_t j = 0; j < length; j++) { bits[j >> 6] |= (uint64_t)ApplyComparison(a[j * ls], b[j * rs], operator) << (j & 63); }
+			} else {
+				const scalar_t * a = left->xyzw[li], * b = right->xyzw[ri];
+				for (uint32_t j = 0; j < length; j++) { bits[j >> 6] |= (uint64_t)ApplyComparison(a[j * ls], b[j * rs], operator) << (j & 63); }
+			}
+			continue;
+		}
+		// in 64 bits so anything that leaves the int32 range can be redone with scalars
+		const int32_t * a = VECTOR_ARRAY_INT32(*left, li), * b = VECTOR_ARRAY_INT32(*right, ri);
+		int32_t * restrict n = VECTOR_ARRAY_INT32(*result, i);
+		bool exact = true;
+		for (uint32_t j = 0; j < length; j++) {
+			int64_t x = a[j * ls], y = b[j * rs], z;
+			switch (operator) {
+				case OperatorAdd: z = x + y; break;
+				case OperatorSubtract: z = x - y; break;
+				case OperatorMultiply: z = x * y; break;
+				default: z = y == 0 ? INT64_MAX : x % y; break;
+			}
+			exact &= z >= INT32_MIN && z <= INT32_MAX;
+			n[j] = (int32_t)z;
+		}
+		if (!exact) {
+			FreeVectorArray(*result);
+			return false;
+		}
+	}
+	return true;
+}
+
+static inline scalar_t ScalarAdd(scalar_t a, scalar_t b) { return a + b; }
+static inline scalar_t ScalarSubtract(scalar_t a, scalar_t b) { return a - b; }
+static inline scalar_t ScalarMultiply(scalar_t a, scalar_t b) { return a * b; }
+static inline scalar_t ScalarDivide(scalar_t a, scalar_t b) { return a / b; }
+static inline scalar_t ScalarModulo(scalar_t a, scalar_t b) { return fmod(a, b); }
+static inline scalar_t ScalarPower(scalar_t a, scalar_t b) { return pow(a, b); }
+static inline scalar_t ScalarFastPower(scalar_t a, scalar_t b) { return fast_pow(a, b); }
+
+static inline void BinaryLoop(scalar_t (* f)(scalar_t, scalar_t), const scalar_t * restrict a, bool aSingle, const scalar_t * restrict b, bool bSingle, scalar_t * restrict r, uint32_t n) {
+	// a side of length one is held in a register so each loop is a plain streaming loop the compiler vectorizes
+	if (aSingle && bSingle) { scalar_t z = f(a[0], b[0]); for (uint32_t j = 0; j < n; j++) { r[j] = z; } }
+	else if (aSingle) { scalar_t x = a[0]; for (uint32_t j = 0; j < n; j++) { r[j] = f(x, b[j]); } }
+	else if (bSingle) { scalar_t y = b[0]; for (uint32_t j = 0; j < n; j++) { r[j] = f(a[j], y); } }
+	else { for (uint32_t j = 0; j < n; j++) { r[j] = f(a[j], b[j]); } }
+}
+
+typedef struct BinaryJob {
+	Operator operator;
+	bool fast;
+	VectorArray left;
+	VectorArray right;
+	VectorArray result;
+} BinaryJob;
+
+static void RunBinaryJob(void * data, uint32_t start, uint32_t end) {
+	// elements [start, end) of every channel
+	BinaryJob * job = data;
+	bool aSingle = job->left.length == 1, bSingle = job->right.length == 1;
+	for (int32_t i = 0; i < job->result.dimensions; i++) {
+		const scalar_t * a = job->left.xyzw[job->left.dimensions == 1 ? 0 : i] + (aSingle ? 0 : start);
+		const scalar_t * b = job->right.xyzw[job->right.dimensions == 1 ? 0 : i] + (bSingle ? 0 : start);
+		scalar_t * r = job->result.xyzw[i] + start;
+		uint32_t n = end - start;
+		switch (job->operator) {
+			case OperatorAdd: BinaryLoop(ScalarAdd, a, aSingle, b, bSingle, r, n); break;
+			case OperatorSubtract: BinaryLoop(ScalarSubtract, a, aSingle, b, bSingle, r, n); break;
+			case OperatorMultiply: BinaryLoop(ScalarMultiply, a, aSingle, b, bSingle, r, n); break;
+			case OperatorDivide:
+				if (job->fast && bSingle) {
+					scalar_t reciprocal = 1.0 / b[0];
+					BinaryLoop(ScalarMultiply, a, aSingle, &reciprocal, true, r, n);
+				} else {
+					BinaryLoop(ScalarDivide, a, aSingle, b, bSingle, r, n);
+				}
+				break;
+			case OperatorModulo: BinaryLoop(ScalarModulo, a, aSingle, b, bSingle, r, n); break;
+			case OperatorPower: BinaryLoop(job->fast ? ScalarFastPower : ScalarPower, a, aSingle, b, bSingle, r, n); break;
+			default: for (uint32_t j = 0; j < n; j++) { r[j] = NAN; } break;
+		}
+	}
+}
+
+static RuntimeError EvaluateBinaryArithmetic(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
+	VectorArray left, right, leftTangent = { 0 }, rightTangent = { 0 };
+	RuntimeError error = EvaluateTypedExpression(context, parameters, *expression.binary.left, depth + 1, &left, tangent == NULL ? NULL : &leftTangent);
 	if (error.code != RuntimeErrorCodeNone) { return error; }
-	error = _EvaluateExpression(environment, parameters, *expression.binary.right, depth + 1, &right);
+	error = EvaluateTypedExpression(context, parameters, *expression.binary.right, depth + 1, &right, tangent == NULL ? NULL : &rightTangent);
 	if (error.code != RuntimeErrorCodeNone) {
 		FreeVectorArray(left);
+		FreeVectorArray(leftTangent);
 		return error;
 	}
 	if (left.dimensions != right.dimensions && left.dimensions != 1 && right.dimensions != 1) {
 		FreeVectorArray(left);
 		FreeVectorArray(right);
+		FreeVectorArray(leftTangent);
+		FreeVectorArray(rightTangent);
 		return (RuntimeError){ RuntimeErrorCodeDifferingOperonDimensions, expression.start, expression.end, expression.line };
 	}
+	// comparisons and integer results don't vary, so there's no tangent to carry
+	if (EvaluateTypedBinary(expression.binary.operator, &left, &right, leftTangent.dimensions == 0 && rightTangent.dimensions == 0, result)) {
+		if (tangent != NULL) { *tangent = (VectorArray){ 0 }; }
+		FreeVectorArray(left);
+		FreeVectorArray(right);
+		FreeVectorArray(leftTangent);
+		FreeVectorArray(rightTangent);
+		return (RuntimeError){ RuntimeErrorCodeNone };
+	}
+	ScalarizeVectorArray(&left);
+	ScalarizeVectorArray(&right);
+	if ((IsVectorArrayComplex(left) || IsVectorArrayComplex(right)) && IsComplexOperator(expression.binary.operator)) {
+		RuntimeErrorCode code = EvaluateComplexArithmetic(expression.binary.operator, left, right, leftTangent, rightTangent, result, tangent);
+		FreeVectorArray(left);
+		FreeVectorArray(right);
+		FreeVectorArray(leftTangent);
+		FreeVectorArray(rightTangent);
+		return (RuntimeError){ code, expression.start, expression.end, expression.line };
+	}
 	
 	if (left.length == 1) { result->length = right.length; }
 	else if (right.length == 1) { result->length = left.length; }
@@ -621,13 +1323,50 @@ static RuntimeError EvaluateBinaryArithmetic(Environment * environment, List(Bin
 	if (left.dimensions == 1) { result->dimensions = right.dimensions; }
 	else { result->dimensions = left.dimensions; }
 	
-	for (int32_t i = 0; i < result->dimensions; i++) {
-		result->xyzw[i] = malloc(sizeof(scalar_t) * result->length);
-		for (int32_t j = 0; j < result->length; j++) {
-			scalar_t a = left.xyzw[left.dimensions == 1 ? 0 : i][left.length == 1 ? 0 : j];
-			scalar_t b = right.xyzw[right.dimensions == 1 ? 0 : i][right.length == 1 ? 0 : j];
-			result->xyzw[i][j] = ApplyBinaryArithmetic(a, b, expression.binary.operator);
+	bool fast = context->profile == EvaluationProfileFast;
+	*result = CreateVectorArray(result->dimensions, result->length);
+	if (left.length == result->length && left.columns > 0) { result->columns = left.columns; }
+	else if (right.length == result->length) { result->columns = right.columns; }
+	// scaling or adding matrices element-wise leaves them matrices
+	if ((IsVectorArrayMatrix(left) && left.length == result->length && left.dimensions == result->dimensions)
+		|| (IsVectorArrayMatrix(right) && right.length == result->length && right.dimensions == result->dimensions)) { result->kind = NumberKindMatrix; }
+	// the planner only picks the plain loop for arrays too short to fill a vector
+	BinaryJob job = { expression.binary.operator, fast, left, right, *result };
+	ExecutionStrategy strategy = PlanExecution(EstimateOperatorCost(expression.binary.operator, fast), result->dimensions, result->length);
+	if (strategy == ExecutionStrategyParallel) { ParallelFor(result->length, RunBinaryJob, &job); }
+	else if (strategy == ExecutionStrategySIMD) { RunBinaryJob(&job, 0, result->length); }
+	else {
+		for (int32_t i = 0; i < result->dimensions; i++) {
+			if (fast && expression.binary.operator == OperatorDivide && right.length == 1) {
+				// dividing by a single value becomes a multiply by its reciprocal
+				scalar_t reciprocal = 1.0 / right.xyzw[right.dimensions == 1 ? 0 : i][0];
+				for (int32_t j = 0; j < result->length; j++) { result->xyzw[i][j] = left.xyzw[left.dimensions == 1 ? 0 : i][left.length == 1 ? 0 : j] * reciprocal; }
+				continue;
+			}
+			for (int32_t j = 0; j < result->length; j++) {
+				scalar_t a = left.xyzw[left.dimensions == 1 ? 0 : i][left.length == 1 ? 0 : j];
+				scalar_t b = right.xyzw[right.dimensions == 1 ? 0 : i][right.length == 1 ? 0 : j];
+				result->xyzw[i][j] = ApplyBinaryArithmetic(a, b, expression.binary.operator, fast);
+			}
+		}
+	}
+	
+	if (tangent != NULL) {
+		*tangent = (VectorArray){ 0 };
+		if (leftTangent.dimensions > 0 || rightTangent.dimensions > 0) {
+			*tangent = CreateVectorArray(result->dimensions, result->length);
+			for (int32_t i = 0; i < result->dimensions; i++) {
+				for (int32_t j = 0; j < result->length; j++) {
+					int32_t li = left.dimensions == 1 ? 0 : i, lj = left.length == 1 ? 0 : j;
+					int32_t ri = right.dimensions == 1 ? 0 : i, rj = right.length == 1 ? 0 : j;
+					scalar_t da = leftTangent.dimensions > 0 ? leftTangent.xyzw[li][lj] : 0.0;
+					scalar_t db = rightTangent.dimensions > 0 ? rightTangent.xyzw[ri][rj] : 0.0;
+					tangent->xyzw[i][j] = ApplyBinaryTangent(left.xyzw[li][lj], right.xyzw[ri][rj], da, db, result->xyzw[i][j], expression.binary.operator);
+				}
+			}
 		}
+		FreeVectorArray(leftTangent);
+		FreeVectorArray(rightTangent);
 	}
 	
 	FreeVectorArray(left);
@@ -635,36 +1374,36 @@ static RuntimeError EvaluateBinaryArithmetic(Environment * environment, List(Bin
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError EvaluateBinary(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+static RuntimeError EvaluateBinary(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
 	switch (expression.binary.operator) {
 		case OperatorRange: return (RuntimeError){ RuntimeErrorCodeInvalidRangePlacement, expression.start, expression.end, expression.line };
 		case OperatorFor: return (RuntimeError){ RuntimeErrorCodeInvalidForPlacement, expression.start, expression.end, expression.line };
-		case OperatorDimension: return EvaluateDimension(environment, parameters, expression, depth, result);
-		case OperatorIndexStart: return EvaluateIndex(environment, parameters, expression, depth, result);
-		case OperatorCallStart: return EvaluateCall(environment, parameters, expression, depth, result);
+		case OperatorDimension: return EvaluateDimension(context, parameters, expression, depth, result, tangent);
+		case OperatorIndexStart: return EvaluateIndex(context, parameters, expression, depth, result, tangent);
+		case OperatorCallStart: return EvaluateCall(context, parameters, expression, depth, result, tangent);
 		case OperatorIf: return (RuntimeError){ RuntimeErrorCodeInvalidIfPlacement, expression.start, expression.end, expression.line };
 		case OperatorElse: return (RuntimeError){ RuntimeErrorCodeInvalidElsePlacement, expression.start, expression.end, expression.line };
 		case OperatorWhen: return (RuntimeError){ RuntimeErrorCodeInvalidWhenPlacement, expression.start, expression.end, expression.line };
-		default: return EvaluateBinaryArithmetic(environment, parameters, expression, depth, result);
+		default: return EvaluateBinaryArithmetic(context, parameters, expression, depth, result, tangent);
 	}
 }
 
-static RuntimeError EvaluateIfElse(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+static RuntimeError EvaluateIfElse(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
 	VectorArray condition;
-	RuntimeError error = _EvaluateExpression(environment, parameters, *expression.ternary.middle, depth + 1, &condition);
+	RuntimeError error = EvaluateTypedExpression(context, parameters, *expression.ternary.middle, depth + 1, &condition, NULL);
 	if (error.code != RuntimeErrorCodeNone) { return error; }
 	
 	if (TruthyVectorArray(condition)) {
 		FreeVectorArray(condition);
-		return _EvaluateExpression(environment, parameters, *expression.ternary.left, depth + 1, result);
+		return _EvaluateExpression(context, parameters, *expression.ternary.left, depth + 1, result, tangent);
 	}
 	FreeVectorArray(condition);
-	return _EvaluateExpression(environment, parameters, *expression.ternary.right, depth + 1, result);
+	return _EvaluateExpression(context, parameters, *expression.ternary.right, depth + 1, result, tangent);
 }
 
-static RuntimeError EvaluateTernary(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+static RuntimeError EvaluateTernary(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
 	if (expression.ternary.leftOperator == OperatorIf && expression.ternary.rightOperator == OperatorElse) {
-		return EvaluateIfElse(environment, parameters, expression, depth, result);
+		return EvaluateIfElse(context, parameters, expression, depth, result, tangent);
 	}
 	if (expression.ternary.leftOperator == OperatorFor && expression.ternary.rightOperator == OperatorWhen) {
 		return (RuntimeError){ RuntimeErrorCodeInvalidForPlacement, expression.start, expression.end, expression.line };
@@ -672,26 +1411,154 @@ static RuntimeError EvaluateTernary(Environment * environment, List(Binding) par
 	return (RuntimeError){ RuntimeErrorCodeNotImplemented, expression.start, expression.end, expression.line };
 }
 
-static RuntimeError _EvaluateExpression(Environment * environment, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result) {
+static RuntimeError EvaluateWhere(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
+	// each binding is evaluated once and passed on like a parameter, so it shadows anything of the same name
+	int32_t count = ListLength(expression.where.bindings);
+	if (parameters == NULL) { parameters = ListCreate(sizeof(Binding), count); }
+	else { parameters = ListClone(parameters); }
+	
+	RuntimeError error = { RuntimeErrorCodeNone };
+	int32_t bound = 0;
+	for (; bound < count; bound++) {
+		ForAssignment assignment = expression.where.bindings[bound].assignment;
+		Binding binding = { .identifier = assignment.identifier };
+		error = _EvaluateExpression(context, parameters, *assignment.expression, depth + 1, &binding.value, tangent == NULL ? NULL : &binding.tangent);
+		if (error.code != RuntimeErrorCodeNone) { break; }
+		parameters = ListInsert(parameters, &binding, 0);
+	}
+	if (error.code == RuntimeErrorCodeNone) { error = _EvaluateExpression(context, parameters, *expression.where.expression, depth + 1, result, tangent); }
+	
+	for (int32_t i = 0; i < bound; i++) {
+		FreeVectorArray(parameters[i].value);
+		FreeVectorArray(parameters[i].tangent);
+	}
+	ListFree(parameters);
+	return error;
+}
+
+static RuntimeError EvaluateTypedExpression(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
+	// the result can be a typed array, callers that aren't ready for one go through _EvaluateExpression
 	if (depth >= EVALUATOR_MAX_DEPTH) {
 		return (RuntimeError){ RuntimeErrorCodeReachedDepthLimit, expression.start, expression.end, expression.line };
 	}
+	RuntimeErrorCode code = EvaluationContextCheckpoint(context);
+	if (code != RuntimeErrorCodeNone) { return (RuntimeError){ code, expression.start, expression.end, expression.line }; }
 	switch (expression.type) {
 		case ExpressionTypeUnknown: return (RuntimeError){ RuntimeErrorCodeInvalidExpression, expression.start, expression.end, expression.line };
-		case ExpressionTypeConstant: return EvaluateConstant(environment, parameters, expression, depth, result);
-		case ExpressionTypeIdentifier: return EvaluateIdentifier(environment, parameters, expression, depth, result);
-		case ExpressionTypeVectorLiteral: return EvaluateVectorLiteral(environment, parameters, expression, depth, result);
-		case ExpressionTypeArrayLiteral: return EvaluateArrayLiteral(environment, parameters, expression, depth, result);
+		case ExpressionTypeConstant: return EvaluateConstant(context, parameters, expression, depth, result, tangent);
+		case ExpressionTypeIdentifier: return EvaluateIdentifier(context, parameters, expression, depth, result, tangent);
+		case ExpressionTypeVectorLiteral: return EvaluateVectorLiteral(context, parameters, expression, depth, result, tangent);
+		case ExpressionTypeArrayLiteral: return EvaluateArrayLiteral(context, parameters, expression, depth, result, tangent);
 		case ExpressionTypeArguments: return (RuntimeError){ RuntimeErrorCodeInvalidArgumentsPlacement, expression.start, expression.end, expression.line };
 		case ExpressionTypeForAssignment: return (RuntimeError){ RuntimeErrorCodeInvalidForAssignmentPlacement, expression.start, expression.end, expression.line };
-		case ExpressionTypeUnary: return EvaluateUnary(environment, parameters, expression, depth, result);
-		case ExpressionTypeBinary: return EvaluateBinary(environment, parameters, expression, depth, result);
-		case ExpressionTypeTernary: return EvaluateTernary(environment, parameters, expression, depth, result);
+		case ExpressionTypeUnary: return EvaluateUnary(context, parameters, expression, depth, result, tangent);
+		case ExpressionTypeBinary: return EvaluateBinary(context, parameters, expression, depth, result, tangent);
+		case ExpressionTypeTernary: return EvaluateTernary(context, parameters, expression, depth, result, tangent);
+		case ExpressionTypeWhere: return EvaluateWhere(context, parameters, expression, depth, result, tangent);
+		case ExpressionTypeConstantArray: return EvaluateConstantArray(context, parameters, expression, depth, result, tangent);
+	}
+}
+
+static RuntimeError _EvaluateExpression(EvaluationContext * context, List(Binding) parameters, Expression expression, int32_t depth, VectorArray * result, VectorArray * tangent) {
+	RuntimeError error = EvaluateTypedExpression(context, parameters, expression, depth, result, tangent);
+	if (error.code == RuntimeErrorCodeNone) { ScalarizeVectorArray(result); }
+	return error;
+}
+
+EvaluationContext CreateEvaluationContext(Environment * environment, EvaluationProfile profile) {
+	return (EvaluationContext){ .environment = environment, .profile = profile, .snapshot = ListCreate(sizeof(Binding), 4), .calls = ListCreate(sizeof(CallSiteCount), 4) };
+}
+
+scalar_t * EvaluationContextScratch(EvaluationContext * context, uint32_t length) {
+	// grows geometrically and is kept for the life of the context, so repeated calls don't allocate
+	if (length > context->scratchLength) {
+		context->scratchLength = length > 2 * context->scratchLength ? length : 2 * context->scratchLength;
+		free(context->scratch);
+		context->scratch = malloc(context->scratchLength * sizeof(scalar_t));
 	}
+	return context->scratch;
+}
+
+static double MonotonicSeconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void BeginEvaluation(EvaluationContext * context) {
+	// the time budget is per evaluation, a context that samples many times gets it afresh for each one
+	double seconds = context->environment->budget.seconds;
+	context->deadline = seconds > 0.0 ? MonotonicSeconds() + seconds : 0.0;
+	context->reserved = 0.0;
+	// the call sites are kept so sampling again doesn't allocate
+	for (int32_t i = 0; i < ListLength(context->calls); i++) { context->calls[i].count = 0; }
+}
+
+RuntimeErrorCode EvaluationContextCheckpoint(const EvaluationContext * context) {
+	// reads the clock every time, a vDSO call is cheap next to a node or a block of a kernel, and changes nothing so
+	// the threads of a parallel kernel can all call it, cancellation and an expired deadline both last until the
+	// evaluation ends so a kernel that stops early can leave the caller to find out why by calling it again
+	if (context == NULL) { return RuntimeErrorCodeNone; }
+	if (atomic_load_explicit(context->environment->cancelled, memory_order_relaxed)) { return RuntimeErrorCodeCancelled; }
+	if (context->deadline > 0.0 && MonotonicSeconds() > context->deadline) { return RuntimeErrorCodeExceededTimeBudget; }
+	return RuntimeErrorCodeNone;
+}
+
+RuntimeErrorCode EvaluationContextReserve(EvaluationContext * context, uint32_t dimensions, double length) {
+	// checked before an array is built from sizes taken from values, length is a double so products can't wrap around,
+	// the reservations of an evaluation add up against the budget
+	uint64_t bytes = context->environment->budget.bytes;
+	if (length > UINT32_MAX) { return RuntimeErrorCodeExceededMemoryBudget; }
+	double reserved = context->reserved + dimensions * length * sizeof(scalar_t);
+	if (bytes > 0 && reserved > bytes) { return RuntimeErrorCodeExceededMemoryBudget; }
+	context->reserved = reserved;
+	return RuntimeErrorCodeNone;
+}
+
+uint32_t EvaluationContextCallIndex(EvaluationContext * context, bool repeat) {
+	// which call from context->callSite this is in the evaluation, from 0, repeat gives the last call's index again
+	// for a second look at the same call
+	for (int32_t i = 0; i < ListLength(context->calls); i++) {
+		if (context->calls[i].callSite != context->callSite) { continue; }
+		return repeat ? context->calls[i].count - 1 : context->calls[i].count++;
+	}
+	context->calls = ListPush(context->calls, &(CallSiteCount){ context->callSite, 1 });
+	return 0;
+}
+
+void FreeEvaluationContext(EvaluationContext context) {
+	// snapshot values are borrowed from the environment
+	for (int32_t i = 0; i < ListLength(context.snapshot); i++) { StringFree(context.snapshot[i].identifier); }
+	ListFree(context.snapshot);
+	ListFree(context.calls);
+	free(context.scratch);
+}
+
+RuntimeError EvaluateExpressionInContext(EvaluationContext * context, List(Binding) parameters, Expression expression, VectorArray * result) {
+	BeginEvaluation(context);
+	return _EvaluateExpression(context, parameters, expression, 0, result, NULL);
+}
+
+RuntimeError EvaluateExpressionTangentInContext(EvaluationContext * context, List(Binding) parameters, Expression expression, VectorArray * result, VectorArray * tangent) {
+	// forward mode differentiation, the tangents of the parameters are propagated alongside their values in a single pass
+	BeginEvaluation(context);
+	RuntimeError error = _EvaluateExpression(context, parameters, expression, 0, result, tangent);
+	if (error.code == RuntimeErrorCodeNone && tangent->dimensions == 0) { *tangent = ZeroVectorArray(result->dimensions, result->length); }
+	return error;
 }
 
 RuntimeError EvaluateExpression(Environment * environment, List(Binding) parameters, Expression expression, VectorArray * result) {
-	return _EvaluateExpression(environment, parameters, expression, 0, result);
+	EvaluationContext context = CreateEvaluationContext(environment, EvaluationProfilePrecise);
+	RuntimeError error = EvaluateExpressionInContext(&context, parameters, expression, result);
+	FreeEvaluationContext(context);
+	return error;
+}
+
+RuntimeError EvaluateExpressionTangent(Environment * environment, List(Binding) parameters, Expression expression, VectorArray * result, VectorArray * tangent) {
+	EvaluationContext context = CreateEvaluationContext(environment, EvaluationProfilePrecise);
+	RuntimeError error = EvaluateExpressionTangentInContext(&context, parameters, expression, result, tangent);
+	FreeEvaluationContext(context);
+	return error;
 }
 
 void FindExpressionParents(Environment environment, Expression expression, List(String) parameters, List(String) * identifiers) {
@@ -744,4 +1611,14 @@ void FindExpressionParents(Environment environment, Expression expression, List(
 			FindExpressionParents(environment, *expression.ternary.right, parameters, identifiers);
 		}
 	}
+	if (expression.type == ExpressionTypeWhere) {
+		parameters = parameters == NULL ? ListCreate(sizeof(String), 1) : ListClone(parameters);
+		for (int32_t i = 0; i < ListLength(expression.where.bindings); i++) {
+			ForAssignment assignment = expression.where.bindings[i].assignment;
+			FindExpressionParents(environment, *assignment.expression, parameters, identifiers);
+			parameters = ListInsert(parameters, &assignment.identifier, 0);
+		}
+		FindExpressionParents(environment, *expression.where.expression, parameters, identifiers);
+		ListFree(parameters);
+	}
 }
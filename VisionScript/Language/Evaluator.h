@@ -1,10 +1,16 @@
 #ifndef Evaluator_h
 #define Evaluator_h
 
+#include <float.h>
+#include <stdatomic.h>
 #include "Parser.h"
 #include "Utilities/HashMap.h"
+#include "Utilities/Half.h"
+#include "Utilities/Threads.h"
 
 #define EVALUATOR_MAX_DEPTH 1024
+#define EVALUATOR_DEFAULT_SECONDS 30.0
+#define EVALUATOR_DEFAULT_BYTES (1ull << 30)
 
 typedef enum RuntimeErrorCode {
 	RuntimeErrorCodeNone,
@@ -32,12 +38,17 @@ typedef enum RuntimeErrorCode {
 	RuntimeErrorCodeIncorrectArgumentCount,
 	RuntimeErrorCodeDifferingOperonDimensions,
 	RuntimeErrorCodeInvalidArgumentType,
+	RuntimeErrorCodeInvalidGridArgument,
 	RuntimeErrorCodeInvalidRenderDimension,
 	RuntimeErrorCodeInvalidParametricEquation,
 	RuntimeErrorCodeInvalidParametricDomain,
 	RuntimeErrorCodeInvalidColorDimension,
 	RuntimeErrorCodeInvalidSizeDimension,
+	RuntimeErrorCodeInvalidApproximationTolerance,
 	RuntimeErrorCodeReachedDepthLimit,
+	RuntimeErrorCodeExceededTimeBudget,
+	RuntimeErrorCodeExceededMemoryBudget,
+	RuntimeErrorCodeCancelled,
 	RuntimeErrorCodeNotImplemented,
 } RuntimeErrorCode;
 
@@ -51,32 +62,105 @@ typedef struct RuntimeError {
 const char * RuntimeErrorToString(RuntimeErrorCode code);
 void PrintRuntimeError(RuntimeError error, List(String) lines);
 
+// evaluation precision is chosen at build time, define VISIONSCRIPT_DOUBLE for double precision
+#if defined(VISIONSCRIPT_DOUBLE)
+typedef double scalar_t;
+#define SCALAR_EPSILON DBL_EPSILON
+#else
 typedef float scalar_t;
+#define SCALAR_EPSILON FLT_EPSILON
+#endif
+
+#define VECTOR_ARRAY_ALIGNMENT 64
+
+typedef enum NumberKind {
+	NumberKindReal,
+	NumberKindComplex, // two channels, the real part in x and the imaginary part in y
+	NumberKindMatrix,  // d by d matrices with a row per element, row r of matrix k at element r * count + k
+} NumberKind;
+
+// how elements are stored, typed arrays only pass between the parts of the evaluator that understand them (ranges,
+// integer arithmetic, comparisons, indexing and conditions) and are converted to scalars before anything else sees them
+typedef enum ElementType {
+	ElementTypeScalar,
+	ElementTypeInt32, // int32_t elements
+	ElementTypeBool,  // bits packed 64 to a uint64_t word, bits past the length are zero
+} ElementType;
 
+// arrays created by CreateVectorArray own a single aligned block starting at xyzw[0], every channel begins at a multiple
+// of VectorArrayAlignedLength(length) in it, arrays that only borrow their channels (parameters) are never freed
 typedef struct VectorArray {
 	scalar_t * xyzw[4];
 	uint32_t dimensions;
 	uint32_t length;
+	uint32_t columns; // row length of a row-major 2D grid (from a 2D range), 0 if the array has no shape
+	NumberKind kind;
+	ElementType type; // channels of typed arrays are reached through the casts below
 } VectorArray;
 
+#define VECTOR_ARRAY_INT32(value, d) ((int32_t *)(value).xyzw[d])
+#define VECTOR_ARRAY_BITS(value, d) ((uint64_t *)(value).xyzw[d])
+
+uint32_t VectorArrayAlignedLength(uint32_t length);
+VectorArray CreateVectorArray(uint32_t dimensions, uint32_t length);
+VectorArray CreateTypedVectorArray(ElementType type, uint32_t dimensions, uint32_t length);
+void ScalarizeVectorArray(VectorArray * value);
 void PrintVectorArray(VectorArray value);
 VectorArray CopyVectorArray(VectorArray value);
+VectorArray ZeroVectorArray(uint32_t dimensions, uint32_t length);
+bool IsVectorArrayComplex(VectorArray value);
+bool IsVectorArrayMatrix(VectorArray value);
 VectorArray VectorArrayAtIndex(VectorArray value, int32_t index);
 bool TruthyVectorArray(VectorArray value);
 void FreeVectorArray(VectorArray value);
+// malloc for count elements of size bytes, an empty array still gets a block since malloc(0) may return NULL, so kernels
+// can hand it to memcpy and qsort and free it without checking
+void * AllocateElements(size_t count, size_t size);
 
 typedef struct Binding {
 	String identifier;
 	VectorArray value;
+	VectorArray tangent; // derivative of value with respect to the differentiation variable, 0 dimensions if constant
 } Binding;
 
+// half precision copy of an array, used for cache entries of variables opted in with A:half = 1
+typedef struct HalfArray {
+	half_t * xyzw[4];
+	uint32_t dimensions;
+	uint32_t length;
+	uint32_t columns;
+	NumberKind kind;
+} HalfArray;
+
+HalfArray EncodeHalfArray(VectorArray value);
+VectorArray DecodeHalfArray(HalfArray value);
+void FreeHalfArray(HalfArray value);
+
 Binding CreateBinding(const char * identifier, VectorArray value);
 void FreeBinding(Binding binding);
 
+typedef enum EvaluationProfile {
+	EvaluationProfilePrecise,
+	EvaluationProfileFast, // reduced accuracy sin, cos, exp, sqrt, length, normalize, powers and division
+} EvaluationProfile;
+
+// limits every evaluation against an environment is held to, checked cooperatively as it runs
+typedef struct EvaluationBudget {
+	double seconds; // wall time of a single evaluation, 0 for no limit
+	uint64_t bytes; // total size of the arrays an evaluation may build from sizes it computed, 0 for no limit
+} EvaluationBudget;
+
+struct SpatialIndex;
+
 typedef struct Environment {
 	HashMap(Equation) equations;
 	HashMap(VectorArray) cache;
+	HashMap(HalfArray) halfCache;
+	HashMap(struct SpatialIndex *) indices; // trees over cached arrays that nearest and within searched, dropped with the entry
 	HashMap(List(Equation)) dependents;
+	pthread_mutex_t * cacheLock; // guards the caches and indices while contexts evaluate, entries are never changed once published
+	EvaluationBudget budget;
+	atomic_int * cancelled;      // set from any thread or a signal handler to stop the evaluations running against the environment
 } Environment;
 
 Environment CreateEmptyEnvironment(void);
@@ -84,10 +168,45 @@ void AddEnvironmentEquation(Environment * environment, Equation equation);
 void SetEnvironmentCache(Environment * environment, const char * identifier, VectorArray value);
 Equation * GetEnvironmentEquation(Environment * environment, const char * identifier);
 VectorArray * GetEnvironmentCache(Environment * environment, const char * identifier);
+VectorArray PublishEnvironmentCache(Environment * environment, const char * identifier, VectorArray value);
+void RemoveEnvironmentCache(Environment * environment, const char * identifier);
+struct SpatialIndex * ReadEnvironmentIndex(Environment * environment, const char * identifier);
+struct SpatialIndex * PublishEnvironmentIndex(Environment * environment, const char * identifier, struct SpatialIndex * index);
 void InitializeEnvironmentDependents(Environment * environment);
+void CancelEnvironmentEvaluations(Environment * environment);
+void ResumeEnvironmentEvaluations(Environment * environment);
 void FreeEnvironment(Environment environment);
 
+typedef struct CallSiteCount {
+	uint64_t callSite;
+	uint32_t count;
+} CallSiteCount;
+
+// per thread evaluation state, any number of contexts can evaluate against one environment at the same time
+typedef struct EvaluationContext {
+	Environment * environment;
+	EvaluationProfile profile;
+	List(Binding) snapshot; // cache entries this context has read, borrowed from the environment so later reads see the same values
+	scalar_t * scratch;     // working storage for builtins that need a copy of their arguments
+	uint32_t scratchLength;
+	double deadline;        // monotonic time the current evaluation has to finish by, 0 without a time budget
+	double reserved;        // bytes the current evaluation has reserved so far
+	uint64_t callSite;      // line and column of the builtin call being made, seeds random builtins called without a seed
+	List(CallSiteCount) calls; // calls made from each call site that counts them in the current evaluation
+	const char * points;    // the variable nearest and within search is read from, NULL when it's computed
+} EvaluationContext;
+
+EvaluationContext CreateEvaluationContext(Environment * environment, EvaluationProfile profile);
+scalar_t * EvaluationContextScratch(EvaluationContext * context, uint32_t length);
+RuntimeErrorCode EvaluationContextCheckpoint(const EvaluationContext * context);
+RuntimeErrorCode EvaluationContextReserve(EvaluationContext * context, uint32_t dimensions, double length);
+uint32_t EvaluationContextCallIndex(EvaluationContext * context, bool repeat);
+void FreeEvaluationContext(EvaluationContext context);
+
+RuntimeError EvaluateExpressionInContext(EvaluationContext * context, List(Binding) parameters, Expression expression, VectorArray * result);
+RuntimeError EvaluateExpressionTangentInContext(EvaluationContext * context, List(Binding) parameters, Expression expression, VectorArray * result, VectorArray * tangent);
 RuntimeError EvaluateExpression(Environment * environment, List(Binding) parameters, Expression expression, VectorArray * result);
+RuntimeError EvaluateExpressionTangent(Environment * environment, List(Binding) parameters, Expression expression, VectorArray * result, VectorArray * tangent);
 void FindExpressionParents(Environment environment, Expression expression, List(String) parameters, List(String) * identifiers);
 
 #endif
@@ -0,0 +1,429 @@
+#include <stdlib.h>
+#include <string.h>
+#include <tgmath.h>
+#include "Geometry.h"
+
+#define GEOMETRY_INSERTION_LENGTH 16
+#define DELAUNAY_EDGE_STACK 512 // edges waiting to be checked after a flip, only very degenerate input fills it
+#define DELAUNAY_EPSILON 0x1p-52
+#define GEOMETRY_CHECKPOINT_LENGTH 4096 // sorts at least this long and sweeps every this many points check the evaluation
+
+typedef struct GeometryKey {
+	double primary, secondary;
+	uint32_t index;
+} GeometryKey;
+
+static inline bool KeyBefore(GeometryKey a, GeometryKey b) {
+	return a.primary < b.primary || (a.primary == b.primary && a.secondary < b.secondary);
+}
+
+static void SortKeys(const EvaluationContext * context, GeometryKey * keys, uint32_t length) {
+	// quicksort with a median of three pivot, the shorter side is sorted first so the recursion stays shallow, the keys
+	// are left part sorted when the evaluation stops
+	while (length > GEOMETRY_INSERTION_LENGTH) {
+		if (length >= GEOMETRY_CHECKPOINT_LENGTH && EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) { return; }
+		GeometryKey a = keys[0], b = keys[length / 2], c = keys[length - 1];
+		GeometryKey pivot = KeyBefore(a, b) ? (KeyBefore(b, c) ? b : (KeyBefore(a, c) ? c : a)) : (KeyBefore(a, c) ? a : (KeyBefore(b, c) ? c : b));
+		int64_t i = 0, j = length - 1;
+		while (i <= j) {
+			while (KeyBefore(keys[i], pivot)) { i++; }
+			while (KeyBefore(pivot, keys[j])) { j--; }
+			if (i <= j) {
+				GeometryKey t = keys[i];
+				keys[i++] = keys[j];
+				keys[j--] = t;
+			}
+		}
+		uint32_t left = j + 1, right = length - i;
+		if (left < right) {
+			SortKeys(context, keys, left);
+			keys += i;
+			length = right;
+		} else {
+			SortKeys(context, keys + i, right);
+			length = left;
+		}
+	}
+	for (uint32_t i = 1; i < length; i++) {
+		GeometryKey k = keys[i];
+		uint32_t j = i;
+		for (; j > 0 && KeyBefore(k, keys[j - 1]); j--) { keys[j] = keys[j - 1]; }
+		keys[j] = k;
+	}
+}
+
+static inline double Cross(double ax, double ay, double bx, double by, double cx, double cy) {
+	// positive when a, b and c turn counter-clockwise
+	return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+static inline bool IsPointFinite(const scalar_t * x, const scalar_t * y, uint32_t i) {
+	return isfinite(x[i]) && isfinite(y[i]);
+}
+
+uint32_t ConvexHull(const EvaluationContext * context, const scalar_t * x, const scalar_t * y, uint32_t length, uint32_t * hull) {
+	// Andrew's monotone chain over the points sorted by x then y, the points strictly inside the octagon of the extreme
+	// points in eight directions can't be corners so they're dropped before sorting, which is most of them
+	static const double directions[8][2] = { { 1.0, 0.0 }, { 1.0, 1.0 }, { 0.0, 1.0 }, { -1.0, 1.0 }, { -1.0, 0.0 }, { -1.0, -1.0 }, { 0.0, -1.0 }, { 1.0, -1.0 } };
+	uint32_t extremes[8];
+	double reach[8];
+	for (int32_t e = 0; e < 8; e++) {
+		extremes[e] = UINT32_MAX;
+		reach[e] = -INFINITY;
+	}
+	for (uint32_t i = 0; i < length; i++) {
+		if (!IsPointFinite(x, y, i)) { continue; }
+		for (int32_t e = 0; e < 8; e++) {
+			double r = directions[e][0] * x[i] + directions[e][1] * y[i];
+			if (r > reach[e]) {
+				reach[e] = r;
+				extremes[e] = i;
+			}
+		}
+	}
+	if (extremes[0] == UINT32_MAX) { return 0; }
+
+	// the extremes go round counter-clockwise, the edges between extremes at the same place are left out
+	uint32_t corners[8], sides = 0;
+	for (int32_t e = 0; e < 8; e++) {
+		uint32_t a = extremes[e], b = extremes[(e + 1) % 8];
+		if (x[a] != x[b] || y[a] != y[b]) { corners[sides++] = a; }
+	}
+	GeometryKey * keys = malloc(length * sizeof(GeometryKey));
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < length; i++) {
+		if (!IsPointFinite(x, y, i)) { continue; }
+		bool inside = sides >= 3;
+		for (uint32_t e = 0; e < sides && inside; e++) {
+			uint32_t a = corners[e], b = corners[(e + 1) % sides];
+			inside = Cross(x[a], y[a], x[b], y[b], x[i], y[i]) > 0.0;
+		}
+		if (!inside) { keys[count++] = (GeometryKey){ x[i], y[i], i }; }
+	}
+	SortKeys(context, keys, count);
+	if (EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) {
+		free(keys);
+		return 0;
+	}
+
+	// the lower chain left to right then the upper one back, a corner that doesn't turn left is popped
+	uint32_t k = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		for (; k >= 2; k--) {
+			uint32_t a = hull[k - 2], b = hull[k - 1];
+			if (Cross(x[a], y[a], x[b], y[b], keys[i].primary, keys[i].secondary) > 0.0) { break; }
+		}
+		hull[k++] = keys[i].index;
+	}
+	for (int64_t i = (int64_t)count - 2, lower = k + 1; i >= 0; i--) {
+		for (; k >= lower; k--) {
+			uint32_t a = hull[k - 2], b = hull[k - 1];
+			if (Cross(x[a], y[a], x[b], y[b], keys[i].primary, keys[i].secondary) > 0.0) { break; }
+		}
+		hull[k++] = keys[i].index;
+	}
+	free(keys);
+	// the chain ends where it started
+	return k > 0 ? k - 1 : 0;
+}
+
+// the triangles are built clockwise, as in Delaunator which this follows, and turned around once they're done, edge
+// e of a triangle goes from corner e to the next one and its halfedge is the same edge in the triangle on its other side
+typedef struct Triangulation {
+	const double * x, * y;
+	uint32_t * triangles;
+	int32_t * halfedges;  // -1 on the hull
+	uint32_t length;      // corners so far
+	uint32_t * hullPrev, * hullNext;
+	uint32_t * hullTri;   // the edge of the triangle on the hull from each hull point
+	int32_t * hullHash;   // a hull point for each range of angles around the center, -1 when there isn't one yet
+	uint32_t hashSize;
+	uint32_t hullStart;
+	double cx, cy;
+} Triangulation;
+
+static inline uint32_t HullHashKey(const Triangulation * t, double x, double y) {
+	// a pseudo angle around the center in [0, 1], it grows with the angle without needing atan2
+	double dx = x - t->cx, dy = y - t->cy, s = fabs(dx) + fabs(dy);
+	double p = s > 0.0 ? dx / s : 0.0;
+	double angle = (dy > 0.0 ? 3.0 - p : 1.0 + p) / 4.0;
+	uint32_t key = angle * t->hashSize;
+	return key < t->hashSize ? key : t->hashSize - 1;
+}
+
+static inline void LinkEdges(Triangulation * t, uint32_t a, int32_t b) {
+	t->halfedges[a] = b;
+	if (b != -1) { t->halfedges[b] = a; }
+}
+
+static uint32_t AddTriangle(Triangulation * t, uint32_t i0, uint32_t i1, uint32_t i2, int32_t a, int32_t b, int32_t c) {
+	uint32_t e = t->length;
+	t->triangles[e] = i0;
+	t->triangles[e + 1] = i1;
+	t->triangles[e + 2] = i2;
+	LinkEdges(t, e, a);
+	LinkEdges(t, e + 1, b);
+	LinkEdges(t, e + 2, c);
+	t->length += 3;
+	return e;
+}
+
+static inline bool InCircle(const Triangulation * t, uint32_t a, uint32_t b, uint32_t c, uint32_t p) {
+	// p strictly inside the circle through a, b and c, which turn clockwise
+	double dx = t->x[a] - t->x[p], dy = t->y[a] - t->y[p];
+	double ex = t->x[b] - t->x[p], ey = t->y[b] - t->y[p];
+	double fx = t->x[c] - t->x[p], fy = t->y[c] - t->y[p];
+	double ap = dx * dx + dy * dy, bp = ex * ex + ey * ey, cp = fx * fx + fy * fy;
+	return dx * (ey * cp - bp * fy) - dy * (ex * cp - bp * fx) + ap * (ex * fy - ey * fx) < 0.0;
+}
+
+static uint32_t Legalize(Triangulation * t, uint32_t a) {
+	// flips edge a while the point across it is inside its triangle's circle, then checks the edges a flip exposed,
+	// returns the edge before a in its triangle after the last check
+	uint32_t stack[DELAUNAY_EDGE_STACK], depth = 0, ar = 0;
+	while (true) {
+		int32_t b = t->halfedges[a];
+		uint32_t a0 = a - a % 3;
+		ar = a0 + (a + 2) % 3;
+		if (b == -1) {
+			if (depth == 0) { break; }
+			a = stack[--depth];
+			continue;
+		}
+		uint32_t b0 = b - b % 3, al = a0 + (a + 1) % 3, bl = b0 + (b + 2) % 3;
+		uint32_t p0 = t->triangles[ar], pr = t->triangles[a], pl = t->triangles[al], p1 = t->triangles[bl];
+		if (!InCircle(t, p0, pr, pl, p1)) {
+			if (depth == 0) { break; }
+			a = stack[--depth];
+			continue;
+		}
+		t->triangles[a] = p1;
+		t->triangles[b] = p0;
+		int32_t hbl = t->halfedges[bl];
+		if (hbl == -1) {
+			// the flip moved an edge on the hull, so the hull point it starts from has to follow it
+			uint32_t e = t->hullStart;
+			do {
+				if (t->hullTri[e] == bl) {
+					t->hullTri[e] = a;
+					break;
+				}
+				e = t->hullPrev[e];
+			} while (e != t->hullStart);
+		}
+		LinkEdges(t, a, hbl);
+		LinkEdges(t, b, t->halfedges[ar]);
+		LinkEdges(t, ar, bl);
+		if (depth < DELAUNAY_EDGE_STACK) { stack[depth++] = b0 + (b + 1) % 3; }
+	}
+	return ar;
+}
+
+static double Circumradius(double ax, double ay, double bx, double by, double cx, double cy, double * x, double * y) {
+	// squared, with the center relative to a, infinite or NaN when the points are on a line
+	double dx = bx - ax, dy = by - ay, ex = cx - ax, ey = cy - ay;
+	double bl = dx * dx + dy * dy, cl = ex * ex + ey * ey, d = 0.5 / (dx * ey - dy * ex);
+	*x = (ey * bl - dy * cl) * d;
+	*y = (dx * cl - ex * bl) * d;
+	return *x * *x + *y * *y;
+}
+
+static uint32_t Triangulate(const EvaluationContext * context, Triangulation * t, uint32_t n) {
+	const double * x = t->x, * y = t->y;
+	double minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+	for (uint32_t i = 0; i < n; i++) {
+		minX = x[i] < minX ? x[i] : minX;
+		minY = y[i] < minY ? y[i] : minY;
+		maxX = x[i] > maxX ? x[i] : maxX;
+		maxY = y[i] > maxY ? y[i] : maxY;
+	}
+
+	// the seed is the point nearest the middle, the point nearest to it and the third point with the smallest circle
+	double middleX = (minX + maxX) / 2.0, middleY = (minY + maxY) / 2.0, nearest = INFINITY;
+	uint32_t i0 = UINT32_MAX, i1 = UINT32_MAX, i2 = UINT32_MAX;
+	for (uint32_t i = 0; i < n; i++) {
+		double d = (x[i] - middleX) * (x[i] - middleX) + (y[i] - middleY) * (y[i] - middleY);
+		if (d < nearest) {
+			i0 = i;
+			nearest = d;
+		}
+	}
+	nearest = INFINITY;
+	for (uint32_t i = 0; i < n; i++) {
+		double d = (x[i] - x[i0]) * (x[i] - x[i0]) + (y[i] - y[i0]) * (y[i] - y[i0]);
+		if (d < nearest && d > 0.0) {
+			i1 = i;
+			nearest = d;
+		}
+	}
+	if (i1 == UINT32_MAX) { return 0; }
+	double smallest = INFINITY, cx, cy;
+	for (uint32_t i = 0; i < n; i++) {
+		if (i == i0 || i == i1) { continue; }
+		double r = Circumradius(x[i0], y[i0], x[i1], y[i1], x[i], y[i], &cx, &cy);
+		if (r < smallest) {
+			i2 = i;
+			smallest = r;
+		}
+	}
+	if (i2 == UINT32_MAX) { return 0; }
+	if (Cross(x[i0], y[i0], x[i1], y[i1], x[i2], y[i2]) > 0.0) {
+		uint32_t i = i1;
+		i1 = i2;
+		i2 = i;
+	}
+	Circumradius(x[i0], y[i0], x[i1], y[i1], x[i2], y[i2], &cx, &cy);
+	t->cx = x[i0] + cx;
+	t->cy = y[i0] + cy;
+
+	// every point is outside the hull of the ones nearer the center than it, they're renumbered in that order so the
+	// points and hull entries the sweep reads are near each other in memory
+	GeometryKey * keys = malloc(n * sizeof(GeometryKey));
+	for (uint32_t i = 0; i < n; i++) { keys[i] = (GeometryKey){ (x[i] - t->cx) * (x[i] - t->cx) + (y[i] - t->cy) * (y[i] - t->cy), 0.0, i }; }
+	SortKeys(context, keys, n);
+	if (EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) {
+		free(keys);
+		return 0;
+	}
+	uint32_t * order = malloc(n * sizeof(uint32_t));
+	double * sorted = malloc(2 * n * sizeof(double));
+	for (uint32_t k = 0; k < n; k++) {
+		uint32_t i = keys[k].index;
+		order[k] = i;
+		sorted[k] = x[i];
+		sorted[n + k] = y[i];
+		if (i == i0 || i == i1 || i == i2) { *(i == i0 ? &i0 : (i == i1 ? &i1 : &i2)) = k + n; }
+	}
+	free(keys);
+	i0 -= n;
+	i1 -= n;
+	i2 -= n;
+	x = t->x = sorted;
+	y = t->y = sorted + n;
+
+	t->hashSize = ceil(sqrt((double)n));
+	for (uint32_t h = 0; h < t->hashSize; h++) { t->hullHash[h] = -1; }
+	t->hullStart = i0;
+	t->hullNext[i0] = t->hullPrev[i2] = i1;
+	t->hullNext[i1] = t->hullPrev[i0] = i2;
+	t->hullNext[i2] = t->hullPrev[i1] = i0;
+	t->hullTri[i0] = 0;
+	t->hullTri[i1] = 1;
+	t->hullTri[i2] = 2;
+	t->hullHash[HullHashKey(t, x[i0], y[i0])] = i0;
+	t->hullHash[HullHashKey(t, x[i1], y[i1])] = i1;
+	t->hullHash[HullHashKey(t, x[i2], y[i2])] = i2;
+	AddTriangle(t, i0, i1, i2, -1, -1, -1);
+
+	double previousX = 0.0, previousY = 0.0;
+	for (uint32_t i = 0; i < n; i++) {
+		if (i % GEOMETRY_CHECKPOINT_LENGTH == 0 && EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) {
+			free(order);
+			free(sorted);
+			return 0;
+		}
+		double px = x[i], py = y[i];
+		// a point on top of the one before it adds nothing
+		if (i > 0 && fabs(px - previousX) <= DELAUNAY_EPSILON && fabs(py - previousY) <= DELAUNAY_EPSILON) { continue; }
+		previousX = px;
+		previousY = py;
+		if (i == i0 || i == i1 || i == i2) { continue; }
+
+		// a hull point near the new one by angle, then walk the hull to the first edge the point can see
+		uint32_t start = 0;
+		for (uint32_t j = 0, key = HullHashKey(t, px, py); j < t->hashSize; j++) {
+			int32_t h = t->hullHash[(key + j) % t->hashSize];
+			if (h != -1 && t->hullNext[h] != (uint32_t)h) {
+				start = h;
+				break;
+			}
+		}
+		start = t->hullPrev[start];
+		uint32_t e = start, q;
+		bool visible = true;
+		while (q = t->hullNext[e], Cross(px, py, x[e], y[e], x[q], y[q]) <= 0.0) {
+			e = q;
+			if (e == start) {
+				visible = false;
+				break;
+			}
+		}
+		// only a point that's almost a duplicate can see none of the hull
+		if (!visible) { continue; }
+
+		uint32_t a = AddTriangle(t, e, i, t->hullNext[e], -1, -1, t->hullTri[e]);
+		t->hullTri[i] = Legalize(t, a + 2);
+		t->hullTri[e] = a;
+
+		// the edges after it that the point sees get a triangle each and leave the hull
+		uint32_t next = t->hullNext[e];
+		while (q = t->hullNext[next], Cross(px, py, x[next], y[next], x[q], y[q]) > 0.0) {
+			a = AddTriangle(t, next, i, q, t->hullTri[i], -1, t->hullTri[next]);
+			t->hullTri[i] = Legalize(t, a + 2);
+			t->hullNext[next] = next;
+			next = q;
+		}
+		// and the ones before it when the walk started at the first edge
+		if (e == start) {
+			while (q = t->hullPrev[e], Cross(px, py, x[q], y[q], x[e], y[e]) > 0.0) {
+				a = AddTriangle(t, q, i, e, -1, t->hullTri[e], t->hullTri[q]);
+				Legalize(t, a + 2);
+				t->hullTri[q] = a;
+				t->hullNext[e] = e;
+				e = q;
+			}
+		}
+
+		t->hullStart = t->hullPrev[i] = e;
+		t->hullNext[e] = t->hullPrev[next] = i;
+		t->hullNext[i] = next;
+		t->hullHash[HullHashKey(t, px, py)] = i;
+		t->hullHash[HullHashKey(t, x[e], y[e])] = e;
+	}
+	for (uint32_t c = 0; c < t->length; c++) { t->triangles[c] = order[t->triangles[c]]; }
+	free(order);
+	free(sorted);
+	return t->length / 3;
+}
+
+uint32_t DelaunayTriangulation(const EvaluationContext * context, const scalar_t * x, const scalar_t * y, uint32_t length, uint32_t * corners) {
+	// the finite points are copied out in double precision and triangulated by their position in the copy
+	uint32_t * points = AllocateElements(length, sizeof(uint32_t));
+	double * xy = AllocateElements(2 * length, sizeof(double));
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < length; i++) {
+		if (!IsPointFinite(x, y, i)) { continue; }
+		points[n] = i;
+		xy[n] = x[i];
+		xy[length + n++] = y[i];
+	}
+	uint32_t count = 0;
+	if (n >= 3) {
+		// at most 2n - 5 triangles
+		Triangulation t = {
+			.x = xy,
+			.y = xy + length,
+			.triangles = corners,
+			.halfedges = malloc(6 * n * sizeof(int32_t)),
+			.hullPrev = malloc(n * sizeof(uint32_t)),
+			.hullNext = malloc(n * sizeof(uint32_t)),
+			.hullTri = malloc(n * sizeof(uint32_t)),
+			.hullHash = malloc((n + 1) * sizeof(int32_t)),
+		};
+		count = Triangulate(context, &t, n);
+		free(t.halfedges);
+		free(t.hullPrev);
+		free(t.hullNext);
+		free(t.hullTri);
+		free(t.hullHash);
+	}
+	for (uint32_t c = 0; c < 3 * count; c += 3) {
+		uint32_t b = corners[c + 1];
+		corners[c] = points[corners[c]];
+		corners[c + 1] = points[corners[c + 2]];
+		corners[c + 2] = points[b];
+	}
+	free(points);
+	free(xy);
+	return count;
+}
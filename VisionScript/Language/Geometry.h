@@ -0,0 +1,17 @@
+#ifndef Geometry_h
+#define Geometry_h
+
+#include "Evaluator.h"
+
+// both take the points as separate x and y channels and skip points with a coordinate that isn't finite, the
+// predicates are evaluated in double precision whatever scalar_t is, both give nothing when the evaluation is cancelled
+// or runs out of time part way
+
+// the corners of the convex hull counter-clockwise from the leftmost point, without collinear points along its edges,
+// hull needs room for length + 1 indices, fewer than 3 corners means the points have no area
+uint32_t ConvexHull(const EvaluationContext * context, const scalar_t * x, const scalar_t * y, uint32_t length, uint32_t * hull);
+// the Delaunay triangles as three indices each, counter-clockwise, corners needs room for 6 * length indices,
+// returns the number of triangles which is 0 when every point is on one line
+uint32_t DelaunayTriangulation(const EvaluationContext * context, const scalar_t * x, const scalar_t * y, uint32_t length, uint32_t * corners);
+
+#endif
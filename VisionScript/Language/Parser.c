@@ -15,6 +15,9 @@ const char * SyntaxErrorCodeToString(SyntaxErrorCode code) {
 		case SyntaxErrorCodeUnreadableConstant: return "invalid numeric constant";
 		case SyntaxErrorCodeInvalidUnaryPlacement: return "unable to understand unary expression (try inserting parenthesis)";
 		case SyntaxErrorCodeInvalidTernaryPlacement: return "unable to understand ternary expression (try inserting parenthesis)";
+		case SyntaxErrorCodeNonDifferentiableExpression: return "unable to differentiate expression";
+		case SyntaxErrorCodeInvalidDerivative: return "derivative must be of a function of one parameter";
+		case SyntaxErrorCodeInvalidWhereBinding: return "where bindings must be of the form identifier = expression";
 		default: return "unknown error";
 	}
 }
@@ -55,6 +58,10 @@ static const char * operators[] = {
 	[OperatorElse]         = KEYWORD_ELSE,
 };
 
+const char * OperatorToString(Operator operator) {
+	return operator < OperatorCount ? operators[operator] : "";
+}
+
 static Operator prefixUnaryOperators[] = {
 	OperatorNegate,
 	OperatorNot,
@@ -182,6 +189,23 @@ static int32_t FindComma(List(Token) tokens, int32_t start, int32_t end) {
 	return -1;
 }
 
+static int32_t FindWhere(List(Token) tokens, int32_t start, int32_t end) {
+	for (int32_t i = start; i <= end; i++) {
+		if (StringEquals(tokens[i].value, SYMBOL_LEFT_PARENTHESIS)) {
+			i = FindClosingParenthesis(tokens, i, end);
+			if (i == -1) { break; }
+			continue;
+		}
+		if (StringEquals(tokens[i].value, SYMBOL_LEFT_BRACKET)) {
+			i = FindClosingBracket(tokens, i, end);
+			if (i == -1) { break; }
+			continue;
+		}
+		if (tokens[i].type == TokenTypeKeyword && StringEquals(tokens[i].value, KEYWORD_WHERE)) { return i; }
+	}
+	return -1;
+}
+
 static bool ShouldReduceParenthesis(List(Token) tokens, int32_t start, int32_t end) {
 	return FindComma(tokens, start, end) == -1 && (start == 0 || tokens[start - 1].type != TokenTypeIdentifier);
 }
@@ -269,6 +293,7 @@ static ExpressionType DetermineExpressionType(List(Token) tokens, int32_t start,
 	if (StringEquals(tokens[start].value, SYMBOL_LEFT_BRACKET) && FindClosingBracket(tokens, start, end) == end) {
 		return ExpressionTypeArrayLiteral;
 	}
+	if (FindWhere(tokens, start, end) != -1) { return ExpressionTypeWhere; }
 	if (tokens[start].type == TokenTypeIdentifier && StringEquals(tokens[start + 1].value, SYMBOL_EQUAL)) {
 		return ExpressionTypeForAssignment;
 	}
@@ -328,6 +353,60 @@ static SyntaxError ParseList(List(Token) tokens, int32_t start, int32_t end, Exp
 	return (SyntaxError){ SyntaxErrorCodeNone };
 }
 
+static bool ReadPackedNumber(List(Token) tokens, int32_t * i, int32_t end, double * value) {
+	// a number token, possibly negated
+	bool negative = *i < end && StringEquals(tokens[*i].value, SYMBOL_MINUS);
+	if (negative) { (*i)++; }
+	if (*i >= end || tokens[*i].type != TokenTypeNumber) { return false; }
+	char * endPtr = NULL;
+	*value = strtod(tokens[*i].value, &endPtr);
+	if (*endPtr != '\0') { return false; }
+	if (negative) { *value = -*value; }
+	(*i)++;
+	return true;
+}
+
+static bool ParseConstantArray(List(Token) tokens, int32_t start, int32_t end, Expression * expression) {
+	// pasted data is read in a single pass straight into a packed block instead of an expression per element,
+	// anything other than numbers or vectors of numbers is left to ParseList
+	bool vectors = StringEquals(tokens[start + 1].value, SYMBOL_LEFT_PARENTHESIS);
+	List(double) values = ListCreate(sizeof(double), (end - start) / 2 + 1);
+	int32_t dimensions = vectors ? 0 : 1, i = start + 1;
+	while (true) {
+		double value;
+		if (vectors) {
+			if (!StringEquals(tokens[i].value, SYMBOL_LEFT_PARENTHESIS)) { break; }
+			int32_t d = 0;
+			for (i++; ReadPackedNumber(tokens, &i, end, &value); i++) {
+				values = ListPush(values, &value);
+				d++;
+				if (!StringEquals(tokens[i].value, SYMBOL_COMMA)) { break; }
+			}
+			if (!StringEquals(tokens[i].value, SYMBOL_RIGHT_PARENTHESIS) || d < 2 || d > 4 || (dimensions != 0 && d != dimensions)) { break; }
+			dimensions = d;
+			i++;
+		} else {
+			if (!ReadPackedNumber(tokens, &i, end, &value)) { break; }
+			values = ListPush(values, &value);
+		}
+		if (i == end) {
+			// element by element as read, repacked channel after channel
+			uint32_t length = ListLength(values) / dimensions;
+			expression->type = ExpressionTypeConstantArray;
+			expression->constants = (ConstantArray){ .dimensions = dimensions, .length = length, .values = malloc(ListLength(values) * sizeof(double)) };
+			for (int32_t d = 0; d < dimensions; d++) {
+				for (uint32_t j = 0; j < length; j++) { expression->constants.values[d * length + j] = values[j * dimensions + d]; }
+			}
+			ListFree(values);
+			return true;
+		}
+		if (!StringEquals(tokens[i].value, SYMBOL_COMMA)) { break; }
+		i++;
+	}
+	ListFree(values);
+	return false;
+}
+
 static SyntaxError ParseForAssignment(List(Token) tokens, int32_t start, int32_t end, Expression * expression) {
 	expression->assignment.identifier = StringCreate(tokens[start].value);
 	expression->assignment.expression = calloc(1, sizeof(Expression));
@@ -394,6 +473,28 @@ static SyntaxError ParseTernary(List(Token) tokens, int32_t start, int32_t end,
 	return error;
 }
 
+static SyntaxError ParseWhere(List(Token) tokens, int32_t start, int32_t end, Expression * expression) {
+	// everything after the first where is a comma separated list of bindings
+	int32_t index = FindWhere(tokens, start, end);
+	expression->where.expression = calloc(1, sizeof(Expression));
+	expression->where.bindings = ListCreate(sizeof(Expression), 1);
+	SyntaxError error = ParseExpression(tokens, start, index - 1, expression->where.expression);
+	if (error.code != SyntaxErrorCodeNone) { return error; }
+	
+	int32_t prevIndex = index;
+	while (true) {
+		int32_t comma = FindComma(tokens, prevIndex, end);
+		expression->where.bindings = ListPush(expression->where.bindings, &(Expression){ 0 });
+		Expression * binding = &expression->where.bindings[ListLength(expression->where.bindings) - 1];
+		error = ParseExpression(tokens, prevIndex + 1, comma == -1 ? end : comma - 1, binding);
+		if (error.code != SyntaxErrorCodeNone) { return error; }
+		if (binding->type != ExpressionTypeForAssignment) { return (SyntaxError){ SyntaxErrorCodeInvalidWhereBinding, binding->start, binding->end, binding->line }; }
+		if (comma == -1) { break; }
+		prevIndex = comma;
+	}
+	return (SyntaxError){ SyntaxErrorCodeNone };
+}
+
 SyntaxError ParseExpression(List(Token) tokens, int32_t start, int32_t end, Expression * expression) {
 	if (end < start) { return (SyntaxError){ SyntaxErrorCodeMissingExpression, tokens[end].start, tokens[start].end, tokens[end].line }; }
 	expression->start = tokens[start].start;
@@ -413,12 +514,16 @@ SyntaxError ParseExpression(List(Token) tokens, int32_t start, int32_t end, Expr
 		case ExpressionTypeConstant: return ParseConstant(tokens, start, end, expression);
 		case ExpressionTypeIdentifier: return ParseIdentifier(tokens, start, end, expression);
 		case ExpressionTypeVectorLiteral: return ParseList(tokens, start, end, expression);
-		case ExpressionTypeArrayLiteral: return ParseList(tokens, start, end, expression);
+		case ExpressionTypeArrayLiteral:
+			if (ParseConstantArray(tokens, start, end, expression)) { return (SyntaxError){ SyntaxErrorCodeNone }; }
+			return ParseList(tokens, start, end, expression);
 		case ExpressionTypeArguments: return ParseList(tokens, start, end, expression);
 		case ExpressionTypeForAssignment: return ParseForAssignment(tokens, start, end, expression);
 		case ExpressionTypeUnary: return ParseUnary(tokens, start, end, expression);
 		case ExpressionTypeBinary: return ParseBinary(tokens, start, end, expression);
 		case ExpressionTypeTernary: return ParseTernary(tokens, start, end, expression);
+		case ExpressionTypeWhere: return ParseWhere(tokens, start, end, expression);
+		case ExpressionTypeConstantArray: break;
 	}
 	
 	return (SyntaxError){ SyntaxErrorCodeNone };
@@ -444,6 +549,18 @@ void PrintExpression(Expression expression) {
 		}
 		printf("]");
 	}
+	if (expression.type == ExpressionTypeConstantArray) {
+		printf("[");
+		for (uint32_t j = 0; j < expression.constants.length; j++) {
+			if (expression.constants.dimensions > 1) { printf("("); }
+			for (uint32_t d = 0; d < expression.constants.dimensions; d++) {
+				printf(d > 0 ? ", %f" : "%f", expression.constants.values[d * expression.constants.length + j]);
+			}
+			if (expression.constants.dimensions > 1) { printf(")"); }
+			if (j < expression.constants.length - 1) { printf(", "); }
+		}
+		printf("]");
+	}
 	if (expression.type == ExpressionTypeArguments) {
 		for (int32_t i = 0; i < ListLength(expression.list); i++) {
 			PrintExpression(expression.list[i]);
@@ -493,6 +610,96 @@ void PrintExpression(Expression expression) {
 		PrintExpression(*expression.ternary.right);
 		printf(")");
 	}
+	if (expression.type == ExpressionTypeWhere) {
+		printf("(");
+		PrintExpression(*expression.where.expression);
+		printf(") %s ", KEYWORD_WHERE);
+		for (int32_t i = 0; i < ListLength(expression.where.bindings); i++) {
+			PrintExpression(expression.where.bindings[i]);
+			if (i < ListLength(expression.where.bindings) - 1) { printf(", "); }
+		}
+	}
+}
+
+static Expression * CopySubexpression(Expression * expression) {
+	if (expression == NULL) { return NULL; }
+	Expression * copy = malloc(sizeof(Expression));
+	*copy = CopyExpression(*expression);
+	return copy;
+}
+
+Expression CopyExpression(Expression expression) {
+	Expression copy = expression;
+	if (expression.type == ExpressionTypeIdentifier) { copy.identifier = StringCreate(expression.identifier); }
+	if (expression.type == ExpressionTypeVectorLiteral || expression.type == ExpressionTypeArguments || expression.type == ExpressionTypeArrayLiteral) {
+		copy.list = ListCreate(sizeof(Expression), ListLength(expression.list) + 1);
+		for (int32_t i = 0; i < ListLength(expression.list); i++) {
+			Expression element = CopyExpression(expression.list[i]);
+			copy.list = ListPush(copy.list, &element);
+		}
+	}
+	if (expression.type == ExpressionTypeConstantArray) {
+		size_t size = expression.constants.dimensions * expression.constants.length * sizeof(double);
+		copy.constants.values = malloc(size);
+		memcpy(copy.constants.values, expression.constants.values, size);
+	}
+	if (expression.type == ExpressionTypeForAssignment) {
+		copy.assignment.identifier = StringCreate(expression.assignment.identifier);
+		copy.assignment.expression = CopySubexpression(expression.assignment.expression);
+	}
+	if (expression.type == ExpressionTypeUnary) { copy.unary.expression = CopySubexpression(expression.unary.expression); }
+	if (expression.type == ExpressionTypeBinary) {
+		copy.binary.left = CopySubexpression(expression.binary.left);
+		copy.binary.right = CopySubexpression(expression.binary.right);
+	}
+	if (expression.type == ExpressionTypeTernary) {
+		copy.ternary.left = CopySubexpression(expression.ternary.left);
+		copy.ternary.middle = CopySubexpression(expression.ternary.middle);
+		copy.ternary.right = CopySubexpression(expression.ternary.right);
+	}
+	if (expression.type == ExpressionTypeWhere) {
+		copy.where.expression = CopySubexpression(expression.where.expression);
+		copy.where.bindings = ListCreate(sizeof(Expression), ListLength(expression.where.bindings) + 1);
+		for (int32_t i = 0; i < ListLength(expression.where.bindings); i++) {
+			Expression binding = CopyExpression(expression.where.bindings[i]);
+			copy.where.bindings = ListPush(copy.where.bindings, &binding);
+		}
+	}
+	return copy;
+}
+
+bool ExpressionEquals(Expression a, Expression b) {
+	// structural equality, source positions are ignored
+	if (a.type != b.type) { return false; }
+	switch (a.type) {
+		case ExpressionTypeUnknown: return true;
+		case ExpressionTypeConstant: return a.constant == b.constant;
+		case ExpressionTypeIdentifier: return StringEquals(a.identifier, b.identifier);
+		case ExpressionTypeVectorLiteral:
+		case ExpressionTypeArrayLiteral:
+		case ExpressionTypeArguments:
+			if (ListLength(a.list) != ListLength(b.list)) { return false; }
+			for (int32_t i = 0; i < ListLength(a.list); i++) {
+				if (!ExpressionEquals(a.list[i], b.list[i])) { return false; }
+			}
+			return true;
+		case ExpressionTypeConstantArray:
+			return a.constants.dimensions == b.constants.dimensions && a.constants.length == b.constants.length &&
+				memcmp(a.constants.values, b.constants.values, a.constants.dimensions * a.constants.length * sizeof(double)) == 0;
+		case ExpressionTypeForAssignment: return StringEquals(a.assignment.identifier, b.assignment.identifier) && ExpressionEquals(*a.assignment.expression, *b.assignment.expression);
+		case ExpressionTypeUnary: return a.unary.operator == b.unary.operator && ExpressionEquals(*a.unary.expression, *b.unary.expression);
+		case ExpressionTypeBinary: return a.binary.operator == b.binary.operator && ExpressionEquals(*a.binary.left, *b.binary.left) && ExpressionEquals(*a.binary.right, *b.binary.right);
+		case ExpressionTypeTernary:
+			return a.ternary.leftOperator == b.ternary.leftOperator && a.ternary.rightOperator == b.ternary.rightOperator &&
+				ExpressionEquals(*a.ternary.left, *b.ternary.left) && ExpressionEquals(*a.ternary.middle, *b.ternary.middle) && ExpressionEquals(*a.ternary.right, *b.ternary.right);
+		case ExpressionTypeWhere:
+			if (ListLength(a.where.bindings) != ListLength(b.where.bindings)) { return false; }
+			for (int32_t i = 0; i < ListLength(a.where.bindings); i++) {
+				if (!ExpressionEquals(a.where.bindings[i], b.where.bindings[i])) { return false; }
+			}
+			return ExpressionEquals(*a.where.expression, *b.where.expression);
+	}
+	return false;
 }
 
 void FreeExpression(Expression expression) {
@@ -501,6 +708,7 @@ void FreeExpression(Expression expression) {
 		for (int32_t i = 0; i < ListLength(expression.list); i++) { FreeExpression(expression.list[i]); }
 		ListFree(expression.list);
 	}
+	if (expression.type == ExpressionTypeConstantArray) { free(expression.constants.values); }
 	if (expression.type == ExpressionTypeForAssignment) {
 		StringFree(expression.assignment.identifier);
 		if (expression.assignment.expression != NULL) { FreeExpression(*expression.assignment.expression); }
@@ -524,6 +732,12 @@ void FreeExpression(Expression expression) {
 		free(expression.ternary.middle);
 		free(expression.ternary.right);
 	}
+	if (expression.type == ExpressionTypeWhere) {
+		if (expression.where.expression != NULL) { FreeExpression(*expression.where.expression); }
+		free(expression.where.expression);
+		for (int32_t i = 0; i < ListLength(expression.where.bindings); i++) { FreeExpression(expression.where.bindings[i]); }
+		ListFree(expression.where.bindings);
+	}
 }
 
 static const char * declarationAttributes[] = { KEYWORD_POINTS, KEYWORD_PARAMETRIC, KEYWORD_POLYGONS };
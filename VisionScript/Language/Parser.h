@@ -16,6 +16,9 @@ typedef enum SyntaxErrorCode {
 	SyntaxErrorCodeUnreadableConstant,
 	SyntaxErrorCodeInvalidUnaryPlacement,
 	SyntaxErrorCodeInvalidTernaryPlacement,
+	SyntaxErrorCodeNonDifferentiableExpression,
+	SyntaxErrorCodeInvalidDerivative,
+	SyntaxErrorCodeInvalidWhereBinding,
 } SyntaxErrorCode;
 
 typedef struct SyntaxError {
@@ -81,6 +84,18 @@ typedef struct Ternary {
 	struct Expression * right;
 } Ternary;
 
+typedef struct Where {
+	struct Expression * expression;
+	List(struct Expression) bindings; // for assignments, each one can refer to the ones before it
+} Where;
+
+// the numbers of an array literal made only of numbers (or of vectors of numbers), packed by the parser
+typedef struct ConstantArray {
+	uint32_t dimensions;
+	uint32_t length;
+	double * values; // channel after channel, each of length values
+} ConstantArray;
+
 typedef enum ExpressionType {
 	ExpressionTypeUnknown,
 	ExpressionTypeConstant,
@@ -92,6 +107,8 @@ typedef enum ExpressionType {
 	ExpressionTypeUnary,
 	ExpressionTypeBinary,
 	ExpressionTypeTernary,
+	ExpressionTypeWhere,
+	ExpressionTypeConstantArray,
 } ExpressionType;
 
 typedef struct Expression {
@@ -104,14 +121,19 @@ typedef struct Expression {
 		Unary unary;
 		Binary binary;
 		Ternary ternary;
+		Where where;
+		ConstantArray constants;
 	};
 	int32_t start;
 	int32_t end;
 	int32_t line;
 } Expression;
 
+const char * OperatorToString(Operator operator);
 SyntaxError ParseExpression(List(Token) tokens, int32_t start, int32_t end, Expression * expression);
 void PrintExpression(Expression expression);
+Expression CopyExpression(Expression expression);
+bool ExpressionEquals(Expression a, Expression b);
 void FreeExpression(Expression expression);
 
 typedef enum DeclarationAttribute {
@@ -0,0 +1,632 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tgmath.h>
+#include <time.h>
+#include <unistd.h>
+#include "Planner.h"
+
+#define CALIBRATION_LENGTH 4096
+#define CALIBRATION_RUNS 8
+#define PLANNER_MAX_DEPTH 64
+
+typedef struct PlannerJob {
+	void (* kernel)(void * data, uint32_t start, uint32_t end);
+	void * data;
+	uint32_t length;
+	uint32_t slice;
+	atomic_uint next; // start of the next slice to be taken
+} PlannerJob;
+
+// one pool for the whole process, the calibration is only written before any worker or evaluation is running
+static struct {
+	PlannerCalibration calibration;
+	pthread_t workers[PLANNER_MAX_THREADS];
+	uint32_t workerCount;
+	pthread_mutex_t submit; // held by whoever's job the workers are running
+	pthread_mutex_t lock;   // guards everything below
+	pthread_cond_t wake;
+	pthread_cond_t finished;
+	PlannerJob job;
+	uint64_t generation;
+	uint32_t busy;          // workers that haven't finished the current job
+	bool stopping;
+} planner = {
+	// until the host is measured nothing runs in parallel
+	.calibration = { .serialCost = 1e-9, .vectorCost = 2.5e-10, .transcendentalCost = 1e-8, .dispatchCost = INFINITY, .threads = 1 },
+	.submit = PTHREAD_MUTEX_INITIALIZER,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER,
+	.finished = PTHREAD_COND_INITIALIZER,
+};
+
+static void RunSlices(PlannerJob * job) {
+	while (true) {
+		uint32_t start = atomic_fetch_add(&job->next, job->slice);
+		if (start >= job->length) { return; }
+		job->kernel(job->data, start, job->length - start < job->slice ? job->length : start + job->slice);
+	}
+}
+
+static void * Worker(void * arg) {
+	uint64_t generation = 0;
+	pthread_mutex_lock(&planner.lock);
+	while (true) {
+		while (!planner.stopping && planner.generation == generation) { pthread_cond_wait(&planner.wake, &planner.lock); }
+		if (planner.stopping) { break; }
+		generation = planner.generation;
+		pthread_mutex_unlock(&planner.lock);
+		RunSlices(&planner.job);
+		pthread_mutex_lock(&planner.lock);
+		if (--planner.busy == 0) { pthread_cond_signal(&planner.finished); }
+	}
+	pthread_mutex_unlock(&planner.lock);
+	return NULL;
+}
+
+static void Dispatch(uint32_t length, uint32_t slice, void (* kernel)(void * data, uint32_t start, uint32_t end), void * data) {
+	// a second evaluation thread doesn't wait for the pool, it's cheaper to run the loop where it is
+	if (planner.workerCount == 0 || length <= slice || pthread_mutex_trylock(&planner.submit) != 0) {
+		kernel(data, 0, length);
+		return;
+	}
+	pthread_mutex_lock(&planner.lock);
+	planner.job.kernel = kernel;
+	planner.job.data = data;
+	planner.job.length = length;
+	planner.job.slice = slice;
+	atomic_store(&planner.job.next, 0);
+	planner.busy = planner.workerCount;
+	planner.generation++;
+	pthread_cond_broadcast(&planner.wake);
+	pthread_mutex_unlock(&planner.lock);
+
+	RunSlices(&planner.job);
+	pthread_mutex_lock(&planner.lock);
+	while (planner.busy > 0) { pthread_cond_wait(&planner.finished, &planner.lock); }
+	pthread_mutex_unlock(&planner.lock);
+	pthread_mutex_unlock(&planner.submit);
+}
+
+void ParallelFor(uint32_t length, void (* kernel)(void * data, uint32_t start, uint32_t end), void * data) {
+	// a few slices per thread so a slow one doesn't hold everyone up
+	const uint32_t lanes = VECTOR_ARRAY_ALIGNMENT / sizeof(scalar_t);
+	uint32_t slice = length / (4 * (planner.workerCount + 1));
+	slice = slice < lanes ? lanes : (slice + lanes - 1) / lanes * lanes;
+	Dispatch(length, slice, kernel, data);
+}
+
+void ParallelTasks(uint32_t count, void (* kernel)(void * data, uint32_t start, uint32_t end), void * data) {
+	Dispatch(count, 1, kernel, data);
+}
+
+static double Seconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+static void SerialLoop(scalar_t * r, const scalar_t * a, uint32_t aLength, const scalar_t * b, uint32_t bLength, uint32_t n) {
+	// shaped like the evaluator's plain loop, with the broadcast picked per element
+	for (uint32_t j = 0; j < n; j++) { r[j] = a[aLength == 1 ? 0 : j] + b[bLength == 1 ? 0 : j]; }
+}
+
+static void VectorLoop(scalar_t * restrict r, const scalar_t * restrict a, const scalar_t * restrict b, uint32_t n) {
+	for (uint32_t j = 0; j < n; j++) { r[j] = a[j] + b[j]; }
+}
+
+static void TranscendentalLoop(scalar_t * restrict r, const scalar_t * restrict a, uint32_t n) {
+	for (uint32_t j = 0; j < n; j++) { r[j] = sin(a[j]); }
+}
+
+static void EmptyKernel(void * data, uint32_t start, uint32_t end) { }
+
+static void Calibrate(void) {
+	// the best of a few runs, anything slower than that was the host doing something else
+	VectorArray buffers = CreateVectorArray(3, CALIBRATION_LENGTH);
+	scalar_t * a = buffers.xyzw[0], * b = buffers.xyzw[1], * r = buffers.xyzw[2];
+	for (uint32_t j = 0; j < CALIBRATION_LENGTH; j++) {
+		a[j] = j * 0.001;
+		b[j] = 1.0 - j * 0.0005;
+	}
+	volatile scalar_t sink = 0.0;
+	double serial = INFINITY, vector = INFINITY, transcendental = INFINITY, dispatch = INFINITY;
+	for (int32_t k = 0; k < CALIBRATION_RUNS; k++) {
+		double start = Seconds();
+		SerialLoop(r, a, CALIBRATION_LENGTH, b, CALIBRATION_LENGTH, CALIBRATION_LENGTH);
+		serial = fmin(serial, Seconds() - start);
+		sink += r[k];
+		start = Seconds();
+		VectorLoop(r, a, b, CALIBRATION_LENGTH);
+		vector = fmin(vector, Seconds() - start);
+		sink += r[k];
+		start = Seconds();
+		TranscendentalLoop(r, a, CALIBRATION_LENGTH);
+		transcendental = fmin(transcendental, Seconds() - start);
+		sink += r[k];
+		if (planner.workerCount > 0) {
+			start = Seconds();
+			ParallelFor(CALIBRATION_LENGTH, EmptyKernel, NULL);
+			dispatch = fmin(dispatch, Seconds() - start);
+		}
+	}
+	FreeVectorArray(buffers);
+
+	// workers aren't always awake when a job arrives, so the typical handoff is a few times the best one
+	planner.calibration = (PlannerCalibration){
+		.serialCost = serial / CALIBRATION_LENGTH,
+		.vectorCost = vector / CALIBRATION_LENGTH,
+		.transcendentalCost = transcendental / CALIBRATION_LENGTH,
+		.dispatchCost = 4.0 * dispatch,
+		.threads = planner.workerCount + 1,
+	};
+}
+
+void InitializePlanner(void) {
+	if (planner.workerCount > 0) { return; }
+	long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	if (processors > PLANNER_MAX_THREADS) { processors = PLANNER_MAX_THREADS; }
+	planner.stopping = false;
+	for (long i = 1; i < processors; i++) {
+		if (pthread_create(&planner.workers[planner.workerCount], NULL, Worker, NULL) != 0) { break; }
+		planner.workerCount++;
+	}
+	Calibrate();
+}
+
+void FreePlanner(void) {
+	pthread_mutex_lock(&planner.lock);
+	planner.stopping = true;
+	pthread_cond_broadcast(&planner.wake);
+	pthread_mutex_unlock(&planner.lock);
+	for (uint32_t i = 0; i < planner.workerCount; i++) { pthread_join(planner.workers[i], NULL); }
+	planner.workerCount = 0;
+	planner.calibration.threads = 1;
+	planner.calibration.dispatchCost = INFINITY;
+}
+
+PlannerCalibration GetPlannerCalibration(void) {
+	return planner.calibration;
+}
+
+double EstimateOperatorCost(Operator operator, bool fast) {
+	// per element of the vectorized kernel
+	PlannerCalibration c = planner.calibration;
+	switch (operator) {
+		case OperatorAdd:
+		case OperatorSubtract:
+		case OperatorMultiply: return c.vectorCost;
+		case OperatorDivide: return fast ? c.vectorCost : 4.0 * c.vectorCost;
+		case OperatorModulo: return c.transcendentalCost;
+		case OperatorPower: return fast ? 0.5 * c.transcendentalCost : 2.0 * c.transcendentalCost;
+		default: return 0.0;
+	}
+}
+
+double EstimateBuiltinCost(BuiltinFunction function, bool fast) {
+	// per element, 0 for builtins that aren't planned
+	PlannerCalibration c = planner.calibration;
+	// selection buckets each element with a short binary search, twice
+	if (function == BuiltinFunctionMEDIAN || function == BuiltinFunctionQUANTILE) { return 16.0 * c.serialCost; }
+	// reductions read their input once, the moments take a few passes over each block while it's in cache
+	switch (function) {
+		case BuiltinFunctionMEAN:
+		case BuiltinFunctionPROD:
+		case BuiltinFunctionSUM: return c.vectorCost;
+		case BuiltinFunctionSTDEV:
+		case BuiltinFunctionVAR: return 3.0 * c.vectorCost;
+		case BuiltinFunctionCORR:
+		case BuiltinFunctionCOV: return 6.0 * c.vectorCost;
+		default: break;
+	}
+	// a radix pass per byte of the key, then the merges, a shuffle sorts random keys
+	if (function == BuiltinFunctionARGSORT || function == BuiltinFunctionSORT || function == BuiltinFunctionSHUFFLE) { return 2.0 * (sizeof(scalar_t) + 2) * c.serialCost; }
+	// group reductions sort the keys, then gather the keys and the values in that order
+	if (function == BuiltinFunctionGROUPCOUNT || function == BuiltinFunctionGROUPMEAN || function == BuiltinFunctionGROUPSUM) { return (2.0 * (sizeof(scalar_t) + 2) + 4.0) * c.serialCost; }
+	// a descent through the tree for each query and a few leaves either side of it
+	if (function == BuiltinFunctionNEAREST || function == BuiltinFunctionWITHIN) { return 64.0 * c.serialCost; }
+	// scans read and write every element twice once they're longer than a block
+	switch (function) {
+		case BuiltinFunctionCUMMAX:
+		case BuiltinFunctionCUMMIN:
+		case BuiltinFunctionCUMPROD:
+		case BuiltinFunctionCUMSUM: return 4.0 * c.vectorCost;
+		default: break;
+	}
+	// a bin index and an increment for each sample, scattered over the bins so it doesn't vectorize
+	if (function == BuiltinFunctionHIST || function == BuiltinFunctionHIST2D) { return 4.0 * c.serialCost; }
+	// a few butterflies per element for each of the log n stages, convolutions take three transforms or a short direct sum
+	switch (function) {
+		case BuiltinFunctionFFT:
+		case BuiltinFunctionIFFT: return 48.0 * c.serialCost;
+		case BuiltinFunctionCONVOLVE:
+		case BuiltinFunctionLOWPASS: return 144.0 * c.serialCost;
+		default: break;
+	}
+	// ten rounds of the generator for every two elements, then the transform
+	switch (function) {
+		case BuiltinFunctionRAND: return 8.0 * c.vectorCost;
+		case BuiltinFunctionRANDDISK:
+		case BuiltinFunctionRANDN: return fast ? 24.0 * c.vectorCost : 8.0 * c.vectorCost + 2.0 * c.transcendentalCost;
+		default: break;
+	}
+	if (!IsFunctionElementwise(function)) { return 0.0; }
+	switch (function) {
+		case BuiltinFunctionSIN:
+		case BuiltinFunctionCOS:
+		case BuiltinFunctionEXP: return fast ? 8.0 * c.vectorCost : c.transcendentalCost;
+		case BuiltinFunctionABS:
+		case BuiltinFunctionCEIL:
+		case BuiltinFunctionFLOOR:
+		case BuiltinFunctionROUND:
+		case BuiltinFunctionSIGN: return 2.0 * c.vectorCost;
+		case BuiltinFunctionSQRT: return 4.0 * c.vectorCost;
+		case BuiltinFunctionNORMALIZE: return fast ? 4.0 * c.vectorCost : 8.0 * c.vectorCost;
+		case BuiltinFunctionDIGAMMA:
+		case BuiltinFunctionFACTORIAL:
+		case BuiltinFunctionGAMMA: return 4.0 * c.transcendentalCost;
+		default: return c.transcendentalCost;
+	}
+}
+
+ExecutionStrategy PlanExecution(double cost, uint32_t dimensions, uint32_t length) {
+	// the workers only pay off once the share of the work they take is worth more than handing it to them
+	const uint32_t lanes = VECTOR_ARRAY_ALIGNMENT / sizeof(scalar_t);
+	double elements = (double)dimensions * length;
+	if (elements < lanes) { return ExecutionStrategySerial; }
+	PlannerCalibration c = planner.calibration;
+	if (c.threads > 1 && cost * elements * (1.0 - 1.0 / c.threads) > c.dispatchCost) { return ExecutionStrategyParallel; }
+	return ExecutionStrategySIMD;
+}
+
+static double StrategySeconds(ExecutionStrategy strategy, double cost, double elements) {
+	PlannerCalibration c = planner.calibration;
+	switch (strategy) {
+		case ExecutionStrategySerial: return elements * fmax(cost, c.serialCost);
+		case ExecutionStrategySIMD: return elements * cost;
+		default: return elements * cost / c.threads + c.dispatchCost;
+	}
+}
+
+// shapes are inferred without evaluating anything, from constants, cached variables and the shapes of parameters
+typedef struct PlanShape {
+	uint32_t dimensions;
+	double length;
+} PlanShape;
+
+typedef struct PlanBinding {
+	const char * identifier;
+	PlanShape shape;
+} PlanBinding;
+
+static PlanShape InferShape(Environment * environment, List(PlanBinding) * bindings, Expression expression, int32_t depth);
+
+static bool ConstantValue(Environment * environment, Expression expression, double values[4], uint32_t * dimensions) {
+	// bounds of ranges, which are usually numbers or variables already in the cache
+	double left[4], right[4];
+	uint32_t leftDimensions, rightDimensions;
+	switch (expression.type) {
+		case ExpressionTypeConstant:
+			values[0] = expression.constant;
+			*dimensions = 1;
+			return true;
+		case ExpressionTypeIdentifier: {
+			VectorArray * cached = GetEnvironmentCache(environment, expression.identifier);
+			if (cached == NULL || cached->length != 1) { return false; }
+			for (int32_t d = 0; d < cached->dimensions; d++) { values[d] = cached->xyzw[d][0]; }
+			*dimensions = cached->dimensions;
+			return true;
+		}
+		case ExpressionTypeVectorLiteral:
+			if (ListLength(expression.list) > 4) { return false; }
+			for (int32_t i = 0; i < ListLength(expression.list); i++) {
+				if (!ConstantValue(environment, expression.list[i], &values[i], &leftDimensions) || leftDimensions != 1) { return false; }
+			}
+			*dimensions = ListLength(expression.list);
+			return true;
+		case ExpressionTypeUnary:
+			if (expression.unary.operator != OperatorNegate || !ConstantValue(environment, *expression.unary.expression, values, dimensions)) { return false; }
+			for (int32_t d = 0; d < *dimensions; d++) { values[d] = -values[d]; }
+			return true;
+		case ExpressionTypeBinary:
+			if (expression.binary.operator > OperatorDivide) { return false; }
+			if (!ConstantValue(environment, *expression.binary.left, left, &leftDimensions) || !ConstantValue(environment, *expression.binary.right, right, &rightDimensions)) { return false; }
+			if (leftDimensions != rightDimensions && leftDimensions != 1 && rightDimensions != 1) { return false; }
+			*dimensions = leftDimensions == 1 ? rightDimensions : leftDimensions;
+			for (int32_t d = 0; d < *dimensions; d++) {
+				double a = left[leftDimensions == 1 ? 0 : d], b = right[rightDimensions == 1 ? 0 : d];
+				switch (expression.binary.operator) {
+					case OperatorAdd: values[d] = a + b; break;
+					case OperatorSubtract: values[d] = a - b; break;
+					case OperatorMultiply: values[d] = a * b; break;
+					default: values[d] = a / b; break;
+				}
+			}
+			return true;
+		default: return false;
+	}
+}
+
+static PlanShape BroadcastShape(PlanShape left, PlanShape right) {
+	PlanShape shape = { .dimensions = left.dimensions == 1 ? right.dimensions : left.dimensions };
+	if (left.length == 1) { shape.length = right.length; }
+	else if (right.length == 1) { shape.length = left.length; }
+	else { shape.length = fmin(left.length, right.length); }
+	return shape;
+}
+
+static PlanShape InferRangeShape(Environment * environment, Expression expression) {
+	// a range whose bounds aren't known is counted as a single element
+	double lower[4], upper[4];
+	uint32_t lowerDimensions, upperDimensions;
+	if (!ConstantValue(environment, *expression.binary.left, lower, &lowerDimensions) || !ConstantValue(environment, *expression.binary.right, upper, &upperDimensions) || lowerDimensions != upperDimensions) {
+		return (PlanShape){ 1, 1 };
+	}
+	PlanShape shape = { lowerDimensions, 1 };
+	for (int32_t d = 0; d < lowerDimensions; d++) { shape.length *= fabs(round(upper[d]) - round(lower[d])) + 1.0; }
+	return shape;
+}
+
+static PlanShape InferForShape(Environment * environment, List(PlanBinding) * bindings, Expression body, Expression assignment, int32_t depth) {
+	// every element of the assignment evaluates the body, a when condition can only make it shorter
+	if (assignment.type != ExpressionTypeForAssignment) { return (PlanShape){ 1, 1 }; }
+	PlanShape elements = InferShape(environment, bindings, *assignment.assignment.expression, depth + 1);
+	*bindings = ListPush(*bindings, &(PlanBinding){ assignment.assignment.identifier, { elements.dimensions, 1 } });
+	PlanShape shape = InferShape(environment, bindings, body, depth + 1);
+	*bindings = ListPop(*bindings);
+	shape.length *= elements.length;
+	return shape;
+}
+
+static PlanShape InferCallShape(Environment * environment, List(PlanBinding) * bindings, Expression expression, int32_t depth) {
+	List(Expression) arguments = expression.binary.right->list;
+	if (expression.binary.left->type != ExpressionTypeIdentifier || expression.binary.right->type != ExpressionTypeArguments || ListLength(arguments) == 0) { return (PlanShape){ 1, 1 }; }
+	PlanShape first = InferShape(environment, bindings, arguments[0], depth + 1);
+
+	Equation * equation = GetEnvironmentEquation(environment, expression.binary.left->identifier);
+	if (equation != NULL) {
+		if (equation->type != EquationTypeFunction || ListLength(equation->declaration.parameters) != ListLength(arguments)) { return (PlanShape){ 1, 1 }; }
+		// parameters take the shapes of the arguments for the body
+		List(PlanBinding) scope = ListCreate(sizeof(PlanBinding), ListLength(arguments));
+		for (int32_t i = 0; i < ListLength(arguments); i++) {
+			PlanShape shape = InferShape(environment, bindings, arguments[i], depth + 1);
+			scope = ListPush(scope, &(PlanBinding){ equation->declaration.parameters[i], shape });
+		}
+		PlanShape shape = InferShape(environment, &scope, equation->expression, depth + 1);
+		ListFree(scope);
+		return shape;
+	}
+
+	BuiltinFunction function = DetermineBuiltinFunction(expression.binary.left->identifier);
+	switch (function) {
+		case BuiltinFunctionRAND:
+		case BuiltinFunctionRANDDISK:
+		case BuiltinFunctionRANDN: {
+			// the length is only known ahead when it's written as a number
+			double length = arguments[0].type == ExpressionTypeConstant && arguments[0].constant >= 1.0 ? floor(arguments[0].constant) : 1.0;
+			return (PlanShape){ function == BuiltinFunctionRANDDISK ? 2 : 1, length };
+		}
+		case BuiltinFunctionHIST:
+		case BuiltinFunctionHIST2D: {
+			// a bin for each element, known ahead when the count is written as a number, hist2d squares it
+			double bins = ListLength(arguments) > 1 && arguments[1].type == ExpressionTypeConstant && arguments[1].constant >= 1.0 ? floor(arguments[1].constant) : 1.0;
+			return function == BuiltinFunctionHIST ? (PlanShape){ 2, bins } : (PlanShape){ 3, bins * bins };
+		}
+		case BuiltinFunctionDIST:
+		case BuiltinFunctionDISTSQ:
+		case BuiltinFunctionDOT:
+		case BuiltinFunctionLENGTH:
+		case BuiltinFunctionLENGTHSQ: return (PlanShape){ 1, first.length };
+		case BuiltinFunctionARGSORT: return (PlanShape){ 1, first.length };
+		case BuiltinFunctionGROUPCOUNT: return (PlanShape){ 2, first.length };
+		case BuiltinFunctionNEAREST: {
+			// k indices for each query, known ahead when k is written as a number
+			double k = ListLength(arguments) > 2 && arguments[2].type == ExpressionTypeConstant && arguments[2].constant >= 1.0 ? floor(arguments[2].constant) : 1.0;
+			return (PlanShape){ 1, first.length * k };
+		}
+		case BuiltinFunctionWITHIN: return (PlanShape){ 1, first.length };
+		// close to 2 triangles for each point
+		case BuiltinFunctionDELAUNAY: return (PlanShape){ 2, 6.0 * first.length };
+		case BuiltinFunctionFFT:
+		case BuiltinFunctionIFFT: return (PlanShape){ 2, first.length };
+		case BuiltinFunctionDIFF: return (PlanShape){ first.dimensions, first.length > 1.0 ? first.length - 1.0 : 0.0 };
+		case BuiltinFunctionARGMAX:
+		case BuiltinFunctionARGMIN:
+		case BuiltinFunctionCORR:
+		case BuiltinFunctionCOV:
+		case BuiltinFunctionMEAN:
+		case BuiltinFunctionMEDIAN:
+		case BuiltinFunctionPROD:
+		case BuiltinFunctionQUANTILE:
+		case BuiltinFunctionSTDEV:
+		case BuiltinFunctionSUM:
+		case BuiltinFunctionVAR: return (PlanShape){ first.dimensions, 1 };
+		default: return first;
+	}
+}
+
+static PlanShape InferShape(Environment * environment, List(PlanBinding) * bindings, Expression expression, int32_t depth) {
+	if (depth >= PLANNER_MAX_DEPTH) { return (PlanShape){ 1, 1 }; }
+	switch (expression.type) {
+		case ExpressionTypeConstantArray: return (PlanShape){ expression.constants.dimensions, expression.constants.length };
+		case ExpressionTypeIdentifier: {
+			for (int32_t i = ListLength(*bindings) - 1; i >= 0; i--) {
+				if (StringEquals(expression.identifier, (*bindings)[i].identifier)) { return (*bindings)[i].shape; }
+			}
+			VectorArray * cached = GetEnvironmentCache(environment, expression.identifier);
+			if (cached != NULL) { return (PlanShape){ cached->dimensions, cached->length }; }
+			Equation * equation = GetEnvironmentEquation(environment, expression.identifier);
+			if (equation != NULL && equation->type != EquationTypeFunction) {
+				List(PlanBinding) scope = ListCreate(sizeof(PlanBinding), 1);
+				PlanShape shape = InferShape(environment, &scope, equation->expression, depth + 1);
+				ListFree(scope);
+				return shape;
+			}
+			return (PlanShape){ 1, 1 };
+		}
+		case ExpressionTypeVectorLiteral: {
+			PlanShape shape = { ListLength(expression.list), 1 };
+			for (int32_t i = 0; i < ListLength(expression.list); i++) { shape.length = fmax(shape.length, InferShape(environment, bindings, expression.list[i], depth + 1).length); }
+			return shape;
+		}
+		case ExpressionTypeArrayLiteral: {
+			PlanShape shape = { 0, 0 };
+			for (int32_t i = 0; i < ListLength(expression.list); i++) {
+				PlanShape element = InferShape(environment, bindings, expression.list[i], depth + 1);
+				if (i == 0) { shape.dimensions = element.dimensions; }
+				shape.length += element.length;
+			}
+			return shape;
+		}
+		case ExpressionTypeUnary: return InferShape(environment, bindings, *expression.unary.expression, depth + 1);
+		case ExpressionTypeBinary:
+			switch (expression.binary.operator) {
+				case OperatorRange: return InferRangeShape(environment, expression);
+				case OperatorFor: return InferForShape(environment, bindings, *expression.binary.left, *expression.binary.right, depth);
+				case OperatorDimension: {
+					PlanShape shape = InferShape(environment, bindings, *expression.binary.left, depth + 1);
+					if (expression.binary.right->type == ExpressionTypeIdentifier) { shape.dimensions = StringLength(expression.binary.right->identifier); }
+					return shape;
+				}
+				case OperatorIndexStart: {
+					PlanShape shape = InferShape(environment, bindings, *expression.binary.left, depth + 1);
+					shape.length = InferShape(environment, bindings, *expression.binary.right, depth + 1).length;
+					return shape;
+				}
+				case OperatorCallStart: return InferCallShape(environment, bindings, expression, depth);
+				default: return BroadcastShape(InferShape(environment, bindings, *expression.binary.left, depth + 1), InferShape(environment, bindings, *expression.binary.right, depth + 1));
+			}
+		case ExpressionTypeTernary:
+			if (expression.ternary.leftOperator == OperatorFor) { return InferForShape(environment, bindings, *expression.ternary.left, *expression.ternary.middle, depth); }
+			return InferShape(environment, bindings, *expression.ternary.left, depth + 1);
+		case ExpressionTypeWhere: {
+			int32_t count = ListLength(expression.where.bindings);
+			for (int32_t i = 0; i < count; i++) {
+				ForAssignment assignment = expression.where.bindings[i].assignment;
+				PlanShape shape = InferShape(environment, bindings, *assignment.expression, depth + 1);
+				*bindings = ListPush(*bindings, &(PlanBinding){ assignment.identifier, shape });
+			}
+			PlanShape shape = InferShape(environment, bindings, *expression.where.expression, depth + 1);
+			for (int32_t i = 0; i < count; i++) { *bindings = ListPop(*bindings); }
+			return shape;
+		}
+		default: return (PlanShape){ 1, 1 };
+	}
+}
+
+static const char * strategyNames[] = {
+	[ExecutionStrategySerial] = "serial",
+	[ExecutionStrategySIMD] = "simd",
+	[ExecutionStrategyParallel] = "parallel",
+};
+
+static void PrintPlanNode(Environment * environment, List(PlanBinding) * bindings, Expression expression, int32_t indent) {
+	// one line per node with its shape, kernels also get the strategy they'd run with and its estimated time
+	char label[64];
+	double cost = 0.0;
+	Expression * input = NULL; // calls are planned over their first argument, which is longer than the result of a reduction
+	switch (expression.type) {
+		case ExpressionTypeConstant: snprintf(label, sizeof(label), "%g", expression.constant); break;
+		case ExpressionTypeConstantArray: snprintf(label, sizeof(label), "[constants]"); break;
+		case ExpressionTypeIdentifier: snprintf(label, sizeof(label), "%s", expression.identifier); break;
+		case ExpressionTypeVectorLiteral: snprintf(label, sizeof(label), "( )"); break;
+		case ExpressionTypeArrayLiteral: snprintf(label, sizeof(label), "[ ]"); break;
+		case ExpressionTypeForAssignment: snprintf(label, sizeof(label), "%s =", expression.assignment.identifier); break;
+		case ExpressionTypeUnary: snprintf(label, sizeof(label), "%s", OperatorToString(expression.unary.operator)); break;
+		case ExpressionTypeBinary:
+			if (expression.binary.operator == OperatorCallStart && expression.binary.left->type == ExpressionTypeIdentifier) {
+				snprintf(label, sizeof(label), "%s( )", expression.binary.left->identifier);
+				BuiltinFunction function = DetermineBuiltinFunction(expression.binary.left->identifier);
+				if (function != BuiltinFunctionNone && GetEnvironmentEquation(environment, expression.binary.left->identifier) == NULL) { cost = EstimateBuiltinCost(function, false); }
+				bool generated = function == BuiltinFunctionRAND || function == BuiltinFunctionRANDDISK || function == BuiltinFunctionRANDN;
+				if (!generated && expression.binary.right->type == ExpressionTypeArguments && ListLength(expression.binary.right->list) > 0) { input = &expression.binary.right->list[0]; }
+			} else if (expression.binary.operator == OperatorDimension && expression.binary.right->type == ExpressionTypeIdentifier) {
+				snprintf(label, sizeof(label), ".%s", expression.binary.right->identifier);
+			} else if (expression.binary.operator == OperatorIndexStart) {
+				snprintf(label, sizeof(label), "[ ]");
+			} else {
+				snprintf(label, sizeof(label), "%s", OperatorToString(expression.binary.operator));
+				cost = EstimateOperatorCost(expression.binary.operator, false);
+			}
+			break;
+		case ExpressionTypeTernary: snprintf(label, sizeof(label), "%s %s", OperatorToString(expression.ternary.leftOperator), OperatorToString(expression.ternary.rightOperator)); break;
+		case ExpressionTypeWhere: snprintf(label, sizeof(label), "where"); break;
+		default: snprintf(label, sizeof(label), "?"); break;
+	}
+
+	PlanShape shape = expression.type == ExpressionTypeForAssignment ? InferShape(environment, bindings, *expression.assignment.expression, 0) : InferShape(environment, bindings, expression, 0);
+	printf("%*s%-*s %u x %-10.0f", 2 * indent, "", 24 - 2 * indent > 0 ? 24 - 2 * indent : 0, label, shape.dimensions, shape.length);
+	if (cost > 0.0) {
+		PlanShape planned = input == NULL ? shape : InferShape(environment, bindings, *input, 0);
+		double elements = planned.dimensions * planned.length;
+		ExecutionStrategy strategy = PlanExecution(cost, planned.dimensions, planned.length > UINT32_MAX ? UINT32_MAX : planned.length);
+		printf(" %-8s %10.3f us", strategyNames[strategy], 1e6 * StrategySeconds(strategy, cost, elements));
+	}
+	printf("\n");
+
+	switch (expression.type) {
+		case ExpressionTypeVectorLiteral:
+		case ExpressionTypeArrayLiteral:
+		case ExpressionTypeArguments:
+			for (int32_t i = 0; i < ListLength(expression.list); i++) { PrintPlanNode(environment, bindings, expression.list[i], indent + 1); }
+			break;
+		case ExpressionTypeForAssignment: PrintPlanNode(environment, bindings, *expression.assignment.expression, indent + 1); break;
+		case ExpressionTypeUnary: PrintPlanNode(environment, bindings, *expression.unary.expression, indent + 1); break;
+		case ExpressionTypeBinary:
+			if (expression.binary.operator == OperatorCallStart) {
+				if (expression.binary.right->type == ExpressionTypeArguments) {
+					for (int32_t i = 0; i < ListLength(expression.binary.right->list); i++) { PrintPlanNode(environment, bindings, expression.binary.right->list[i], indent + 1); }
+				}
+			} else if (expression.binary.operator == OperatorFor && expression.binary.right->type == ExpressionTypeForAssignment) {
+				// the body sees the loop variable as a single element
+				PrintPlanNode(environment, bindings, *expression.binary.right, indent + 1);
+				PlanShape elements = InferShape(environment, bindings, *expression.binary.right->assignment.expression, 0);
+				*bindings = ListPush(*bindings, &(PlanBinding){ expression.binary.right->assignment.identifier, { elements.dimensions, 1 } });
+				PrintPlanNode(environment, bindings, *expression.binary.left, indent + 1);
+				*bindings = ListPop(*bindings);
+			} else if (expression.binary.operator == OperatorDimension) {
+				PrintPlanNode(environment, bindings, *expression.binary.left, indent + 1);
+			} else {
+				PrintPlanNode(environment, bindings, *expression.binary.left, indent + 1);
+				PrintPlanNode(environment, bindings, *expression.binary.right, indent + 1);
+			}
+			break;
+		case ExpressionTypeTernary:
+			if (expression.ternary.leftOperator == OperatorFor && expression.ternary.middle->type == ExpressionTypeForAssignment) {
+				PrintPlanNode(environment, bindings, *expression.ternary.middle, indent + 1);
+				PlanShape elements = InferShape(environment, bindings, *expression.ternary.middle->assignment.expression, 0);
+				*bindings = ListPush(*bindings, &(PlanBinding){ expression.ternary.middle->assignment.identifier, { elements.dimensions, 1 } });
+				PrintPlanNode(environment, bindings, *expression.ternary.left, indent + 1);
+				PrintPlanNode(environment, bindings, *expression.ternary.right, indent + 1);
+				*bindings = ListPop(*bindings);
+			} else {
+				PrintPlanNode(environment, bindings, *expression.ternary.left, indent + 1);
+				PrintPlanNode(environment, bindings, *expression.ternary.middle, indent + 1);
+				PrintPlanNode(environment, bindings, *expression.ternary.right, indent + 1);
+			}
+			break;
+		case ExpressionTypeWhere: {
+			int32_t count = ListLength(expression.where.bindings);
+			for (int32_t i = 0; i < count; i++) {
+				ForAssignment assignment = expression.where.bindings[i].assignment;
+				PrintPlanNode(environment, bindings, expression.where.bindings[i], indent + 1);
+				PlanShape shape = InferShape(environment, bindings, *assignment.expression, 0);
+				*bindings = ListPush(*bindings, &(PlanBinding){ assignment.identifier, shape });
+			}
+			PrintPlanNode(environment, bindings, *expression.where.expression, indent + 1);
+			for (int32_t i = 0; i < count; i++) { *bindings = ListPop(*bindings); }
+			break;
+		}
+		default: break;
+	}
+}
+
+void PrintExecutionPlan(Environment * environment, Expression expression, List(String) parameters) {
+	PlannerCalibration c = planner.calibration;
+	printf("%u threads, add %.3f ns (%.3f ns unvectorized), sin %.3f ns, dispatch %.3f us\n", c.threads, 1e9 * c.vectorCost, 1e9 * c.serialCost, 1e9 * c.transcendentalCost, 1e6 * c.dispatchCost);
+	// parameters are planned as single elements
+	List(PlanBinding) bindings = ListCreate(sizeof(PlanBinding), 4);
+	for (int32_t i = 0; parameters != NULL && i < ListLength(parameters); i++) { bindings = ListPush(bindings, &(PlanBinding){ parameters[i], { 1, 1 } }); }
+	PrintPlanNode(environment, &bindings, expression, 0);
+	ListFree(bindings);
+}
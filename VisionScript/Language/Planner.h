@@ -0,0 +1,40 @@
+#ifndef Planner_h
+#define Planner_h
+
+#include "Builtin.h"
+
+#define PLANNER_MAX_THREADS 16
+
+// how a kernel node runs over its elements
+typedef enum ExecutionStrategy {
+	ExecutionStrategySerial,   // the plain element loop, for arrays too short to fill a vector
+	ExecutionStrategySIMD,     // branch free loops over whole channels that the compiler vectorizes
+	ExecutionStrategyParallel, // the same loops over slices of the channels spread across the worker threads
+} ExecutionStrategy;
+
+// measurements of the host the cost model is scaled by, taken once at startup, costs are seconds per element
+typedef struct PlannerCalibration {
+	double serialCost;         // an addition in the plain loop
+	double vectorCost;         // an addition in the vectorized loop
+	double transcendentalCost; // a libm call like sin
+	double dispatchCost;       // seconds to hand a job to the workers and wait for it
+	uint32_t threads;          // workers plus the thread that hands out the job
+} PlannerCalibration;
+
+void InitializePlanner(void);
+void FreePlanner(void);
+PlannerCalibration GetPlannerCalibration(void);
+
+double EstimateOperatorCost(Operator operator, bool fast);
+double EstimateBuiltinCost(BuiltinFunction function, bool fast);
+ExecutionStrategy PlanExecution(double cost, uint32_t dimensions, uint32_t length);
+
+// runs kernel over [0, length) in slices on the worker threads and the calling thread, or on the calling thread alone
+// when the workers are busy with another job, slices start on a multiple of the vector alignment
+void ParallelFor(uint32_t length, void (* kernel)(void * data, uint32_t start, uint32_t end), void * data);
+// the same for independent tasks numbered [0, count), which are handed out one at a time
+void ParallelTasks(uint32_t count, void (* kernel)(void * data, uint32_t start, uint32_t end), void * data);
+
+void PrintExecutionPlan(Environment * environment, Expression expression, List(String) parameters);
+
+#endif
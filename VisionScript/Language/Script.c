@@ -1,5 +1,6 @@
 #include "Script.h"
 #include "Builtin.h"
+#include "Derivative.h"
 #include <stdio.h>
 
 Script LoadScript(const char * code) {
@@ -7,6 +8,7 @@ Script LoadScript(const char * code) {
 		.lines = SplitCodeIntoLines((char *)code),
 		.environment = CreateEmptyEnvironment(),
 		.needsRender = ListCreate(sizeof(Equation), 1),
+		.approximations = HashMapCreate(sizeof(Approximation)),
 	};
 	InitializeBuiltinVariables(&script.environment);
 	for (int32_t i = 0; i < ListLength(script.lines); i++) {
@@ -27,6 +29,16 @@ Script LoadScript(const char * code) {
 		AddToScriptRenderList(&script, equation);
 		FreeTokens(tokens);
 	}
+	
+	// derivatives are built once every function they refer to is known
+	List(String) keys = HashMapKeys(script.environment.equations);
+	for (int32_t i = 0; i < ListLength(keys); i++) {
+		Equation * equation = GetEnvironmentEquation(&script.environment, keys[i]);
+		if (equation == NULL) { continue; }
+		SyntaxError error = AddEnvironmentDerivatives(&script.environment, equation->expression);
+		if (error.code != SyntaxErrorCodeNone) { PrintSyntaxError(error, script.lines); }
+	}
+	ListFree(keys);
 	InitializeEnvironmentDependents(&script.environment);
 	return script;
 }
@@ -48,9 +60,12 @@ void InvalidateDependents(Script * script, const char * identifer) {
 		Equation * dependent = HashMapGet(script->environment.equations, (*dependents)[i].declaration.identifier);
 		if (dependent == NULL) { continue; }
 		if (dependent->type == EquationTypeVariable) {
-			VectorArray * cache = HashMapGet(script->environment.cache, (*dependents)[i].declaration.identifier);
-			if (cache != NULL) { FreeVectorArray(*cache); }
-			HashMapSet(script->environment.cache, (*dependents)[i].declaration.identifier, NULL);
+			RemoveEnvironmentCache(&script->environment, (*dependents)[i].declaration.identifier);
+		}
+		Approximation * approximation = HashMapGet(script->approximations, (*dependents)[i].declaration.identifier);
+		if (approximation != NULL) {
+			FreeApproximation(*approximation);
+			HashMapSet(script->approximations, (*dependents)[i].declaration.identifier, NULL);
 		}
 		if (dependent->declaration.attribute != DeclarationAttributeNone) { AddToScriptRenderList(script, *dependent); }
 	}
@@ -68,5 +83,9 @@ void FreeScript(Script script) {
 	for (int32_t i = 0; i < ListLength(script.lines); i++) { StringFree(script.lines[i]); }
 	ListFree(script.lines);
 	ListFree(script.needsRender);
+	List(String) keys = HashMapKeys(script.approximations);
+	for (int32_t i = 0; i < ListLength(keys); i++) { FreeApproximation(*(Approximation *)HashMapGet(script.approximations, keys[i])); }
+	ListFree(keys);
+	HashMapFree(script.approximations);
 	FreeEnvironment(script.environment);
 }
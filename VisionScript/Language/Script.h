@@ -4,11 +4,13 @@
 #include "Tokenizer.h"
 #include "Parser.h"
 #include "Evaluator.h"
+#include "Approximation.h"
 
 typedef struct Script {
 	List(String) lines;
 	Environment environment;
 	List(Equation) needsRender;
+	HashMap(Approximation) approximations;
 } Script;
 
 Script LoadScript(const char * code);
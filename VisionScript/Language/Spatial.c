@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+#include <tgmath.h>
+#include "Spatial.h"
+#include "Planner.h"
+
+#define SPATIAL_LEAF_LENGTH 8
+#define SPATIAL_PARALLEL_LEVELS 4 // levels built before the subtrees below them are handed out to the threads
+#define SPATIAL_STACK_NEIGHBORS 64
+#define SPATIAL_CHECKPOINT_LENGTH 4096 // nodes at least this long check the evaluation before they're split
+
+typedef struct SpatialBuild {
+	const EvaluationContext * context;
+	SpatialIndex * index;
+} SpatialBuild;
+
+static inline void SwapPoints(SpatialIndex * index, uint32_t a, uint32_t b) {
+	for (uint32_t d = 0; d < index->dimensions; d++) {
+		scalar_t t = index->points[d][a];
+		index->points[d][a] = index->points[d][b];
+		index->points[d][b] = t;
+	}
+	uint32_t t = index->indices[a];
+	index->indices[a] = index->indices[b];
+	index->indices[b] = t;
+}
+
+static void SelectMedian(SpatialIndex * index, uint32_t axis, uint32_t lo, uint32_t hi, uint32_t k) {
+	// quickselect, afterwards the points before k are no greater along axis and the ones after no less
+	const scalar_t * x = index->points[axis];
+	while (hi - lo > 2) {
+		scalar_t a = x[lo], b = x[lo + (hi - lo) / 2], c = x[hi - 1];
+		scalar_t pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+		int64_t i = lo, j = hi - 1;
+		while (i <= j) {
+			while (x[i] < pivot) { i++; }
+			while (x[j] > pivot) { j--; }
+			if (i <= j) { SwapPoints(index, i++, j--); }
+		}
+		// [lo, j] is no greater than the pivot, [i, hi) no less and anything between them equals it
+		if (k <= j) { hi = j + 1; }
+		else if (k >= i) { lo = i; }
+		else { return; }
+	}
+	if (hi - lo == 2 && x[lo] > x[lo + 1]) { SwapPoints(index, lo, lo + 1); }
+}
+
+static void BuildNode(const SpatialBuild * build, uint32_t node, uint32_t lo, uint32_t hi, uint32_t levels) {
+	// stops after levels levels so the subtrees below can be built separately
+	if (hi - lo <= SPATIAL_LEAF_LENGTH || levels == 0) { return; }
+	if (hi - lo >= SPATIAL_CHECKPOINT_LENGTH && EvaluationContextCheckpoint(build->context) != RuntimeErrorCodeNone) { return; }
+	SpatialIndex * index = build->index;
+	uint32_t axis = 0;
+	scalar_t widest = -1.0;
+	for (uint32_t d = 0; d < index->dimensions; d++) {
+		scalar_t low = index->points[d][lo], high = low;
+		for (uint32_t i = lo + 1; i < hi; i++) {
+			scalar_t x = index->points[d][i];
+			low = x < low ? x : low;
+			high = x > high ? x : high;
+		}
+		if (high - low > widest) {
+			widest = high - low;
+			axis = d;
+		}
+	}
+	index->axes[node] = axis;
+	uint32_t mid = lo + (hi - lo) / 2;
+	SelectMedian(index, axis, lo, hi, mid);
+	index->splits[node] = index->points[axis][mid];
+	BuildNode(build, 2 * node, lo, mid, levels - 1);
+	BuildNode(build, 2 * node + 1, mid, hi, levels - 1);
+}
+
+static void BuildSubtrees(void * data, uint32_t start, uint32_t end) {
+	// subtree t is node 2^levels + t, its range found by following the bits of t down from the root
+	const SpatialBuild * build = data;
+	for (uint32_t t = start; t < end; t++) {
+		uint32_t lo = 0, hi = build->index->length;
+		for (int32_t bit = SPATIAL_PARALLEL_LEVELS - 1; bit >= 0; bit--) {
+			uint32_t mid = lo + (hi - lo) / 2;
+			if (hi - lo <= SPATIAL_LEAF_LENGTH) { break; }
+			if (t >> bit & 1) { lo = mid; }
+			else { hi = mid; }
+		}
+		if (hi - lo > SPATIAL_LEAF_LENGTH) { BuildNode(build, (1 << SPATIAL_PARALLEL_LEVELS) + t, lo, hi, UINT32_MAX); }
+	}
+}
+
+SpatialIndex * CreateSpatialIndex(const EvaluationContext * context, VectorArray points) {
+	SpatialIndex * index = calloc(1, sizeof(SpatialIndex));
+	index->dimensions = points.dimensions;
+	for (uint32_t d = 0; d < points.dimensions; d++) { index->points[d] = AllocateElements(points.length, sizeof(scalar_t)); }
+	index->indices = AllocateElements(points.length, sizeof(uint32_t));
+	for (uint32_t i = 0; i < points.length; i++) {
+		bool valid = true;
+		for (uint32_t d = 0; d < points.dimensions; d++) { valid &= points.xyzw[d][i] == points.xyzw[d][i]; }
+		if (!valid) { continue; }
+		for (uint32_t d = 0; d < points.dimensions; d++) { index->points[d][index->length] = points.xyzw[d][i]; }
+		index->indices[index->length++] = i;
+	}
+
+	// a node for every split down to the leaves, the ranges halve at each level
+	uint32_t nodes = 1;
+	for (uint32_t size = index->length; size > SPATIAL_LEAF_LENGTH; size = (size + 1) / 2) { nodes *= 2; }
+	index->axes = calloc(nodes, sizeof(uint8_t));
+	index->splits = calloc(nodes, sizeof(scalar_t));
+	SpatialBuild build = { context, index };
+	if (PlanExecution(EstimateBuiltinCost(BuiltinFunctionNEAREST, false), points.dimensions, index->length) == ExecutionStrategyParallel) {
+		BuildNode(&build, 1, 0, index->length, SPATIAL_PARALLEL_LEVELS);
+		ParallelTasks(1 << SPATIAL_PARALLEL_LEVELS, BuildSubtrees, &build);
+	} else { BuildNode(&build, 1, 0, index->length, UINT32_MAX); }
+	// a tree left part built is no good to anyone
+	if (EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) {
+		FreeSpatialIndex(index);
+		return NULL;
+	}
+	return index;
+}
+
+void FreeSpatialIndex(SpatialIndex * index) {
+	if (index == NULL) { return; }
+	for (uint32_t d = 0; d < index->dimensions; d++) { free(index->points[d]); }
+	free(index->indices);
+	free(index->axes);
+	free(index->splits);
+	free(index);
+}
+
+typedef struct Neighbors {
+	uint32_t k, count;
+	scalar_t * distances; // squared, nearest first
+	uint32_t * indices;
+} Neighbors;
+
+static inline bool NeighborBefore(scalar_t distance, uint32_t index, scalar_t otherDistance, uint32_t otherIndex) {
+	return distance < otherDistance || (distance == otherDistance && index < otherIndex);
+}
+
+static void SearchNearest(const SpatialIndex * index, uint32_t node, uint32_t lo, uint32_t hi, const scalar_t * query, Neighbors * n) {
+	if (hi - lo <= SPATIAL_LEAF_LENGTH) {
+		for (uint32_t i = lo; i < hi; i++) {
+			scalar_t distance = 0.0;
+			for (uint32_t d = 0; d < index->dimensions; d++) { distance += (index->points[d][i] - query[d]) * (index->points[d][i] - query[d]); }
+			uint32_t original = index->indices[i];
+			if (n->count == n->k && !NeighborBefore(distance, original, n->distances[n->k - 1], n->indices[n->k - 1])) { continue; }
+			// insertion into the sorted list, the last one drops off once there are k
+			uint32_t j = n->count < n->k ? n->count++ : n->k - 1;
+			for (; j > 0 && NeighborBefore(distance, original, n->distances[j - 1], n->indices[j - 1]); j--) {
+				n->distances[j] = n->distances[j - 1];
+				n->indices[j] = n->indices[j - 1];
+			}
+			n->distances[j] = distance;
+			n->indices[j] = original;
+		}
+		return;
+	}
+	// the near side first, the far side only when the splitting plane is no farther than the kth nearest so far
+	uint32_t axis = index->axes[node], mid = lo + (hi - lo) / 2;
+	scalar_t offset = query[axis] - index->splits[node];
+	bool left = offset < 0.0;
+	if (left) { SearchNearest(index, 2 * node, lo, mid, query, n); }
+	else { SearchNearest(index, 2 * node + 1, mid, hi, query, n); }
+	if (n->count < n->k || offset * offset <= n->distances[n->k - 1]) {
+		if (left) { SearchNearest(index, 2 * node + 1, mid, hi, query, n); }
+		else { SearchNearest(index, 2 * node, lo, mid, query, n); }
+	}
+}
+
+void NearestPoints(const SpatialIndex * index, const scalar_t * query, uint32_t k, uint32_t * nearest) {
+	k = k < index->length ? k : index->length;
+	bool valid = true;
+	for (uint32_t d = 0; d < index->dimensions; d++) { valid &= query[d] == query[d]; }
+	if (!valid) {
+		for (uint32_t j = 0; j < k; j++) { nearest[j] = j; }
+		return;
+	}
+	scalar_t stack[SPATIAL_STACK_NEIGHBORS];
+	Neighbors n = { k, 0, k <= SPATIAL_STACK_NEIGHBORS ? stack : malloc(k * sizeof(scalar_t)), nearest };
+	if (k > 0) { SearchNearest(index, 1, 0, index->length, query, &n); }
+	if (n.distances != stack) { free(n.distances); }
+}
+
+static uint32_t SearchWithin(const SpatialIndex * index, uint32_t node, uint32_t lo, uint32_t hi, const scalar_t * query, scalar_t radius) {
+	if (hi - lo <= SPATIAL_LEAF_LENGTH) {
+		uint32_t count = 0;
+		for (uint32_t i = lo; i < hi; i++) {
+			scalar_t distance = 0.0;
+			for (uint32_t d = 0; d < index->dimensions; d++) { distance += (index->points[d][i] - query[d]) * (index->points[d][i] - query[d]); }
+			count += distance <= radius * radius;
+		}
+		return count;
+	}
+	// a NaN query fails both comparisons and finds nothing
+	uint32_t axis = index->axes[node], mid = lo + (hi - lo) / 2, count = 0;
+	scalar_t offset = query[axis] - index->splits[node];
+	if (offset <= radius) { count += SearchWithin(index, 2 * node, lo, mid, query, radius); }
+	if (offset >= -radius) { count += SearchWithin(index, 2 * node + 1, mid, hi, query, radius); }
+	return count;
+}
+
+uint32_t CountPointsWithin(const SpatialIndex * index, const scalar_t * query, scalar_t radius) {
+	if (!(radius >= 0.0) || index->length == 0) { return 0; }
+	return SearchWithin(index, 1, 0, index->length, query, radius);
+}
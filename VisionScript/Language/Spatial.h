@@ -0,0 +1,28 @@
+#ifndef Spatial_h
+#define Spatial_h
+
+#include "Evaluator.h"
+
+// a k-d tree over an array of points, split at the median of the widest axis until a few points are left, the points
+// are kept in tree order so every subtree is a contiguous run, points with a NaN coordinate are left out
+typedef struct SpatialIndex {
+	const scalar_t * source; // the first channel of the cached array the tree was built for, NULL for a single call
+	uint32_t dimensions;
+	uint32_t length;
+	scalar_t * points[4];
+	uint32_t * indices;      // where each point was in the array
+	uint8_t * axes;          // the split axis of each node, numbered from 1 with the children of n at 2n and 2n + 1
+	scalar_t * splits;       // the value along that axis the halves were split at
+} SpatialIndex;
+
+// NULL when the evaluation is cancelled or runs out of time while the tree is built
+SpatialIndex * CreateSpatialIndex(const EvaluationContext * context, VectorArray points);
+void FreeSpatialIndex(SpatialIndex * index);
+
+// the k nearest points to query, nearest first with equally near points in array order, a query with a NaN
+// coordinate gets the first k points, k is at most the length of the index
+void NearestPoints(const SpatialIndex * index, const scalar_t * query, uint32_t k, uint32_t * nearest);
+// the number of points at most radius away from query
+uint32_t CountPointsWithin(const SpatialIndex * index, const scalar_t * query, scalar_t radius);
+
+#endif
@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <string.h>
+#include <tgmath.h>
+#include "Spectral.h"
+
+#define FOURIER_MAX_FACTORS 32
+#define FOURIER_MAX_RADIX 31      // larger prime factors go through Bluestein's algorithm instead of a butterfly
+#define FOURIER_CACHED_PLANS 32
+#define CONVOLUTION_TRANSFORM_COST 2.0 // a transform element per level against a multiply add of the direct sum, measured
+
+// a Stockham transform, each stage reads one buffer and writes the other in natural order so there's no bit reversal
+// pass, lengths with a large prime factor keep a power of two plan to convolve with instead of stages
+typedef struct FourierPlan {
+	uint32_t length;
+	uint32_t stages;
+	uint32_t factors[FOURIER_MAX_FACTORS];
+	scalar_t * twiddles[2];      // w^(p k) for k in [1, r) of each p in [0, m), stage after stage
+	struct FourierPlan * inner;
+	scalar_t * chirp[2];         // exp(-pi i k^2 / n)
+	scalar_t * filter[2];        // transform of the conjugate chirp, at the length of the inner plan
+} FourierPlan;
+
+// plans are never changed or freed once cached, so they're read without the lock
+static struct {
+	FourierPlan * plans[FOURIER_CACHED_PLANS];
+	uint32_t count;
+	pthread_mutex_t lock;
+} fourierPlans = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void Radix2(const scalar_t * restrict xr, const scalar_t * restrict xi, scalar_t * restrict yr, scalar_t * restrict yi, const scalar_t * twr, const scalar_t * twi, uint32_t m, uint32_t s) {
+	for (uint32_t p = 0; p < m; p++) {
+		scalar_t wr = twr[p], wi = twi[p];
+		const scalar_t * a0r = xr + s * p, * a0i = xi + s * p, * a1r = xr + s * (p + m), * a1i = xi + s * (p + m);
+		scalar_t * b0r = yr + s * 2 * p, * b0i = yi + s * 2 * p, * b1r = b0r + s, * b1i = b0i + s;
+		for (uint32_t q = 0; q < s; q++) {
+			scalar_t cr = a0r[q] - a1r[q], ci = a0i[q] - a1i[q];
+			b0r[q] = a0r[q] + a1r[q];
+			b0i[q] = a0i[q] + a1i[q];
+			b1r[q] = cr * wr - ci * wi;
+			b1i[q] = cr * wi + ci * wr;
+		}
+	}
+}
+
+static void Radix4(const scalar_t * restrict xr, const scalar_t * restrict xi, scalar_t * restrict yr, scalar_t * restrict yi, const scalar_t * twr, const scalar_t * twi, uint32_t m, uint32_t s) {
+	for (uint32_t p = 0; p < m; p++) {
+		scalar_t w1r = twr[3 * p], w1i = twi[3 * p], w2r = twr[3 * p + 1], w2i = twi[3 * p + 1], w3r = twr[3 * p + 2], w3i = twi[3 * p + 2];
+		const scalar_t * a0r = xr + s * p, * a0i = xi + s * p;
+		const scalar_t * a1r = a0r + s * m, * a1i = a0i + s * m, * a2r = a1r + s * m, * a2i = a1i + s * m, * a3r = a2r + s * m, * a3i = a2i + s * m;
+		scalar_t * b0r = yr + s * 4 * p, * b0i = yi + s * 4 * p;
+		scalar_t * b1r = b0r + s, * b1i = b0i + s, * b2r = b1r + s, * b2i = b1i + s, * b3r = b2r + s, * b3i = b2i + s;
+		for (uint32_t q = 0; q < s; q++) {
+			scalar_t t0r = a0r[q] + a2r[q], t0i = a0i[q] + a2i[q], t1r = a0r[q] - a2r[q], t1i = a0i[q] - a2i[q];
+			scalar_t t2r = a1r[q] + a3r[q], t2i = a1i[q] + a3i[q], t3r = a1r[q] - a3r[q], t3i = a1i[q] - a3i[q];
+			// t1 - i t3, t0 - t2 and t1 + i t3 before their twiddles
+			scalar_t c1r = t1r + t3i, c1i = t1i - t3r, c2r = t0r - t2r, c2i = t0i - t2i, c3r = t1r - t3i, c3i = t1i + t3r;
+			b0r[q] = t0r + t2r;
+			b0i[q] = t0i + t2i;
+			b1r[q] = c1r * w1r - c1i * w1i;
+			b1i[q] = c1r * w1i + c1i * w1r;
+			b2r[q] = c2r * w2r - c2i * w2i;
+			b2i[q] = c2r * w2i + c2i * w2r;
+			b3r[q] = c3r * w3r - c3i * w3i;
+			b3i[q] = c3r * w3i + c3i * w3r;
+		}
+	}
+}
+
+static void RadixOdd(const scalar_t * restrict xr, const scalar_t * restrict xi, scalar_t * restrict yr, scalar_t * restrict yi, const scalar_t * twr, const scalar_t * twi, uint32_t r, uint32_t m, uint32_t s) {
+	// a direct r point transform, quadratic in r which stays small
+	scalar_t rootr[FOURIER_MAX_RADIX], rooti[FOURIER_MAX_RADIX], ar[FOURIER_MAX_RADIX], ai[FOURIER_MAX_RADIX];
+	for (uint32_t t = 0; t < r; t++) {
+		rootr[t] = cos(-2.0 * M_PI * t / r);
+		rooti[t] = sin(-2.0 * M_PI * t / r);
+	}
+	for (uint32_t p = 0; p < m; p++) {
+		for (uint32_t q = 0; q < s; q++) {
+			for (uint32_t j = 0; j < r; j++) {
+				ar[j] = xr[q + s * (p + j * m)];
+				ai[j] = xi[q + s * (p + j * m)];
+			}
+			for (uint32_t k = 0; k < r; k++) {
+				scalar_t br = 0.0, bi = 0.0;
+				for (uint32_t j = 0, t = 0; j < r; j++, t = t + k < r ? t + k : t + k - r) {
+					br += ar[j] * rootr[t] - ai[j] * rooti[t];
+					bi += ar[j] * rooti[t] + ai[j] * rootr[t];
+				}
+				scalar_t wr = k == 0 ? 1.0 : twr[(r - 1) * p + k - 1], wi = k == 0 ? 0.0 : twi[(r - 1) * p + k - 1];
+				yr[q + s * (r * p + k)] = br * wr - bi * wi;
+				yi[q + s * (r * p + k)] = br * wi + bi * wr;
+			}
+		}
+	}
+}
+
+static void TransformStages(const EvaluationContext * context, const FourierPlan * plan, scalar_t * re, scalar_t * im, scalar_t * workRe, scalar_t * workIm) {
+	// a cancelled or late evaluation stops it between stages with the buffers half done
+	scalar_t * xr = re, * xi = im, * yr = workRe, * yi = workIm;
+	const scalar_t * twr = plan->twiddles[0], * twi = plan->twiddles[1];
+	uint32_t n = plan->length, s = 1;
+	for (uint32_t stage = 0; stage < plan->stages; stage++) {
+		if (EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) { return; }
+		uint32_t r = plan->factors[stage], m = n / r;
+		switch (r) {
+			case 2: Radix2(xr, xi, yr, yi, twr, twi, m, s); break;
+			case 4: Radix4(xr, xi, yr, yi, twr, twi, m, s); break;
+			default: RadixOdd(xr, xi, yr, yi, twr, twi, r, m, s); break;
+		}
+		twr += m * (r - 1);
+		twi += m * (r - 1);
+		scalar_t * t = xr;
+		xr = yr;
+		yr = t;
+		t = xi;
+		xi = yi;
+		yi = t;
+		n = m;
+		s *= r;
+	}
+	if (xr != re) {
+		memcpy(re, xr, plan->length * sizeof(scalar_t));
+		memcpy(im, xi, plan->length * sizeof(scalar_t));
+	}
+}
+
+static void Transform(const EvaluationContext * context, const FourierPlan * plan, scalar_t * re, scalar_t * im) {
+	// forward and in place
+	if (plan->inner == NULL) {
+		scalar_t * work = AllocateElements(2 * plan->length, sizeof(scalar_t));
+		TransformStages(context, plan, re, im, work, work + plan->length);
+		free(work);
+		return;
+	}
+	// Bluestein's algorithm, with jk = (j^2 + k^2 - (k - j)^2) / 2 the transform is a convolution with the chirp
+	uint32_t n = plan->length, m = plan->inner->length;
+	const scalar_t * cr = plan->chirp[0], * ci = plan->chirp[1], * fr = plan->filter[0], * fi = plan->filter[1];
+	scalar_t * ar = calloc(2 * m, sizeof(scalar_t)), * ai = ar + m;
+	for (uint32_t k = 0; k < n; k++) {
+		ar[k] = re[k] * cr[k] - im[k] * ci[k];
+		ai[k] = re[k] * ci[k] + im[k] * cr[k];
+	}
+	Transform(context, plan->inner, ar, ai);
+	// the product with the filter, conjugated so the forward transform inverts it
+	for (uint32_t k = 0; k < m; k++) {
+		scalar_t pr = ar[k] * fr[k] - ai[k] * fi[k], pi = ar[k] * fi[k] + ai[k] * fr[k];
+		ar[k] = pr;
+		ai[k] = -pi;
+	}
+	Transform(context, plan->inner, ar, ai);
+	scalar_t scale = 1.0 / m;
+	for (uint32_t k = 0; k < n; k++) {
+		scalar_t pr = ar[k] * scale, pi = -ai[k] * scale;
+		re[k] = pr * cr[k] - pi * ci[k];
+		im[k] = pr * ci[k] + pi * cr[k];
+	}
+	free(ar);
+}
+
+static void FreeFourierPlan(FourierPlan * plan);
+
+static FourierPlan * CreateFourierPlan(const EvaluationContext * context, uint32_t length) {
+	// NULL when the evaluation stops while the twiddles are worked out, a plan is only cached once it's whole
+	FourierPlan * plan = calloc(1, sizeof(FourierPlan));
+	plan->length = length;
+	// radix 4 as far as it goes, then a single 2 and the odd factors
+	uint32_t rest = length;
+	while (rest % 4 == 0) { plan->factors[plan->stages++] = 4; rest /= 4; }
+	if (rest % 2 == 0) { plan->factors[plan->stages++] = 2; rest /= 2; }
+	for (uint32_t p = 3; p <= FOURIER_MAX_RADIX && rest > 1; p += 2) {
+		while (rest % p == 0) { plan->factors[plan->stages++] = p; rest /= p; }
+	}
+
+	if (rest > 1) {
+		plan->stages = 0;
+		uint64_t m = 1;
+		while (m < 2 * (uint64_t)length - 1) { m *= 2; }
+		plan->inner = CreateFourierPlan(context, m);
+		if (plan->inner == NULL) {
+			free(plan);
+			return NULL;
+		}
+		plan->chirp[0] = malloc(2 * length * sizeof(scalar_t));
+		plan->chirp[1] = plan->chirp[0] + length;
+		plan->filter[0] = calloc(2 * m, sizeof(scalar_t));
+		plan->filter[1] = plan->filter[0] + m;
+		for (uint32_t k = 0; k < length; k++) {
+			// k^2 taken modulo 2n keeps the angle accurate for long transforms
+			double angle = -M_PI * (double)((uint64_t)k * k % (2 * (uint64_t)length)) / length;
+			plan->chirp[0][k] = cos(angle);
+			plan->chirp[1][k] = sin(angle);
+			plan->filter[0][k] = plan->chirp[0][k];
+			plan->filter[1][k] = -plan->chirp[1][k];
+			if (k > 0) {
+				plan->filter[0][m - k] = plan->filter[0][k];
+				plan->filter[1][m - k] = plan->filter[1][k];
+			}
+		}
+		Transform(context, plan->inner, plan->filter[0], plan->filter[1]);
+		if (EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) {
+			FreeFourierPlan(plan);
+			return NULL;
+		}
+		return plan;
+	}
+
+	uint32_t total = 0;
+	for (uint32_t stage = 0, n = length; stage < plan->stages; n /= plan->factors[stage++]) { total += n / plan->factors[stage] * (plan->factors[stage] - 1); }
+	plan->twiddles[0] = AllocateElements(2 * total, sizeof(scalar_t));
+	plan->twiddles[1] = plan->twiddles[0] + total;
+	scalar_t * twr = plan->twiddles[0], * twi = plan->twiddles[1];
+	for (uint32_t stage = 0, n = length; stage < plan->stages; n /= plan->factors[stage++]) {
+		if (EvaluationContextCheckpoint(context) != RuntimeErrorCodeNone) {
+			FreeFourierPlan(plan);
+			return NULL;
+		}
+		uint32_t r = plan->factors[stage], m = n / r;
+		for (uint32_t p = 0; p < m; p++) {
+			for (uint32_t k = 1; k < r; k++) {
+				double angle = -2.0 * M_PI * (double)((uint64_t)p * k % n) / n;
+				*twr++ = cos(angle);
+				*twi++ = sin(angle);
+			}
+		}
+	}
+	return plan;
+}
+
+static void FreeFourierPlan(FourierPlan * plan) {
+	if (plan->inner != NULL) { FreeFourierPlan(plan->inner); }
+	free(plan->twiddles[0]);
+	free(plan->chirp[0]);
+	free(plan->filter[0]);
+	free(plan);
+}
+
+static FourierPlan * AcquireFourierPlan(const EvaluationContext * context, uint32_t length, bool * cached) {
+	// built outside the lock, a thread that loses the race to cache the same length uses the winner's plan,
+	// past the limit a plan is only made for the one transform
+	pthread_mutex_lock(&fourierPlans.lock);
+	for (uint32_t i = 0; i < fourierPlans.count; i++) {
+		if (fourierPlans.plans[i]->length == length) {
+			pthread_mutex_unlock(&fourierPlans.lock);
+			*cached = true;
+			return fourierPlans.plans[i];
+		}
+	}
+	pthread_mutex_unlock(&fourierPlans.lock);
+
+	FourierPlan * plan = CreateFourierPlan(context, length);
+	if (plan == NULL) { return NULL; }
+	pthread_mutex_lock(&fourierPlans.lock);
+	*cached = false;
+	for (uint32_t i = 0; i < fourierPlans.count; i++) {
+		if (fourierPlans.plans[i]->length == length) {
+			FreeFourierPlan(plan);
+			plan = fourierPlans.plans[i];
+			*cached = true;
+			break;
+		}
+	}
+	if (!*cached && fourierPlans.count < FOURIER_CACHED_PLANS) {
+		fourierPlans.plans[fourierPlans.count++] = plan;
+		*cached = true;
+	}
+	pthread_mutex_unlock(&fourierPlans.lock);
+	return plan;
+}
+
+void FourierTransform(const EvaluationContext * context, const scalar_t * re, const scalar_t * im, uint32_t length, bool inverse, scalar_t * outRe, scalar_t * outIm) {
+	// the inverse is the forward transform of the conjugate, conjugated and scaled
+	if (length == 0) { return; }
+	memcpy(outRe, re, length * sizeof(scalar_t));
+	if (im == NULL) { memset(outIm, 0, length * sizeof(scalar_t)); }
+	else if (inverse) { for (uint32_t k = 0; k < length; k++) { outIm[k] = -im[k]; } }
+	else { memcpy(outIm, im, length * sizeof(scalar_t)); }
+	bool cached;
+	FourierPlan * plan = AcquireFourierPlan(context, length, &cached);
+	if (plan == NULL) { return; }
+	Transform(context, plan, outRe, outIm);
+	if (!cached) { FreeFourierPlan(plan); }
+	if (inverse) {
+		scalar_t scale = 1.0 / length;
+		for (uint32_t k = 0; k < length; k++) {
+			outRe[k] *= scale;
+			outIm[k] *= -scale;
+		}
+	}
+}
+
+void ConvolveChannel(const EvaluationContext * context, const scalar_t * x, uint32_t length, const scalar_t * kernel, uint32_t kernelLength, scalar_t * out) {
+	memset(out, 0, length * sizeof(scalar_t));
+	if (length == 0 || kernelLength == 0) { return; }
+	int64_t center = (kernelLength - 1) / 2;
+	uint32_t n = 1;
+	while (n < (uint64_t)length + kernelLength - 1) { n *= 2; }
+	if ((double)length * kernelLength <= CONVOLUTION_TRANSFORM_COST * n * log2((double)n)) {
+		// a pass over the elements per tap so the inner loop vectorizes
+		for (uint32_t j = 0; j < kernelLength && EvaluationContextCheckpoint(context) == RuntimeErrorCodeNone; j++) {
+			int64_t shift = center - j, start = shift < 0 ? -shift : 0, end = shift > 0 ? length - shift : length;
+			if (start >= end) { continue; }
+			const scalar_t * row = x + start + shift;
+			scalar_t * o = out + start, w = kernel[j];
+			for (int64_t i = 0; i < end - start; i++) { o[i] += w * row[i]; }
+		}
+		return;
+	}
+
+	// both real signals go through one complex transform, x as the real part and the kernel as the imaginary part,
+	// and are told apart by the symmetry of transforms of real signals
+	scalar_t * buffer = calloc(4 * (size_t)n, sizeof(scalar_t));
+	scalar_t * zr = buffer, * zi = buffer + n, * pr = buffer + 2 * n, * pi = buffer + 3 * n;
+	memcpy(zr, x, length * sizeof(scalar_t));
+	memcpy(zi, kernel, kernelLength * sizeof(scalar_t));
+	FourierTransform(context, zr, zi, n, false, pr, pi);
+	for (uint32_t f = 0; f < n; f++) {
+		// X = (Z[f] + conj(Z[-f])) / 2 and K = (Z[f] - conj(Z[-f])) / 2i
+		uint32_t g = (n - f) & (n - 1);
+		scalar_t xr = 0.5 * (pr[f] + pr[g]), xi = 0.5 * (pi[f] - pi[g]);
+		scalar_t kr = 0.5 * (pi[f] + pi[g]), ki = -0.5 * (pr[f] - pr[g]);
+		zr[f] = xr * kr - xi * ki;
+		zi[f] = xr * ki + xi * kr;
+	}
+	FourierTransform(context, zr, zi, n, true, pr, pi);
+	memcpy(out, pr + center, length * sizeof(scalar_t));
+	free(buffer);
+}
@@ -0,0 +1,15 @@
+#ifndef Spectral_h
+#define Spectral_h
+
+#include "Evaluator.h"
+
+// discrete Fourier transform of length elements over split real and imaginary channels, im may be NULL for a real
+// input, the inverse is scaled by 1 / length, plans of factors and twiddles are built once per length and kept, the
+// output is left unfinished when the evaluation is cancelled or runs out of time
+void FourierTransform(const EvaluationContext * context, const scalar_t * re, const scalar_t * im, uint32_t length, bool inverse, scalar_t * outRe, scalar_t * outIm);
+
+// linear convolution with the kernel centered on each element, zero outside x, out has the length of x and is
+// computed directly for short kernels and through transforms for long ones
+void ConvolveChannel(const EvaluationContext * context, const scalar_t * x, uint32_t length, const scalar_t * kernel, uint32_t kernelLength, scalar_t * out);
+
+#endif
@@ -1,3 +1,5 @@
+#include <stdlib.h>
+#include <string.h>
 #include "Tokenizer.h"
 
 static bool IsLetter(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
@@ -6,7 +8,7 @@ static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
 
 static bool IsWhitespace(char c) { return c == ' ' || c == '\t'; }
 
-static bool IsValidInIdentifier(char c) { return IsLetter(c) || IsDigit(c) || c == '_' || c == ':'; }
+static bool IsValidInIdentifier(char c) { return IsLetter(c) || IsDigit(c) || c == '_' || c == ':' || c == '\''; }
 
 static bool MatchesWord(String line, int32_t start, int32_t * end, const char * word) {
 	int32_t j = 0;
@@ -29,6 +31,7 @@ static const char * keywords[] = {
 	KEYWORD_IF,
 	KEYWORD_ELSE,
 	KEYWORD_NOT,
+	KEYWORD_WHERE,
 };
 
 static bool IsKeyword(String line, int32_t start, int32_t * end) {
@@ -102,10 +105,18 @@ static bool IsNumber(String line, int32_t start, int32_t * end) {
 	} else { return false; }
 }
 
+static String TokenValue(String line, int32_t start, int32_t end) {
+	// copies straight out of the line, StringSub measures the whole line each time which makes long lines quadratic
+	String value = malloc(end - start + 2);
+	memcpy(value, line + start, end - start + 1);
+	value[end - start + 1] = '\0';
+	return value;
+}
+
 List(Token) TokenizeLine(String line, int32_t lineNumber) {
 	List(Token) tokens = ListCreate(sizeof(Token), 32);
-	int32_t i = 0;
-	while (i < StringLength(line)) {
+	int32_t i = 0, length = StringLength(line);
+	while (i < length) {
 		int32_t end = i;
 		TokenType tokenType = TokenTypeUnknown;
 		if (IsKeyword(line, i, &end)) { tokenType = TokenTypeKeyword; }
@@ -116,7 +127,7 @@ List(Token) TokenizeLine(String line, int32_t lineNumber) {
 			i++;
 			continue;
 		}
-		tokens = ListPush(tokens, &(Token){ .type = tokenType, .value = StringSub(line, i, end), .line = lineNumber, .start = i, .end = end });
+		tokens = ListPush(tokens, &(Token){ .type = tokenType, .value = TokenValue(line, i, end), .line = lineNumber, .start = i, .end = end });
 		i = end + 1;
 	}
 	return tokens;
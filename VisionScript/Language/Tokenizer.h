@@ -12,6 +12,7 @@
 #define KEYWORD_IF         "if"
 #define KEYWORD_ELSE       "else"
 #define KEYWORD_NOT        "not"
+#define KEYWORD_WHERE      "where"
 
 #define SYMBOL_COMMA             ","
 #define SYMBOL_EQUAL             "="
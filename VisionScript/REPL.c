@@ -3,17 +3,166 @@
 #include <string.h>
 #include <time.h>
 #include <stdlib.h>
+#include <math.h>
+#include <signal.h>
 #include "REPL.h"
 #include "Language/Tokenizer.h"
 #include "Language/Parser.h"
 #include "Language/Evaluator.h"
 #include "Language/Builtin.h"
+#include "Language/Derivative.h"
+#include "Language/Planner.h"
+
+static Environment * interruptible;
+static volatile sig_atomic_t evaluating;
+
+static void Interrupt(int code) {
+	// Ctrl-C cancels the evaluation that's running, at the prompt it quits like it normally would
+	if (!evaluating) {
+		signal(SIGINT, SIG_DFL);
+		raise(SIGINT);
+		return;
+	}
+	CancelEnvironmentEvaluations(interruptible);
+}
+
+static void BeginInterruptible(Environment * environment) {
+	ResumeEnvironmentEvaluations(environment);
+	evaluating = 1;
+}
+
+static void EndInterruptible(void) {
+	evaluating = 0;
+}
+
+static double WallSeconds(void) {
+	// kernels may run on several threads, so timings are taken on the wall clock rather than as CPU time
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void PrintProfileError(Environment * environment, Expression expression, List(String) inputs) {
+	// how far the fast evaluation profile drifts from the precise one on an expression
+	VectorArray precise, fast;
+	BeginInterruptible(environment);
+	double preciseSeconds = WallSeconds();
+	RuntimeError error = EvaluateExpression(environment, NULL, expression, &precise);
+	preciseSeconds = WallSeconds() - preciseSeconds;
+	if (error.code != RuntimeErrorCodeNone) {
+		EndInterruptible();
+		PrintRuntimeError(error, inputs);
+		return;
+	}
+	EvaluationContext context = CreateEvaluationContext(environment, EvaluationProfileFast);
+	double fastSeconds = WallSeconds();
+	error = EvaluateExpressionInContext(&context, NULL, expression, &fast);
+	fastSeconds = WallSeconds() - fastSeconds;
+	EndInterruptible();
+	FreeEvaluationContext(context);
+	if (error.code != RuntimeErrorCodeNone) {
+		PrintRuntimeError(error, inputs);
+		FreeVectorArray(precise);
+		return;
+	}
+	
+	if (precise.length == fast.length && precise.dimensions == fast.dimensions) {
+		scalar_t absolute = 0.0, relative = 0.0;
+		for (int32_t d = 0; d < precise.dimensions; d++) {
+			for (int32_t i = 0; i < precise.length; i++) {
+				scalar_t p = precise.xyzw[d][i], f = fast.xyzw[d][i];
+				if (p == f || (isnan(p) && isnan(f))) { continue; }
+				scalar_t difference = fabs(p - f);
+				if (!(difference <= absolute)) { absolute = difference; }
+				if (!(difference / fmax(fabs(p), 1.0) <= relative)) { relative = difference / fmax(fabs(p), 1.0); }
+			}
+		}
+		printf("max error %g, max relative error %g\n", absolute, relative);
+	} else { printf("fast profile changed the shape of the result\n"); }
+	printf("precise %fs, fast %fs\n", preciseSeconds, fastSeconds);
+	FreeVectorArray(precise);
+	FreeVectorArray(fast);
+}
+
+#define TANGENT_SAMPLES 16384
+
+static void PrintTangentTiming(Environment * environment, Expression expression, List(String) inputs) {
+	// samples a curve of one parameter over [0, 1] like the renderer does, once with the position and tangent from a single
+	// evaluation and once from the evaluations at t and t + dt it used to make, and how far the two directions are apart
+	Equation * equation = expression.type == ExpressionTypeIdentifier ? GetEnvironmentEquation(environment, expression.identifier) : NULL;
+	if (equation == NULL || equation->type != EquationTypeFunction || ListLength(equation->declaration.parameters) != 1) {
+		printf("tangent takes the name of a function of one parameter\n");
+		return;
+	}
+	List(Binding) parameters = ListPush(ListCreate(sizeof(Binding), 1), &(Binding){ 0 });
+	parameters[0].identifier = equation->declaration.parameters[0];
+	scalar_t t, one = 1.0, dt = 0.5 / TANGENT_SAMPLES;
+	parameters[0].value = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = &t };
+	EvaluationContext context = CreateEvaluationContext(environment, EvaluationProfilePrecise);
+	BeginInterruptible(environment);
+	
+	double exactSeconds = 0.0, differenceSeconds = 0.0, angle = 0.0;
+	RuntimeError error = { RuntimeErrorCodeNone };
+	for (int32_t j = 0; j <= TANGENT_SAMPLES && error.code == RuntimeErrorCodeNone; j++) {
+		VectorArray result, tangent, before, after;
+		t = (scalar_t)j / TANGENT_SAMPLES;
+		double seconds = WallSeconds();
+		parameters[0].tangent = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = &one };
+		error = EvaluateExpressionTangentInContext(&context, parameters, equation->expression, &result, &tangent);
+		parameters[0].tangent = (VectorArray){ 0 };
+		exactSeconds += WallSeconds() - seconds;
+		if (error.code != RuntimeErrorCodeNone) { break; }
+		
+		seconds = WallSeconds();
+		error = EvaluateExpressionInContext(&context, parameters, equation->expression, &before);
+		if (error.code == RuntimeErrorCodeNone) {
+			t += dt;
+			error = EvaluateExpressionInContext(&context, parameters, equation->expression, &after);
+			if (error.code != RuntimeErrorCodeNone) { FreeVectorArray(before); }
+		}
+		differenceSeconds += WallSeconds() - seconds;
+		if (error.code != RuntimeErrorCodeNone) {
+			FreeVectorArray(result);
+			FreeVectorArray(tangent);
+			break;
+		}
+		
+		// a constant curve has no tangent to compare
+		for (int32_t i = 0; i < result.length && tangent.dimensions == result.dimensions && after.length == result.length; i++) {
+			double exact = 0.0, difference = 0.0, dot = 0.0;
+			for (int32_t d = 0; d < result.dimensions; d++) {
+				double e = tangent.xyzw[d][i], f = after.xyzw[d][i] - before.xyzw[d][i];
+				exact += e * e;
+				difference += f * f;
+				dot += e * f;
+			}
+			if (exact > 0.0 && difference > 0.0) { angle = fmax(angle, acos(fmin(dot / sqrt(exact * difference), 1.0))); }
+		}
+		FreeVectorArray(result);
+		FreeVectorArray(tangent);
+		FreeVectorArray(before);
+		FreeVectorArray(after);
+	}
+	EndInterruptible();
+	FreeEvaluationContext(context);
+	ListFree(parameters);
+	if (error.code != RuntimeErrorCodeNone) {
+		PrintRuntimeError(error, inputs);
+		return;
+	}
+	printf("%i samples\n", TANGENT_SAMPLES + 1);
+	printf("exact tangent %i evaluations %fs, t and t + dt %i evaluations %fs\n", TANGENT_SAMPLES + 1, exactSeconds, 2 * (TANGENT_SAMPLES + 1), differenceSeconds);
+	printf("max angle between the directions %g\n", angle);
+}
 
 void RunREPL(void) {
 	printf("VisionScript v1.0 – REPL\n");
+	InitializePlanner();
 	
 	Environment environment = CreateEmptyEnvironment();
 	InitializeBuiltinVariables(&environment);
+	interruptible = &environment;
+	signal(SIGINT, Interrupt);
 	List(String) inputs = ListCreate(sizeof(String), 1);
 	while (true) {
 		// wait for input
@@ -28,6 +177,26 @@ void RunREPL(void) {
 			StringFree(input);
 			continue;
 		}
+		bool compareProfiles = strncmp(input, "fastmath ", strlen("fastmath ")) == 0;
+		if (compareProfiles) {
+			String expression = StringCreate(input + strlen("fastmath "));
+			StringFree(input);
+			input = expression;
+		}
+		// tangent times the samples of a curve with both ways of finding its direction
+		bool compareTangents = strncmp(input, "tangent ", strlen("tangent ")) == 0;
+		if (compareTangents) {
+			String expression = StringCreate(input + strlen("tangent "));
+			StringFree(input);
+			input = expression;
+		}
+		// plan prints the strategy each node would run with instead of evaluating
+		bool printPlan = strncmp(input, "plan ", strlen("plan ")) == 0;
+		if (printPlan) {
+			String expression = StringCreate(input + strlen("plan "));
+			StringFree(input);
+			input = expression;
+		}
 		inputs = ListPush(inputs, &input);
 		
 		List(Token) tokenLine = TokenizeLine(input, ListLength(inputs) - 1);
@@ -41,12 +210,62 @@ void RunREPL(void) {
 		//PrintExpression(equation.expression);
 		//printf("\n");
 		
+		// a function may refer to its own derivative, so it has to be known first, the definition it replaces is kept
+		// until its derivatives are built
+		Equation previous = { .type = EquationTypeNone };
+		if (equation.type == EquationTypeFunction) {
+			Equation * existing = GetEnvironmentEquation(&environment, equation.declaration.identifier);
+			if (existing != NULL) {
+				previous = *existing;
+				HashMapSet(environment.equations, equation.declaration.identifier, NULL);
+			}
+			AddEnvironmentEquation(&environment, equation);
+			error = RebuildEnvironmentDerivatives(&environment, equation.declaration.identifier);
+		}
+		if (error.code == SyntaxErrorCodeNone) { error = AddEnvironmentDerivatives(&environment, equation.expression); }
+		if (error.code != SyntaxErrorCodeNone) {
+			PrintSyntaxError(error, inputs);
+			if (equation.type == EquationTypeFunction) {
+				// put back what was there before the line
+				HashMapSet(environment.equations, equation.declaration.identifier, NULL);
+				if (previous.type != EquationTypeNone) { AddEnvironmentEquation(&environment, previous); }
+				RebuildEnvironmentDerivatives(&environment, equation.declaration.identifier);
+			}
+			FreeEquation(equation);
+			FreeTokens(tokenLine);
+			continue;
+		}
+		if (previous.type != EquationTypeNone) { FreeEquation(previous); }
+		
+		if (printPlan) {
+			PrintExecutionPlan(&environment, equation.expression, equation.type == EquationTypeFunction ? equation.declaration.parameters : NULL);
+			if (equation.type != EquationTypeFunction) { FreeEquation(equation); }
+			FreeTokens(tokenLine);
+			continue;
+		}
+		
+		if (compareTangents && equation.type == EquationTypeNone) {
+			PrintTangentTiming(&environment, equation.expression, inputs);
+			FreeEquation(equation);
+			FreeTokens(tokenLine);
+			continue;
+		}
+		
+		if (compareProfiles && equation.type == EquationTypeNone) {
+			PrintProfileError(&environment, equation.expression, inputs);
+			FreeEquation(equation);
+			FreeTokens(tokenLine);
+			continue;
+		}
+		
 		if (equation.type == EquationTypeNone || equation.type == EquationTypeVariable) {
 			// evaluate the expression
-			clock_t timer = clock();
+			double seconds = WallSeconds();
 			VectorArray result;
+			BeginInterruptible(&environment);
 			RuntimeError error = EvaluateExpression(&environment, NULL, equation.expression, &result);
-			timer = clock() - timer;
+			EndInterruptible();
+			seconds = WallSeconds() - seconds;
 			if (error.code != RuntimeErrorCodeNone) {
 				PrintRuntimeError(error, inputs);
 				FreeEquation(equation);
@@ -66,15 +285,13 @@ void RunREPL(void) {
 			}
 			
 			// print time if it takes more than .01 seconds
-			if (timer / (float)CLOCKS_PER_SEC > 0.01) { printf("Done in %fs\n", timer / (float)CLOCKS_PER_SEC); }
+			if (seconds > 0.01) { printf("Done in %fs\n", seconds); }
 			FreeVectorArray(result);
 		}
-		
-		if (equation.type == EquationTypeFunction) {
-			AddEnvironmentEquation(&environment, equation);
-		}
 	}
+	signal(SIGINT, SIG_DFL);
 	FreeEnvironment(environment);
+	FreePlanner();
 	for (int32_t i = 0; i < ListLength(inputs); i++) { StringFree(inputs[i]); }
 	ListFree(inputs);
 }
@@ -1,7 +1,9 @@
 #include "Renderer.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include "Language/Evaluator.h"
+#include "Language/Planner.h"
 #include "Sampler.h"
 
 #define SCROLL_ZOOM_FACTOR 100.0
@@ -97,13 +99,13 @@ static void UpdateUniforms() {
 }
 
 static void BindLayout() {
-	glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(vertex_t), (void *)0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(vertex_t), (void *)offsetof(vertex_t, position));
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, false, sizeof(vertex_t), (void *)8);
+	glVertexAttribPointer(1, 4, COLOR_GL_TYPE, false, sizeof(vertex_t), (void *)offsetof(vertex_t, color));
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 1, GL_FLOAT, false, sizeof(vertex_t), (void *)24);
+	glVertexAttribPointer(2, 1, GL_FLOAT, false, sizeof(vertex_t), (void *)offsetof(vertex_t, size));
 	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(3, 2, GL_FLOAT, false, sizeof(vertex_t), (void *)28);
+	glVertexAttribPointer(3, 2, GL_FLOAT, false, sizeof(vertex_t), (void *)offsetof(vertex_t, pair));
 	glEnableVertexAttribArray(3);
 }
 
@@ -174,7 +176,7 @@ static void UpdateSamples() {
 				error = SampleParametric(&renderer.script, object.equation, camera, &object);
 			}
 			RemoveFromRenderList(&renderer.script, object.equation);
-			if (error.code != RuntimeErrorCodeNone) { PrintRuntimeError(error, renderer.script.lines); }
+			if (error.code != RuntimeErrorCodeNone && error.code != RuntimeErrorCodeCancelled) { PrintRuntimeError(error, renderer.script.lines); }
 			renderer.objects[i] = object;
 		}
 	}
@@ -218,6 +220,7 @@ static void Startup() {
 	
 	CreateShaders();
 	
+	InitializePlanner();
 	renderer.samplerRunning = true;
 	pthread_create(&renderer.samplerThread, NULL, UpdateThread, NULL);
 }
@@ -301,8 +304,11 @@ static void Event(const sapp_event * event) {
 }
 
 static void Shutdown() {
+	// a long evaluation would otherwise hold up the join
 	renderer.samplerRunning = false;
+	CancelEnvironmentEvaluations(&renderer.script.environment);
 	pthread_join(renderer.samplerThread, NULL);
+	FreePlanner();
 }
 
 sapp_desc RenderScript(Script script, bool testMode) {
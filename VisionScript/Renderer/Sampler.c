@@ -5,9 +5,9 @@
 
 #define MAX_PARAMETRIC_VERTICES 1048576
 
-static RuntimeError SamplePositions(Environment * environment, Equation equation, RenderObject * object) {
+static RuntimeError SamplePositions(EvaluationContext * context, Equation equation, RenderObject * object) {
 	VectorArray positions;
-	RuntimeError error = EvaluateExpression(environment, NULL, equation.expression, &positions);
+	RuntimeError error = EvaluateExpressionInContext(context, NULL, equation.expression, &positions);
 	if (error.code != RuntimeErrorCodeNone) { return error; }
 	if (positions.dimensions != 2) { return (RuntimeError){ RuntimeErrorCodeInvalidRenderDimension, 0, equation.end, equation.line }; }
 	
@@ -18,7 +18,7 @@ static RuntimeError SamplePositions(Environment * environment, Equation equation
 	for (int32_t i = 0; i < positions.length; i++) {
 		object->vertices[i] = (vertex_t) {
 			.position = { positions.xyzw[0][i], positions.xyzw[1][i] },
-			.color = { 0.0, 0.0, 0.0, 1.0 },
+			.color = PackColor((vec4_t){ 0.0, 0.0, 0.0, 1.0 }),
 		};
 	}
 	object->vertexCount = positions.length;
@@ -27,18 +27,18 @@ static RuntimeError SamplePositions(Environment * environment, Equation equation
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError SampleColor(Environment * environment, Equation equation, RenderObject * object) {
+static RuntimeError SampleColor(EvaluationContext * context, Equation equation, RenderObject * object) {
 	String identifier = StringCreate(equation.declaration.identifier);
 	StringConcat(&identifier, ":color");
-	Equation * color = GetEnvironmentEquation(environment, identifier);
+	Equation * color = GetEnvironmentEquation(context->environment, identifier);
 	StringFree(identifier);
 	if (color == NULL) {
 		for (int32_t i = 0; i < object->vertexCount; i++) {
-			object->vertices[i].color = (vec4_t){ 0.0, 0.0, 0.0, 1.0 };
+			object->vertices[i].color = PackColor((vec4_t){ 0.0, 0.0, 0.0, 1.0 });
 		}
 	} else {
 		VectorArray colors;
-		RuntimeError error = EvaluateExpression(environment, NULL, color->expression, &colors);
+		RuntimeError error = EvaluateExpressionInContext(context, NULL, color->expression, &colors);
 		if (error.code != RuntimeErrorCodeNone) { return error; }
 		if (colors.dimensions != 3 && colors.dimensions != 4) {
 			FreeVectorArray(colors);
@@ -46,22 +46,22 @@ static RuntimeError SampleColor(Environment * environment, Equation equation, Re
 		}
 		for (int32_t i = 0; i < object->vertexCount; i++) {
 			int32_t index = i < colors.length ? i : colors.length - 1;
-			object->vertices[i].color = (vec4_t){
+			object->vertices[i].color = PackColor((vec4_t){
 				colors.xyzw[0][index],
 				colors.xyzw[1][index],
 				colors.xyzw[2][index],
 				colors.dimensions == 4 ? colors.xyzw[3][index] : 1.0,
-			};
+			});
 		}
 		FreeVectorArray(colors);
 	}
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError SampleSize(Environment * environment, Equation equation, RenderObject * object) {
+static RuntimeError SampleSize(EvaluationContext * context, Equation equation, RenderObject * object) {
 	String identifier = StringCreate(equation.declaration.identifier);
 	StringConcat(&identifier, ":size");
-	Equation * size = GetEnvironmentEquation(environment, identifier);
+	Equation * size = GetEnvironmentEquation(context->environment, identifier);
 	StringFree(identifier);
 	if (size == NULL) {
 		for (int32_t i = 0; i < object->vertexCount; i++) {
@@ -69,7 +69,7 @@ static RuntimeError SampleSize(Environment * environment, Equation equation, Ren
 		}
 	} else {
 		VectorArray sizes;
-		RuntimeError error = EvaluateExpression(environment, NULL, size->expression, &sizes);
+		RuntimeError error = EvaluateExpressionInContext(context, NULL, size->expression, &sizes);
 		if (error.code != RuntimeErrorCodeNone) { return error; }
 		if (sizes.dimensions != 1) {
 			FreeVectorArray(sizes);
@@ -84,11 +84,32 @@ static RuntimeError SampleSize(Environment * environment, Equation equation, Ren
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
+static RuntimeError SampleProfile(Environment * environment, Equation equation, EvaluationProfile * profile) {
+	// opted into with P:fastmath = 1, trades a few ulps in the elementary functions for speed
+	String identifier = StringCreate(equation.declaration.identifier);
+	StringConcat(&identifier, ":fastmath");
+	Equation * attribute = GetEnvironmentEquation(environment, identifier);
+	StringFree(identifier);
+	if (attribute == NULL) {
+		*profile = EvaluationProfilePrecise;
+		return (RuntimeError){ RuntimeErrorCodeNone };
+	}
+	
+	VectorArray value;
+	RuntimeError error = EvaluateExpression(environment, NULL, attribute->expression, &value);
+	if (error.code != RuntimeErrorCodeNone) { return error; }
+	*profile = TruthyVectorArray(value) ? EvaluationProfileFast : EvaluationProfilePrecise;
+	FreeVectorArray(value);
+	return (RuntimeError){ RuntimeErrorCodeNone };
+}
+
 RuntimeError SamplePolygons(Script * script, Equation equation, RenderObject * object) {
 	if (!object->needsUpload) {
-		RuntimeError error = SamplePositions(&script->environment, equation, object);
-		if (error.code != RuntimeErrorCodeNone) { return error; }
-		error = SampleColor(&script->environment, equation, object);
+		EvaluationContext context = CreateEvaluationContext(&script->environment, EvaluationProfilePrecise);
+		RuntimeError error = SampleProfile(&script->environment, equation, &context.profile);
+		if (error.code == RuntimeErrorCodeNone) { error = SamplePositions(&context, equation, object); }
+		if (error.code == RuntimeErrorCodeNone) { error = SampleColor(&context, equation, object); }
+		FreeEvaluationContext(context);
 		if (error.code != RuntimeErrorCodeNone) { return error; }
 		object->needsUpload = true;
 	}
@@ -97,11 +118,12 @@ RuntimeError SamplePolygons(Script * script, Equation equation, RenderObject * o
 
 RuntimeError SamplePoints(Script * script, Equation equation, RenderObject * object) {
 	if (!object->needsUpload) {
-		RuntimeError error = SamplePositions(&script->environment, equation, object);
-		if (error.code != RuntimeErrorCodeNone) { return error; }
-		error = SampleColor(&script->environment, equation, object);
-		if (error.code != RuntimeErrorCodeNone) { return error; }
-		error = SampleSize(&script->environment, equation, object);
+		EvaluationContext context = CreateEvaluationContext(&script->environment, EvaluationProfilePrecise);
+		RuntimeError error = SampleProfile(&script->environment, equation, &context.profile);
+		if (error.code == RuntimeErrorCodeNone) { error = SamplePositions(&context, equation, object); }
+		if (error.code == RuntimeErrorCodeNone) { error = SampleColor(&context, equation, object); }
+		if (error.code == RuntimeErrorCodeNone) { error = SampleSize(&context, equation, object); }
+		FreeEvaluationContext(context);
 		if (error.code != RuntimeErrorCodeNone) { return error; }
 		object->needsUpload = true;
 	}
@@ -109,7 +131,7 @@ RuntimeError SamplePoints(Script * script, Equation equation, RenderObject * obj
 }
 
 typedef struct ParametricSample {
-	float t;
+	scalar_t t;
 	vec2_t position;
 	vec2_t screenPosition;
 	vec2_t tangent;
@@ -118,17 +140,17 @@ typedef struct ParametricSample {
 	int32_t next;
 } ParametricSample;
 
-static RuntimeError SampleParametricDomain(Environment * environment, Equation equation, float * lower, float * upper) {
+static RuntimeError SampleParametricDomain(EvaluationContext * context, Equation equation, scalar_t * lower, scalar_t * upper) {
 	String identifier = StringCreate(equation.declaration.identifier);
 	StringConcat(&identifier, ":domain");
-	Equation * domain = GetEnvironmentEquation(environment, identifier);
+	Equation * domain = GetEnvironmentEquation(context->environment, identifier);
 	StringFree(identifier);
 	if (domain == NULL) {
 		*lower = 0.0;
 		*upper = 1.0;
 	} else {
 		VectorArray value;
-		RuntimeError error = EvaluateExpression(environment, NULL, domain->expression, &value);
+		RuntimeError error = EvaluateExpressionInContext(context, NULL, domain->expression, &value);
 		if (error.code != RuntimeErrorCodeNone) { return error; }
 		if (value.length != 2 || value.dimensions != 1) {
 			FreeVectorArray(value);
@@ -142,20 +164,62 @@ static RuntimeError SampleParametricDomain(Environment * environment, Equation e
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError SampleParametricPosition(Environment * environment, Equation equation, List(Binding) parameters, float t, float dt, Camera camera, int32_t index, ParametricSample * samples) {
-	VectorArray result, resultdt;
-	parameters[0].value.xyzw[0] = &t;
-	RuntimeError error = EvaluateExpression(environment, parameters, equation.expression, &result);
+static RuntimeError SampleParametricApproximation(Script * script, EvaluationContext * context, Equation equation, scalar_t lower, scalar_t upper, Approximation ** approximation) {
+	// opted into with P:approximate = tolerance, the interpolant is kept until one of P's parents changes
+	String identifier = StringCreate(equation.declaration.identifier);
+	StringConcat(&identifier, ":approximate");
+	Equation * attribute = GetEnvironmentEquation(&script->environment, identifier);
+	StringFree(identifier);
+	*approximation = NULL;
+	if (attribute == NULL) { return (RuntimeError){ RuntimeErrorCodeNone }; }
+	
+	VectorArray value;
+	RuntimeError error = EvaluateExpressionInContext(context, NULL, attribute->expression, &value);
 	if (error.code != RuntimeErrorCodeNone) { return error; }
-	parameters[0].value.xyzw[0] = &(float){ t + dt };
-	error = EvaluateExpression(environment, parameters, equation.expression, &resultdt);
-	if (error.code != RuntimeErrorCodeNone) {
-		FreeVectorArray(result);
-		return error;
+	if (value.length != 1 || value.dimensions != 1) {
+		FreeVectorArray(value);
+		return (RuntimeError){ RuntimeErrorCodeInvalidApproximationTolerance, attribute->expression.start, attribute->expression.end, attribute->line };
 	}
-	if (result.dimensions != 2 || resultdt.dimensions != 2) {
+	scalar_t tolerance = value.xyzw[0][0];
+	FreeVectorArray(value);
+	if (!(tolerance > 0.0)) { return (RuntimeError){ RuntimeErrorCodeNone }; }
+	
+	Approximation * cached = HashMapGet(script->approximations, equation.declaration.identifier);
+	if (cached != NULL && (cached->lower != lower || cached->upper != upper || cached->tolerance != tolerance)) {
+		FreeApproximation(*cached);
+		HashMapSet(script->approximations, equation.declaration.identifier, NULL);
+		cached = NULL;
+	}
+	if (cached == NULL) {
+		Approximation created;
+		error = CreateApproximation(context, equation, lower, upper, tolerance, &created);
+		if (error.code != RuntimeErrorCodeNone) {
+			FreeApproximation(created);
+			return error;
+		}
+		HashMapSet(script->approximations, equation.declaration.identifier, &created);
+		cached = HashMapGet(script->approximations, equation.declaration.identifier);
+	}
+	
+	// functions that can't be approximated within the tolerance are evaluated exactly
+	if (IsApproximationUsable(*cached)) { *approximation = cached; }
+	return (RuntimeError){ RuntimeErrorCodeNone };
+}
+
+static RuntimeError SampleParametricPosition(EvaluationContext * context, Equation equation, List(Binding) parameters, Approximation * approximation, scalar_t t, Camera camera, int32_t index, ParametricSample * samples) {
+	// the position and its exact derivative come out of a single evaluation by seeding the parameter's tangent with 1
+	VectorArray result, tangent;
+	if (approximation != NULL) { EvaluateApproximation(*approximation, t, &result, &tangent); }
+	else {
+		parameters[0].value.xyzw[0] = &t;
+		parameters[0].tangent = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = &(scalar_t){ 1.0 } };
+		RuntimeError error = EvaluateExpressionTangentInContext(context, parameters, equation.expression, &result, &tangent);
+		parameters[0].tangent = (VectorArray){ 0 };
+		if (error.code != RuntimeErrorCodeNone) { return error; }
+	}
+	if (result.dimensions != 2) {
 		FreeVectorArray(result);
-		FreeVectorArray(resultdt);
+		FreeVectorArray(tangent);
 		return (RuntimeError){ RuntimeErrorCodeInvalidRenderDimension, equation.expression.start, equation.expression.end, equation.line };
 	}
 	
@@ -163,17 +227,15 @@ static RuntimeError SampleParametricPosition(Environment * environment, Equation
 		VectorArray old = result;
 		result = VectorArrayAtIndex(old, index);
 		FreeVectorArray(old);
-		old = resultdt;
-		resultdt = VectorArrayAtIndex(old, index);
+		old = tangent;
+		tangent = VectorArrayAtIndex(old, index);
 		FreeVectorArray(old);
 	}
 	
 	for (int32_t i = 0; i < result.length; i++) {
-		vec2_t pos = (vec2_t){ result.xyzw[0][i], result.xyzw[1][i] };
-		vec2_t posdt = (vec2_t){ resultdt.xyzw[0][i], resultdt.xyzw[1][i] };
 		samples[i] = (ParametricSample) {
-			.position = pos,
-			.tangent = vec2_normalize(vec2_sub(posdt, pos)),
+			.position = (vec2_t){ result.xyzw[0][i], result.xyzw[1][i] },
+			.tangent = vec2_normalize((vec2_t){ tangent.xyzw[0][i], tangent.xyzw[1][i] }),
 			.thickness = 6.0,
 			.t = t,
 		};
@@ -181,14 +243,14 @@ static RuntimeError SampleParametricPosition(Environment * environment, Equation
 	}
 	
 	FreeVectorArray(result);
-	FreeVectorArray(resultdt);
+	FreeVectorArray(tangent);
 	return (RuntimeError){ RuntimeErrorCodeNone };
 }
 
-static RuntimeError SampleParametricColor(Environment * environment, Equation equation, List(Binding) parameters, float t, int32_t index, int32_t sampleCount, ParametricSample * samples) {
+static RuntimeError SampleParametricColor(EvaluationContext * context, Equation equation, List(Binding) parameters, scalar_t t, int32_t index, int32_t sampleCount, ParametricSample * samples) {
 	String identifier = StringCreate(equation.declaration.identifier);
 	StringConcat(&identifier, ":color");
-	Equation * color = GetEnvironmentEquation(environment, identifier);
+	Equation * color = GetEnvironmentEquation(context->environment, identifier);
 	StringFree(identifier);
 	if (color == NULL) {
 		for (int32_t i = 0; i < sampleCount; i++) {
@@ -197,7 +259,7 @@ static RuntimeError SampleParametricColor(Environment * environment, Equation eq
 	} else  {
 		VectorArray colors;
 		parameters[0].value.xyzw[0] = &t;
-		RuntimeError error = EvaluateExpression(environment, parameters, color->expression, &colors);
+		RuntimeError error = EvaluateExpressionInContext(context, parameters, color->expression, &colors);
 		if (error.code != RuntimeErrorCodeNone) { return error; }
 		if (colors.dimensions != 3 && colors.dimensions != 4) {
 			FreeVectorArray(colors);
@@ -235,17 +297,26 @@ RuntimeError SampleParametric(Script * script, Equation equation, Camera camera,
 		return (RuntimeError){ RuntimeErrorCodeInvalidParametricEquation, 0, equation.end, equation.line };
 	}
 	
-	float lower, upper;
-	RuntimeError error = SampleParametricDomain(&script->environment, equation, &lower, &upper);
-	if (error.code != RuntimeErrorCodeNone) { return error; }
+	EvaluationContext context = CreateEvaluationContext(&script->environment, EvaluationProfilePrecise);
+	scalar_t lower, upper;
+	RuntimeError error = SampleParametricDomain(&context, equation, &lower, &upper);
+	
+	Approximation * approximation = NULL;
+	if (error.code == RuntimeErrorCodeNone) { error = SampleProfile(&script->environment, equation, &context.profile); }
+	if (error.code == RuntimeErrorCodeNone) { error = SampleParametricApproximation(script, &context, equation, lower, upper, &approximation); }
+	if (error.code != RuntimeErrorCodeNone) {
+		FreeEvaluationContext(context);
+		return error;
+	}
 	
 	List(Binding) parameters = ListPush(ListCreate(sizeof(Binding), 1), &(Binding){ 0 });
 	parameters[0].identifier = equation.declaration.parameters[0];
 	parameters[0].value = (VectorArray){ .length = 1, .dimensions = 1, .xyzw[0] = &lower };
 	
 	VectorArray initial;
-	error = EvaluateExpression(&script->environment, parameters, equation.expression, &initial);
+	error = EvaluateExpressionInContext(&context, parameters, equation.expression, &initial);
 	if (error.code != RuntimeErrorCodeNone) {
+		FreeEvaluationContext(context);
 		ListFree(parameters);
 		return error;
 	}
@@ -258,14 +329,14 @@ RuntimeError SampleParametric(Script * script, Equation equation, Camera camera,
 	
 	// evaluate each base sample across all equations
 	for (int32_t j = 0; j <= baseSampleCount; j++) {
-		float t = (upper - lower) * ((float)j / baseSampleCount) + lower;
+		scalar_t t = (upper - lower) * ((scalar_t)j / baseSampleCount) + lower;
 		ParametricSample * baseSamples = malloc(initial.length * sizeof(ParametricSample));
-		error = SampleParametricPosition(&script->environment, equation, parameters, t, 0.5 / baseSampleCount, camera, -1, baseSamples);
+		error = SampleParametricPosition(&context, equation, parameters, approximation, t, camera, -1, baseSamples);
 		if (error.code != RuntimeErrorCodeNone) {
 			free(baseSamples);
 			goto free;
 		}
-		error = SampleParametricColor(&script->environment, equation, parameters, t, -1, initial.length, baseSamples);
+		error = SampleParametricColor(&context, equation, parameters, t, -1, initial.length, baseSamples);
 		if (error.code != RuntimeErrorCodeNone) {
 			free(baseSamples);
 			goto free;
@@ -287,16 +358,16 @@ RuntimeError SampleParametric(Script * script, Equation equation, Camera camera,
 			if (samples[i][j].next == 0) { continue; }
 			ParametricSample left = samples[i][j];
 			ParametricSample right = samples[i][left.next];
-			if (fabsf(left.t - right.t) < 1e-7) { continue; }
+			if (fabs(left.t - right.t) < 1e-7) { continue; }
 			float segmentLength = vec2_dist(left.screenPosition, right.screenPosition);
 			float radius = vec2_len((vec2_t){ camera.aspectRatio, 1.0 });
 			float innerDetail = 1.0 / 128.0;
 			if (segmentLength > innerDetail && SegmentCircleIntersection(left.screenPosition, right.screenPosition, radius)) {
 				if (vec2_dot(left.tangent, right.tangent) > 1.0 - 1e-4 / segmentLength) { continue; }
 				ParametricSample sample;
-				error = SampleParametricPosition(&script->environment, equation, parameters, (left.t + right.t) / 2.0, fabsf(right.t - left.t) / 4.0, camera, i, &sample);
+				error = SampleParametricPosition(&context, equation, parameters, approximation, (left.t + right.t) / 2.0, camera, i, &sample);
 				if (error.code != RuntimeErrorCodeNone) { goto free; }
-				error = SampleParametricColor(&script->environment, equation, parameters, (left.t + right.t) / 2.0, i, 1, &sample);
+				error = SampleParametricColor(&context, equation, parameters, (left.t + right.t) / 2.0, i, 1, &sample);
 				if (error.code != RuntimeErrorCodeNone) { goto free; }
 				sample.next = left.next;
 				samples[i][j].next = ListLength(samples[i]);
@@ -321,13 +392,13 @@ RuntimeError SampleParametric(Script * script, Equation equation, Camera camera,
 			if (vec2_dist(sample.screenPosition, prevSample.screenPosition) > 10) { prevSample = sample; }
 			vertex_t v1 = (vertex_t) {
 				.position = sample.position,
-				.color = sample.color,
+				.color = PackColor(sample.color),
 				.size = sample.thickness,
 				.pair = prevSample.position,
 			};
 			vertex_t v2 = (vertex_t) {
 				.position = prevSample.position,
-				.color = prevSample.color,
+				.color = PackColor(prevSample.color),
 				.size = prevSample.thickness,
 				.pair = sample.position,
 			};
@@ -346,6 +417,7 @@ RuntimeError SampleParametric(Script * script, Equation equation, Camera camera,
 	object->needsUpload = true;
 	
 free:
+	FreeEvaluationContext(context);
 	ListFree(parameters);
 	for (int32_t i = 0; i < initial.length; i++) { ListFree(samples[i]); }
 	free(samples);
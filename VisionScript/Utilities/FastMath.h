@@ -0,0 +1,75 @@
+#ifndef FastMath_h
+#define FastMath_h
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// reduced accuracy kernels used by the fast evaluation profile, each is within a few ulps of the libm
+// result for reasonable inputs but skips the special case handling and full range reduction
+
+static inline int32_t fast_bits(float x) { int32_t i; memcpy(&i, &x, sizeof(i)); return i; }
+static inline float fast_float(int32_t i) { float x; memcpy(&x, &i, sizeof(x)); return x; }
+
+static inline float fast_round(float x) {
+	// round to nearest for |x| < 2^22 without a library call
+	return (x + 12582912.0f) - 12582912.0f;
+}
+
+// sin and cos together, reduced by multiples of pi/2 in three float steps so accuracy falls off past |x| ~ 1e5
+static inline void fast_sincos(float x, float * s, float * c) {
+	float k = fast_round(x * 0.636619772f);
+	float r = ((x - k * 1.5703125f) - k * 4.83751297e-4f) - k * 7.54978995e-8f;
+	float r2 = r * r;
+	float sr = r * (1.0f + r2 * (-1.66666672e-1f + r2 * (8.33332818e-3f + r2 * -1.98066279e-4f)));
+	float cr = 1.0f + r2 * (-0.5f + r2 * (4.16666418e-2f + r2 * (-1.38873165e-3f + r2 * 2.44331568e-5f)));
+	
+	// branch free quadrant selection so loops over it can be vectorized
+	int32_t q = (int32_t)k;
+	int32_t swap = (fast_bits(sr) ^ fast_bits(cr)) & -(q & 1);
+	*s = fast_float(fast_bits(sr) ^ swap ^ ((q & 2) << 30));
+	*c = fast_float(fast_bits(cr) ^ swap ^ (((q + 1) & 2) << 30));
+}
+
+static inline float fast_rsqrt(float x) {
+	// integer estimate refined with newton's method, written without branches or intrinsics so loops over it vectorize
+	float y = fast_float(0x5f375a86 - (fast_bits(x) >> 1));
+	y = y * (1.5f - 0.5f * x * y * y);
+	y = y * (1.5f - 0.5f * x * y * y);
+	return y * (1.5f - 0.5f * x * y * y);
+}
+
+static inline float fast_exp2(float x) {
+	// clamped to [-150, 128] with integer selects on the bits since float compares keep loops over it from
+	// vectorizing, the ends overflow to infinity and underflow to 0, NaN is left alone and propagates
+	int32_t i = fast_bits(x), a = i & 0x7fffffff;
+	int32_t limit = 0x43000000 + (0x00160000 & (i >> 31));
+	int32_t mask = -((a > limit) & (a <= 0x7f800000));
+	float y = fast_float((i & ~mask) | ((limit | (i & 0x80000000)) & mask));
+	
+	// the rounding constant leaves n in the low bits of the sum, which avoids a float to int conversion
+	float sum = y + 12582912.0f, f = y - (sum - 12582912.0f);
+	float p = 1.0f + f * (6.93147182e-1f + f * (2.40226507e-1f + f * (5.55040957e-2f + f * (9.61812911e-3f + f * (1.33335581e-3f + f * 1.54035304e-4f)))));
+	
+	// 2^n in two halves so both stay normal numbers, the result still rounds to a denormal or infinity when it should
+	int32_t n = fast_bits(sum) - 0x4b400000, h = n >> 1;
+	return (p * fast_float((uint32_t)(h + 127) << 23)) * fast_float((uint32_t)(n - h + 127) << 23);
+}
+
+static inline float fast_log2(float x) {
+	// mantissa in [sqrt(1/2), sqrt(2)) so the atanh series converges quickly, for positive normal x
+	int32_t i = fast_bits(x);
+	int32_t high = (i & 0x007fffff) > 0x003504f3;
+	float m = fast_float((i & 0x007fffff) | (0x3f800000 - (high << 23)));
+	int32_t e = ((i >> 23) & 0xff) - 127 + high;
+	float s = (m - 1.0f) / (m + 1.0f), s2 = s * s;
+	return e + s * (2.88539008f + s2 * (9.61796694e-1f + s2 * (5.77078016e-1f + s2 * 4.12198583e-1f)));
+}
+
+static inline float fast_pow(float a, float b) {
+	// negative, zero and non-finite bases keep their exact semantics
+	if (!(a > 0.0f) || !isfinite(a)) { return powf(a, b); }
+	return fast_exp2(b * fast_log2(a));
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef Half_h
+#define Half_h
+
+#include <stdint.h>
+#include <string.h>
+
+// IEEE 754 binary16 storage, values are converted to and from float around every use
+typedef uint16_t half_t;
+
+static inline half_t half_from_float(float x) {
+	// rounds to nearest even, overflows to infinity and keeps NaNs quiet
+	uint32_t i, sign;
+	memcpy(&i, &x, sizeof(i));
+	sign = (i >> 16) & 0x8000;
+	i &= 0x7fffffff;
+	if (i >= 0x47800000) { return sign | (i > 0x7f800000 ? 0x7e00 : 0x7c00); }
+	if (i < 0x38800000) {
+		// denormal results, adding 0.5 lines the half mantissa up with the low bits and lets the fpu do the rounding
+		float f;
+		memcpy(&f, &i, sizeof(f));
+		f += 0.5f;
+		memcpy(&i, &f, sizeof(i));
+		return sign | (i - 0x3f000000);
+	}
+	// rebias the exponent, round the 13 dropped bits to even, a carry out of the mantissa bumps the exponent
+	i += 0xc8000fff + ((i >> 13) & 1);
+	return sign | (i >> 13);
+}
+
+static inline float half_to_float(half_t h) {
+	uint32_t i = (uint32_t)(h & 0x7fff) << 13, exponent = i & 0x0f800000;
+	i += 0x38000000;
+	if (exponent == 0x0f800000) { i += 0x38000000; }
+	else if (exponent == 0) {
+		// denormal inputs, renormalized by subtracting the implicit bit back out in float
+		float f;
+		i += 0x00800000;
+		memcpy(&f, &i, sizeof(f));
+		f -= 6.10351562e-05f;
+		memcpy(&i, &f, sizeof(i));
+	}
+	i |= (uint32_t)(h & 0x8000) << 16;
+	float x;
+	memcpy(&x, &i, sizeof(x));
+	return x;
+}
+
+#endif